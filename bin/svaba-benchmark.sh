@@ -0,0 +1,126 @@
+#!/usr/bin/env bash
+# svaba-benchmark -- Reproducible end-to-end throughput and accuracy benchmark
+# Usage: svaba-benchmark.sh [-r ref.fa | -l synthetic_bp] [-k region] [-c tumor_cov,normal_cov]
+#                           [-R num_svs] [-X num_indels] [-s seed] [-T 1,2,4,8] [-o outdir]
+#
+# Simulates a tumor and normal with svaba benchmark sim, aligns them with
+# bwa mem, runs svaba run at each thread count in -T and
+# prints one TSV row per run: wall time, windows/sec, reads/sec, peak RSS
+# and SV / indel sensitivity and precision against the simulated truth set.
+# The same arguments (and seed) give the same reads, so rows can be compared
+# across builds. The normal is the reference, so only the somatic VCFs are
+# scored. Needs bwa, samtools, GNU time and svaba on the PATH (or set SVABA,
+# BWA, SAMTOOLS). With -r, -k must be a region of the first contig of the
+# reference; svaba run is restricted to the simulated region.
+#
+set -euo pipefail
+
+SVABA=${SVABA:-svaba}
+BWA=${BWA:-bwa}
+SAMTOOLS=${SAMTOOLS:-samtools}
+
+REF=
+SYNTH=10000000
+REGION=
+COV=30,30
+NSV=20
+NINDEL=200
+SEED=42
+THREADS=1,2,4,8
+OUT=svaba_bench
+TOL=10
+
+while getopts "r:l:k:c:R:X:s:T:o:h" o; do
+  case $o in
+    r) REF=$OPTARG; SYNTH= ;;
+    l) SYNTH=$OPTARG ;;
+    k) REGION=$OPTARG ;;
+    c) COV=$OPTARG ;;
+    R) NSV=$OPTARG ;;
+    X) NINDEL=$OPTARG ;;
+    s) SEED=$OPTARG ;;
+    T) THREADS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,/^#$/ s/^# \{0,1\}//p' < "$0"; exit 1 ;;
+  esac
+done
+
+## absolute paths, since everything below runs in $OUT
+abspath() { echo "$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"; }
+[[ -z $REF ]] || REF=$(abspath "$REF")
+for v in SVABA BWA SAMTOOLS; do
+  [[ ${!v} != */* ]] || printf -v $v '%s' "$(abspath "${!v}")"
+done
+
+mkdir -p "$OUT"
+cd "$OUT"
+ID=sim
+
+## simulate
+SIMARGS="benchmark sim -a $ID -s $SEED -c $COV -R $NSV -X $NINDEL"
+if [[ -n $SYNTH ]]; then
+  $SVABA $SIMARGS --synthetic-ref $SYNTH
+  REF=$ID.ref.fa
+else
+  [[ -n $REGION ]] || { echo "ERROR: -k region is required with -r" 1>&2; exit 1; }
+  $SVABA $SIMARGS -G "$REF" -k "$REGION"
+fi
+[[ -f $REF.fai ]] || $SAMTOOLS faidx "$REF"
+[[ -f $REF.bwt ]] || $BWA index "$REF" 2> bwa_index.log
+
+## the simulated region: all of the synthetic contig, or -k on the first contig of -r
+CHR=$(head -1 "$REF.fai" | cut -f1)
+if [[ -n $SYNTH ]]; then
+  REGION=$CHR
+elif [[ ${REGION%%:*} != "$CHR" ]]; then
+  echo "ERROR: -k $REGION is not on $CHR, the first contig of $REF" 1>&2; exit 1
+fi
+TBAM=$PWD/tumor.bam
+NBAM=$PWD/normal.bam
+
+## align
+for s in tumor normal; do
+  if [[ ! -f $s.bam.bai ]]; then
+    $BWA mem -t 4 -R "@RG\tID:$s\tSM:$s" "$REF" $ID.${s}_1.fq $ID.${s}_2.fq 2> bwa_$s.log | \
+      $SAMTOOLS sort -o $s.bam -
+    $SAMTOOLS index $s.bam
+  fi
+done
+
+## truth, with chromosome ids as names. SV lines are SV chr pos1 strand pos2 strand ...
+## and INDEL lines are INDEL len type chr pos1 ...
+awk 'NR==FNR { name[NR-1] = $1; next }
+     $1 == "SV"    { print "SV",    name[$2], $3; print "SV", name[$2], $5 }
+     $1 == "INDEL" { print "INDEL", name[$4], $5 }' "$REF.fai" $ID.truth.tsv > truth.txt
+
+## fraction of truth sites with a call within TOL bp, and of calls near a truth site
+score() { # type vcf...
+  local type=$1; shift
+  cat "$@" 2> /dev/null | grep -v '^#' | awk -v OFS='\t' '{ print $1, $2 }' > calls_$type.txt || true
+  awk -v t=$type -v tol=$TOL '
+    NR==FNR { if ($1 == t) { tc[++nt] = $2; tp[nt] = $3 } ; next }
+    { cc[++nc] = $1; cp[nc] = $2 }
+    END {
+      for (i = 1; i <= nt; ++i) for (j = 1; j <= nc; ++j)
+        if (tc[i] == cc[j] && tp[i] - cp[j] <= tol && cp[j] - tp[i] <= tol) { hit[i] = 1; good[j] = 1 }
+      nh = 0; for (i in hit) ++nh
+      ng = 0; for (j in good) ++ng
+      printf "%.4f\t%.4f", nt ? nh / nt : 0, nc ? ng / nc : 0
+    }' truth.txt calls_$type.txt
+}
+
+printf "threads\twall_sec\twindows\twindows_per_sec\treads\treads_per_sec\tpeak_rss_kb\tsv_sens\tsv_prec\tindel_sens\tindel_prec\n"
+for t in ${THREADS//,/ }; do
+  a=bench_p$t
+  /usr/bin/time -v $SVABA run -t "$TBAM" -n "$NBAM" -G "$REF" -k "$REGION" -p $t -a $a > $a.stdout 2> $a.time
+  wall=$(awk -F': ' '/Elapsed \(wall clock\)/ { n = split($2, x, ":"); s = 0; for (i = 1; i <= n; ++i) s = s * 60 + x[i]; print s }' $a.time)
+  rss=$(awk -F': ' '/Maximum resident set size/ { print $2 }' $a.time)
+  read windows reads < <(gunzip -c $a.metrics.tsv.gz | awk -F'\t' '
+    NR == 1 { for (i = 1; i <= NF; ++i) col[$i] = i; next }
+    $1 != "ALL" { ++w; r += $col["t_reads"] + $col["n_reads"] }
+    END { print w + 0, r + 0 }')
+  sv=$(score SV $a.svaba.somatic.sv.vcf)
+  indel=$(score INDEL $a.svaba.somatic.indel.vcf)
+  awk -v OFS='\t' -v t=$t -v w=$wall -v nw=$windows -v nr=$reads -v rss=$rss -v sv="$sv" -v indel="$indel" \
+    'BEGIN { print t, w, nw, (w > 0 ? nw / w : 0), nr, (w > 0 ? nr / w : 0), rss, sv, indel }'
+done
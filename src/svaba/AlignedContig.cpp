@@ -1,5 +1,6 @@
 #include "AlignedContig.h"
 #include "PlottedRead.h"
+#include "svabaMemory.h"
 
 AlignedContig::AlignedContig(const SeqLib::BamRecordVector& bav, const std::set<std::string>& pref) {
     
@@ -131,7 +132,7 @@ AlignedContig::AlignedContig(const SeqLib::BamRecordVector& bav, const std::set<
     os << getSequence() << std::endl;
   }
   
-void AlignedContig::blacklist(SeqLib::GRC &grv) {
+void AlignedContig::blacklist(IntervalCursor &grv) {
     
     // loop through the indel breaks and blacklist
     for (auto& i : m_frag_v) 
@@ -463,7 +464,7 @@ bool AlignedContig::checkLocal(const SeqLib::GenomicRegion& window)
   }
   
   
-void AlignedContig::checkAgainstCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap) {
+void AlignedContig::checkAgainstCigarMatches(const CigarIndexMap& cmap) {
 
     for (auto& i : m_frag_v)
       i.indelCigarMatches(cmap);
@@ -628,6 +629,15 @@ std::string AlignedContig::getSequence() const {
   return m_seq; 
 }
 
+size_t AlignedContig::Bytes() const {
+  size_t b = sizeof(AlignedContig) + m_seq.capacity() + aligned_coverage.capacity() * sizeof(int);
+  b += svabaMemory::Bytes(m_bamreads);
+  for (auto& f : m_frag_v)
+    b += sizeof(AlignmentFragment) + svabaMemory::Bytes(f.m_align) - sizeof(SeqLib::BamRecord);
+  b += svabaMemory::Bytes(m_local_breaks) + svabaMemory::Bytes(m_local_breaks_secondaries) + svabaMemory::Bytes(m_global_bp) - sizeof(BreakPoint);
+  return b;
+}
+
 void AlignedContig::AddAlignedRead(const SeqLib::BamRecord& br) {
   m_bamreads.push_back(br);
 }
@@ -31,7 +31,7 @@ class AlignedContig {
   SeqLib::GenomicRegionVector getAsGenomicRegionVector() const;
 
   // Loop through all the alignment framgents and their indel breaks and check against cigar database
-  void checkAgainstCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap); 
+  void checkAgainstCigarMatches(const CigarIndexMap& cmap); 
 
   // apply repeat filter to each indel break
   void assessRepeats();
@@ -59,7 +59,7 @@ class AlignedContig {
   
   // Checks if any of the indel breaks are in a blacklist. If so, mark the
   // breakpoints of the indels for skipping. That is, hasMinmal() will return false;
-  void blacklist(SeqLib::GRC& grv);
+  void blacklist(IntervalCursor& grv);
   
   // Dump the contigs to a fasta
   void printContigFasta(std::ofstream &os) const;
@@ -107,6 +107,9 @@ class AlignedContig {
   // return number of bam reads
   size_t NumBamReads() const { return m_bamreads.size(); }
 
+  /** Approximate heap bytes of the contig, its fragments and the reads aligned to it */
+  size_t Bytes() const;
+
  private:
 
   int insertion_against_contig_read_count = 0;
@@ -134,21 +134,23 @@ void AlignmentFragment::SetIndels(const AlignedContig * c) {
   }
 
 
-void AlignmentFragment::indelCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap) {
+void AlignmentFragment::indelCigarMatches(const CigarIndexMap& cmap) {
 
     // loop through the indel breakpoints
     for (auto& i : m_indel_breaks) {
       
       assert(i.getSpan() > 0);
 
-      // get the hash string in same formate as cigar map (eg. pos_3D)
-      std::string st = i.getHashString();
+      // get the key in same format as the cigar index
+      CigarKey k = i.getCigarKey();
+      if (k == CIGAR_KEY_NONE)
+	continue;
 
       for (auto& c : cmap) {
-	SeqLib::CigarMap::const_iterator ff = c.second.find(st);
+	int32_t n = c.second.count(k);
 	// if it is, add it
-	if (ff != c.second.end()) {
-	  i.allele[c.first].cigar = ff->second;	  
+	if (n) {
+	  i.allele[c.first].cigar = n;
 	}
       }
     }      
@@ -33,7 +33,7 @@ class AlignedContig;
     // sort AlignmentFragment objects by start position
     bool operator < (const AlignmentFragment& str) const { return (start < str.start); }
 
-    void indelCigarMatches(const std::unordered_map<std::string, SeqLib::CigarMap>& cmap);
+    void indelCigarMatches(const CigarIndexMap& cmap);
     
     // print the AlignmentFragment
     friend std::ostream& operator<<(std::ostream &out, const AlignmentFragment& c); 
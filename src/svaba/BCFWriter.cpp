@@ -0,0 +1,315 @@
+#include "BCFWriter.h"
+
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+
+#include "htslib/hts.h"
+#include "htslib/tbx.h"
+
+// CSI bin size for BCF
+#define BCF_MIN_SHIFT 14
+
+// the FORMAT fields are written from SampleInfo::toFileString, which is
+// GT:AD:DP:GQ:PL:SR:(DR or CR):LR:LO
+#define NUM_FORMAT_FIELDS 9
+
+static int32_t __to_int(const std::string& s) {
+  if (s.empty())
+    return bcf_int32_missing;
+  char * end;
+  long v = strtol(s.c_str(), &end, 10);
+  return *end ? bcf_int32_missing : (int32_t)v;
+}
+
+static float __to_float(const std::string& s) {
+  float f;
+  bcf_float_set_missing(f);
+  if (s.empty())
+    return f;
+  char * end;
+  double v = strtod(s.c_str(), &end);
+  return *end ? f : (float)v;
+}
+
+bool BCFWriter::Open(const std::string& file, const char * mode, const VCFHeader& h, int threads) {
+
+  m_file = file;
+  m_bcf = strchr(mode, 'b') != NULL;
+
+  m_fp = hts_open(file.c_str(), mode);
+  if (!m_fp) {
+    std::cerr << "BCFWriter: could not open " << file << std::endl;
+    return false;
+  }
+  if (threads > 1)
+    hts_set_threads(m_fp, threads);
+
+  // build the htslib header from the text one
+  m_hdr = bcf_hdr_init("w");
+  std::stringstream ss;
+  ss << h;
+  std::string line;
+  while (std::getline(ss, line)) {
+    if (line.compare(0, 6, "#CHROM") == 0) {
+      // samples are the columns after FORMAT
+      std::istringstream iss(line);
+      std::string col;
+      for (int c = 0; std::getline(iss, col, '\t'); ++c)
+	if (c >= 9)
+	  bcf_hdr_add_sample(m_hdr, col.c_str());
+    } else if (line.compare(0, 2, "##") == 0 && line.compare(0, 13, "##fileformat=") != 0) {
+      bcf_hdr_append(m_hdr, line.c_str());
+    }
+  }
+  bcf_hdr_add_sample(m_hdr, NULL);
+  bcf_hdr_sync(m_hdr);
+  m_nsamples = bcf_hdr_nsamples(m_hdr);
+
+  // GT goes through bcf_update_genotypes, which needs the standard Number=1,Type=String field
+  int gt = bcf_hdr_id2int(m_hdr, BCF_DT_ID, "GT");
+  if (gt < 0 || !bcf_hdr_idinfo_exists(m_hdr, BCF_HL_FMT, gt) || bcf_hdr_id2type(m_hdr, BCF_HL_FMT, gt) != BCF_HT_STR ||
+      bcf_hdr_id2length(m_hdr, BCF_HL_FMT, gt) != BCF_VL_FIXED || bcf_hdr_id2number(m_hdr, BCF_HL_FMT, gt) != 1) {
+    std::cerr << "BCFWriter: header for " << file << " must declare FORMAT GT as Number=1,Type=String" << std::endl;
+    return false;
+  }
+
+  if (bcf_hdr_write(m_fp, m_hdr) < 0) {
+    std::cerr << "BCFWriter: could not write header to " << file << std::endl;
+    return false;
+  }
+
+  // build the index as records go out. Older htslib has to re-read the file at Close
+#if defined(HTS_VERSION) && HTS_VERSION >= 101000
+  std::string fnidx = m_file + (m_bcf ? ".csi" : ".tbi");
+  m_idx_inline = bcf_idx_init(m_fp, m_hdr, m_bcf ? BCF_MIN_SHIFT : 0, fnidx.c_str()) == 0;
+#endif
+
+  m_rec = bcf_init();
+
+  return true;
+}
+
+bool BCFWriter::Write(const VCFEntry& e) {
+
+  if (!m_fp)
+    return false;
+
+  const ReducedBreakPoint * bp = e.bp.get();
+  const ReducedBreakEnd * be = e.id_num == 1 ? &bp->b1 : &bp->b2;
+
+  bcf_clear(m_rec);
+
+  m_rec->rid = bcf_hdr_name2id(m_hdr, be->chr_name.c_str());
+  if (m_rec->rid < 0) {
+    std::cerr << "BCFWriter: contig not in header " << be->chr_name << std::endl;
+    return false;
+  }
+  m_rec->pos = be->gr.pos1 - 1; // 0-based
+  m_rec->qual = bp->quality;
+
+  bcf_update_id(m_hdr, m_rec, e.getIdString().c_str());
+  std::string alleles = e.getRefString() + "," + e.getAltString();
+  bcf_update_alleles_str(m_hdr, m_rec, alleles.c_str());
+
+  // the confidence is the FILTER, and has to be one the header declares
+  int f = bp->confidence ? bcf_hdr_id2int(m_hdr, BCF_DT_ID, bp->confidence) : -1;
+  if (f < 0 || !bcf_hdr_idinfo_exists(m_hdr, BCF_HL_FLT, f)) {
+    std::cerr << "BCFWriter: FILTER " << (bp->confidence ? bp->confidence : "(none)") << " of " << e.getIdString()
+	      << " is not in the header of " << m_file << std::endl;
+    return false;
+  }
+  bcf_update_filter(m_hdr, m_rec, &f, 1);
+
+  if (!__fill_info(e) || !__fill_format(e)) {
+    std::cerr << "BCFWriter: record " << e.getIdString() << " has a field that is not in the header of " << m_file << std::endl;
+    return false;
+  }
+
+  if (bcf_write(m_fp, m_hdr, m_rec) < 0) {
+    std::cerr << "BCFWriter: failed to write record " << e.getIdString() << " to " << m_file << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// same fields as VCFEntry::fillInfoFields, and the same ones
+// skipped for imprecise calls as operator<<(VCFEntry). False if
+// one is not in the header, rather than dropping it
+bool BCFWriter::__fill_info(const VCFEntry& e) {
+
+  const ReducedBreakPoint * bp = e.bp.get();
+  int32_t v;
+  bool ok = true;
+
+  v = bp->getSpan();
+  ok &= bcf_update_info_int32(m_hdr, m_rec, "SPAN", &v, 1) >= 0;
+  if (bp->cname)
+    ok &= bcf_update_info_string(m_hdr, m_rec, "SCTG", bp->cname) >= 0;
+  if (!bp->indel) {
+    if (bp->evidence)
+      ok &= bcf_update_info_string(m_hdr, m_rec, "EVDNC", bp->evidence) >= 0;
+    ok &= bcf_update_info_string(m_hdr, m_rec, "SVTYPE", "BND") >= 0;
+  }
+
+  if (!bp->read_names.empty() && bp->read_names != "x")
+    ok &= bcf_update_info_string(m_hdr, m_rec, "READNAMES", bp->read_names.c_str()) >= 0;
+  if (!bp->bxtable.empty() && bp->bxtable != "x")
+    ok &= bcf_update_info_string(m_hdr, m_rec, "BX", bp->bxtable.c_str()) >= 0;
+  if (bp->repeat)
+    ok &= bcf_update_info_string(m_hdr, m_rec, "REPSEQ", bp->repeat) >= 0;
+  if (bp->pon) {
+    v = bp->pon;
+    ok &= bcf_update_info_int32(m_hdr, m_rec, "PON", &v, 1) >= 0;
+  }
+
+  if (bp->num_align != 1) {
+    std::string mateid = std::to_string(e.id) + ":" + std::to_string(e.id_num == 1 ? 2 : 1);
+    ok &= bcf_update_info_string(m_hdr, m_rec, "MATEID", mateid.c_str()) >= 0;
+    v = e.id_num == 1 ? bp->b1.nm : bp->b2.nm;
+    ok &= bcf_update_info_int32(m_hdr, m_rec, "NM", &v, 1) >= 0;
+    v = e.id_num == 1 ? bp->b2.nm : bp->b1.nm;
+    ok &= bcf_update_info_int32(m_hdr, m_rec, "MATENM", &v, 1) >= 0;
+  } else {
+    v = bp->b1.nm;
+    ok &= bcf_update_info_int32(m_hdr, m_rec, "NM", &v, 1) >= 0;
+  }
+
+  v = e.id_num == 1 ? bp->b1.mapq : bp->b2.mapq;
+  ok &= bcf_update_info_int32(m_hdr, m_rec, "MAPQ", &v, 1) >= 0;
+
+  if (bp->num_align != 1) {
+
+    if (e.id_num == 1 && (bp->b1.sub_n || bp->b2.sub_n)) {
+      v = bp->b1.sub_n ? bp->b1.sub_n : bp->b2.sub_n;
+      ok &= bcf_update_info_int32(m_hdr, m_rec, "SUBN", &v, 1) >= 0;
+    }
+
+    if (!bp->imprecise) {
+      if (bp->homology)
+	ok &= bcf_update_info_string(m_hdr, m_rec, "HOMSEQ", bp->homology) >= 0;
+      if (bp->insertion)
+	ok &= bcf_update_info_string(m_hdr, m_rec, "INSERTION", bp->insertion) >= 0;
+    }
+    v = bp->num_align;
+    ok &= bcf_update_info_int32(m_hdr, m_rec, "NUMPARTS", &v, 1) >= 0;
+
+    if (bp->imprecise)
+      ok &= bcf_update_info_flag(m_hdr, m_rec, "IMPRECISE", NULL, 1) >= 0;
+    if (bp->secondary)
+      ok &= bcf_update_info_flag(m_hdr, m_rec, "SECONDARY", NULL, 1) >= 0;
+
+    if (!bp->evidence || strcmp(bp->evidence, "ASSMB")) {
+      v = e.id_num == 1 ? bp->dc.mapq1 : bp->dc.mapq2;
+      ok &= bcf_update_info_int32(m_hdr, m_rec, "DISC_MAPQ", &v, 1) >= 0;
+    }
+
+  } else {
+
+    float lod = bp->true_lod;
+    ok &= bcf_update_info_float(m_hdr, m_rec, "LOD", &lod, 1) >= 0;
+    if (bp->dbsnp)
+      ok &= bcf_update_info_flag(m_hdr, m_rec, "DBSNP", NULL, 1) >= 0;
+  }
+
+  return ok;
+}
+
+bool BCFWriter::__fill_format(const VCFEntry& e) {
+
+  const ReducedBreakPoint * bp = e.bp.get();
+  size_t n = m_nsamples;
+  bool ok = true;
+
+  m_gt.assign(2 * n, bcf_gt_missing);
+  m_ad.assign(n, bcf_int32_missing);
+  m_dp.assign(n, bcf_int32_missing);
+  m_sr.assign(n, bcf_int32_missing);
+  m_dr.assign(n, bcf_int32_missing);
+  float fm;
+  bcf_float_set_missing(fm);
+  m_pl.assign(3 * n, fm);
+  m_lr.assign(n, fm);
+  m_lo.assign(n, fm);
+  m_gq.assign(n, std::string("."));
+
+  std::vector<std::string> vals;
+  for (size_t s = 0; s < n && s < bp->format_s.size(); ++s) {
+
+    vals.clear();
+    std::istringstream iss(bp->format_s[s]);
+    std::string val;
+    while (std::getline(iss, val, ':'))
+      vals.push_back(val);
+    if (vals.size() < NUM_FORMAT_FIELDS)
+      continue;
+
+    // eg 0/1
+    if (vals[0].length() == 3 && isdigit(vals[0][0]) && isdigit(vals[0][2])) {
+      m_gt[2*s]   = bcf_gt_unphased(vals[0][0] - '0');
+      m_gt[2*s+1] = bcf_gt_unphased(vals[0][2] - '0');
+    }
+    m_ad[s] = __to_int(vals[1]);
+    m_dp[s] = __to_int(vals[2]);
+    if (!vals[3].empty())
+      m_gq[s] = vals[3];
+    std::istringstream pl(vals[4]);
+    for (size_t k = 0; k < 3 && std::getline(pl, val, ','); ++k)
+      m_pl[3*s+k] = __to_float(val);
+    m_sr[s] = __to_int(vals[5]);
+    m_dr[s] = __to_int(vals[6]);
+    m_lr[s] = __to_float(vals[7]);
+    m_lo[s] = __to_float(vals[8]);
+  }
+
+  std::vector<const char*> gq(n);
+  for (size_t s = 0; s < n; ++s)
+    gq[s] = m_gq[s].c_str();
+
+  ok &= bcf_update_genotypes(m_hdr, m_rec, m_gt.data(), 2 * n) >= 0;
+  ok &= bcf_update_format_int32(m_hdr, m_rec, "AD", m_ad.data(), n) >= 0;
+  ok &= bcf_update_format_int32(m_hdr, m_rec, "DP", m_dp.data(), n) >= 0;
+  ok &= bcf_update_format_string(m_hdr, m_rec, "GQ", gq.data(), n) >= 0;
+  ok &= bcf_update_format_float(m_hdr, m_rec, "PL", m_pl.data(), 3 * n) >= 0;
+  ok &= bcf_update_format_int32(m_hdr, m_rec, "SR", m_sr.data(), n) >= 0;
+  ok &= bcf_update_format_int32(m_hdr, m_rec, bp->indel ? "CR" : "DR", m_dr.data(), n) >= 0;
+  ok &= bcf_update_format_float(m_hdr, m_rec, "LR", m_lr.data(), n) >= 0;
+  ok &= bcf_update_format_float(m_hdr, m_rec, "LO", m_lo.data(), n) >= 0;
+
+  return ok;
+}
+
+void BCFWriter::Close() {
+
+  if (!m_fp)
+    return;
+
+#if defined(HTS_VERSION) && HTS_VERSION >= 101000
+  if (m_idx_inline && bcf_idx_save(m_fp) < 0)
+    std::cerr << "BCFWriter: failed to save index for " << m_file << std::endl;
+#endif
+
+  hts_close(m_fp);
+  m_fp = nullptr;
+
+  if (!m_idx_inline) {
+    if (m_bcf) {
+      if (bcf_index_build(m_file.c_str(), BCF_MIN_SHIFT))
+	std::cerr << "BCFWriter: bcf_index_build failed: " << m_file << std::endl;
+    } else {
+      tbx_conf_t conf = tbx_conf_vcf;
+      if (tbx_index_build(m_file.c_str(), 0, &conf))
+	std::cerr << "tbx_index_build failed: " << m_file << std::endl;
+    }
+  }
+
+  if (m_rec)
+    bcf_destroy(m_rec);
+  if (m_hdr)
+    bcf_hdr_destroy(m_hdr);
+  m_rec = nullptr;
+  m_hdr = nullptr;
+}
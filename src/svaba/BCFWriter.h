@@ -0,0 +1,61 @@
+#ifndef SVABA_BCF_WRITER_H__
+#define SVABA_BCF_WRITER_H__
+
+#include <string>
+#include <vector>
+
+#include "htslib/vcf.h"
+
+#include "vcf.h"
+
+/** Write VCFEntry records through htslib as BCF or bgzipped VCF.
+ *
+ * Records are built as bcf1_t with the typed htslib calls, so there is no
+ * text formatting step. Compression runs on its own htslib threads, and the
+ * index (CSI for BCF, TBI for vcf.gz) is built as the records are written.
+ */
+class BCFWriter {
+
+ public:
+
+  BCFWriter() {}
+
+  ~BCFWriter() { Close(); }
+
+  /** Open the file and write the header.
+   * @param mode htslib mode, "wb" for BCF or "wz" for vcf.gz
+   * @param threads Number of compression threads. 0 or 1 is inline
+   */
+  bool Open(const std::string& file, const char * mode, const VCFHeader& h, int threads);
+
+  /** Add one record. Must be in coordinate order for the index.
+   * False if it could not be written, or has a FILTER or field the header lacks
+   */
+  bool Write(const VCFEntry& e);
+
+  /** Write the index and close the file */
+  void Close();
+
+ private:
+
+  htsFile * m_fp = nullptr;
+  bcf_hdr_t * m_hdr = nullptr;
+  bcf1_t * m_rec = nullptr;
+
+  std::string m_file;
+  bool m_bcf = false;
+  bool m_idx_inline = false;
+
+  int m_nsamples = 0;
+
+  // per-sample FORMAT values, reused between records
+  std::vector<int32_t> m_gt, m_ad, m_dp, m_sr, m_dr;
+  std::vector<float> m_pl, m_lr, m_lo;
+  std::vector<std::string> m_gq;
+
+  bool __fill_info(const VCFEntry& e);
+  bool __fill_format(const VCFEntry& e);
+
+};
+
+#endif
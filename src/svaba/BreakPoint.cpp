@@ -3,6 +3,8 @@
 #include <getopt.h>
 #include <iomanip>
 #include <cassert>
+#include <numeric>
+#include <algorithm>
 
 #include "gzstream.h"
 #include "svabaUtils.h"
@@ -62,12 +64,7 @@ using namespace SeqLib;
     std::string sep = "\t";
     std::stringstream ss;
     
-    // put the read names into a string
-    if (!noreads)  
-      format_readname_string();
-    
-    // make the BX table
-    format_bx_string();
+    formatStrings(noreads);
 
     double max_lod = 0;
     for (auto& s : allele) 
@@ -102,6 +99,16 @@ using namespace SeqLib;
 
   }
   
+  void BreakPoint::formatStrings(bool noreads) {
+
+    // put the read names into a string
+    if (!noreads)  
+      format_readname_string();
+    
+    // make the BX table
+    format_bx_string();
+  }
+
   BreakEnd::BreakEnd(const GenomicRegion& g, int mq, const std::string& chr_n) {
     gr = g;
     mapq = mq;
@@ -214,6 +221,60 @@ BreakPoint::BreakPoint(DiscordantCluster& tdc, const BWAWrapper * bwa, Discordan
   bool BreakPoint::operator==(const BreakPoint &bp) const {
     return (b1.gr == bp.b1.gr && b2.gr == bp.b2.gr && bp.insertion == insertion); 
   }
+
+// ids in sorted string order, so the ids compare like the strings
+static std::vector<uint32_t> __intern_sorted(const std::vector<const std::string*>& s) {
+
+  std::vector<uint32_t> order(s.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&s](uint32_t a, uint32_t b) { return *s[a] < *s[b]; });
+
+  std::vector<uint32_t> ids(s.size());
+  uint32_t id = 0;
+  for (size_t k = 0; k < order.size(); ++k) {
+    if (k && *s[order[k]] != *s[order[k-1]])
+      ++id;
+    ids[order[k]] = id;
+  }
+  return ids;
+}
+
+void BreakPoint::sortUnique(BPVec& bps) {
+
+  std::vector<const std::string*> cn, ins;
+  cn.reserve(bps.size());
+  ins.reserve(bps.size());
+  for (auto& b : bps) {
+    cn.push_back(&b.cname);
+    ins.push_back(&b.insertion);
+  }
+  std::vector<uint32_t> cid = __intern_sorted(cn);
+  std::vector<uint32_t> iid = __intern_sorted(ins);
+
+  std::vector<BreakPointCore> core(bps.size());
+  for (size_t i = 0; i < bps.size(); ++i) {
+    const BreakPoint& b = bps[i];
+    BreakPointCore& c = core[i];
+    c.gr1 = b.b1.gr;
+    c.gr2 = b.b2.gr;
+    c.nsplit = b.n.split;
+    c.tsplit = b.t.split;
+    c.ncount = b.dc.ncount;
+    c.tcount = b.dc.tcount;
+    c.cname = cid[i];
+    c.insertion = iid[i];
+    c.idx = i;
+  }
+
+  std::sort(core.begin(), core.end());
+  core.erase(std::unique(core.begin(), core.end()), core.end());
+
+  BPVec out;
+  out.reserve(core.size());
+  for (auto& c : core)
+    out.push_back(std::move(bps[c.idx]));
+  bps.swap(out);
+}
     
   void BreakPoint::repeatFilter() {
 
@@ -537,14 +598,12 @@ BreakPoint::BreakPoint(const std::string &line, const SeqLib::BamHeader& h) {
 
   }
   
-  std::string BreakPoint::getHashString() const {
+  CigarKey BreakPoint::getCigarKey() const {
     
     bool isdel = insertion.length() == 0;
-    //if (isdel) // del breaks are stored as last non-deleted base. CigarMap stores as THE deleted base
+    //if (isdel) // del breaks are stored as last non-deleted base. CigarIndex stores as THE deleted base
     //  pos1++;
-    std::string st = std::to_string(b1.gr.chr) + "_" + std::to_string(b1.gr.pos1) + "_" + std::to_string(this->getSpan()) + (isdel ? "D" : "I");
-    //std::string st = std::to_string(b1.gr.chr) + "_" + std::to_string(b1.gr.pos1); // + "_" + std::to_string(this->getSpan()) + (isdel ? "D" : "I");
-    return st;
+    return makeCigarKey(b1.gr.chr, b1.gr.pos1, this->getSpan(), isdel ? 'D' : 'I');
   }
   
 /*  int BreakPoint::checkPon(const PONFilter * p) {
@@ -595,8 +654,8 @@ std::ostream& operator<<(std::ostream& out, const BreakPoint& b) {
       
     }
   
-  void BreakPoint::checkBlacklist(GRC &grv) {
-    if (grv.CountOverlaps(b1.gr) || grv.CountOverlaps(b2.gr)) 
+  void BreakPoint::checkBlacklist(IntervalCursor &grv) {
+    if (grv.overlaps(b1.gr) || grv.overlaps(b2.gr)) 
       blacklist = true;
   }
   
@@ -966,7 +1025,36 @@ void BreakPoint::score_indel(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP) {
   // LOD SOM DBSNP cutoff same as above, but at DBSNP site (should be HIGHER threshold,
   //   since we have prior that it's NOT somatic
 void BreakPoint::scoreBreakpoint(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, double LOD_CUTOFF_SOMATIC, double LOD_CUTOFF_SOMATIC_DBSNP, double scale_errors, int min_dscrd_size) {
-    
+    std::vector<BreakPoint*> one(1, this);
+    scoreBreakpoints(one, LOD_CUTOFF, LOD_CUTOFF_DBSNP, LOD_CUTOFF_SOMATIC, LOD_CUTOFF_SOMATIC_DBSNP, scale_errors, min_dscrd_size);
+  }
+
+void BreakPoint::scoreBreakpoints(const std::vector<BreakPoint*>& bps, double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, double LOD_CUTOFF_SOMATIC, double LOD_CUTOFF_SOMATIC_DBSNP, double scale_errors, int min_dscrd_size) {
+
+    // queue the combined tumor / normal and each sample, in that order
+    GenotypeBatch gb;
+    for (auto b : bps) {
+      b->__prepare_scoring();
+      gb.add(b->t, b->error_rate);
+      gb.add(b->n, b->error_rate);
+      for (auto& i : b->allele)
+	gb.add(i.second, b->error_rate);
+    }
+
+    gb.run();
+
+    size_t k = 0;
+    for (auto b : bps) {
+      gb.get(k++, b->t);
+      gb.get(k++, b->n);
+      for (auto& i : b->allele)
+	gb.get(k++, i.second);
+      b->__finish_scoring(LOD_CUTOFF, LOD_CUTOFF_DBSNP, LOD_CUTOFF_SOMATIC, LOD_CUTOFF_SOMATIC_DBSNP, min_dscrd_size);
+    }
+  }
+
+void BreakPoint::__prepare_scoring() {
+
     // set the evidence (INDEL, DSCRD, etc)
     set_evidence();
 
@@ -974,10 +1062,11 @@ void BreakPoint::scoreBreakpoint(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, dou
 
     // 
     error_rate = repeat_seq.length() > 10 ? MAX_ERROR : ERROR_RATES[repeat_seq.length()];
-    for (auto& i : allele) {
+    for (auto& i : allele)
       i.second.readlen = readlen;
-      i.second.modelSelection(error_rate);
-    }
+  }
+
+void BreakPoint::__finish_scoring(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, double LOD_CUTOFF_SOMATIC, double LOD_CUTOFF_SOMATIC_DBSNP, int min_dscrd_size) {
 
     // kludge. make sure we have included the DC counts (should have done this arleady...)
     if (evidence == "DSCRD" || evidence == "ASDIS") {
@@ -1217,6 +1306,10 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
     insertion = nullptr;
     homology = nullptr;
 
+    // not in the file, zero so that operator< is deterministic
+    nsplit = 0; tsplit = 0;
+    dc.tcount = 0; dc.ncount = 0;
+
     //float afn, aft;
     std::string ref_s, alt_s, cname_s, insertion_s, homology_s, evidence_s, confidence_s, read_names_s, bxtable_s;
     
@@ -1303,7 +1396,71 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
 
   }
 
-  double SampleInfo::__log_likelihood(double ref, double alt, double f, double e) {
+// round as the default stream formatting does, so values match
+// what is read back from a bps.txt.gz
+static double __as_printed(double v) {
+  std::stringstream ss;
+  ss << v;
+  return std::stod(ss.str());
+}
+
+ReducedBreakPoint::ReducedBreakPoint(const BreakPoint& b, const SeqLib::BamHeader& h) {
+
+  if (h.isEmpty()) {
+    std::cerr << "ReducedBreakPoint::ReducedBreakPoint - Must supply non-empty header" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  nsplit = 0; tsplit = 0;
+  dc.tcount = 0; dc.ncount = 0;
+
+  b1 = ReducedBreakEnd(GenomicRegion(h.Name2ID(b.b1.chr_name), b.b1.gr.pos1, b.b1.gr.pos1), b.b1.mapq, b.b1.chr_name);
+  b2 = ReducedBreakEnd(GenomicRegion(h.Name2ID(b.b2.chr_name), b.b2.gr.pos1, b.b2.gr.pos1), b.b2.mapq, b.b2.chr_name);
+  b1.gr.strand = b.b1.gr.strand;
+  b2.gr.strand = b.b2.gr.strand;
+  b1.nm = b.b1.nm;
+  b2.nm = b.b2.nm;
+  b1.sub_n = std::min(255, b.b1.sub_n);
+  b2.sub_n = std::min(255, b.b2.sub_n);
+  dc.mapq1 = b.dc.mapq1;
+  dc.mapq2 = b.dc.mapq2;
+
+  num_align = std::min(31, b.num_align);
+  pass = b.confidence == "PASS";
+  indel = b.evidence == "INDEL";
+  imprecise = b.evidence == "DSCRD";
+  quality = b.quality;
+  secondary = b.secondary ? 1 : 0;
+  somatic_score = __as_printed(b.somatic_score);
+  somatic_lod = __as_printed(b.somatic_lod);
+
+  double max_lod = 0;
+  for (auto& s : b.allele)
+    max_lod = std::max(max_lod, s.second.LO);
+  true_lod = __as_printed(max_lod);
+
+  pon = std::min(255, b.pon);
+  blacklist = b.blacklist ? 1 : 0;
+  dbsnp = !b.rs.empty() && b.rs != "x";
+
+  confidence = __string_alloc2char(b.confidence, confidence);
+  evidence   = __string_alloc2char(b.evidence, evidence);
+  insertion  = __string_alloc2char(b.insertion, insertion);
+  homology   = __string_alloc2char(b.homology, homology);
+  cname      = __string_alloc2char(b.cname, cname);
+  ref        = __string_alloc2char(b.ref, ref);
+  alt        = __string_alloc2char(b.alt, alt);
+  repeat     = __string_alloc2char(b.repeat_seq, repeat);
+  if (somatic_score && pass)
+    read_names = b.read_names.empty() ? "x" : b.read_names;
+  bxtable = b.bxtable.empty() ? "x" : b.bxtable;
+
+  for (auto& a : b.allele)
+    format_s.push_back(a.second.toFileString());
+}
+
+  // shared by SampleInfo and GenotypeBatch
+  static inline double __loglik(double ref, double alt, double f, double e) {
     
     // less negative log-likelihoods means more likely
     // eg for low error rate, odds that you see 5 ALT and 5 REF
@@ -1336,6 +1493,15 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
 
   }
 
+  static inline double __genotype_ll(int g, double er, int alt, int cov) {
+    double val =  - cov * log10(2) + (cov - alt) * log10( (2 - g) * er + g  * (1 - er) ) + alt * log10( (2 - g) * (1 - er) + g * er);
+    return val;
+  }
+
+  double SampleInfo::__log_likelihood(double ref, double alt, double f, double e) {
+    return __loglik(ref, alt, f, e);
+  }
+
   void SampleInfo::modelSelection(double er) {
 
     // can't have more alt reads than total reads
@@ -1403,6 +1569,11 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
     //  " 1/1 " << genotype_likelihoods[2] << " LOD " << LO << " LO_n " << LO_n << 
     //  " af " << af << std::endl;
 
+    __set_genotype();
+  }
+
+  void SampleInfo::__set_genotype() {
+
     double max_likelihood = *std::max_element(genotype_likelihoods.begin(), genotype_likelihoods.end());
     if (max_likelihood == genotype_likelihoods[0])
       genotype = "0/0";
@@ -1432,6 +1603,69 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
 
   }
 
+  void GenotypeBatch::clear() {
+    alt.clear(); cov.clear(); readlen.clear(); er.clear();
+    af.clear(); LO.clear(); LO_n.clear(); gl0.clear(); gl1.clear(); gl2.clear();
+  }
+
+  size_t GenotypeBatch::add(const SampleInfo& s, double e) {
+    alt.push_back(s.alt);
+    cov.push_back(s.cov);
+    readlen.push_back(s.readlen);
+    er.push_back(e);
+    return alt.size() - 1;
+  }
+
+  // same steps as SampleInfo::modelSelection, one pass per step
+  void GenotypeBatch::run() {
+
+    const size_t n = size();
+    af.resize(n); LO.resize(n); LO_n.resize(n);
+    gl0.resize(n); gl1.resize(n); gl2.resize(n);
+
+    std::vector<double> a_cov(n);
+    std::vector<int32_t> scaled_alt(n);
+
+    // adjusted coverage and allelic fraction
+    for (size_t i = 0; i < n; ++i) {
+      int thiscov = alt[i] >= cov[i] ? alt[i] : cov[i];
+      double c = thiscov;
+      if (readlen[i]) {
+	c = (double)thiscov * (double)(readlen[i] - 2 * T_SPLIT_BUFF)/readlen[i];
+	c = c < 0 ? 0 : c;
+      }
+      double f = c > 0 ? (double)alt[i] / c : 1;
+      af[i] = f > 1 ? 1 : f;
+      a_cov[i] = c;
+      scaled_alt[i] = std::min(alt[i], (int)c);
+    }
+
+    // variant vs error, and AF 0 vs AF >= 0.5. AF 0 is the same term in both
+    for (size_t i = 0; i < n; ++i) {
+      double ref = a_cov[i] - scaled_alt[i];
+      double ll_err = __loglik(ref, scaled_alt[i], 0, er[i]);
+      LO[i] = __loglik(ref, scaled_alt[i], af[i], er[i]) - ll_err;
+      LO_n[i] = ll_err - __loglik(ref, scaled_alt[i], std::max(af[i], 0.5), er[i]);
+    }
+
+    // 0/0, 0/1, 1/1
+    for (size_t i = 0; i < n; ++i) {
+      gl0[i] = __genotype_ll(2, er[i], scaled_alt[i], a_cov[i]);
+      gl1[i] = __genotype_ll(1, er[i], scaled_alt[i], a_cov[i]);
+      gl2[i] = __genotype_ll(0, er[i], scaled_alt[i], a_cov[i]);
+    }
+  }
+
+  void GenotypeBatch::get(size_t i, SampleInfo& s) const {
+    s.af = af[i];
+    s.LO = LO[i];
+    s.LO_n = LO_n[i];
+    s.genotype_likelihoods[0] = gl0[i];
+    s.genotype_likelihoods[1] = gl1[i];
+    s.genotype_likelihoods[2] = gl2[i];
+    s.__set_genotype();
+  }
+
   void BreakPoint::addCovs(const std::unordered_map<std::string, STCoverage*>& covs) {
 
     // setting to min coverage because we want to accurately genotype indels
@@ -1490,8 +1724,6 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
     t.readlen = readlen;
     n.readlen = readlen;
     error_rate = (repeat_seq.length() > 10) ? MAX_ERROR : ERROR_RATES[repeat_seq.length()];
-    t.modelSelection(error_rate);
-    n.modelSelection(error_rate);
   }
 
 
@@ -1641,8 +1873,7 @@ ReducedBreakPoint::ReducedBreakPoint(const std::string &line, const SeqLib::BamH
   // assumes biallelic model
   // http://bioinformatics.oxfordjournals.org/content/early/2011/09/08/bioinformatics.btr509.full.pdf+html
   double SampleInfo::__genotype_likelihoods(int g, double er, int alt, int cov) {
-    double val =  - cov * log10(2) + (cov - alt) * log10( (2 - g) * er + g  * (1 - er) ) + alt * log10( (2 - g) * (1 - er) + g * er);
-    return val;
+    return __genotype_ll(g, er, alt, cov);
   }
 
 bool ReducedBreakPoint::operator<(const ReducedBreakPoint& bp) const { 
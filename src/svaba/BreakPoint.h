@@ -12,6 +12,8 @@
 #include "STCoverage.h"
 #include "SeqLib/RefGenome.h"
 #include "DiscordantCluster.h"
+#include "CigarIndex.h"
+#include "IntervalView.h"
 
   // forward declares
   struct BreakPoint;
@@ -42,6 +44,9 @@ struct ReducedBreakEnd {
 
    std::string hash(int offset = 0) const;
 
+   // same position as hash, packed in an integer
+   int64_t key(int offset = 0) const { return (int64_t)(((uint64_t)(uint32_t)gr.chr << 32) | (uint32_t)(gr.pos1 + offset)); }
+
    std::string id;
    std::string chr_name;
    SeqLib::GenomicRegion gr;
@@ -113,6 +118,12 @@ struct ReducedBreakEnd {
    }
    ReducedBreakPoint(const std::string &line, const SeqLib::BamHeader& h);
 
+   /** Make directly from a scored BreakPoint, with the same values as a
+    * round trip through BreakPoint::toFileString. The read name and BX strings
+    * must already be filled in (BreakPoint::formatStrings)
+    */
+   ReducedBreakPoint(const BreakPoint& b, const SeqLib::BamHeader& h);
+
    char * ref;
    char * alt;
    char * cname;
@@ -179,6 +190,9 @@ struct ReducedBreakEnd {
 
    double __genotype_likelihoods(int g, double er, int alt, int cov);
 
+   // call the genotype and fill GQ, NH_GQ and PL from genotype_likelihoods
+   void __set_genotype();
+
    std::string toFileString() const;
 
    void fromString(const std::string& s);
@@ -187,6 +201,76 @@ struct ReducedBreakEnd {
    
  };
  
+/** Genotype likelihoods and LODs for many samples at once.
+ *
+ * Inputs and outputs are held as separate arrays, so the per-sample math
+ * runs as flat loops the compiler can vectorize. The formulas are the same
+ * as SampleInfo::modelSelection, which stays as the scalar reference.
+ */
+struct GenotypeBatch {
+
+  // inputs
+  std::vector<int32_t> alt, cov, readlen;
+  std::vector<double> er;
+
+  // outputs
+  std::vector<double> af, LO, LO_n, gl0, gl1, gl2;
+
+  size_t size() const { return alt.size(); }
+
+  void clear();
+
+  /** Queue a sample to be scored at error rate er. Returns its index */
+  size_t add(const SampleInfo& s, double er);
+
+  /** Score everything that was added */
+  void run();
+
+  /** Copy the results for sample i into s and call its genotype */
+  void get(size_t i, SampleInfo& s) const;
+
+};
+
+/** The fields that order and de-duplicate BreakPoints, as a fixed-size record.
+ *
+ * cname and insertion are interned to ids in sorted string order, so comparing
+ * ids is the same as comparing the strings. idx is the BreakPoint it came from.
+ */
+struct BreakPointCore {
+
+  SeqLib::GenomicRegion gr1, gr2;
+  int32_t nsplit, tsplit, ncount, tcount;
+  uint32_t cname, insertion;
+  uint32_t idx;
+
+  // same order as BreakPoint::operator<
+  bool operator<(const BreakPointCore& c) const {
+    if (gr1 < c.gr1)
+      return true;
+    else if (c.gr1 < gr1)
+      return false;
+    if (gr2 < c.gr2)
+      return true;
+    else if (c.gr2 < gr2)
+      return false;
+    if (nsplit != c.nsplit)
+      return nsplit > c.nsplit;
+    if (tsplit != c.tsplit)
+      return tsplit > c.tsplit;
+    if (ncount != c.ncount)
+      return ncount > c.ncount;
+    if (tcount != c.tcount)
+      return tcount > c.tcount;
+    return cname > c.cname;
+  }
+
+  // same as BreakPoint::operator==
+  bool operator==(const BreakPointCore& c) const {
+    return gr1 == c.gr1 && gr2 == c.gr2 && insertion == c.insertion;
+  }
+
+};
+
  struct BreakPoint {
    
    static std::string header() { 
@@ -286,13 +370,22 @@ struct ReducedBreakEnd {
     *
     * Note that currently this only is set for the pos1 of indels.
     * If the BreakPoint object is not an indel, no action is taken. 
-    * @param grm An interval tree map created from a BED file containing blacklist regions
+    * @param grm Cursor on a view of the blacklist regions
     */
-   void checkBlacklist(SeqLib::GRC &grv);
+   void checkBlacklist(IntervalCursor &grv);
    
    /*! Score a breakpoint with a QUAL score, and as somatic or germline
     */
    void scoreBreakpoint(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, double LOD_CUTOFF_SOMATIC, double LOD_CUTOFF_SOMATIC_DBSNP, double scale_errors, int min_dscrd_size);
+
+   /*! Score many breakpoints, with the genotype and LOD math for all of
+    * their samples done as one GenotypeBatch. Same results as scoreBreakpoint on each
+    */
+   static void scoreBreakpoints(const std::vector<BreakPoint*>& bps, double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, double LOD_CUTOFF_SOMATIC, double LOD_CUTOFF_SOMATIC_DBSNP, double scale_errors, int min_dscrd_size);
+
+   // the parts of scoring before and after the genotype math
+   void __prepare_scoring();
+   void __finish_scoring(double LOD_CUTOFF, double LOD_CUTOFF_DBSNP, double LOD_CUTOFF_SOMATIC, double LOD_CUTOFF_SOMATIC_DBSNP, int min_dscrd_size);
    
    /*! Compute the allelic fraction (tumor and normal) for this BreakPoint.
     *
@@ -313,11 +406,10 @@ struct ReducedBreakEnd {
    */
    int getSpan() const;
 
-   /*! @function get a unique string representation of this breakpoint.
-    * Format for indel is chr_breakpos_type (eg. 0_134134_I)
-    * @return string with breakpoint info
+   /*! @function get the packed cigar key of this indel, to look up in a CigarIndex
+    * @return key with chr, breakpos, span and type. CIGAR_KEY_NONE if it can't be packed
     */
-   std::string getHashString() const;
+   CigarKey getCigarKey() const;
 
    bool hasMinimal() const;
    
@@ -328,10 +420,18 @@ struct ReducedBreakEnd {
    bool isEmpty() const { return (b1.gr.pos1 == 0 && b2.gr.pos1 == 0); }
    
    std::string toFileString(bool noreads = false);
+
+   /** Fill in the read name (unless noreads) and BX tag strings. Done by toFileString */
+   void formatStrings(bool noreads);
    
    bool hasDiscordant() const;
    
    bool operator==(const BreakPoint& bp) const;
+
+   /** Sort and remove duplicates, as std::sort and std::unique would.
+    * The comparisons run on an array of BreakPointCore, and each
+    * kept BreakPoint is moved once into place */
+   static void sortUnique(BPVec& bps);
    
    // define how to sort these 
    bool operator < (const BreakPoint& bp) const { 
@@ -0,0 +1,604 @@
+#include "BreakPointStore.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <map>
+
+#define BPS_MAGIC "SVB\1"
+
+// block flags
+#define BPS_HAS_READ_NAMES 0x1
+
+void BreakPointColumns::clear() {
+  n = 0;
+  for (auto& c : ints)
+    c.clear();
+  for (auto& c : dbls)
+    c.clear();
+  for (auto& c : dicts)
+    c.clear();
+  for (auto& c : strs)
+    c.clear();
+  read_names.clear();
+  for (auto& c : s_ints)
+    c.clear();
+  for (auto& c : s_dbls)
+    c.clear();
+  s_genotype.clear();
+  s_pl.clear();
+}
+
+// low-level helpers for the binary layout. Everything is host byte order
+static bool __write_int(BGZF * fp, int32_t v) {
+  return bgzf_write(fp, &v, sizeof(int32_t)) == sizeof(int32_t);
+}
+
+static bool __read_int(BGZF * fp, int32_t& v) {
+  return bgzf_read(fp, &v, sizeof(int32_t)) == sizeof(int32_t);
+}
+
+static bool __write_string(BGZF * fp, const std::string& s) {
+  if (!__write_int(fp, s.length()))
+    return false;
+  return s.empty() || bgzf_write(fp, s.c_str(), s.length()) == (ssize_t)s.length();
+}
+
+static bool __read_string(BGZF * fp, std::string& s) {
+  int32_t len;
+  if (!__read_int(fp, len) || len < 0)
+    return false;
+  s.resize(len);
+  return !len || bgzf_read(fp, &s[0], len) == len;
+}
+
+template <typename T>
+static bool __write_array(BGZF * fp, const std::vector<T>& v) {
+  ssize_t bytes = v.size() * sizeof(T);
+  return !bytes || bgzf_write(fp, &v[0], bytes) == bytes;
+}
+
+template <typename T>
+static bool __read_array(BGZF * fp, std::vector<T>& v, size_t n) {
+  v.resize(n);
+  ssize_t bytes = n * sizeof(T);
+  return !bytes || bgzf_read(fp, &v[0], bytes) == bytes;
+}
+
+static bool __write_strings(BGZF * fp, const std::vector<std::string>& v) {
+  for (auto& s : v)
+    if (!__write_string(fp, s))
+      return false;
+  return true;
+}
+
+static bool __read_strings(BGZF * fp, std::vector<std::string>& v, size_t n) {
+  v.resize(n);
+  for (auto& s : v)
+    if (!__read_string(fp, s))
+      return false;
+  return true;
+}
+
+// dictionary, then one int32 code per value
+static bool __write_dict(BGZF * fp, const std::vector<std::string>& v) {
+
+  std::vector<std::string> dict;
+  std::unordered_map<std::string, int32_t> codes;
+  std::vector<int32_t> c;
+  c.reserve(v.size());
+  for (auto& s : v) {
+    auto ff = codes.find(s);
+    if (ff == codes.end()) {
+      ff = codes.insert(std::pair<std::string, int32_t>(s, dict.size())).first;
+      dict.push_back(s);
+    }
+    c.push_back(ff->second);
+  }
+
+  return __write_int(fp, dict.size()) && __write_strings(fp, dict) && __write_array(fp, c);
+}
+
+static bool __read_dict(BGZF * fp, std::vector<std::string>& v, size_t n) {
+
+  int32_t nd;
+  std::vector<std::string> dict;
+  std::vector<int32_t> c;
+  if (!__read_int(fp, nd) || nd < 0 || !__read_strings(fp, dict, nd) || !__read_array(fp, c, n))
+    return false;
+
+  v.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    if (c[i] < 0 || c[i] >= nd)
+      return false;
+    v[i] = dict[c[i]];
+  }
+  return true;
+}
+
+bool BreakPointStoreWriter::Open(const std::string& file, const std::vector<std::string>& ids, const std::vector<std::string>& names) {
+
+  m_ids = ids;
+  m_cols.clear();
+
+  m_fp = bgzf_open(file.c_str(), "w");
+  if (!m_fp)
+    return false;
+
+  m_idx.open(file + ".idx");
+  if (!m_idx.is_open())
+    return false;
+
+  bool ok = bgzf_write(m_fp, BPS_MAGIC, 4) == 4;
+  ok = ok && __write_int(m_fp, ids.size());
+  for (size_t i = 0; ok && i < ids.size(); ++i)
+    ok = __write_string(m_fp, ids[i]) && __write_string(m_fp, i < names.size() ? names[i] : ids[i]);
+
+  // start the blocks on a fresh BGZF block
+  ok = ok && bgzf_flush(m_fp) == 0;
+
+  return ok;
+}
+
+bool BreakPointStoreWriter::Add(const BreakPoint& b) {
+
+  if (!m_fp)
+    return false;
+
+  typedef BreakPointColumns C;
+
+  m_cols.ints[C::POS1].push_back(b.b1.gr.pos1);
+  m_cols.ints[C::POS2].push_back(b.b2.gr.pos1);
+  m_cols.ints[C::STRANDS].push_back(((uint8_t)b.b1.gr.strand << 8) | (uint8_t)b.b2.gr.strand);
+  m_cols.ints[C::MAPQ1].push_back(b.b1.mapq);
+  m_cols.ints[C::MAPQ2].push_back(b.b2.mapq);
+  m_cols.ints[C::NM1].push_back(b.b1.nm);
+  m_cols.ints[C::NM2].push_back(b.b2.nm);
+  m_cols.ints[C::DMAPQ1].push_back(b.dc.mapq1);
+  m_cols.ints[C::DMAPQ2].push_back(b.dc.mapq2);
+  m_cols.ints[C::SUBN1].push_back(b.b1.sub_n);
+  m_cols.ints[C::SUBN2].push_back(b.b2.sub_n);
+  m_cols.ints[C::NUMALIGN].push_back(b.num_align);
+  m_cols.ints[C::QUALITY].push_back(b.quality);
+  m_cols.ints[C::SECONDARY].push_back(b.secondary);
+  m_cols.ints[C::PON].push_back(b.pon);
+  m_cols.ints[C::BLACKLIST].push_back(b.blacklist);
+
+  double max_lod = 0;
+  for (auto& s : b.allele)
+    max_lod = std::max(max_lod, s.second.LO);
+  m_cols.dbls[C::SOMATIC_SCORE].push_back(b.somatic_score);
+  m_cols.dbls[C::SOMATIC_LOD].push_back(b.somatic_lod);
+  m_cols.dbls[C::TRUE_LOD].push_back(max_lod);
+
+  m_cols.dicts[C::CHR1].push_back(b.b1.chr_name);
+  m_cols.dicts[C::CHR2].push_back(b.b2.chr_name);
+  m_cols.dicts[C::CONFIDENCE].push_back(b.confidence);
+  m_cols.dicts[C::EVIDENCE].push_back(b.evidence);
+
+  m_cols.strs[C::REF].push_back(b.ref);
+  m_cols.strs[C::ALT].push_back(b.alt);
+  m_cols.strs[C::HOMOLOGY].push_back(b.homology);
+  m_cols.strs[C::INSERTION].push_back(b.insertion);
+  m_cols.strs[C::CNAME].push_back(b.cname);
+  m_cols.strs[C::REPEAT].push_back(b.repeat_seq);
+  m_cols.strs[C::RS].push_back(b.rs);
+  m_cols.strs[C::BX].push_back(b.bxtable);
+
+  m_cols.read_names.push_back(b.read_names == "x" ? std::string() : b.read_names);
+
+  // per sample values are appended in record order here, and
+  // transposed to sample-major when the block is written
+  SampleInfo empty;
+  for (auto& id : m_ids) {
+    auto ff = b.allele.find(id);
+    const SampleInfo& s = ff == b.allele.end() ? empty : ff->second;
+    m_cols.s_ints[C::S_PRESENT].push_back(ff != b.allele.end());
+    m_cols.s_ints[C::S_ALT].push_back(s.alt);
+    m_cols.s_ints[C::S_COV].push_back(s.cov);
+    m_cols.s_ints[C::S_SPLIT].push_back(s.split);
+    m_cols.s_ints[C::S_CIGAR].push_back(s.cigar);
+    m_cols.s_ints[C::S_DISC].push_back(s.disc);
+    m_cols.s_dbls[C::S_GQ].push_back(s.GQ);
+    m_cols.s_dbls[C::S_LO_N].push_back(s.LO_n);
+    m_cols.s_dbls[C::S_LO].push_back(s.LO);
+    m_cols.s_genotype.push_back(s.genotype);
+    m_cols.s_pl.push_back(s.PL);
+  }
+
+  if (++m_cols.n >= BPS_BLOCK_SIZE)
+    return __flush();
+
+  return true;
+}
+
+template <typename T>
+static void __to_sample_major(std::vector<T>& v, size_t n, size_t ns) {
+  std::vector<T> out(v.size());
+  for (size_t i = 0; i < n; ++i)
+    for (size_t s = 0; s < ns; ++s)
+      out[s * n + i] = std::move(v[i * ns + s]);
+  v.swap(out);
+}
+
+bool BreakPointStoreWriter::__flush() {
+
+  if (!m_cols.n)
+    return true;
+
+  typedef BreakPointColumns C;
+  const size_t n = m_cols.n;
+  const size_t ns = m_ids.size();
+
+  // index the pos1 range of each chr1 in this block
+  int64_t voffset = bgzf_tell(m_fp);
+  std::map<std::string, std::pair<int32_t, int32_t>> ranges;
+  for (size_t i = 0; i < n; ++i) {
+    const int32_t p = m_cols.ints[C::POS1][i];
+    auto ff = ranges.find(m_cols.dicts[C::CHR1][i]);
+    if (ff == ranges.end())
+      ranges[m_cols.dicts[C::CHR1][i]] = std::pair<int32_t, int32_t>(p, p);
+    else {
+      ff->second.first = std::min(ff->second.first, p);
+      ff->second.second = std::max(ff->second.second, p);
+    }
+  }
+
+  for (auto& c : m_cols.s_ints)
+    __to_sample_major(c, n, ns);
+  for (auto& c : m_cols.s_dbls)
+    __to_sample_major(c, n, ns);
+  __to_sample_major(m_cols.s_genotype, n, ns);
+  __to_sample_major(m_cols.s_pl, n, ns);
+
+  int32_t flags = 0;
+  for (auto& r : m_cols.read_names)
+    if (!r.empty()) {
+      flags |= BPS_HAS_READ_NAMES;
+      break;
+    }
+
+  bool ok = __write_int(m_fp, n) && __write_int(m_fp, flags);
+  for (auto& c : m_cols.ints)
+    ok = ok && __write_array(m_fp, c);
+  for (auto& c : m_cols.dbls)
+    ok = ok && __write_array(m_fp, c);
+  for (auto& c : m_cols.dicts)
+    ok = ok && __write_dict(m_fp, c);
+  for (auto& c : m_cols.strs)
+    ok = ok && __write_strings(m_fp, c);
+  if (flags & BPS_HAS_READ_NAMES)
+    ok = ok && __write_strings(m_fp, m_cols.read_names);
+
+  for (auto& c : m_cols.s_ints)
+    ok = ok && __write_array(m_fp, c);
+  for (auto& c : m_cols.s_dbls)
+    ok = ok && __write_array(m_fp, c);
+  ok = ok && __write_dict(m_fp, m_cols.s_genotype) && __write_strings(m_fp, m_cols.s_pl);
+
+  // one BGZF block boundary per column block, so the offsets can be seeked to
+  ok = ok && bgzf_flush(m_fp) == 0;
+
+  for (auto& r : ranges)
+    m_idx << r.first << "\t" << r.second.first << "\t" << r.second.second << "\t"
+	  << voffset << "\t" << n << "\n";
+
+  m_cols.clear();
+
+  if (!ok)
+    std::cerr << "ERROR: Failed to write breakpoint store block" << std::endl;
+
+  return ok;
+}
+
+void BreakPointStoreWriter::Close() {
+
+  if (m_fp) {
+    __flush();
+    bgzf_close(m_fp);
+    m_fp = nullptr;
+  }
+  if (m_idx.is_open())
+    m_idx.close();
+}
+
+BreakPointStoreReader::~BreakPointStoreReader() {
+  if (m_fp)
+    bgzf_close(m_fp);
+}
+
+bool BreakPointStoreReader::IsStore(const std::string& file) {
+
+  BGZF * fp = bgzf_open(file.c_str(), "r");
+  if (!fp)
+    return false;
+  char magic[4];
+  bool is = bgzf_read(fp, magic, 4) == 4 && !memcmp(magic, BPS_MAGIC, 4);
+  bgzf_close(fp);
+  return is;
+}
+
+bool BreakPointStoreReader::Open(const std::string& file, const SeqLib::BamHeader& h) {
+
+  m_file = file;
+  m_hdr = h;
+
+  m_fp = bgzf_open(file.c_str(), "r");
+  if (!m_fp)
+    return false;
+
+  char magic[4];
+  if (bgzf_read(m_fp, magic, 4) != 4 || memcmp(magic, BPS_MAGIC, 4)) {
+    std::cerr << "ERROR: Not an svaba breakpoint store: " << file << std::endl;
+    return false;
+  }
+
+  int32_t ns = 0;
+  bool ok = __read_int(m_fp, ns) && ns >= 0;
+  m_ids.resize(ok ? ns : 0);
+  m_names.resize(ok ? ns : 0);
+  for (int32_t i = 0; ok && i < ns; ++i)
+    ok = __read_string(m_fp, m_ids[i]) && __read_string(m_fp, m_names[i]);
+
+  if (!ok)
+    std::cerr << "ERROR: Truncated header in breakpoint store " << file << std::endl;
+
+  return ok;
+}
+
+bool BreakPointStoreReader::SetRegion(const std::string& chr, int32_t pos1, int32_t pos2) {
+
+  std::ifstream idx(m_file + ".idx");
+  if (!idx.is_open()) {
+    std::cerr << "ERROR: Cannot open breakpoint store index " << m_file << ".idx" << std::endl;
+    return false;
+  }
+
+  m_region = true;
+  m_rchr = chr;
+  m_rpos1 = pos1;
+  m_rpos2 = pos2;
+  m_blocks.clear();
+  m_next_block = 0;
+  m_cols.clear();
+  m_row = 0;
+
+  std::string line, c;
+  while (std::getline(idx, line)) {
+    std::istringstream iss(line);
+    int32_t mn, mx;
+    int64_t voffset;
+    if (!(iss >> c >> mn >> mx >> voffset))
+      continue;
+    if (c == chr && mn <= pos2 && mx >= pos1)
+      m_blocks.push_back(voffset);
+  }
+
+  std::sort(m_blocks.begin(), m_blocks.end());
+  m_blocks.erase(std::unique(m_blocks.begin(), m_blocks.end()), m_blocks.end());
+
+  return true;
+}
+
+bool BreakPointStoreReader::__read_block() {
+
+  m_cols.clear();
+  m_row = 0;
+
+  if (m_region) {
+    if (m_next_block >= m_blocks.size())
+      return false;
+    if (bgzf_seek(m_fp, m_blocks[m_next_block++], SEEK_SET) < 0)
+      return false;
+  }
+
+  int32_t n, flags;
+  if (!__read_int(m_fp, n)) // end of the store
+    return false;
+
+  bool ok = n >= 0 && __read_int(m_fp, flags);
+  const size_t ns = m_ids.size();
+
+  for (auto& c : m_cols.ints)
+    ok = ok && __read_array(m_fp, c, n);
+  for (auto& c : m_cols.dbls)
+    ok = ok && __read_array(m_fp, c, n);
+  for (auto& c : m_cols.dicts)
+    ok = ok && __read_dict(m_fp, c, n);
+  for (auto& c : m_cols.strs)
+    ok = ok && __read_strings(m_fp, c, n);
+  if (ok && (flags & BPS_HAS_READ_NAMES))
+    ok = __read_strings(m_fp, m_cols.read_names, n);
+  else
+    m_cols.read_names.assign(n, std::string());
+
+  for (auto& c : m_cols.s_ints)
+    ok = ok && __read_array(m_fp, c, n * ns);
+  for (auto& c : m_cols.s_dbls)
+    ok = ok && __read_array(m_fp, c, n * ns);
+  ok = ok && __read_dict(m_fp, m_cols.s_genotype, n * ns) && __read_strings(m_fp, m_cols.s_pl, n * ns);
+
+  if (!ok) {
+    std::cerr << "ERROR: Truncated block in breakpoint store " << m_file << std::endl;
+    m_cols.clear();
+    return false;
+  }
+
+  m_cols.n = n;
+  return true;
+}
+
+int32_t BreakPointStoreReader::__chr_id(const std::string& chr) {
+
+  auto ff = m_chr_ids.find(chr);
+  if (ff != m_chr_ids.end())
+    return ff->second;
+
+  int32_t id;
+  if (m_hdr.isEmpty())
+    id = m_chr_ids.size();
+  else
+    try {
+      id = m_hdr.Name2ID(chr);
+    } catch (...) { // eg "Unknown"
+      id = -1;
+    }
+
+  m_chr_ids[chr] = id;
+  return id;
+}
+
+void BreakPointStoreReader::__fill(size_t i, BreakPoint& b) {
+
+  typedef BreakPointColumns C;
+  const BreakPointColumns& c = m_cols;
+  const size_t n = c.n;
+
+  b = BreakPoint();
+
+  const std::string& chr1 = c.dicts[C::CHR1][i];
+  const std::string& chr2 = c.dicts[C::CHR2][i];
+  int32_t p1 = c.ints[C::POS1][i], p2 = c.ints[C::POS2][i];
+  b.b1 = BreakEnd(SeqLib::GenomicRegion(__chr_id(chr1), p1, p1), c.ints[C::MAPQ1][i], chr1);
+  b.b2 = BreakEnd(SeqLib::GenomicRegion(__chr_id(chr2), p2, p2), c.ints[C::MAPQ2][i], chr2);
+  b.b1.gr.strand = (char)((c.ints[C::STRANDS][i] >> 8) & 0xff);
+  b.b2.gr.strand = (char)(c.ints[C::STRANDS][i] & 0xff);
+  b.b1.nm = c.ints[C::NM1][i];
+  b.b2.nm = c.ints[C::NM2][i];
+  b.dc.mapq1 = c.ints[C::DMAPQ1][i];
+  b.dc.mapq2 = c.ints[C::DMAPQ2][i];
+  b.b1.sub_n = c.ints[C::SUBN1][i];
+  b.b2.sub_n = c.ints[C::SUBN2][i];
+  b.num_align = c.ints[C::NUMALIGN][i];
+  b.quality = c.ints[C::QUALITY][i];
+  b.secondary = c.ints[C::SECONDARY][i];
+  b.pon = c.ints[C::PON][i];
+  b.blacklist = c.ints[C::BLACKLIST][i];
+
+  b.somatic_score = c.dbls[C::SOMATIC_SCORE][i];
+  b.somatic_lod = c.dbls[C::SOMATIC_LOD][i];
+  b.a.LO = c.dbls[C::TRUE_LOD][i];
+
+  b.confidence = c.dicts[C::CONFIDENCE][i];
+  b.evidence = c.dicts[C::EVIDENCE][i];
+
+  b.ref = c.strs[C::REF][i];
+  b.alt = c.strs[C::ALT][i];
+  b.homology = c.strs[C::HOMOLOGY][i];
+  b.insertion = c.strs[C::INSERTION][i];
+  b.cname = c.strs[C::CNAME][i];
+  b.repeat_seq = c.strs[C::REPEAT][i];
+  b.rs = c.strs[C::RS][i];
+  b.bxtable = c.strs[C::BX][i];
+  b.read_names = c.read_names[i];
+
+  const bool indel = b.evidence == "INDEL";
+  for (size_t s = 0; s < m_ids.size(); ++s) {
+    const size_t k = s * n + i;
+    if (!c.s_ints[C::S_PRESENT][k])
+      continue;
+    SampleInfo& a = b.allele[m_ids[s]];
+    a.indel = indel;
+    a.alt = c.s_ints[C::S_ALT][k];
+    a.cov = c.s_ints[C::S_COV][k];
+    a.split = c.s_ints[C::S_SPLIT][k];
+    a.cigar = c.s_ints[C::S_CIGAR][k];
+    a.disc = c.s_ints[C::S_DISC][k];
+    a.GQ = c.s_dbls[C::S_GQ][k];
+    a.LO_n = c.s_dbls[C::S_LO_N][k];
+    a.LO = c.s_dbls[C::S_LO][k];
+    a.genotype = c.s_genotype[k];
+    a.PL = c.s_pl[k];
+  }
+}
+
+bool BreakPointStoreReader::Next(BreakPoint& b) {
+
+  if (!m_fp)
+    return false;
+
+  while (true) {
+
+    if (m_row >= m_cols.n && !__read_block())
+      return false;
+
+    size_t i = m_row++;
+
+    // blocks can hold other chr / positions, so check each record
+    if (m_region) {
+      int32_t p = m_cols.ints[BreakPointColumns::POS1][i];
+      if (m_cols.dicts[BreakPointColumns::CHR1][i] != m_rchr || p < m_rpos1 || p > m_rpos2)
+	continue;
+    }
+
+    __fill(i, b);
+    return true;
+  }
+}
+
+static const char *BPS2TXT_USAGE_MESSAGE =
+"Usage: svaba bps2txt <id.bps.svb> [chr:pos1-pos2]\n\n"
+"  Description: Print a breakpoint store as bps.txt (with header) to stdout.\n"
+"               A region selects breakpoints by their first break-end, using <id.bps.svb>.idx\n"
+"\n"
+"  -h, --help                           Display this help and exit\n"
+"\n";
+
+void runBpsToText(int argc, char** argv) {
+
+  // argv[0] is "bps2txt"
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string a(argv[i]);
+    if (a == "-h" || a == "--help") {
+      args.clear();
+      break;
+    }
+    args.push_back(a);
+  }
+
+  if (args.empty() || args.size() > 2) {
+    std::cerr << "\n" << BPS2TXT_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+
+  BreakPointStoreReader reader;
+  if (!reader.Open(args[0])) {
+    std::cerr << "ERROR: Cannot open breakpoint store " << args[0] << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (args.size() == 2) {
+    // chr:pos1-pos2, or a whole chr
+    std::string chr = args[1];
+    int32_t pos1 = 0, pos2 = INT32_MAX;
+    size_t c = args[1].rfind(':');
+    if (c != std::string::npos) {
+      chr = args[1].substr(0, c);
+      std::string r = args[1].substr(c + 1);
+      r.erase(std::remove(r.begin(), r.end(), ','), r.end());
+      size_t d = r.find('-');
+      try {
+	pos1 = std::stoi(r.substr(0, d));
+	pos2 = d == std::string::npos ? pos1 : std::stoi(r.substr(d + 1));
+      } catch (...) {
+	std::cerr << "ERROR: Cannot parse region " << args[1] << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    }
+    if (!reader.SetRegion(chr, pos1, pos2))
+      exit(EXIT_FAILURE);
+  }
+
+  std::cout << BreakPoint::header();
+  for (auto& s : reader.SampleNames())
+    std::cout << "\t" << s;
+  std::cout << "\n";
+
+  // read names were formatted before the store was written
+  BreakPoint bp;
+  while (reader.Next(bp))
+    std::cout << bp.toFileString(true) << "\n";
+}
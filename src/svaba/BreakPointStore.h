@@ -0,0 +1,157 @@
+#ifndef SVABA_BREAKPOINT_STORE_H__
+#define SVABA_BREAKPOINT_STORE_H__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+
+#include "htslib/bgzf.h"
+
+#include "SeqLib/BamHeader.h"
+#include "BreakPoint.h"
+
+// records per block. A block is the unit of compression and of the index
+#define BPS_BLOCK_SIZE 4096
+
+/** One block of breakpoints, stored by column.
+ *
+ * Columns are typed: int32 and double columns are written as raw arrays,
+ * low-cardinality strings (chr, confidence, evidence, genotype) are dictionary
+ * encoded per block, and the rest are length-prefixed. Per-sample columns
+ * are sample-major, so sample s of record i is at [s * n + i].
+ */
+struct BreakPointColumns {
+
+  enum { POS1, POS2, STRANDS, MAPQ1, MAPQ2, NM1, NM2, DMAPQ1, DMAPQ2, SUBN1, SUBN2,
+	 NUMALIGN, QUALITY, SECONDARY, PON, BLACKLIST, NUM_INT };
+  enum { SOMATIC_SCORE, SOMATIC_LOD, TRUE_LOD, NUM_DBL };
+  enum { CHR1, CHR2, CONFIDENCE, EVIDENCE, NUM_DICT };
+  enum { REF, ALT, HOMOLOGY, INSERTION, CNAME, REPEAT, RS, BX, NUM_STR };
+
+  // per sample
+  enum { S_PRESENT, S_ALT, S_COV, S_SPLIT, S_CIGAR, S_DISC, NUM_SINT };
+  enum { S_GQ, S_LO_N, S_LO, NUM_SDBL };
+
+  size_t n = 0;
+
+  std::vector<int32_t> ints[NUM_INT];
+  std::vector<double> dbls[NUM_DBL];
+  std::vector<std::string> dicts[NUM_DICT];
+  std::vector<std::string> strs[NUM_STR];
+
+  // only written if any record in the block has read names
+  std::vector<std::string> read_names;
+
+  std::vector<int32_t> s_ints[NUM_SINT];
+  std::vector<double> s_dbls[NUM_SDBL];
+  std::vector<std::string> s_genotype, s_pl;
+
+  void clear();
+
+};
+
+/** Write breakpoints to a block-compressed, columnar store (<id>.bps.svb).
+ *
+ * The store is a BGZF stream with a sample header followed by blocks of
+ * BreakPointColumns. A plain-text index (<store>.idx) gives, for each block,
+ * the virtual offset and the pos1 range of each chr1 it holds.
+ */
+class BreakPointStoreWriter {
+
+ public:
+
+  BreakPointStoreWriter() {}
+
+  ~BreakPointStoreWriter() { Close(); }
+
+  /** Open the store and write the sample header
+   * @param ids Sample ids that key BreakPoint::allele (eg t000)
+   * @param names Column names for bps.txt.gz (eg t000_/path/to.bam)
+   */
+  bool Open(const std::string& file, const std::vector<std::string>& ids, const std::vector<std::string>& names);
+
+  /** Add a breakpoint that has been scored and had formatStrings run.
+   * Not thread-safe, caller must lock */
+  bool Add(const BreakPoint& b);
+
+  /** Write the last block and close the store and its index */
+  void Close();
+
+ private:
+
+  BGZF * m_fp = nullptr;
+  std::ofstream m_idx;
+
+  std::vector<std::string> m_ids;
+
+  BreakPointColumns m_cols;
+
+  bool __flush();
+
+};
+
+/** Sequential or region reader for a store made by BreakPointStoreWriter.
+ *
+ * Breakpoints come back as they would from a bps.txt.gz line, with
+ * BreakPoint::allele keyed by sample id and the max LOD in a.LO
+ */
+class BreakPointStoreReader {
+
+ public:
+
+  BreakPointStoreReader() {}
+
+  ~BreakPointStoreReader();
+
+  /** Does this file start with the store magic */
+  static bool IsStore(const std::string& file);
+
+  /** Open the store and read the sample header.
+   * @param h Header to set chr ids from. If empty, ids are given in the order
+   * chromosomes are first seen
+   */
+  bool Open(const std::string& file, const SeqLib::BamHeader& h = SeqLib::BamHeader());
+
+  /** Only return breakpoints with pos1 in this region. Needs the .idx */
+  bool SetRegion(const std::string& chr, int32_t pos1, int32_t pos2);
+
+  /** Read the next breakpoint. Returns false at the end of the store */
+  bool Next(BreakPoint& b);
+
+  const std::vector<std::string>& SampleIds() const { return m_ids; }
+
+  const std::vector<std::string>& SampleNames() const { return m_names; }
+
+ private:
+
+  BGZF * m_fp = nullptr;
+  std::string m_file;
+
+  SeqLib::BamHeader m_hdr;
+  std::unordered_map<std::string, int32_t> m_chr_ids;
+
+  std::vector<std::string> m_ids, m_names;
+
+  BreakPointColumns m_cols;
+  size_t m_row = 0;
+
+  // region query
+  bool m_region = false;
+  std::string m_rchr;
+  int32_t m_rpos1 = 0, m_rpos2 = 0;
+  std::vector<int64_t> m_blocks;
+  size_t m_next_block = 0;
+
+  bool __read_block();
+
+  int32_t __chr_id(const std::string& chr);
+
+  void __fill(size_t i, BreakPoint& b);
+
+};
+
+/** svaba bps2txt: print a breakpoint store as bps.txt */
+void runBpsToText(int argc, char** argv);
+
+#endif
@@ -0,0 +1,40 @@
+#include "CigarIndex.h"
+
+#include <algorithm>
+#include <cassert>
+
+void CigarIndex::settle() {
+
+  if (m_settled)
+    return;
+
+  std::sort(m_entries.begin(), m_entries.end());
+
+  // collapse runs of the same key, in place
+  size_t j = 0;
+  for (size_t i = 0; i < m_entries.size(); ++i) {
+    if (j && m_entries[j-1].first == m_entries[i].first)
+      m_entries[j-1].second += m_entries[i].second;
+    else
+      m_entries[j++] = m_entries[i];
+  }
+  m_entries.resize(j);
+
+  m_settled = true;
+}
+
+int32_t CigarIndex::count(CigarKey k) const {
+
+  assert(m_settled);
+
+  std::vector<Entry>::const_iterator ff = std::lower_bound(m_entries.begin(), m_entries.end(), Entry(k, INT32_MIN));
+  if (ff == m_entries.end() || ff->first != k)
+    return 0;
+  return ff->second;
+}
+
+void CigarIndex::merge(const CigarIndex& c) {
+  m_entries.insert(m_entries.end(), c.m_entries.begin(), c.m_entries.end());
+  m_settled = false;
+  settle();
+}
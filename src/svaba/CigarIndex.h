@@ -0,0 +1,78 @@
+#ifndef SVABA_CIGAR_INDEX_H__
+#define SVABA_CIGAR_INDEX_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+// an indel cigar op packed into 64 bits
+// [63..48] chr (16) | [47..17] pos (31) | [16] I=1/D=0 (1) | [15..0] length (16)
+typedef uint64_t CigarKey;
+
+#define CIGAR_KEY_NONE UINT64_MAX
+
+/** Pack an indel into a CigarKey. Returns CIGAR_KEY_NONE
+ * if any of the fields are out of range for the packing.
+ * @param pos Position on the reference of the first inserted / deleted base
+ */
+inline CigarKey makeCigarKey(int32_t chr, int32_t pos, uint32_t len, char type) {
+  if (chr < 0 || chr > 0xFFFF || pos < 0 || len > 0xFFFF || (type != 'I' && type != 'D'))
+    return CIGAR_KEY_NONE;
+  return ((uint64_t)chr << 48) | ((uint64_t)pos << 17) | ((uint64_t)(type == 'I') << 16) | len;
+}
+
+/** Count of reads supporting each indel cigar op in a window.
+ *
+ * Keys are appended in the read loop with no hashing. settle() then sorts
+ * and collapses them once per window, and lookups are a binary search.
+ */
+class CigarIndex {
+
+ public:
+
+  typedef std::pair<CigarKey, int32_t> Entry;
+
+  CigarIndex() {}
+
+  /** Add count observations of a key. Must settle() before querying */
+  void add(CigarKey k, int32_t count = 1) {
+    m_entries.push_back(Entry(k, count));
+    m_settled = false;
+  }
+
+  /** Sort and collapse the keys added since the last settle */
+  void settle();
+
+  /** Number of reads with this indel. 0 if none */
+  int32_t count(CigarKey k) const;
+
+  /** Add all of the counts from another index */
+  void merge(const CigarIndex& c);
+
+  void clear() {
+    m_entries.clear();
+    m_settled = true;
+  }
+
+  size_t size() const { return m_entries.size(); }
+
+  bool empty() const { return m_entries.empty(); }
+
+  const std::vector<Entry>& entries() const { return m_entries; }
+
+  size_t Bytes() const { return m_entries.capacity() * sizeof(Entry); }
+
+ private:
+
+  std::vector<Entry> m_entries;
+
+  bool m_settled = true;
+
+};
+
+// key is the sample id (eg t000)
+typedef std::unordered_map<std::string, CigarIndex> CigarIndexMap;
+
+#endif
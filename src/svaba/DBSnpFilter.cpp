@@ -1,43 +1,134 @@
 #include "DBSnpFilter.h"
 #include "gzstream.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+
+// index layout: magic, uint32 number of chr, uint64 size and int64 mtime of the
+// VCF it was made from, then per chr a fixed-size entry (name, byte offset of
+// its sites, number of sites), then the DBSnpSite arrays
+#define DBSNP_INDEX_MAGIC "SVD\2"
+#define DBSNP_NAME_LEN 64
+#define DBSNP_HEADER_LEN 24
+
+struct DBSnpIndexEntry {
+  char name[DBSNP_NAME_LEN];
+  uint64_t offset;
+  uint64_t n;
+};
+
 using namespace SeqLib;
 
-DBSnpSite::DBSnpSite(const std::string& tchr, const std::string& pos, const std::string& rs, const std::string& ref, const std::string& alt, const BamHeader& h) {
-    
-    // make the genomic region
-    try { 
-      GenomicRegion gr(tchr, pos, pos, h);
-      chr = gr.chr; 
-      pos1 = std::stoi(pos);
-    } catch (...) {
-      //std::cerr << "DBSnpSite: Error trying to convert " << tchr << ":" << pos << " to number" << std::endl;
+// pull chr, start and end from a VCF line. Only indels are kept (for now reject SNP sites)
+static bool __parse_site(const std::string& line, std::string& chr, DBSnpSite& s) {
+
+  if (line.find("#") != std::string::npos || line.length() == 0)
+    return false;
+
+  std::istringstream thisline(line);
+  std::string val;
+  int this_count = -1;
+  std::string pos, rs, ref, alt;
+  while (std::getline(thisline, val, '\t')) {
+    ++this_count;
+    switch (this_count) {
+    case 0: chr = val; break;
+    case 1: pos = val; break;
+    case 2: rs = val; break;
+    case 3: ref = val; break;
+    case 4: alt = val; break;
     }
+    if (this_count >= 4)
+      break;
+  }
 
-    //m_rs = rs;
-    //m_ref = ref;
-    //m_alt = alt;
+  if (ref.length() == 0 || alt.length() == 0)
+    std::cerr << "DBSnpSite: Is the VCF formated correctly for this entry? Ref " << ref << " ALT " << alt << " rs " << rs << std::endl;
 
-    if (ref.length() == 0 || alt.length() == 0) // || m_rs.length() == 0)
-      std::cerr << "DBSnpSite: Is the VCF formated correctly for this entry? Ref " << ref << " ALT " << alt << " rs " << rs << std::endl;
+  if (ref.length() + alt.length() <= 2)
+    return false;
 
-    // insertion
-    if (ref.length() == 1)
-      pos2 = pos1 + 1;
-    // deletion
-    else
-      pos2 = pos1 + ref.length() + 1;
-    
+  try {
+    s.pos1 = std::stoi(pos);
+  } catch (...) {
+    return false;
   }
 
+  // insertion
+  if (ref.length() == 1)
+    s.pos2 = s.pos1 + 1;
+  // deletion
+  else
+    s.pos2 = s.pos1 + ref.length() + 1;
+
+  return true;
+}
+
+// sort by start and set the running max end
+static void __settle(std::vector<DBSnpSite>& v) {
+  std::sort(v.begin(), v.end(), [](const DBSnpSite& a, const DBSnpSite& b) {
+      return a.pos1 < b.pos1 || (a.pos1 == b.pos1 && a.pos2 < b.pos2);
+    });
+  int32_t m = INT32_MIN;
+  for (auto& s : v) {
+    m = std::max(m, s.pos2);
+    s.maxend = m;
+  }
+}
+
+static bool __file_stat(const std::string& file, uint64_t& size, int64_t& mtime) {
+  struct stat st;
+  if (stat(file.c_str(), &st) != 0)
+    return false;
+  size = st.st_size;
+  mtime = st.st_mtime;
+  return true;
+}
+
+static int32_t __chr_id(const BamHeader& h, const std::string& chr) {
+  try {
+    return h.Name2ID(chr);
+  } catch (...) {
+    return -1;
+  }
+}
+
 DBSnpFilter::DBSnpFilter(const std::string& db, const BamHeader& h) {
-    
+
     // read in the file
     if (!read_access_test(db)) {
-      std::cerr << std::endl << "**** Cannot read DBSnp database " << db << "   Expecting a VCF file" << std::endl;
+      std::cerr << std::endl << "**** Cannot read DBSnp database " << db << "   Expecting a VCF file or svaba dbsnp-index file" << std::endl;
       return;
     }
 
+    if (IsIndex(db)) {
+      if (!__open_index(db, h))
+	std::cerr << std::endl << "**** Cannot read DBSnp index " << db << std::endl;
+      return;
+    }
+
+    // an index made with svaba dbsnp-index next to the VCF, if made from this VCF
+    std::string idx = db + ".svdb";
+    if (read_access_test(idx) && IsIndex(idx) && __open_index(idx, h, db))
+      return;
+
+    __read_vcf(db, h);
+}
+
+DBSnpFilter::~DBSnpFilter() {
+  if (m_map)
+    munmap(m_map, m_map_len);
+}
+
+void DBSnpFilter::__read_vcf(const std::string& db, const BamHeader& h) {
+
     // read it in
     igzstream in(db.c_str());
     if (!in) {
@@ -45,82 +136,267 @@ DBSnpFilter::DBSnpFilter(const std::string& db, const BamHeader& h) {
       return;
     }
 
-    std::string line;
+    m_own.resize(h.NumSequences());
+
+    std::unordered_map<std::string, int32_t> ids;
+    std::string line, chr;
+    DBSnpSite s;
     while (std::getline(in, line)) {
 
-      if (line.find("#") != std::string::npos || line.length() == 0)
+      if (!__parse_site(line, chr, s))
 	continue;
 
-      std::istringstream thisline(line);
-      std::string val;
-      int this_count = -1;
-      std::string chr, pos, rs, ref, alt;
-      while (std::getline(thisline, val, '\t')) {
-	++this_count;
-	switch (this_count) { 
-	case 0: chr = val; break;
-	case 1: pos = val; break;
-	case 2: rs = val; break;
-	case 3: ref = val; break;
-	case 4: alt = val; break;
-	}
-      }
+      std::unordered_map<std::string, int32_t>::const_iterator ff = ids.find(chr);
+      int32_t id = ff != ids.end() ? ff->second : (ids[chr] = __chr_id(h, chr));
+      if (id < 0 || id >= (int32_t)m_own.size())
+	continue;
+      m_own[id].push_back(s);
+    }
+
+    m_chr.resize(m_own.size());
+    m_n.resize(m_own.size());
+    for (size_t i = 0; i < m_own.size(); ++i) {
+      __settle(m_own[i]);
+      m_chr[i] = m_own[i].data();
+      m_n[i] = m_own[i].size();
+    }
+}
+
+// any version, so an old index is rejected rather than read as a VCF
+bool DBSnpFilter::IsIndex(const std::string& file) {
+  std::ifstream in(file, std::ios::binary);
+  char magic[4];
+  return in.read(magic, 4) && !memcmp(magic, DBSNP_INDEX_MAGIC, 3);
+}
+
+bool DBSnpFilter::__open_index(const std::string& file, const BamHeader& h, const std::string& source) {
+
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  char magic[4];
+  if (fstat(fd, &st) != 0 || st.st_size < DBSNP_HEADER_LEN || read(fd, magic, 4) != 4) {
+    close(fd);
+    return false;
+  }
+  if (memcmp(magic, DBSNP_INDEX_MAGIC, 4)) {
+    std::cerr << "DBSnp index " << file << " is from an older svaba. Rebuild it with svaba dbsnp-index" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
 
-      DBSnpSite db(chr, pos, rs, ref, alt, h);
-
-      // for now reject SNP sites
-      if (ref.length() + alt.length() > 2) {
-	m_sites.add(db);
-
-	// make the hash
-	cig.str(std::string());
-	//cig << db.chr << "_" << db.pos1 << "_" << (db.pos2-db.pos1) << (db.m_ref.length() == 1 ? "I" : "D");
-	cig << db.chr << "_" << db.pos1;
-	//m_hash.insert(cig.str());
-	
-	m_int_hash.insert(hasher(cig.str()));
-	//std::cerr << line << " hash " << cig.str() << std::endl;
-	
+  const char * base = static_cast<const char*>(map);
+  uint32_t num_chr;
+  uint64_t src_size, size;
+  int64_t src_mtime, mtime;
+  memcpy(&num_chr, base + 4, sizeof(uint32_t));
+  memcpy(&src_size, base + 8, sizeof(uint64_t));
+  memcpy(&src_mtime, base + 16, sizeof(int64_t));
+  const DBSnpIndexEntry * e = reinterpret_cast<const DBSnpIndexEntry*>(base + DBSNP_HEADER_LEN);
+  if (DBSNP_HEADER_LEN + num_chr * sizeof(DBSnpIndexEntry) > (size_t)st.st_size) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  // the VCF was changed since the index was made
+  if (!source.empty() && (!__file_stat(source, size, mtime) || size != src_size || mtime != src_mtime)) {
+    std::cerr << "DBSnp index " << file << " does not match the size / modification time of " << source
+	      << ". Ignoring it and reading the VCF. Rebuild it with svaba dbsnp-index" << std::endl;
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  m_chr.assign(h.NumSequences(), nullptr);
+  m_n.assign(h.NumSequences(), 0);
+  for (uint32_t i = 0; i < num_chr; ++i) {
+    if (e[i].offset + e[i].n * sizeof(DBSnpSite) > (uint64_t)st.st_size) {
+      munmap(map, st.st_size);
+      m_chr.clear();
+      m_n.clear();
+      return false;
+    }
+    std::string name(e[i].name, strnlen(e[i].name, DBSNP_NAME_LEN));
+    int32_t id = __chr_id(h, name);
+    if (id < 0 || id >= (int32_t)m_chr.size())
+      continue;
+    m_chr[id] = reinterpret_cast<const DBSnpSite*>(base + e[i].offset);
+    m_n[id] = e[i].n;
+  }
+
+  m_map = map;
+  m_map_len = st.st_size;
+  return true;
+}
+
+bool DBSnpFilter::BuildIndex(const std::string& vcf, const std::string& out) {
+
+  // before reading, so a VCF written to during the build looks stale
+  uint64_t src_size;
+  int64_t src_mtime;
+  if (!__file_stat(vcf, src_size, src_mtime)) {
+    std::cerr << "ERROR: Cannot read DBSnp database " << vcf << std::endl;
+    return false;
+  }
+
+  igzstream in(vcf.c_str());
+  if (!in) {
+    std::cerr << "ERROR: Cannot read DBSnp database " << vcf << std::endl;
+    return false;
+  }
+
+  // chr in the order they are first seen
+  std::vector<std::string> names;
+  std::vector<std::vector<DBSnpSite>> sites;
+  std::unordered_map<std::string, size_t> ids;
+
+  std::string line, chr;
+  DBSnpSite s;
+  while (std::getline(in, line)) {
+    if (!__parse_site(line, chr, s))
+      continue;
+    std::unordered_map<std::string, size_t>::const_iterator ff = ids.find(chr);
+    size_t id;
+    if (ff == ids.end()) {
+      if (chr.length() >= DBSNP_NAME_LEN) {
+	std::cerr << "ERROR: Chromosome name too long for DBSnp index: " << chr << std::endl;
+	return false;
       }
+      id = names.size();
+      ids[chr] = id;
+      names.push_back(chr);
+      sites.push_back(std::vector<DBSnpSite>());
+    } else {
+      id = ff->second;
     }
-    
-    // build the tree
-    m_sites.CreateTreeMap();
+    sites[id].push_back(s);
+  }
 
+  std::ofstream os(out, std::ios::binary);
+  if (!os) {
+    std::cerr << "ERROR: Cannot write DBSnp index " << out << std::endl;
+    return false;
   }
 
-  std::ostream& operator<<(std::ostream& out, const DBSnpFilter& d) {
-    out << "DBSnpFilter with a total of " << AddCommas<size_t>(d.m_sites.size());
-    return out;
+  uint32_t num_chr = names.size();
+  os.write(DBSNP_INDEX_MAGIC, 4);
+  os.write(reinterpret_cast<const char*>(&num_chr), sizeof(uint32_t));
+  os.write(reinterpret_cast<const char*>(&src_size), sizeof(uint64_t));
+  os.write(reinterpret_cast<const char*>(&src_mtime), sizeof(int64_t));
+
+  uint64_t offset = DBSNP_HEADER_LEN + num_chr * sizeof(DBSnpIndexEntry);
+  for (size_t i = 0; i < names.size(); ++i) {
+    __settle(sites[i]);
+    DBSnpIndexEntry e;
+    memset(&e, 0, sizeof(e));
+    memcpy(e.name, names[i].c_str(), names[i].length());
+    e.offset = offset;
+    e.n = sites[i].size();
+    os.write(reinterpret_cast<const char*>(&e), sizeof(e));
+    offset += e.n * sizeof(DBSnpSite);
   }
+  for (auto& v : sites)
+    os.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(DBSnpSite));
 
-  std::ostream& operator<<(std::ostream& out, const DBSnpSite& d) {
-    //out << d.chr << ":" << d.pos1 << "-" << d.pos2 << "\t" << d.m_rs << " REF " << d.m_ref << " ALT " << d.m_alt;
-    out << d.chr << ":" << d.pos1 << "-" << d.pos2;;
+  os.close();
+  return !os.fail();
+}
+
+size_t DBSnpFilter::size() const {
+  size_t n = 0;
+  for (auto& i : m_n)
+    n += i;
+  return n;
+}
+
+  std::ostream& operator<<(std::ostream& out, const DBSnpFilter& d) {
+    out << "DBSnpFilter with a total of " << AddCommas<size_t>(d.size());
     return out;
   }
 
+bool DBSnpFilter::__overlaps(int32_t chr, int32_t pos1, int32_t pos2) const {
+
+  if (chr < 0 || chr >= (int32_t)m_chr.size() || !m_n[chr])
+    return false;
+
+  // first site that could reach pos1, then walk until sites start past pos2
+  const DBSnpSite * b = m_chr[chr];
+  const DBSnpSite * e = b + m_n[chr];
+  const DBSnpSite * it = std::lower_bound(b, e, pos1, [](const DBSnpSite& s, int32_t p) { return s.maxend < p; });
+  for (; it != e && it->pos1 <= pos2; ++it)
+    if (it->pos2 >= pos1)
+      return true;
+  return false;
+}
+
   bool DBSnpFilter::queryHash(const std::string& h) const {
-    //return m_hash.count(h);
-    return m_int_hash.count(hasher(h));
+
+    // chr_pos
+    size_t u = h.find('_');
+    if (u == std::string::npos)
+      return false;
+    int32_t chr, pos;
+    try {
+      chr = std::stoi(h.substr(0, u));
+      pos = std::stoi(h.substr(u + 1));
+    } catch (...) {
+      return false;
+    }
+    if (chr < 0 || chr >= (int32_t)m_chr.size())
+      return false;
+
+    const DBSnpSite * b = m_chr[chr];
+    const DBSnpSite * e = b + m_n[chr];
+    const DBSnpSite * it = std::lower_bound(b, e, pos, [](const DBSnpSite& s, int32_t p) { return s.pos1 < p; });
+    return it != e && it->pos1 == pos;
   }
 
   bool DBSnpFilter::queryBreakpoint(BreakPoint& bp) {
-    
-    std::vector<int32_t> sub, que;
+
     GenomicRegion gr = bp.b1.gr;
     gr.Pad(2);
-    GRC subject(gr);
-    GRC out = subject.FindOverlaps(m_sites, sub, que, true); // true = ignore_strand
-    
-    if (que.size()) {
-      //bp.rs = m_sites[sub[0]].m_rs;
-      bp.rs = "D"; 
-      //for (auto& j : que) {
-      //bp.rs += m_sites[j].m_rs + "_";
-      //}
-      //bp.rs.pop_back(); // just drop the last comma
+
+    if (__overlaps(gr.chr, gr.pos1, gr.pos2)) {
+      bp.rs = "D";
       return true;
     }
     return false;
   }
+
+static const char *DBSNP_INDEX_USAGE_MESSAGE =
+"Usage: svaba dbsnp-index <dbsnp.vcf[.gz]> [out.svdb]\n\n"
+"  Description: Compile the indel sites of a DBSnp VCF to a binary index that svaba mmaps at startup.\n"
+"               Pass the index to svaba run / refilter with -D. An index at <dbsnp.vcf>.svdb is\n"
+"               also picked up automatically when -D is given the VCF, unless the VCF has changed\n"
+"               size or modification time since the index was made.\n"
+"               Default output is <dbsnp.vcf>.svdb\n"
+"\n";
+
+void runDBSnpIndex(int argc, char** argv) {
+
+  // argv[0] is "dbsnp-index"
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string a(argv[i]);
+    if (a == "-h" || a == "--help") {
+      args.clear();
+      break;
+    }
+    args.push_back(a);
+  }
+
+  if (args.empty() || args.size() > 2) {
+    std::cerr << "\n" << DBSNP_INDEX_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+
+  std::string out = args.size() == 2 ? args[1] : args[0] + ".svdb";
+  if (!DBSnpFilter::BuildIndex(args[0], out))
+    exit(EXIT_FAILURE);
+  std::cerr << "...wrote DBSnp index " << out << std::endl;
+}
@@ -2,63 +2,82 @@
 #define SNOWTOOLS_DBSNP_FILTER_H__
 
 #include <vector>
+#include <string>
 #include <cstring>
+#include <cstdint>
 #include <iostream>
-#include <unordered_set>
-#include <functional> //for std::hash
 
-#include "SeqLib/GenomicRegionCollection.h"
 #include "SeqLib/BamHeader.h"
 
 #include "BreakPoint.h"
 
-class DBSnpSite: public SeqLib::GenomicRegion {
+// an indel site. maxend is the running max of pos2 along the chr, so
+// overlaps can be found with a binary search like IntervalView
+struct DBSnpSite {
+  int32_t pos1, pos2, maxend;
+};
+
+  /** Indel sites from a DBSnp VCF, or from a pre-built index of one.
+   *
+   * The index (svaba dbsnp-index) holds the sorted sites of each chromosome
+   * and is mmapped read-only, so loading is immediate and the pages are shared
+   * by every svaba process on the node. A VCF is parsed into the same layout.
+   */
+  class DBSnpFilter {
 
   public:
 
-  DBSnpSite(const std::string& tchr, const std::string& pos, const std::string& rs, const std::string& ref, const std::string& alt, const SeqLib::BamHeader& h);
-
-    //std::string m_rs;
-    //std::string m_ref;
-    //std::string m_alt;
-
-    friend std::ostream& operator<<(std::ostream& out, const DBSnpSite& d);
-    
-  };
-
-typedef SeqLib::GenomicRegionCollection<DBSnpSite> DBC;
+    DBSnpFilter() {}
 
-  class DBSnpFilter {
-    
-  public:
+    /** Load from an index, or from a VCF. If the VCF has an index next
+     * to it (<db>.svdb) with the VCF's size and mtime, that is used instead */
+    DBSnpFilter(const std::string& db, const SeqLib::BamHeader& h);
 
-    DBSnpFilter() {}
+    ~DBSnpFilter();
 
-    DBSnpFilter(const std::string& db, const SeqLib::BamHeader& h); 
+    DBSnpFilter(const DBSnpFilter&) = delete;
+    DBSnpFilter& operator=(const DBSnpFilter&) = delete;
 
-    /** Test whether the variant overlaps a DBSnp site 
+    /** Test whether the variant overlaps a DBSnp site
      * If it does, fill the BreakPoint rs field
      */
     bool queryBreakpoint(BreakPoint& bp);
 
-    bool queryRead(const SeqLib::BamRecord& r) const;
-
+    /** Is there a site starting at chr_pos (chr is the header id) */
     bool queryHash(const std::string& r) const;
-    
+
+    /** Number of sites loaded */
+    size_t size() const;
+
+    /** Compile a DBSnp VCF to an index that can be mmapped */
+    static bool BuildIndex(const std::string& vcf, const std::string& out);
+
+    /** Does this file start with the index magic */
+    static bool IsIndex(const std::string& file);
+
     friend std::ostream& operator<<(std::ostream& out, const DBSnpFilter& d);
 
   private:
 
-    std::hash<std::string> hasher;
-    
-    // initialize here once
-    std::stringstream cig;
+    // sites by header chr id. Points into the mmap, or into m_own
+    std::vector<const DBSnpSite*> m_chr;
+    std::vector<size_t> m_n;
+
+    std::vector<std::vector<DBSnpSite>> m_own;
 
-    DBC m_sites;
-    std::unordered_set<std::string> m_hash;
+    void * m_map = nullptr;
+    size_t m_map_len = 0;
+
+    // source: if given, the VCF the index must have been made from
+    bool __open_index(const std::string& file, const SeqLib::BamHeader& h, const std::string& source = std::string());
+
+    void __read_vcf(const std::string& file, const SeqLib::BamHeader& h);
+
+    bool __overlaps(int32_t chr, int32_t pos1, int32_t pos2) const;
 
-    std::unordered_set<size_t> m_int_hash;
-    
   };
 
+/** svaba dbsnp-index: compile a DBSnp VCF for fast loading */
+void runDBSnpIndex(int argc, char** argv);
+
 #endif
@@ -18,6 +18,15 @@
 
 using namespace SeqLib;
 
+  static void __remove_singletons(DiscIdxClusterVector& b);
+
+  static bool __add_read_to_cluster(DiscIdxClusterVector &cvec, DiscIdxVector &clust, const std::vector<DiscRead>& dr, uint32_t k, bool mate);
+
+  static void __cluster_reads(const std::vector<DiscRead>& dr, size_t num_pairs, DiscIdxClusterVector& fwd, DiscIdxClusterVector& rev, int orientation);
+
+  static void __cluster_mate_reads(const std::vector<DiscRead>& dr, DiscIdxClusterVector& brcv, DiscIdxClusterVector& fwd, DiscIdxClusterVector& rev);
+
+
   DiscordantClusterMap DiscordantCluster::clusterReads(const BamRecordVector& bav, const GenomicRegion& interval, int max_mapq_possible, const std::unordered_map<std::string, int> * min_isize_for_disc) {
 
 #ifdef DEBUG_CLUSTER
@@ -42,120 +51,66 @@ using namespace SeqLib;
 
     // only add the discordant reads, respecting diff size cutoffs for diff RG
     BamRecordVector bav_dd;
-    for (auto& r : bav) {
-     
-      // if suspicious as disccordant, chuck it
-      if (r.GetIntTag("DD") < 0)
-	continue;
-
-      int cutoff = 800;
-      if (min_isize_for_disc) {
-
-	std::string RG = r.GetZTag("RG");
-	// hack for simulated data
-	if (RG.find("tumor") != std::string::npos) {
-	  std::string qn = r.Qname();
-	  size_t posr = qn.find(":", 0);
-	  RG = (posr != std::string::npos) ? qn.substr(0, posr) : RG;
-	} else {
-	  // best practice without "tumor" hack
-	  RG = r.ParseReadGroup();
-	}
-
-	std::unordered_map<std::string, int>::const_iterator ff = min_isize_for_disc->find(RG);
-	if (ff != min_isize_for_disc->end())
-	  cutoff = ff->second;
-
-      }
-
-      // accept as discordant if not FR, has large enough isize, is inter-chromosomal, and has both mates mapping
-      // also dont cluster on weird chr
-      if ( ( r.PairOrientation() != FRORIENTATION || r.FullInsertSize() >= cutoff || r.Interchromosomal()) && r.PairMappedFlag() && r.ChrID() < 24 && r.MateChrID() < 24)
+    for (auto& r : bav)
+      if (isDiscordant(r, min_isize_for_disc))
 	bav_dd.push_back(r);
-    }
 
     
     if (!bav_dd.size())
       return DiscordantClusterMap();
 
-    // sort by position
-    std::sort(bav_dd.begin(), bav_dd.end(), BamRecordSort::ByReadPosition());
+    // pull out what clustering needs into a compact array, with the qname
+    // hashed once to an integer pair id
+    std::vector<DiscRead> dr(bav_dd.size());
+    std::unordered_map<std::string, uint32_t> pids;
+    pids.reserve(bav_dd.size());
+    for (size_t i = 0; i < bav_dd.size(); ++i) {
+      const BamRecord& r = bav_dd[i];
+      DiscRead& d = dr[i];
+      d.chr = r.ChrID();
+      d.pos = r.Position();
+      d.mchr = r.MateChrID();
+      d.mpos = r.MatePosition();
+      d.pid = pids.emplace(r.Qname(), (uint32_t)pids.size()).first->second;
+      d.idx = i;
+      d.orientation = r.PairOrientation();
+      d.rev = r.ReverseFlag();
+      d.mrev = r.MateReverseFlag();
+    }
 
-#ifdef DEBUG_CLUSTER    
-    for (auto& i : bav_dd)
-      std::cerr << " DEDUPED CLUSTER " << i << std::endl;
-#endif
-
-    // clear the tmp map. Now we want to use it to store if we already clustered read
-    //tmp_map.clear();
-    
-    BamRecordClusterVector fwd, rev, fwdfwd, revrev, fwdrev, revfwd;
-    std::pair<int, int> fwd_info, rev_info; // refid, pos
-    fwd_info = {-1,-1};
-    rev_info = {-1,-1};
-    
-    // make the fwd and reverse READ clusters. dont consider mate yet
-    __cluster_reads(bav_dd, fwd, rev, FRORIENTATION);
-    __cluster_reads(bav_dd, fwd, rev, FFORIENTATION);
-    __cluster_reads(bav_dd, fwd, rev, RFORIENTATION);
-    __cluster_reads(bav_dd, fwd, rev, RRORIENTATION);
-
-    // remove singletons
-    __remove_singletons(fwd);
-    __remove_singletons(rev);
+    // cluster on the compact array
+    DiscIdxClusterVector clusters = clusterCompact(dr, pids.size());
 
 #ifdef DEBUG_CLUSTER
-    for (auto& i : fwd) {
-      std::cerr << "fwd cluster " << std::endl;
-      for (auto& j : i)
-	std::cerr << "fwd " << j << std::endl;
-    }
-    for (auto& i : rev) {
-      std::cerr << "rev cluster " << std::endl;
-      for (auto& j : i)
-	std::cerr << "rev " << j << std::endl;
+    for (auto& ii : clusters) {
+      std::cerr << " ____________ CLUSTER ______________" << std::endl;
+      for (auto& jj : ii)
+	std::cerr << "CLUSTER _____ " << bav_dd[dr[jj].idx] << std::endl;
     }
 #endif
 
-    // within the forward read clusters, cluster mates on fwd and rev
-    __cluster_mate_reads(fwd, fwdfwd, fwdrev);
-    
-    // within the reverse read clusters, cluster mates on fwd and rev
-    __cluster_mate_reads(rev, revfwd, revrev); 
+    // pair id -> positions in dr of its reads, for the mate lookup
+    std::vector<uint32_t> pid_start, pid_reads;
+    pairIndex(dr, pids.size(), pid_start, pid_reads);
 
-    // remove singletons
-    __remove_singletons(fwdfwd);
-    __remove_singletons(revfwd);
-    __remove_singletons(fwdrev);
-    __remove_singletons(revrev);
-    
-    // we have the reads in their clusters. Just convert to discordant reads clusters
+    // we have the reads in their clusters. Just convert to discordant reads clusters.
+    // Only now go back to the BamRecords, and give each cluster just the reads
+    // that share its pairs to look for mates in
     DiscordantClusterMap dd;
-    __convertToDiscordantCluster(dd, fwdfwd, bav_dd, max_mapq_possible);
-    __convertToDiscordantCluster(dd, fwdrev, bav_dd, max_mapq_possible);
-    __convertToDiscordantCluster(dd, revfwd, bav_dd, max_mapq_possible);
-    __convertToDiscordantCluster(dd, revrev, bav_dd, max_mapq_possible);
-
-#ifdef DEBUG_CLUSTER
-    std::cerr << "----fwd cluster count: " << fwd.size() << std::endl;
-    std::cerr << "----rev cluster count: " << rev.size() << std::endl;
-    std::cerr << "----fwdfwd cluster count: " << fwdfwd.size() << std::endl;
-    std::cerr << "----fwdrev cluster count: " << fwdrev.size() << std::endl;
-    std::cerr << "----revfwd cluster count: " << revfwd.size() << std::endl;
-    std::cerr << "----revrev cluster count: " << revrev.size() << std::endl;
-
-    for (auto& ii : fwdrev) {
-      std::cerr << " ____________ CLUSTER ______________" << std::endl;
-      for (auto& jj : ii)
-	std::cerr << "FWDREV _____ " << jj << std::endl;
-    }
-    for (auto& ii : revfwd) {
-      std::cerr << " ____________ CLUSTER ______________" << std::endl;
-      for (auto& jj : ii)
-	std::cerr << "FWDREV _____ " << jj << std::endl;
+    for (auto& v : clusters) {
+      BamRecordVector this_reads, cand;
+      DiscIdxVector ci;
+      for (auto& k : v) {
+	this_reads.push_back(bav_dd[dr[k].idx]);
+	ci.insert(ci.end(), pid_reads.begin() + pid_start[dr[k].pid], pid_reads.begin() + pid_start[dr[k].pid + 1]);
+      }
+      std::sort(ci.begin(), ci.end());
+      ci.erase(std::unique(ci.begin(), ci.end()), ci.end());
+      for (auto& k : ci)
+	cand.push_back(bav_dd[dr[k].idx]);
+      DiscordantCluster d(this_reads, cand, max_mapq_possible);
+      dd[d.m_id] = d;
     }
-      
-#endif    
 
     // remove clusters that dont overlap with the window
     DiscordantClusterMap dd_clean;
@@ -189,6 +144,89 @@ using namespace SeqLib;
     
   }
   
+  bool DiscordantCluster::isDiscordant(const BamRecord& r, const std::unordered_map<std::string, int> * min_isize_for_disc) {
+
+    // if suspicious as disccordant, chuck it
+    if (r.GetIntTag("DD") < 0)
+      return false;
+
+    int cutoff = 800;
+    if (min_isize_for_disc) {
+
+      std::string RG = r.GetZTag("RG");
+      // hack for simulated data
+      if (RG.find("tumor") != std::string::npos) {
+	std::string qn = r.Qname();
+	size_t posr = qn.find(":", 0);
+	RG = (posr != std::string::npos) ? qn.substr(0, posr) : RG;
+      } else {
+	// best practice without "tumor" hack
+	RG = r.ParseReadGroup();
+      }
+
+      std::unordered_map<std::string, int>::const_iterator ff = min_isize_for_disc->find(RG);
+      if (ff != min_isize_for_disc->end())
+	cutoff = ff->second;
+
+    }
+
+    // accept as discordant if not FR, has large enough isize, is inter-chromosomal, and has both mates mapping
+    // also dont cluster on weird chr
+    return ( r.PairOrientation() != FRORIENTATION || r.FullInsertSize() >= cutoff || r.Interchromosomal()) && r.PairMappedFlag() && r.ChrID() < 24 && r.MateChrID() < 24;
+  }
+
+  DiscIdxClusterVector DiscordantCluster::clusterCompact(std::vector<DiscRead>& dr, size_t num_pairs) {
+
+    // sort by position
+    std::sort(dr.begin(), dr.end(), [](const DiscRead& a, const DiscRead& b) {
+	return a.chr < b.chr || (a.chr == b.chr && (a.pos < b.pos || (a.pos == b.pos && a.idx < b.idx)));
+      });
+
+    DiscIdxClusterVector fwd, rev, fwdfwd, revrev, fwdrev, revfwd;
+    
+    // make the fwd and reverse READ clusters. dont consider mate yet
+    __cluster_reads(dr, num_pairs, fwd, rev, FRORIENTATION);
+    __cluster_reads(dr, num_pairs, fwd, rev, FFORIENTATION);
+    __cluster_reads(dr, num_pairs, fwd, rev, RFORIENTATION);
+    __cluster_reads(dr, num_pairs, fwd, rev, RRORIENTATION);
+
+    // remove singletons
+    __remove_singletons(fwd);
+    __remove_singletons(rev);
+
+    // within the forward read clusters, cluster mates on fwd and rev
+    __cluster_mate_reads(dr, fwd, fwdfwd, fwdrev);
+    
+    // within the reverse read clusters, cluster mates on fwd and rev
+    __cluster_mate_reads(dr, rev, revfwd, revrev); 
+
+    // remove singletons
+    __remove_singletons(fwdfwd);
+    __remove_singletons(revfwd);
+    __remove_singletons(fwdrev);
+    __remove_singletons(revrev);
+
+    DiscIdxClusterVector out;
+    out.reserve(fwdfwd.size() + fwdrev.size() + revfwd.size() + revrev.size());
+    for (auto cvec : { &fwdfwd, &fwdrev, &revfwd, &revrev })
+      for (auto& v : *cvec)
+	out.push_back(std::move(v));
+    return out;
+  }
+
+  void DiscordantCluster::pairIndex(const std::vector<DiscRead>& dr, size_t num_pairs, std::vector<uint32_t>& pid_start, std::vector<uint32_t>& pid_reads) {
+
+    pid_start.assign(num_pairs + 1, 0);
+    pid_reads.resize(dr.size());
+    for (auto& d : dr)
+      ++pid_start[d.pid + 1];
+    for (size_t i = 1; i < pid_start.size(); ++i)
+      pid_start[i] += pid_start[i-1];
+    std::vector<uint32_t> pid_fill(pid_start.begin(), pid_start.end() - 1);
+    for (size_t k = 0; k < dr.size(); ++k)
+      pid_reads[pid_fill[dr[k].pid]++] = k;
+  }
+  
   // this reads is reads in the cluster. all_reads is big pile where all the clusters came from
   DiscordantCluster::DiscordantCluster(const BamRecordVector& this_reads, const BamRecordVector& all_reads, int max_mapq_possible) {
     
@@ -513,47 +551,39 @@ using namespace SeqLib;
    * Checks whether a read belongs to a cluster. If so, adds it. If not, ends
    * and stores cluster, adds a new one.
    *
-   * @param cvec Stores the vector of clusters, which themselves are vectors of read pointers
+   * @param cvec Stores the vector of clusters, which themselves are vectors of positions in dr
    * @param clust The current cluster that is being added to
-   * @param a Read to add to cluster
+   * @param dr Sorted compact reads
+   * @param k Position in dr of the read to add to cluster
    * @param mate Flag to specify if we should cluster on mate position instead of read position
-   * @return Description of the return value
+   * @return true if the read was added to the current cluster
    */
-  bool DiscordantCluster::__add_read_to_cluster(BamRecordClusterVector &cvec, BamRecordVector &clust, const BamRecord &a, bool mate) {
+  static bool __add_read_to_cluster(DiscIdxClusterVector &cvec, DiscIdxVector &clust, const std::vector<DiscRead>& dr, uint32_t k, bool mate) {
+
+    const DiscRead& a = dr[k];
 
     // get the position of the previous read. If none, we're starting a new one so make a dummy
-    std::pair<int,int> last_info;
-    if (clust.size() == 0)
-      last_info = {-1, -1};
-    else if (mate)
-      last_info = {clust.back().MateChrID(), clust.back().MatePosition()};
-    else
-      last_info = {clust.back().ChrID(), clust.back().Position()};
+    std::pair<int,int> last_info = {-1, -1};
+    if (clust.size() && mate)
+      last_info = {dr[clust.back()].mchr, dr[clust.back()].mpos};
+    else if (clust.size())
+      last_info = {dr[clust.back()].chr, dr[clust.back()].pos};
     
     // get the position of the current read
-    std::pair<int,int> this_info;
-    if (mate)
-      this_info = {a.MateChrID(), a.MatePosition()};
-    else 
-      this_info = {a.ChrID(), a.Position()};
+    std::pair<int,int> this_info = mate ? std::pair<int,int>(a.mchr, a.mpos) : std::pair<int,int>(a.chr, a.pos);
 
     // is this cluster too big? happens if too many discordant reads. Enforce a hard cutoff
     bool too_big;
     if (mate)
-      too_big = (clust.size() > 1 && (clust.back().MatePosition() - clust[0].MatePosition()) > 3000);
+      too_big = (clust.size() > 1 && (dr[clust.back()].mpos - dr[clust[0]].mpos) > 3000);
     else
-      too_big = (clust.size() > 1 && (clust.back().Position() - clust[0].Position()) > 3000);      
-    
-    // note to self. this rarely gets hit?
-    //if (too_big) 
-    //  std::cerr << "Cluster too big at " << clust[0].Brief() << " to " << clust.back().Brief() << ". Breaking off after 3000bp" << std::endl;
+      too_big = (clust.size() > 1 && (dr[clust.back()].pos - dr[clust[0]].pos) > 3000);
 
     // check if this read is close enough to the last
     if (!too_big &&  (this_info.first == last_info.first) && (this_info.second - last_info.second) <= DISC_PAD) {
 
       // read belongs in current cluster, so add
-      clust.push_back(a);
-      last_info = this_info;
+      clust.push_back(k);
       return true;
       
     // read does not belong to cluster. close this cluster and add to cvec
@@ -566,29 +596,32 @@ using namespace SeqLib;
       
       // clear this cluster and start a new one
       clust.clear();
-      clust.push_back(a);
+      clust.push_back(k);
       
       return false;
     }
   }
 
-  void DiscordantCluster::__cluster_mate_reads(BamRecordClusterVector& brcv, BamRecordClusterVector& fwd, BamRecordClusterVector& rev)
+  static void __cluster_mate_reads(const std::vector<DiscRead>& dr, DiscIdxClusterVector& brcv, DiscIdxClusterVector& fwd, DiscIdxClusterVector& rev)
   {
     // loop through the clusters, and cluster within clusters based on mate read
     for (auto& v : brcv) 
       {
-	BamRecordVector this_fwd, this_rev;
-	std::sort(v.begin(), v.end(), BamRecordSort::ByMatePosition());
-
-	for (auto& r : v) 
+	DiscIdxVector this_fwd, this_rev;
+	std::sort(v.begin(), v.end(), [&dr](uint32_t x, uint32_t y) {
+	    const DiscRead& a = dr[x];
+	    const DiscRead& b = dr[y];
+	    return a.mchr < b.mchr || (a.mchr == b.mchr && (a.mpos < b.mpos || (a.mpos == b.mpos && x < y)));
+	  });
+
+	for (auto& k : v) 
 	  {
 	    // forward clustering
-	    if (!r.MateReverseFlag())
-	      __add_read_to_cluster(fwd, this_fwd, r, true);
+	    if (!dr[k].mrev)
+	      __add_read_to_cluster(fwd, this_fwd, dr, k, true);
 	    // reverse clustering 
-	    else if (r.MateReverseFlag()) 
-	      __add_read_to_cluster(rev, this_rev, r, true);
-	    
+	    else
+	      __add_read_to_cluster(rev, this_rev, dr, k, true);
 	  }
 	// finish the last clusters
 	if (this_fwd.size() > 0)
@@ -598,36 +631,35 @@ using namespace SeqLib;
       } // finish main cluster loop
   }
   
-  void DiscordantCluster::__cluster_reads(const BamRecordVector& brv, BamRecordClusterVector& fwd, BamRecordClusterVector& rev, int orientation) 
+  // one linear sweep over the position-sorted reads for a single pair orientation
+  static void __cluster_reads(const std::vector<DiscRead>& dr, size_t num_pairs, DiscIdxClusterVector& fwd, DiscIdxClusterVector& rev, int orientation) 
   {
 
     // hold the current cluster
-    BamRecordVector this_fwd, this_rev;
+    DiscIdxVector this_fwd, this_rev;
 
-    std::unordered_set<std::string> tmp_set;
+    std::vector<bool> seen(num_pairs, false);
 
     // cluster in the READ direction, separately for fwd and rev
-    for (auto& i : brv) {
+    for (uint32_t k = 0; k < dr.size(); ++k) {
+
+      const DiscRead& d = dr[k];
 
       // only cluster FR reads together, RF reads together, FF together and RR together
-      if (i.PairOrientation() != orientation) {
+      if (d.orientation != orientation)
 	continue;
-      }
-
-      std::string qq = i.Qname();
 
       // only cluster if not seen before (e.g. left-most is READ, right most is MATE)
-      if (i.PairMappedFlag() && tmp_set.count(qq) == 0) {
-
-	tmp_set.insert(qq);
-
-	// forward clustering
-	if (!i.ReverseFlag()) 
-	  __add_read_to_cluster(fwd, this_fwd, i, false);
-	// reverse clustering 
-	else 
-	  __add_read_to_cluster(rev, this_rev, i, false);
-      }
+      if (seen[d.pid])
+	continue;
+      seen[d.pid] = true;
+
+      // forward clustering
+      if (!d.rev) 
+	__add_read_to_cluster(fwd, this_fwd, dr, k, false);
+      // reverse clustering 
+      else 
+	__add_read_to_cluster(rev, this_rev, dr, k, false);
     }
 
     // finish the last clusters
@@ -638,16 +670,6 @@ using namespace SeqLib;
 
   }
 
-  void DiscordantCluster::__convertToDiscordantCluster(DiscordantClusterMap &dd, const BamRecordClusterVector& cvec, const BamRecordVector& bav, int max_mapq_possible) {
-    
-    for (auto& v : cvec) {
-      if (v.size() > 1) {
-	DiscordantCluster d(v, bav, max_mapq_possible); /// slow but works (erm, not really slow)
-	dd[d.m_id] = d;
-      }
-    }
-  }
-  
   GenomicRegion DiscordantCluster::GetMateRegionOfOverlap(const GenomicRegion& gr) const {
     
     if (gr.GetOverlap(m_reg1))
@@ -662,13 +684,12 @@ using namespace SeqLib;
     return m_reg1.IsEmpty() || m_reg2.IsEmpty() || m_reg1.chr == -1 || m_reg2.chr == -1;
   }
 
-  void DiscordantCluster::__remove_singletons(BamRecordClusterVector& b)  {
+  static void __remove_singletons(DiscIdxClusterVector& b)  {
 
-    BamRecordClusterVector tmp;
+    DiscIdxClusterVector tmp;
     for (auto& f : b)
       if (f.size() > 1)
-	tmp.push_back(f);
+	tmp.push_back(std::move(f));
     
-    b = tmp;
+    b.swap(tmp);
   }
-
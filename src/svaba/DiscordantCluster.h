@@ -9,7 +9,18 @@
 
 #include "SeqLib/BamRecord.h"
 
-typedef std::vector<SeqLib::BamRecordVector> BamRecordClusterVector;
+/** Compact record of one discordant read, for clustering. idx points back to the full read */
+struct DiscRead {
+  int32_t chr, pos, mchr, mpos;
+  uint32_t pid; // integer id of the read pair (qname)
+  uint32_t idx;
+  int8_t orientation;
+  bool rev, mrev;
+};
+
+// a cluster is a list of positions into the sorted DiscRead array
+typedef std::vector<uint32_t> DiscIdxVector;
+typedef std::vector<DiscIdxVector> DiscIdxClusterVector;
 
   /** Class to hold clusters of discordant reads */
   class DiscordantCluster 
@@ -65,17 +76,18 @@ typedef std::vector<SeqLib::BamRecordVector> BamRecordClusterVector;
     /** Is this a valid cluster? */
     bool valid() const;
 
-    static void __remove_singletons(BamRecordClusterVector& b);
+    /** Should this read be clustered as discordant. The insert size cutoff is per read group */
+    static bool isDiscordant(const SeqLib::BamRecord& r, const std::unordered_map<std::string, int> * min_isize_for_disc);
 
-    static std::unordered_map<std::string, DiscordantCluster> clusterReads(const SeqLib::BamRecordVector& bav, const SeqLib::GenomicRegion& interval, int max_mapq_possible, const std::unordered_map<std::string, int> * min_isize_for_disc);
-
-    static bool __add_read_to_cluster(BamRecordClusterVector &cvec, SeqLib::BamRecordVector &clust, const SeqLib::BamRecord &a, bool mate);
-
-    static void __cluster_reads(const SeqLib::BamRecordVector& brv, BamRecordClusterVector& fwd, BamRecordClusterVector& rev, int orientation);
+    /** Sort the reads by position and cluster them on read, then mate, position.
+     * @return Clusters of 2+ reads, as positions in the sorted dr
+     */
+    static DiscIdxClusterVector clusterCompact(std::vector<DiscRead>& dr, size_t num_pairs);
 
-    static void __cluster_mate_reads(BamRecordClusterVector& brcv, BamRecordClusterVector& fwd, BamRecordClusterVector& rev);
+    /** Index the sorted reads by pair id. The reads of pair p are pid_reads[pid_start[p] .. pid_start[p+1]) */
+    static void pairIndex(const std::vector<DiscRead>& dr, size_t num_pairs, std::vector<uint32_t>& pid_start, std::vector<uint32_t>& pid_reads);
 
-    static void __convertToDiscordantCluster(std::unordered_map<std::string, DiscordantCluster> &dd, const BamRecordClusterVector& cvec, const SeqLib::BamRecordVector& bav, int max_mapq_possible);
+    static std::unordered_map<std::string, DiscordantCluster> clusterReads(const SeqLib::BamRecordVector& bav, const SeqLib::GenomicRegion& interval, int max_mapq_possible, const std::unordered_map<std::string, int> * min_isize_for_disc);
 
     /** Query an interval against the two regions of the cluster. If the region overlaps
      * with one region, return the other region. This is useful for finding the partner 
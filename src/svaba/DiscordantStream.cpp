@@ -0,0 +1,264 @@
+#include "DiscordantStream.h"
+
+#include <pthread.h>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+#include "SeqLib/BamReader.h"
+#include "SeqLib/BamWriter.h"
+#include "svabaUtils.h"
+
+using namespace SeqLib;
+
+DiscordantStream::~DiscordantStream() {
+  for (auto& s : m_samples)
+    if (!s.tmp.empty())
+      std::remove(s.tmp.c_str());
+}
+
+void* DiscordantStream::__read_sample(void * arg) {
+  Sample * s = static_cast<Sample*>(arg);
+  s->ok = s->ds->__read_bam(*s);
+  return NULL;
+}
+
+bool DiscordantStream::Read(const std::map<std::string, std::string>& bams, const std::string& tmp_prefix, int threads, ThreadPool * pool) {
+
+  m_samples.clear();
+  m_samples.resize(bams.size());
+  size_t i = 0;
+  for (auto& b : bams) {
+    Sample& s = m_samples[i++];
+    s.id = b.first;
+    s.bam = b.second;
+    s.tmp = tmp_prefix + "." + b.first + ".disc.tmp.bam";
+    s.ds = this;
+    s.pool = pool;
+  }
+
+  // one thread per BAM
+  threads = std::max(1, threads);
+  for (size_t k = 0; k < m_samples.size(); k += threads) {
+    std::vector<pthread_t> tt;
+    for (size_t j = k; j < m_samples.size() && j < k + threads; ++j) {
+      pthread_t t;
+      pthread_create(&t, NULL, __read_sample, &m_samples[j]);
+      tt.push_back(t);
+    }
+    for (auto& t : tt)
+      pthread_join(t, NULL);
+  }
+
+  for (auto& s : m_samples)
+    if (!s.ok)
+      return false;
+  return true;
+}
+
+bool DiscordantStream::__read_bam(Sample& s) {
+
+  BamReader reader;
+  if (!reader.Open(s.bam)) {
+    std::cerr << "ERROR: Cannot open BAM for discordant read streaming: " << s.bam << std::endl;
+    return false;
+  }
+  if (s.pool)
+    reader.SetThreadPool(*s.pool);
+
+  BamWriter writer;
+  if (!svabaUtils::__openWriterBam(m_hdr, s.tmp, writer)) {
+    std::cerr << "ERROR: Cannot open temporary BAM: " << s.tmp << std::endl;
+    return false;
+  }
+
+  // only the chromosomes that are clustered on
+  s.starts.resize(std::min(m_hdr.NumSequences(), 24));
+  for (size_t c = 0; c < s.starts.size(); ++c)
+    s.starts[c].resize(m_hdr.GetSequenceLength(c) / DSTREAM_COV_BIN + 1, 0);
+
+  std::hash<std::string> qhasher;
+  IntervalCursor blacklist(m_blacklist);
+
+  BamRecord r;
+  while (reader.GetNextRecord(r)) {
+
+    ++s.scanned;
+
+    // same global rules as the walker (no duplicates or qc fail), and
+    // primary alignments only, so each pair is counted once
+    if (r.DuplicateFlag() || r.QCFailFlag() || (r.AlignmentFlag() & 0x900) || !r.MappedFlag())
+      continue;
+
+    // reads come in coordinate order, so the cursor only moves forward
+    if (m_blacklist && blacklist.overlaps(r.ChrID(), r.Position(), r.PositionEnd()))
+      continue;
+
+    if (r.ChrID() >= 0 && r.ChrID() < (int)s.starts.size()) {
+      std::vector<uint16_t>& bins = s.starts[r.ChrID()];
+      size_t b = r.Position() / DSTREAM_COV_BIN;
+      if (b < bins.size() && bins[b] < UINT16_MAX)
+	++bins[b];
+    }
+
+    if (!r.PairedFlag() || !DiscordantCluster::isDiscordant(r, &m_min_isize))
+      continue;
+
+    // for memory conservation
+    r.RemoveTag("BQ");
+    r.RemoveTag("OQ");
+
+    // add the ID tag, as the walker does
+    r.AddZTag("SR", s.id + "_" + std::to_string(r.AlignmentFlag()) + "_" + r.Qname());
+
+    DiscRead d;
+    d.chr = r.ChrID();
+    d.pos = r.Position();
+    d.mchr = r.MateChrID();
+    d.mpos = r.MatePosition();
+    d.pid = 0; // set across samples in Cluster
+    d.idx = s.reads.size();
+    d.orientation = r.PairOrientation();
+    d.rev = r.ReverseFlag();
+    d.mrev = r.MateReverseFlag();
+    s.reads.push_back(d);
+    s.qhash.push_back(qhasher(r.Qname()));
+    s.qnames.push_back(r.Qname());
+
+    writer.WriteRecord(r);
+  }
+
+  writer.Close();
+  return true;
+}
+
+DiscordantClusterMap DiscordantStream::Cluster(int max_mapq_possible) {
+
+  DiscordantClusterMap dd;
+
+  // put the samples together. idx becomes offset[sample] + record number
+  std::vector<uint32_t> offset(m_samples.size() + 1, 0);
+  for (size_t i = 0; i < m_samples.size(); ++i)
+    offset[i+1] = offset[i] + m_samples[i].reads.size();
+  if (!offset.back())
+    return dd;
+
+  // pair ids by qname hash. A qname whose hash is already another pair's
+  // gets its own id from the (rarely used) collided map
+  std::vector<DiscRead> dr;
+  dr.reserve(offset.back());
+  std::unordered_map<uint64_t, uint32_t> pids;
+  pids.reserve(offset.back() / 2 + 1);
+  std::vector<const std::string*> pid_qname;
+  std::unordered_map<std::string, uint32_t> collided;
+  for (size_t i = 0; i < m_samples.size(); ++i) {
+    Sample& s = m_samples[i];
+    for (size_t k = 0; k < s.reads.size(); ++k) {
+      DiscRead d = s.reads[k];
+      d.idx += offset[i];
+      const std::string& q = s.qnames[k];
+      auto h = pids.emplace(s.qhash[k], (uint32_t)pid_qname.size());
+      if (h.second) {
+	pid_qname.push_back(&q);
+      } else if (*pid_qname[h.first->second] != q) {
+	auto c = collided.emplace(q, (uint32_t)pid_qname.size());
+	if (c.second)
+	  pid_qname.push_back(&q);
+	d.pid = c.first->second;
+	dr.push_back(d);
+	continue;
+      }
+      d.pid = h.first->second;
+      dr.push_back(d);
+    }
+    std::vector<DiscRead>().swap(s.reads);
+    std::vector<uint64_t>().swap(s.qhash);
+  }
+  const size_t num_pairs = pid_qname.size();
+
+  // done with the qnames
+  pid_qname.clear();
+  collided.clear();
+  for (auto& s : m_samples)
+    std::vector<std::string>().swap(s.qnames);
+
+  DiscIdxClusterVector clusters = DiscordantCluster::clusterCompact(dr, num_pairs);
+
+  std::vector<uint32_t> pid_start, pid_reads;
+  DiscordantCluster::pairIndex(dr, num_pairs, pid_start, pid_reads);
+
+  // which records to read back: the clustered reads and everything sharing their pairs
+  std::vector<bool> want(offset.back(), false);
+  for (auto& v : clusters)
+    for (auto& k : v)
+      for (uint32_t j = pid_start[dr[k].pid]; j < pid_start[dr[k].pid + 1]; ++j)
+	want[dr[pid_reads[j]].idx] = true;
+
+  std::unordered_map<uint32_t, BamRecord> recs;
+  for (size_t i = 0; i < m_samples.size(); ++i) {
+    BamReader reader;
+    if (!reader.Open(m_samples[i].tmp)) {
+      std::cerr << "ERROR: Cannot read back temporary BAM: " << m_samples[i].tmp << std::endl;
+      return dd;
+    }
+    BamRecord r;
+    for (uint32_t n = offset[i]; n < offset[i+1] && reader.GetNextRecord(r); ++n)
+      if (want[n])
+	recs[n] = r;
+  }
+
+  // same as the end of DiscordantCluster::clusterReads
+  for (auto& v : clusters) {
+    BamRecordVector this_reads, cand;
+    DiscIdxVector ci;
+    for (auto& k : v) {
+      this_reads.push_back(recs[dr[k].idx]);
+      ci.insert(ci.end(), pid_reads.begin() + pid_start[dr[k].pid], pid_reads.begin() + pid_start[dr[k].pid + 1]);
+    }
+    std::sort(ci.begin(), ci.end());
+    ci.erase(std::unique(ci.begin(), ci.end()), ci.end());
+    for (auto& k : ci)
+      cand.push_back(recs[dr[k].idx]);
+    DiscordantCluster d(this_reads, cand, max_mapq_possible);
+    if (!d.isEmpty())
+      dd[d.ID()] = d;
+  }
+
+  return dd;
+}
+
+int DiscordantStream::Coverage(const std::string& id, int chr, int pos, int readlen) const {
+
+  for (auto& s : m_samples) {
+    if (s.id != id)
+      continue;
+    if (chr < 0 || chr >= (int)s.starts.size() || pos < 0)
+      return 0;
+    const std::vector<uint16_t>& bins = s.starts[chr];
+    size_t b = pos / DSTREAM_COV_BIN;
+    if (b >= bins.size())
+      return 0;
+
+    // reads covering pos started within readlen before it. Take the
+    // density over this bin and the one before
+    double n = bins[b] + (b ? bins[b-1] : 0);
+    return (int)(n * readlen / (2 * DSTREAM_COV_BIN));
+  }
+  return 0;
+}
+
+size_t DiscordantStream::NumReads() const {
+  size_t n = 0;
+  for (auto& s : m_samples)
+    n += s.reads.size();
+  return n;
+}
+
+size_t DiscordantStream::NumScanned() const {
+  size_t n = 0;
+  for (auto& s : m_samples)
+    n += s.scanned;
+  return n;
+}
@@ -0,0 +1,85 @@
+#ifndef SVABA_DISCORDANT_STREAM_H__
+#define SVABA_DISCORDANT_STREAM_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "SeqLib/BamHeader.h"
+#include "SeqLib/ThreadPool.h"
+
+#include "DiscordantCluster.h"
+#include "IntervalView.h"
+
+// read starts are counted in bins of this many bp, for a coverage estimate
+#define DSTREAM_COV_BIN 100
+
+/** Genome-wide discordant read clustering from one sequential pass over each BAM.
+ *
+ * Read() streams each BAM once and keeps only the discordant reads: a DiscRead
+ * per read in memory, and the full record in a temporary BAM next to the output.
+ * Cluster() sorts and sweeps the compact reads for the whole genome at once, so
+ * clusters are not cut at window edges, then reads back only the clustered
+ * reads from the temporary BAMs to make the DiscordantClusters.
+ */
+class DiscordantStream {
+
+ public:
+
+  /**
+   * @param h Header of the main BAM. All BAMs are expected to share it
+   * @param min_isize_for_disc Insert size cutoff per read group, as for DiscordantCluster::clusterReads
+   * @param blacklist Reads overlapping these regions are skipped, as in the walker
+   */
+  DiscordantStream(const SeqLib::BamHeader& h, const std::unordered_map<std::string, int>& min_isize_for_disc,
+		   const IntervalView * blacklist = nullptr)
+    : m_hdr(h), m_min_isize(min_isize_for_disc), m_blacklist(blacklist) {}
+
+  /** Removes the temporary BAMs */
+  ~DiscordantStream();
+
+  /** Make one pass over each BAM (sample id -> path), up to threads at a time
+   * @param tmp_prefix Temporary BAMs are <tmp_prefix>.<sample id>.disc.tmp.bam
+   */
+  bool Read(const std::map<std::string, std::string>& bams, const std::string& tmp_prefix, int threads, SeqLib::ThreadPool * pool = nullptr);
+
+  /** Cluster all of the discordant reads. Keyed as for DiscordantCluster::clusterReads */
+  DiscordantClusterMap Cluster(int max_mapq_possible);
+
+  /** Coverage at chr:pos for a sample, estimated from the read starts seen by Read() */
+  int Coverage(const std::string& id, int chr, int pos, int readlen) const;
+
+  /** Number of discordant reads kept. Zero once Cluster() has run */
+  size_t NumReads() const;
+
+  /** Number of reads streamed */
+  size_t NumScanned() const;
+
+ private:
+
+  struct Sample {
+    std::string id, bam, tmp;
+    std::vector<DiscRead> reads; // idx is the record number in tmp
+    std::vector<uint64_t> qhash; // qname hash, by record number
+    std::vector<std::string> qnames; // to tell apart pairs whose qname hashes collide
+    std::vector<std::vector<uint16_t>> starts; // read starts per bin, by chr
+    size_t scanned = 0;
+    bool ok = false;
+    DiscordantStream * ds = nullptr;
+    SeqLib::ThreadPool * pool = nullptr;
+  };
+
+  SeqLib::BamHeader m_hdr;
+  std::unordered_map<std::string, int> m_min_isize;
+  const IntervalView * m_blacklist;
+
+  std::vector<Sample> m_samples;
+
+  static void* __read_sample(void * arg);
+
+  bool __read_bam(Sample& s);
+
+};
+
+#endif
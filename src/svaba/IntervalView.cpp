@@ -0,0 +1,94 @@
+#include "IntervalView.h"
+
+#include <algorithm>
+
+IntervalView::IntervalView(const SeqLib::GRC& track) {
+
+  for (auto& g : track) {
+    if (g.chr < 0)
+      continue;
+    if (g.chr >= (int)m_chr.size())
+      m_chr.resize(g.chr + 1);
+    m_chr[g.chr].push_back({g.pos1, g.pos2, g.pos2});
+    ++m_size;
+  }
+
+  for (auto& v : m_chr) {
+    std::sort(v.begin(), v.end(), [](const Ivl& a, const Ivl& b) {
+	return a.pos1 < b.pos1 || (a.pos1 == b.pos1 && a.pos2 < b.pos2);
+      });
+    for (size_t i = 1; i < v.size(); ++i)
+      v[i].maxend = std::max(v[i].pos2, v[i-1].maxend);
+  }
+}
+
+const std::vector<IntervalView::Ivl> * IntervalCursor::seek(int32_t chr, int32_t pos) {
+
+  if (!m_view || chr < 0 || chr >= (int)m_view->m_chr.size())
+    return nullptr;
+
+  const std::vector<IntervalView::Ivl>& v = m_view->m_chr[chr];
+  if (v.empty())
+    return nullptr;
+
+  if (chr != m_chr || pos < m_pos) {
+    // jumped, so binary search on the running max end
+    m_idx = std::lower_bound(v.begin(), v.end(), pos, [](const IntervalView::Ivl& a, int32_t p) {
+	return a.maxend < p;
+      }) - v.begin();
+  } else {
+    // sweep forward
+    while (m_idx < v.size() && v[m_idx].maxend < pos)
+      ++m_idx;
+  }
+
+  m_chr = chr;
+  m_pos = pos;
+
+  return &v;
+}
+
+bool IntervalCursor::overlaps(int32_t chr, int32_t pos1, int32_t pos2) {
+
+  const std::vector<IntervalView::Ivl> * v = seek(chr, pos1);
+  if (!v)
+    return false;
+
+  for (size_t i = m_idx; i < v->size() && (*v)[i].pos1 <= pos2; ++i)
+    if ((*v)[i].pos2 >= pos1)
+      return true;
+
+  return false;
+}
+
+int32_t IntervalCursor::maxOverlapWidth(int32_t chr, int32_t pos1, int32_t pos2) {
+
+  const std::vector<IntervalView::Ivl> * v = seek(chr, pos1);
+  if (!v)
+    return 0;
+
+  int32_t w = 0;
+  for (size_t i = m_idx; i < v->size() && (*v)[i].pos1 <= pos2; ++i)
+    if ((*v)[i].pos2 >= pos1)
+      w = std::max(w, (*v)[i].pos2 - (*v)[i].pos1 + 1);
+
+  return w;
+}
+
+bool IntervalCursor::overlapsSameInterval(const SeqLib::GenomicRegion& a, const SeqLib::GenomicRegion& b) {
+
+  if (a.chr != b.chr)
+    return false;
+
+  const std::vector<IntervalView::Ivl> * v = seek(a.chr, a.pos1);
+  if (!v)
+    return false;
+
+  for (size_t i = m_idx; i < v->size() && (*v)[i].pos1 <= a.pos2; ++i) {
+    const IntervalView::Ivl& k = (*v)[i];
+    if (k.pos2 >= a.pos1 && k.pos1 <= b.pos2 && k.pos2 >= b.pos1)
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,86 @@
+#ifndef SVABA_INTERVAL_VIEW_H__
+#define SVABA_INTERVAL_VIEW_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "SeqLib/GenomicRegion.h"
+#include "SeqLib/GenomicRegionCollection.h"
+
+class IntervalCursor;
+
+/** Read-only, sorted view of a BED track (eg blacklist, simple repeats).
+ *
+ * Built once from a GRC and shared across threads. Queries go through an
+ * IntervalCursor, which keeps the per-caller position.
+ */
+class IntervalView {
+
+  friend class IntervalCursor;
+
+ public:
+
+  IntervalView() {}
+
+  /** Make a view of the track. Strand is ignored */
+  IntervalView(const SeqLib::GRC& track);
+
+  size_t size() const { return m_size; }
+
+  bool empty() const { return !m_size; }
+
+ private:
+
+  // maxend is the running max of pos2 up to and including this interval,
+  // so it is non-decreasing and can be searched / swept like pos1
+  struct Ivl {
+    int32_t pos1, pos2, maxend;
+  };
+
+  std::vector<std::vector<Ivl>> m_chr;
+
+  size_t m_size = 0;
+
+};
+
+/** Overlap queries against an IntervalView, with a sweep-line cursor.
+ *
+ * For queries that arrive in coordinate order (eg reads from a region), the
+ * cursor only moves forward, so lookups are amortized O(1) and don't allocate.
+ * A query behind the cursor or on a new chromosome re-seeks with a binary search.
+ * Coordinates are inclusive, as in SeqLib::GenomicRegion.
+ */
+class IntervalCursor {
+
+ public:
+
+  IntervalCursor() {}
+
+  IntervalCursor(const IntervalView * v) : m_view(v) {}
+
+  /** Does [pos1, pos2] on chr overlap any interval */
+  bool overlaps(int32_t chr, int32_t pos1, int32_t pos2);
+
+  bool overlaps(const SeqLib::GenomicRegion& gr) { return overlaps(gr.chr, gr.pos1, gr.pos2); }
+
+  /** Width of the widest interval that overlaps [pos1, pos2]. 0 if none */
+  int32_t maxOverlapWidth(int32_t chr, int32_t pos1, int32_t pos2);
+
+  /** Is there a single interval that overlaps both regions */
+  bool overlapsSameInterval(const SeqLib::GenomicRegion& a, const SeqLib::GenomicRegion& b);
+
+ private:
+
+  const IntervalView * m_view = nullptr;
+
+  int32_t m_chr = -1;
+  int32_t m_pos = -1;
+  size_t m_idx = 0;
+
+  // move to the first interval on chr that could overlap pos. Returns
+  // nullptr if there are none on this chr
+  const std::vector<IntervalView::Ivl> * seek(int32_t chr, int32_t pos);
+
+};
+
+#endif
@@ -1,9 +1,38 @@
 #include "LearnBamParams.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <climits>
+#include <cstdlib>
+
 #include <numeric>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 #include "SeqLib/BamReader.h"
 #include "svabaUtils.h"
 
+#define PARAMS_CACHE_MAGIC "#svaba_params"
+
+// shared by the window threads
+struct LearnWindows {
+  const LearnBamParams * lb;
+  std::string bam;
+  std::vector<SeqLib::GenomicRegion> windows;
+  size_t per_window = 0;
+  size_t next = 0;
+  pthread_mutex_t lock;
+};
+
+struct LearnWorker {
+  LearnWindows * w;
+  BamParamsMap p;
+  int wid = 0;
+  bool ok = true;
+};
+
 std::ostream& operator<<(std::ostream& out, const BamParams& p) {
  
   out << "@@@ READ GROUP " << p.read_group << " Insert Size: " << p.mean_isize 
@@ -55,6 +84,220 @@ void LearnBamParams::learnParams(BamParamsMap& p, int max_count) {
   
 }
 
+void* LearnBamParams::learn_windows(void * arg) {
+
+  LearnWorker * k = static_cast<LearnWorker*>(arg);
+  LearnWindows * w = k->w;
+
+  SeqLib::BamReader reader;
+  if (!reader.Open(w->bam)) {
+    k->ok = false;
+    return NULL;
+  }
+
+  SeqLib::BamRecord r;
+  while (true) {
+    pthread_mutex_lock(&w->lock);
+    size_t i = w->next++;
+    pthread_mutex_unlock(&w->lock);
+    if (i >= w->windows.size())
+      break;
+
+    if (!reader.SetRegion(w->windows[i])) {
+      k->ok = false;
+      break;
+    }
+
+    size_t count = 0;
+    int wid = 0;
+    double pos1 = 0, pos2 = 0, chr = -1;
+    while (count < w->per_window && reader.GetNextRecord(r))
+      w->lb->process_read(r, ++count, k->p, pos1, pos2, chr, wid);
+    k->wid += wid + (int)(pos2 - pos1);
+  }
+
+  return NULL;
+}
+
+void LearnBamParams::learnParams(BamParamsMap& p, int max_count, int threads) {
+
+  SeqLib::BamReader reader;
+  if (!reader.Open(bam)) {
+    learnParams(p, max_count);
+    return;
+  }
+
+  // random windows on the main chromosomes, by length. Fixed seed so
+  // reruns learn the same thing
+  const SeqLib::BamHeader h = reader.Header();
+  const int nchr = std::min(h.NumSequences(), 24);
+  std::vector<int64_t> cum;
+  int64_t total = 0;
+  for (int c = 0; c < nchr; ++c) {
+    int64_t len = h.GetSequenceLength(c);
+    total += len > LEARN_WINDOW_WIDTH ? len - LEARN_WINDOW_WIDTH : 0;
+    cum.push_back(total);
+  }
+
+  LearnWindows w;
+  w.lb = this;
+  w.bam = bam;
+  if (total > 0) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int64_t> pos_d(0, total - 1);
+    for (int i = 0; i < LEARN_NUM_WINDOWS; ++i) {
+      int64_t x = pos_d(rng);
+      int c = std::upper_bound(cum.begin(), cum.end(), x) - cum.begin();
+      int64_t pos = x - (c ? cum[c-1] : 0) + 1;
+      w.windows.push_back(SeqLib::GenomicRegion(c, pos, pos + LEARN_WINDOW_WIDTH));
+    }
+    // in file order, so each thread seeks forward
+    std::sort(w.windows.begin(), w.windows.end());
+  }
+
+  // no index, or nothing to sample
+  if (w.windows.empty() || !reader.SetRegion(w.windows[0])) {
+    learnParams(p, max_count);
+    return;
+  }
+
+  w.per_window = std::max(1, max_count / LEARN_NUM_WINDOWS);
+  threads = std::max(1, std::min(threads, LEARN_NUM_WINDOWS));
+  pthread_mutex_init(&w.lock, NULL);
+
+  std::vector<LearnWorker> k(threads);
+  std::vector<pthread_t> tt(threads);
+  for (int i = 0; i < threads; ++i) {
+    k[i].w = &w;
+    pthread_create(&tt[i], NULL, learn_windows, &k[i]);
+  }
+  for (auto& t : tt)
+    pthread_join(t, NULL);
+  pthread_mutex_destroy(&w.lock);
+
+  // merge the read groups of each thread
+  BamParamsMap m;
+  int wid = 0;
+  int visited = 0;
+  bool ok = true;
+  for (auto& i : k) {
+    ok = ok && i.ok;
+    wid += i.wid;
+    for (auto& j : i.p) {
+      visited += j.second.visited;
+      BamParamsMap::iterator ff = m.find(j.first);
+      if (ff == m.end())
+	m[j.first] = j.second;
+      else
+	ff->second.merge(j.second);
+    }
+  }
+
+  // eg a targeted BAM, where most windows are empty
+  if (!ok || visited < max_count / 10) {
+    learnParams(p, max_count);
+    return;
+  }
+
+  for (auto& i : m) {
+    i.second.collectStats();
+    i.second.mean_cov = (wid > 0) ? i.second.visited * i.second.readlen / wid : 0;
+  }
+  p.swap(m);
+}
+
+bool LearnBamParams::cacheKey(std::string& key) const {
+
+  struct stat st;
+  if (bam == "-" || stat(bam.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+
+  char buf[PATH_MAX];
+  std::string path = realpath(bam.c_str(), buf) ? std::string(buf) : bam;
+
+  std::stringstream ss;
+  ss << path << "\t" << st.st_size << "\t" << st.st_mtime;
+  key = ss.str();
+  return true;
+}
+
+bool LearnBamParams::readCache(BamParamsMap& p, int max_count) const {
+
+  std::string key;
+  if (cache.empty() || !cacheKey(key))
+    return false;
+
+  std::ifstream in(cacheFile());
+  if (!in)
+    return false;
+
+  std::stringstream ss;
+  ss << PARAMS_CACHE_MAGIC << "\t" << key << "\t" << max_count;
+  std::string line;
+  if (!std::getline(in, line) || line != ss.str())
+    return false;
+
+  BamParamsMap m;
+  while (std::getline(in, line)) {
+    if (line.empty())
+      continue;
+    size_t t = line.find('\t');
+    if (t == std::string::npos)
+      return false;
+    BamParams b(line.substr(0, t));
+    std::istringstream is(line.substr(t + 1));
+    if (!(is >> b.visited >> b.num_clip >> b.num_disc >> b.num_bad >> b.lp >> b.hp
+	  >> b.readlen >> b.frac_clip >> b.frac_disc >> b.frac_bad >> b.max_mapq
+	  >> b.mean_cov >> b.mean_isize >> b.median_isize >> b.sd_isize))
+      return false;
+    m[b.read_group] = b;
+  }
+
+  if (m.empty())
+    return false;
+  p.swap(m);
+  return true;
+}
+
+bool LearnBamParams::writeCache(const BamParamsMap& p, int max_count) const {
+
+  std::string key;
+  if (cache.empty() || !cacheKey(key))
+    return false;
+
+  // write then rename, so a concurrent run never reads half a file
+  std::string tmp = cacheFile() + ".tmp." + std::to_string(getpid());
+  std::ofstream os(tmp);
+  if (!os)
+    return false;
+
+  os << PARAMS_CACHE_MAGIC << "\t" << key << "\t" << max_count << "\n" << std::setprecision(17);
+  for (auto& i : p) {
+    const BamParams& b = i.second;
+    os << b.read_group << "\t" << b.visited << "\t" << b.num_clip << "\t" << b.num_disc << "\t" << b.num_bad << "\t"
+       << b.lp << "\t" << b.hp << "\t" << b.readlen << "\t" << b.frac_clip << "\t" << b.frac_disc << "\t"
+       << b.frac_bad << "\t" << b.max_mapq << "\t" << b.mean_cov << "\t" << b.mean_isize << "\t"
+       << b.median_isize << "\t" << b.sd_isize << "\n";
+  }
+  os.close();
+
+  if (os.fail() || rename(tmp.c_str(), cacheFile().c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+void BamParams::merge(const BamParams& o) {
+  visited += o.visited;
+  num_clip += o.num_clip;
+  num_disc += o.num_disc;
+  num_bad += o.num_bad;
+  readlen = std::max(readlen, o.readlen);
+  max_mapq = std::max(max_mapq, o.max_mapq);
+  isize_vec.insert(isize_vec.end(), o.isize_vec.begin(), o.isize_vec.end());
+}
+
 void BamParams::collectStats() {
 
   if (isize_vec.size() < 100) {
@@ -18,6 +18,9 @@ struct BamParams {
 
   void collectStats();
 
+  /** Add the raw counts of another sample of the same read group */
+  void merge(const BamParams& o);
+
   friend std::ostream& operator<<(std::ostream& out, const BamParams& p);
   
   int visited = 0;
@@ -47,17 +50,43 @@ struct BamParams {
 
 typedef std::unordered_map<std::string, BamParams> BamParamsMap;
 
+// windows sampled across the genome by the parallel learner
+#define LEARN_NUM_WINDOWS 200
+#define LEARN_WINDOW_WIDTH 1000000
+
 class LearnBamParams {
 
  public:
- LearnBamParams(const std::string& b) : bam(b) { };
+ /** @param cache File to store the learned params in (see writeCache). None if empty */
+ LearnBamParams(const std::string& b, const std::string& c = std::string()) : bam(b), cache(c) { };
   
   void learnParams(BamParams& p, int max_count);
 
+  /** Learn from the first max_count reads of the BAM */
   void learnParams(BamParamsMap& p, int max_count);
 
+  /** Learn from max_count reads spread over random windows of the genome,
+   * read with index seeks on up to threads threads. Falls back to reading
+   * from the start if the BAM has no index or the windows come back empty */
+  void learnParams(BamParamsMap& p, int max_count, int threads);
+
+  /** Load params stored by writeCache. False if there is no cache, or if the
+   * BAM size / mtime or max_count differ from when it was written */
+  bool readCache(BamParamsMap& p, int max_count) const;
+
+  /** Store the params in the cache file, keyed by the BAM's path, size and mtime */
+  bool writeCache(const BamParamsMap& p, int max_count) const;
+
+  const std::string& cacheFile() const { return cache; }
+
  private:
   std::string bam;
+  std::string cache;
+
+  // path, size and mtime that identify the BAM in the cache. False for stdin / non-files
+  bool cacheKey(std::string& key) const;
+
+  static void* learn_windows(void * arg);
 
   void process_read(const SeqLib::BamRecord& r, size_t count, 
 		    BamParamsMap& p, double& pos1, double& pos2, double& chr, int& wid) const;
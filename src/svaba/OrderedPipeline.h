@@ -0,0 +1,168 @@
+#ifndef SVABA_ORDERED_PIPELINE_H__
+#define SVABA_ORDERED_PIPELINE_H__
+
+#include <pthread.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+
+/** Reader thread -> N worker threads -> ordered writer, over batches of T.
+ *
+ * The reader fills batches until it returns false. Each batch is processed
+ * in place by one worker, and the writer (the calling thread) gets the batches
+ * back in the order they were read. At most max_in_flight batches are held at
+ * once, so memory stays bounded when the writer is the slow part.
+ * With one thread everything runs inline on the caller.
+ */
+template <typename T>
+class OrderedPipeline {
+
+ public:
+
+  typedef std::vector<T> Batch;
+
+  OrderedPipeline(int threads, size_t batch_size = 1000, size_t max_in_flight = 0)
+    : m_threads(threads < 1 ? 1 : threads), m_batch_size(batch_size),
+      m_max_in_flight(max_in_flight ? max_in_flight : 4 * (threads < 1 ? 1 : threads)) {}
+
+  /** Run to the end of the input.
+   * @param read Fill the (empty) batch with up to batch_size items. Return false when there is no more input
+   * @param work Process a batch in place. Called from the worker threads
+   * @param write Consume a batch, in input order. Called from the calling thread
+   */
+  void run(std::function<bool(Batch&, size_t)> read, std::function<void(Batch&)> work,
+	   std::function<void(Batch&)> write) {
+
+    if (m_threads == 1) {
+      Batch b;
+      while (true) {
+	b.clear();
+	bool more = read(b, m_batch_size);
+	if (!b.empty()) {
+	  work(b);
+	  write(b);
+	}
+	if (!more)
+	  return;
+      }
+    }
+
+    m_read = read;
+    m_work = work;
+
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_cond, NULL);
+
+    pthread_t reader;
+    std::vector<pthread_t> workers(m_threads);
+    pthread_create(&reader, NULL, __reader, this);
+    for (auto& t : workers)
+      pthread_create(&t, NULL, __worker, this);
+
+    // write the batches back out in order
+    for (size_t seq = 0; ; ++seq) {
+      pthread_mutex_lock(&m_lock);
+      while (!m_done.count(seq) && !(m_read_done && seq >= m_num_read))
+	pthread_cond_wait(&m_cond, &m_lock);
+      if (!m_done.count(seq)) {
+	pthread_mutex_unlock(&m_lock);
+	break;
+      }
+      Batch b;
+      b.swap(m_done[seq]);
+      m_done.erase(seq);
+      pthread_mutex_unlock(&m_lock);
+
+      write(b);
+
+      pthread_mutex_lock(&m_lock);
+      ++m_num_written;
+      pthread_cond_broadcast(&m_cond);
+      pthread_mutex_unlock(&m_lock);
+    }
+
+    pthread_join(reader, NULL);
+    for (auto& t : workers)
+      pthread_join(t, NULL);
+
+    pthread_mutex_destroy(&m_lock);
+    pthread_cond_destroy(&m_cond);
+  }
+
+ private:
+
+  int m_threads;
+  size_t m_batch_size;
+  size_t m_max_in_flight;
+
+  std::function<bool(Batch&, size_t)> m_read;
+  std::function<void(Batch&)> m_work;
+
+  pthread_mutex_t m_lock;
+  pthread_cond_t m_cond;
+
+  std::deque<std::pair<size_t, Batch>> m_todo; // read, waiting for a worker
+  std::map<size_t, Batch> m_done;              // worked, waiting for the writer
+
+  size_t m_num_read = 0;
+  size_t m_num_written = 0;
+  bool m_read_done = false;
+
+  static void* __reader(void * arg) {
+
+    OrderedPipeline * p = static_cast<OrderedPipeline*>(arg);
+
+    bool more = true;
+    while (more) {
+
+      // wait for room
+      pthread_mutex_lock(&p->m_lock);
+      while (p->m_num_read - p->m_num_written >= p->m_max_in_flight)
+	pthread_cond_wait(&p->m_cond, &p->m_lock);
+      pthread_mutex_unlock(&p->m_lock);
+
+      Batch b;
+      more = p->m_read(b, p->m_batch_size);
+
+      pthread_mutex_lock(&p->m_lock);
+      if (!b.empty())
+	p->m_todo.push_back(std::pair<size_t, Batch>(p->m_num_read++, std::move(b)));
+      if (!more)
+	p->m_read_done = true;
+      pthread_cond_broadcast(&p->m_cond);
+      pthread_mutex_unlock(&p->m_lock);
+    }
+
+    return NULL;
+  }
+
+  static void* __worker(void * arg) {
+
+    OrderedPipeline * p = static_cast<OrderedPipeline*>(arg);
+
+    while (true) {
+
+      pthread_mutex_lock(&p->m_lock);
+      while (p->m_todo.empty() && !p->m_read_done)
+	pthread_cond_wait(&p->m_cond, &p->m_lock);
+      if (p->m_todo.empty()) {
+	pthread_mutex_unlock(&p->m_lock);
+	return NULL;
+      }
+      std::pair<size_t, Batch> job = std::move(p->m_todo.front());
+      p->m_todo.pop_front();
+      pthread_mutex_unlock(&p->m_lock);
+
+      p->m_work(job.second);
+
+      pthread_mutex_lock(&p->m_lock);
+      p->m_done[job.first].swap(job.second);
+      pthread_cond_broadcast(&p->m_cond);
+      pthread_mutex_unlock(&p->m_lock);
+    }
+  }
+
+};
+
+#endif
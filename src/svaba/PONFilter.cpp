@@ -1,23 +1,123 @@
 #include "PONFilter.h"
 
-#include <regex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
+
 #include <sstream>
+#include <fstream>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <unordered_map>
 
 #include "gzstream.h"
 #include "SeqLib/SeqLibUtils.h"
+#include "BreakPointStore.h"
+
+// index layout: 48 byte header (magic, num chr, bucket bits, num source files, n,
+// entries offset, total size and newest mtime of the source files), chr names
+// (sorted, the chr index of the keys), bucket starts, then the entries at an 8 byte aligned offset
+#define PON_INDEX_MAGIC "SVP\2"
+#define PON_NAME_LEN 64
+#define PON_HEADER_LEN 48
+
+// columns of a bps.txt.gz line
+#define PON_BPS_CHR 0
+#define PON_BPS_POS 1
+#define PON_BPS_EVIDENCE 22
+#define PON_BPS_FIRST_SAMPLE 34
 
 using namespace SeqLib;
 
+// splitmix64 finalizer. The bucket is the top bits
+static inline uint64_t __mix(uint64_t k) {
+  k ^= k >> 30;
+  k *= 0xbf58476d1ce4e5b9ULL;
+  k ^= k >> 27;
+  k *= 0x94d049bb133111ebULL;
+  k ^= k >> 31;
+  return k;
+}
+
+// about one entry per bucket
+static uint32_t __table_bits(size_t n) {
+  uint32_t b = 1;
+  while (((size_t)1 << b) < n && b < 31)
+    ++b;
+  return b;
+}
+
+// order the entries by bucket and fill the bucket starts
+static void __bucket(std::vector<PONEntry>& e, uint32_t bits, std::vector<uint32_t>& buckets) {
+
+  std::sort(e.begin(), e.end(), [bits](const PONEntry& a, const PONEntry& b) {
+      uint64_t ha = __mix(a.key) >> (64 - bits);
+      uint64_t hb = __mix(b.key) >> (64 - bits);
+      return ha < hb || (ha == hb && a.key < b.key);
+    });
+
+  buckets.assign(((size_t)1 << bits) + 1, 0);
+  for (auto& i : e)
+    ++buckets[(__mix(i.key) >> (64 - bits)) + 1];
+  for (size_t i = 1; i < buckets.size(); ++i)
+    buckets[i] += buckets[i-1];
+}
+
   std::ostream& operator<<(std::ostream& out, const PONFilter& p) {
     size_t max_samples = 0;
-    for (auto& i : p.m_map)
-      if (i.second > max_samples)
-	max_samples = i.second;
-    out << "Indel PON Num sites: " << AddCommas(p.m_map.size()) << " Max Samples Found " << AddCommas(max_samples);
+    for (size_t i = 0; i < p.m_n; ++i)
+      if (p.m_entries[i].count > max_samples)
+	max_samples = p.m_entries[i].count;
+    out << "Indel PON Num sites: " << AddCommas(p.m_n) << " Max Samples Found " << AddCommas(max_samples);
+    if (p.m_src_files) {
+      char tm[32];
+      time_t t = p.m_src_mtime;
+      strftime(tm, sizeof(tm), "%Y-%m-%d %H:%M:%S", localtime(&t));
+      out << " Built from " << p.m_src_files << " files (" << AddCommas(p.m_src_size) << " bytes, newest " << tm << ")";
+    }
     return out;
   }
 
-  PONFilter::PONFilter(const std::string& file) {
+  PONFilter::PONFilter(const std::string& file, const BamHeader& h) {
+
+    if (IsIndex(file)) {
+      if (h.isEmpty()) {
+	std::cerr << "A header is needed to read the chromosomes of PON index " << file << std::endl;
+	exit(EXIT_FAILURE);
+      }
+      if (!__open_index(file, h)) {
+	std::cerr << "Can't read PON index " << file << std::endl;
+	exit(EXIT_FAILURE);
+      }
+      return;
+    }
+
+    __read_text(file);
+  }
+
+PONFilter::PONFilter(std::vector<PONEntry> sites) {
+  __make_table(sites);
+}
+
+PONFilter::~PONFilter() {
+  if (m_map)
+    munmap(m_map, m_map_len);
+}
+
+void PONFilter::__make_table(std::vector<PONEntry>& sites) {
+  m_bits = __table_bits(sites.size());
+  __bucket(sites, m_bits, m_own_buckets);
+  m_own_entries.swap(sites);
+  m_buckets = m_own_buckets.data();
+  m_entries = m_own_entries.data();
+  m_n = m_own_entries.size();
+}
+
+  void PONFilter::__read_text(const std::string& file) {
 
     // import the pon
     igzstream izp(file.c_str());
@@ -26,6 +126,8 @@ using namespace SeqLib;
       exit(EXIT_FAILURE);
     }
 
+    std::vector<PONEntry> sites;
+
     std::string pval;
     while (std::getline(izp, pval, '\n')) {
 
@@ -44,30 +146,473 @@ using namespace SeqLib;
 	    break;
 	}
 	else if (tval.length())
-	  try { 
-	    sample_count_total += (stoi(tval) > 0 ? 1 : 0); 
-	  } catch(...) { 
-	    std::cerr << "stoi error in PON read with val " << tval << " on line " << pval << std::endl; 
+	  try {
+	    sample_count_total += (stoi(tval) > 0 ? 1 : 0);
+	  } catch(...) {
+	    std::cerr << "stoi error in PON read with val " << tval << " on line " << pval << std::endl;
 	  }
-	//else if (tval.length() && c==2)
-	//	try { read_count_total += stoi(tval); } catch(...) { std::cerr << "stoi error in PON read with val " << tval << " on line " << pval << std::endl; }
-	
       }
-      
-      // trim it down
-      std::regex regc("(.*?_.*?)_.*");
-      std::smatch smatchr;
-      if (!std::regex_search(key, smatchr, regc)) {
-	std::cerr << "regex failed on " << key << std::endl; 
-      } else {
-	key = smatchr[1].str();
+
+      if (sample_count_total <= 1)
+	continue;
+
+      // trim it down to chr_pos
+      size_t u1 = key.find('_');
+      size_t u2 = u1 == std::string::npos ? u1 : key.find('_', u1 + 1);
+      if (u1 == std::string::npos) {
+	std::cerr << "key parse failed on " << key << std::endl;
+	continue;
       }
 
-      if (sample_count_total > 1) {
-	m_map[key] = sample_count_total;
+      PONEntry e;
+      try {
+	e.key = Key(std::stoi(key.substr(0, u1)), std::stoi(key.substr(u1 + 1, u2 == std::string::npos ? u2 : u2 - u1 - 1)));
+      } catch (...) {
+	std::cerr << "key parse failed on " << key << std::endl;
+	continue;
       }
+      e.count = sample_count_total;
+      e.pad = 0;
+      sites.push_back(e);
+    }
+
+    // later lines win, as when this was a map
+    std::stable_sort(sites.begin(), sites.end(), [](const PONEntry& a, const PONEntry& b) { return a.key < b.key; });
+    std::vector<PONEntry> uniq;
+    for (size_t i = 0; i < sites.size(); ++i)
+      if (i + 1 == sites.size() || sites[i+1].key != sites[i].key)
+	uniq.push_back(sites[i]);
+
+    __make_table(uniq);
+  }
+
+// any version, so an old index is rejected rather than read as a text PON
+bool PONFilter::IsIndex(const std::string& file) {
+  std::ifstream in(file, std::ios::binary);
+  char magic[4];
+  return in.read(magic, 4) && !memcmp(magic, PON_INDEX_MAGIC, 3);
+}
+
+bool PONFilter::SourceStat(const std::vector<std::string>& files, uint64_t& size, int64_t& mtime) {
+  size = 0;
+  mtime = 0;
+  for (auto& f : files) {
+    struct stat st;
+    if (stat(f.c_str(), &st) != 0)
+      return false;
+    size += st.st_size;
+    mtime = std::max(mtime, (int64_t)st.st_mtime);
+  }
+  return true;
+}
 
+bool PONFilter::__open_index(const std::string& file, const BamHeader& h) {
+
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  char magic[4];
+  if (fstat(fd, &st) != 0 || st.st_size < PON_HEADER_LEN || read(fd, magic, 4) != 4) {
+    close(fd);
+    return false;
+  }
+  if (memcmp(magic, PON_INDEX_MAGIC, 4)) {
+    std::cerr << "PON index " << file << " is from an older svaba. Rebuild it with svaba pon build" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const char * base = static_cast<const char*>(map);
+  uint32_t num_chr, bits;
+  uint64_t n, entries_off;
+  memcpy(&num_chr, base + 4, 4);
+  memcpy(&bits, base + 8, 4);
+  memcpy(&m_src_files, base + 12, 4);
+  memcpy(&n, base + 16, 8);
+  memcpy(&entries_off, base + 24, 8);
+  memcpy(&m_src_size, base + 32, 8);
+  memcpy(&m_src_mtime, base + 40, 8);
+
+  size_t buckets_off = PON_HEADER_LEN + (size_t)num_chr * PON_NAME_LEN;
+  if (bits < 1 || bits > 31 || buckets_off + ((((size_t)1 << bits) + 1) * 4) > entries_off ||
+      entries_off + n * sizeof(PONEntry) > (uint64_t)st.st_size) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  // chr of the header -> chr of the table, by name
+  m_chr_map.assign(h.NumSequences(), -1);
+  for (uint32_t i = 0; i < num_chr; ++i) {
+    const char * nm = base + PON_HEADER_LEN + (size_t)i * PON_NAME_LEN;
+    std::string name(nm, strnlen(nm, PON_NAME_LEN));
+    try {
+      int32_t id = h.Name2ID(name);
+      if (id >= 0 && id < (int32_t)m_chr_map.size())
+	m_chr_map[id] = i;
+    } catch (...) {
     }
+  }
+
+  m_buckets = reinterpret_cast<const uint32_t*>(base + buckets_off);
+  m_entries = reinterpret_cast<const PONEntry*>(base + entries_off);
+  m_bits = bits;
+  m_n = n;
+  m_map = map;
+  m_map_len = st.st_size;
+  return true;
+}
+
+int PONFilter::NSamps(int32_t chr, int32_t pos) const {
+
+  if (!m_n)
+    return 0;
 
-    
+  if (!m_chr_map.empty()) {
+    if (chr < 0 || chr >= (int32_t)m_chr_map.size() || m_chr_map[chr] < 0)
+      return 0;
+    chr = m_chr_map[chr];
   }
+
+  uint64_t key = Key(chr, pos);
+  uint64_t b = __mix(key) >> (64 - m_bits);
+  for (uint32_t i = m_buckets[b]; i < m_buckets[b+1]; ++i)
+    if (m_entries[i].key == key)
+      return m_entries[i].count;
+  return 0;
+}
+
+int PONFilter::NSamps(const std::string& s) const {
+
+  size_t u = s.find('_');
+  if (u == std::string::npos)
+    return 0;
+  try {
+    return NSamps(std::stoi(s.substr(0, u)), std::stoi(s.substr(u + 1)));
+  } catch (...) {
+    return 0;
+  }
+}
+
+// shared state for svaba pon build
+struct PONBuild {
+  const std::vector<std::string> * files;
+  size_t next = 0;
+  bool ok = true;
+  pthread_mutex_t lock;
+
+  std::unordered_map<std::string, int32_t> chr_ids;
+  std::vector<std::string> chr_names;
+
+  std::vector<std::unordered_map<uint64_t, uint32_t>> counts; // per thread
+};
+
+struct PONWorker {
+  PONBuild * b;
+  size_t t;
+};
+
+static int32_t __pon_chr(PONBuild * b, std::unordered_map<std::string, int32_t>& local, const std::string& chr) {
+
+  std::unordered_map<std::string, int32_t>::const_iterator ff = local.find(chr);
+  if (ff != local.end())
+    return ff->second;
+
+  pthread_mutex_lock(&b->lock);
+  std::unordered_map<std::string, int32_t>::const_iterator gg = b->chr_ids.find(chr);
+  int32_t id;
+  if (gg != b->chr_ids.end()) {
+    id = gg->second;
+  } else {
+    id = b->chr_names.size();
+    b->chr_ids[chr] = id;
+    b->chr_names.push_back(chr);
+  }
+  pthread_mutex_unlock(&b->lock);
+
+  local[chr] = id;
+  return id;
+}
+
+// keys of the indels with alt support in one bps.txt.gz or bps.svb
+static bool __pon_read_file(PONBuild * b, std::unordered_map<std::string, int32_t>& local, const std::string& file, std::vector<uint64_t>& keys) {
+
+  if (BreakPointStoreReader::IsStore(file)) {
+    BreakPointStoreReader reader;
+    if (!reader.Open(file))
+      return false;
+    BreakPoint bp;
+    while (reader.Next(bp)) {
+      if (bp.evidence != "INDEL")
+	continue;
+      for (auto& a : bp.allele)
+	if (std::max(a.second.alt, a.second.cigar) > 0) { // the AD of bps.txt
+	  keys.push_back(PONFilter::Key(__pon_chr(b, local, bp.b1.chr_name), bp.b1.gr.pos1));
+	  break;
+	}
+    }
+    return true;
+  }
+
+  igzstream in(file.c_str());
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+
+    if (line.empty() || line.compare(0, 5, "chr1\t") == 0)
+      continue;
+
+    // walk the tabs, only looking at the columns needed
+    std::string chr;
+    int32_t pos = -1;
+    bool indel = false, alt = false;
+    size_t s = 0, c = 0;
+    while (s <= line.length()) {
+      size_t e = line.find('\t', s);
+      if (e == std::string::npos)
+	e = line.length();
+      if (c == PON_BPS_CHR)
+	chr = line.substr(s, e - s);
+      else if (c == PON_BPS_POS)
+	pos = std::atoi(line.c_str() + s);
+      else if (c == PON_BPS_EVIDENCE) {
+	indel = line.compare(s, e - s, "INDEL") == 0;
+	if (!indel)
+	  break;
+      } else if (c >= PON_BPS_FIRST_SAMPLE) {
+	// GT:AD:...
+	size_t k = line.find(':', s);
+	if (k != std::string::npos && k < e && std::atoi(line.c_str() + k + 1) > 0) {
+	  alt = true;
+	  break;
+	}
+      }
+      s = e + 1;
+      ++c;
+    }
+
+    if (indel && alt && pos >= 0)
+      keys.push_back(PONFilter::Key(__pon_chr(b, local, chr), pos));
+  }
+  return true;
+}
+
+static void* __pon_worker(void * arg) {
+
+  PONWorker * w = static_cast<PONWorker*>(arg);
+  PONBuild * b = w->b;
+  std::unordered_map<std::string, int32_t> local;
+  std::vector<uint64_t> keys;
+
+  while (true) {
+    pthread_mutex_lock(&b->lock);
+    size_t i = b->next++;
+    pthread_mutex_unlock(&b->lock);
+    if (i >= b->files->size())
+      break;
+
+    const std::string& f = b->files->at(i);
+    keys.clear();
+    if (!__pon_read_file(b, local, f, keys)) {
+      std::cerr << "ERROR: Cannot read breakpoints file " << f << std::endl;
+      pthread_mutex_lock(&b->lock);
+      b->ok = false;
+      pthread_mutex_unlock(&b->lock);
+      continue;
+    }
+
+    // once per file
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    for (auto& k : keys)
+      ++b->counts[w->t][k];
+  }
+
+  return NULL;
+}
+
+bool PONFilter::Build(const std::vector<std::string>& files, const std::string& out, int threads, int min_samples) {
+
+  // before reading, so a file written to during the build looks changed
+  uint64_t src_size;
+  int64_t src_mtime;
+  if (!SourceStat(files, src_size, src_mtime)) {
+    std::cerr << "ERROR: Cannot stat all of the breakpoints files" << std::endl;
+    return false;
+  }
+
+  threads = std::max(1, std::min(threads, (int)files.size()));
+
+  PONBuild b;
+  b.files = &files;
+  b.counts.resize(threads);
+  pthread_mutex_init(&b.lock, NULL);
+
+  std::vector<PONWorker> w(threads);
+  std::vector<pthread_t> tt(threads);
+  for (int i = 0; i < threads; ++i) {
+    w[i].b = &b;
+    w[i].t = i;
+    pthread_create(&tt[i], NULL, __pon_worker, &w[i]);
+  }
+  for (auto& t : tt)
+    pthread_join(t, NULL);
+  pthread_mutex_destroy(&b.lock);
+
+  if (!b.ok)
+    return false;
+
+  // merge the per-thread counts
+  for (int i = 1; i < threads; ++i) {
+    for (auto& k : b.counts[i])
+      b.counts[0][k.first] += k.second;
+    std::unordered_map<uint64_t, uint32_t>().swap(b.counts[i]);
+  }
+
+  // the threads number the chr as they find them, so the order changes
+  // from run to run. Store the names sorted, and renumber the keys to match
+  std::vector<int32_t> order(b.chr_names.size()), renum(b.chr_names.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&b](int32_t x, int32_t y) { return b.chr_names[x] < b.chr_names[y]; });
+  std::vector<std::string> names(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    renum[order[i]] = i;
+    names[i] = b.chr_names[order[i]];
+  }
+  b.chr_names.swap(names);
+
+  std::vector<PONEntry> e;
+  for (auto& k : b.counts[0])
+    if ((int)k.second >= min_samples) {
+      PONEntry p;
+      p.key = Key(renum[k.first >> 32], (int32_t)(uint32_t)k.first);
+      p.count = k.second;
+      p.pad = 0;
+      e.push_back(p);
+    }
+  std::unordered_map<uint64_t, uint32_t>().swap(b.counts[0]);
+
+  uint32_t bits = __table_bits(e.size());
+  std::vector<uint32_t> buckets;
+  __bucket(e, bits, buckets);
+
+  std::ofstream os(out, std::ios::binary);
+  if (!os) {
+    std::cerr << "ERROR: Cannot write PON index " << out << std::endl;
+    return false;
+  }
+
+  uint32_t num_chr = b.chr_names.size(), nfiles = files.size();
+  uint64_t n = e.size();
+  uint64_t buckets_off = PON_HEADER_LEN + (uint64_t)num_chr * PON_NAME_LEN;
+  uint64_t entries_off = buckets_off + buckets.size() * 4;
+  entries_off = (entries_off + 7) & ~(uint64_t)7;
+
+  os.write(PON_INDEX_MAGIC, 4);
+  os.write(reinterpret_cast<const char*>(&num_chr), 4);
+  os.write(reinterpret_cast<const char*>(&bits), 4);
+  os.write(reinterpret_cast<const char*>(&nfiles), 4);
+  os.write(reinterpret_cast<const char*>(&n), 8);
+  os.write(reinterpret_cast<const char*>(&entries_off), 8);
+  os.write(reinterpret_cast<const char*>(&src_size), 8);
+  os.write(reinterpret_cast<const char*>(&src_mtime), 8);
+  for (auto& c : b.chr_names) {
+    if (c.length() >= PON_NAME_LEN) {
+      std::cerr << "ERROR: Chromosome name too long for PON index: " << c << std::endl;
+      return false;
+    }
+    char nm[PON_NAME_LEN];
+    memset(nm, 0, PON_NAME_LEN);
+    memcpy(nm, c.c_str(), c.length());
+    os.write(nm, PON_NAME_LEN);
+  }
+  os.write(reinterpret_cast<const char*>(buckets.data()), buckets.size() * 4);
+  for (uint64_t p = buckets_off + buckets.size() * 4; p < entries_off; ++p)
+    os.put(0);
+  os.write(reinterpret_cast<const char*>(e.data()), e.size() * sizeof(PONEntry));
+
+  os.close();
+  if (os.fail())
+    return false;
+
+  std::cerr << "...wrote " << AddCommas(e.size()) << " PON sites from " << files.size() << " files to " << out << std::endl;
+  return true;
+}
+
+static const char* shortopts = "hi:o:p:m:";
+static const struct option longopts[] = {
+  { "help",                    no_argument, NULL, 'h' },
+  { "input-list",              required_argument, NULL, 'i' },
+  { "output",                  required_argument, NULL, 'o' },
+  { "threads",                 required_argument, NULL, 'p' },
+  { "min-samples",             required_argument, NULL, 'm' },
+  { NULL, 0, NULL, 0 }
+};
+
+static const char *PON_USAGE_MESSAGE =
+"Usage: svaba pon build -o <pon.svpon> [OPTION] [bps.txt.gz / bps.svb ...]\n\n"
+"  Description: Merge the breakpoints of many normal runs into a binary indel panel of normals.\n"
+"               A site counts once for each file with an indel there that has alt reads.\n"
+"               The index records the number, total size and newest modification time of the files.\n"
+"\n"
+"  -o, --output                         Output PON index\n"
+"  -i, --input-list                     File with one bps.txt.gz / bps.svb path per line, in addition to the arguments\n"
+"  -p, --threads                        Number of files to read at once. Default: 1\n"
+"  -m, --min-samples                    Keep sites seen in at least this many files. Default: 2\n"
+"  -h, --help                           Display this help and exit\n"
+"\n";
+
+void runPON(int argc, char** argv) {
+
+  // argv[0] is "pon", argv[1] the subcommand
+  std::string sub = argc > 1 ? argv[1] : "";
+  bool die = sub != "build";
+
+  std::string out, list;
+  int threads = 1, min_samples = 2;
+  std::vector<std::string> files;
+
+  if (!die) {
+    --argc; ++argv;
+    for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+      std::istringstream arg(optarg != NULL ? optarg : "");
+      switch (c) {
+      case 'o': arg >> out; break;
+      case 'i': arg >> list; break;
+      case 'p': arg >> threads; break;
+      case 'm': arg >> min_samples; break;
+      default: die = true; break;
+      }
+    }
+    for (int i = optind; i < argc; ++i)
+      files.push_back(argv[i]);
+  }
+
+  if (!list.empty()) {
+    std::ifstream in(list);
+    if (!in) {
+      std::cerr << "ERROR: Cannot read input list " << list << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string line;
+    while (std::getline(in, line))
+      if (!line.empty())
+	files.push_back(line);
+  }
+
+  if (die || out.empty() || files.empty()) {
+    std::cerr << "\n" << PON_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+
+  if (!PONFilter::Build(files, out, threads, min_samples))
+    exit(EXIT_FAILURE);
+}
@@ -2,32 +2,111 @@
 #define SNOWTOOLS_PONFILTER_H__
 
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <cstdlib>
-#include <unordered_map>
+#include <iostream>
 
+#include "SeqLib/BamHeader.h"
+
+// a panel of normals site. key is chr << 32 | pos
+struct PONEntry {
+  uint64_t key;
+  uint32_t count; // number of normals with the site
+  uint32_t pad;
+};
+
+/** Indel panel of normals, as a static hash table.
+ *
+ * Keys are packed chr / pos integers. Entries are grouped into buckets by a
+ * hash of the key, with a bucket start table, so a lookup is one or two
+ * probes. The binary index from svaba pon build is mmapped as is; a text
+ * PON is parsed into the same table.
+ */
 class PONFilter {
-  
- public: 
-  
+
+ public:
+
   PONFilter() {}
-  
-  PONFilter(const std::string& file);
-  
+
+  /** Load a PON.
+   * @param h Header to map the chromosome names of a binary index to ids. Exits if
+   * it is empty for a binary index. Not used for a text PON, whose keys already hold ids
+   */
+  PONFilter(const std::string& file, const SeqLib::BamHeader& h);
+
+  /** Make a PON from in-memory sites, with chr as given */
+  PONFilter(std::vector<PONEntry> sites);
+
+  ~PONFilter();
+
+  PONFilter(const PONFilter&) = delete;
+  PONFilter& operator=(const PONFilter&) = delete;
+
   friend std::ostream& operator<<(std::ostream& out, const PONFilter& p);
-  
-  bool count(const std::string& s) const { return m_map.count(s); }
-  
-  int NSamps(const std::string& s) const { 
-    std::unordered_map<std::string, size_t>::const_iterator it = m_map.find(s);
-    if (it == m_map.end())
-      return 0;
-    return it->second; 
-  }
+
+  bool count(const std::string& s) const { return NSamps(s) > 0; }
+
+  /** Number of normals with the site, for a chr_pos key */
+  int NSamps(const std::string& s) const;
+
+  /** Number of normals with the site at chr:pos */
+  int NSamps(int32_t chr, int32_t pos) const;
+
+  size_t size() const { return m_n; }
+
+  static uint64_t Key(int32_t chr, int32_t pos) { return ((uint64_t)(uint32_t)chr << 32) | (uint32_t)pos; }
+
+  /** Does this file start with the index magic, of any version */
+  static bool IsIndex(const std::string& file);
+
+  /** Total size and newest mtime of the files a PON is built from. False if one can not be read */
+  static bool SourceStat(const std::vector<std::string>& files, uint64_t& size, int64_t& mtime);
+
+  /** Number of files a binary index was built from, and their SourceStat. 0 for other PONs */
+  uint32_t SourceFiles() const { return m_src_files; }
+
+  uint64_t SourceSize() const { return m_src_size; }
+
+  int64_t SourceMtime() const { return m_src_mtime; }
+
+  /** Merge svaba bps.txt.gz / bps.svb files into a binary PON index. A site is
+   * counted once per file that has an indel there with alt reads in any sample
+   * @param min_samples Only keep sites seen in at least this many files
+   */
+  static bool Build(const std::vector<std::string>& files, const std::string& out, int threads, int min_samples);
 
  private:
-  
-  std::unordered_map<std::string, size_t> m_map;
-  
+
+  // table, pointing into the mmap or into m_own_*
+  const uint32_t * m_buckets = nullptr;
+  const PONEntry * m_entries = nullptr;
+  uint32_t m_bits = 0;
+  size_t m_n = 0;
+
+  // header chr id -> chr index in the table (chr names in sorted order). Empty for
+  // a text or in-memory PON, whose keys hold header ids
+  std::vector<int32_t> m_chr_map;
+
+  std::vector<uint32_t> m_own_buckets;
+  std::vector<PONEntry> m_own_entries;
+
+  void * m_map = nullptr;
+  size_t m_map_len = 0;
+
+  uint32_t m_src_files = 0;
+  uint64_t m_src_size = 0;
+  int64_t m_src_mtime = 0;
+
+  void __make_table(std::vector<PONEntry>& sites);
+
+  bool __open_index(const std::string& file, const SeqLib::BamHeader& h);
+
+  void __read_text(const std::string& file);
+
 };
 
+/** svaba pon: build a binary panel of normals */
+void runPON(int argc, char** argv);
+
 #endif
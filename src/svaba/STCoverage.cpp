@@ -10,6 +10,14 @@ using namespace SeqLib;
     m_map.clear();
   }
 
+  size_t STCoverage::Bytes() const {
+    // a node per position (key, value and next pointer, rounded by malloc) plus the buckets
+    size_t b = m_map.capacity() * sizeof(CovMap);
+    for (auto& m : m_map)
+      b += m.size() * 32 + m.bucket_count() * sizeof(void*);
+    return b;
+  }
+
   void STCoverage::settleCoverage() {
     //SeqLib::GRC tmp = m_grc;
     //m_grc.MergeOverlappingIntervals();
@@ -175,3 +183,14 @@ using namespace SeqLib;
     
 
 }
+
+  void STCoverage::setCoverageAtPosition(int chr, int pos, int count) {
+
+    if (chr < 0)
+      return;
+    
+    if (chr >= (int)m_map.size())
+      m_map.resize(chr + 1);
+
+    m_map[chr][pos] = count;
+  }
@@ -60,6 +60,9 @@ class STCoverage {
 
   uint16_t maxCov() const;
 
+  /** Approximate heap bytes of the coverage maps */
+  size_t Bytes() const;
+
   /** Make an empty coverage */
   STCoverage() {}
 
@@ -77,6 +80,12 @@ class STCoverage {
 
   /** Return the coverage count at a position */
   int getCoverageAtPosition(int chr, int pos) const;
+
+  /** Set the coverage count at a position (eg when reloading a stored track) */
+  void setCoverageAtPosition(int chr, int pos, int count);
+
+  /** Return the per-chromosome position -> count maps */
+  const std::vector<CovMap>& GetCoverageMaps() const { return m_map; }
   
 };
 
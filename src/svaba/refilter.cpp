@@ -10,11 +10,14 @@
 
 #include "vcf.h"
 #include "BreakPoint.h"
+#include "BreakPointStore.h"
+#include "OrderedPipeline.h"
 #include "svabaUtils.h"
 
 
 static DBSnpFilter * dbsnp_filter;
 static ogzstream os_allbps_r;
+static BreakPointStoreWriter * bps_store_r;
 
 namespace opt {
 
@@ -35,6 +38,7 @@ namespace opt {
   static std::string dbsnp; // = "/xchip/gistic/Jeremiah/svabaFilters/dbsnp_138.b37_indel.vcf";
 
   static int verbose = 1;
+  static int threads = 1;
 
   // indel probability cutoffs
   static double lod = 8; // LOD that variant is not ref
@@ -54,7 +58,7 @@ enum {
 };
 
 
-static const char* shortopts = "hi:a:v:g:D:b:";
+static const char* shortopts = "hi:a:v:g:D:b:p:";
 static const struct option longopts[] = {
   { "help",                    no_argument, NULL, 'h' },
   { "input-bps",               required_argument, NULL, 'i'},
@@ -64,6 +68,7 @@ static const struct option longopts[] = {
   { "reference-genome",        required_argument, NULL, 'g'},
   { "analysis-id",             required_argument, NULL, 'a'},
   { "verbose",                 required_argument, NULL, 'v' },
+  { "threads",                 required_argument, NULL, 'p' },
   { "lod",                     required_argument, NULL, OPT_LOD },
   { "lod-dbsnp",               required_argument, NULL, OPT_LOD_DB },
   { "lod-somatic",             required_argument, NULL, OPT_LOD_SOMATIC },
@@ -82,14 +87,15 @@ static const char *BP_USAGE_MESSAGE =
 "  General options\n"
 "  -v, --verbose                        Select verbosity level (0-4). Default: 1 \n"
 "  -h, --help                           Display this help and exit\n"
+"  -p, --threads                        Use NUM threads to rescore the breakpoints and make the VCFs. Default: 1\n"
 "  -g, --reference-genome               Path to indexed reference genome to be used by BWA-MEM. Default is Broad hg19 (/seq/reference/...)\n"
 "  -b, --opt-bam                        Input BAM file to get header from\n"
 "  -a, --id-string                      String specifying the analysis ID to be used as part of ID common.\n"
 "  Required input\n"
-"  -i, --input-bps                      Original bps.txt.gz file\n"
+"  -i, --input-bps                      Original bps.txt.gz file, or the bps.svb breakpoint store\n"
 "  -b, --bam                            BAM file used to grab header from\n"
 "  Optional external database\n"
-"  -D, --dbsnp-vcf                      DBsnp database (VCF) to compare indels against\n"
+"  -D, --dbsnp-vcf                      DBsnp database (VCF, or index from svaba dbsnp-index) to compare indels against\n"
 "  -B, --blacklist                      BED-file with blacklisted regions to not extract any reads from.\n"
 "  -Y, --microbial-genome               Path to indexed reference genome of microbial sequences to be used by BWA-MEM to filter reads.\n"
 "  -V, --germline-sv-database           BED file containing sites of known germline SVs. Used as additional filter for somatic SV detection\n"
@@ -119,6 +125,7 @@ void parseBreakOptions(int argc, char** argv) {
     case 'g': arg >> opt::ref_index; break;
     case 'i': arg >> opt::input_file; break;
     case 'v': arg >> opt::verbose; break;
+    case 'p': arg >> opt::threads; break;
     case 'a': arg >> opt::analysis_id; break;
     case 'D': arg >> opt::dbsnp; break;
     case OPT_LOD: arg >> opt::lod; break;
@@ -188,70 +195,139 @@ void runRefilterBreakpoints(int argc, char** argv) {
   // open bps file
   std::string new_bps_file = opt::analysis_id + ".bps.txt.gz";
   svabaUtils::fopen(new_bps_file, os_allbps_r);
+  std::string new_store_file = opt::analysis_id + ".bps.svb";
 
-  // read in the BPS
+  // read in the header, from the store or the first line of the bps.txt.gz
   std::vector<std::string> allele_names; // store with real name
-  std::map<std::string, SampleInfo> tmp_alleles;
-  std::string line, line2, val;
-  igzstream infile(opt::input_file.c_str(), std::ios::in);
-  size_t line_count = 0;
+  std::vector<std::string> column_names; 
   SeqLib::BamHeader hdr = bwalker.Header();
-  while (getline(infile, line, '\n')) {
-    if (line_count % 100000 == 0) 
-      std::cerr << "...read input bps / write output bps file at line " << SeqLib::AddCommas(line_count) << std::endl;
-      
-    if (line_count == 0) { // read the header
-      os_allbps_r << line << std::endl;
-      std::istringstream f(line);
-      size_t scount = 0;
-      while (std::getline(f, val, '\t')) {
-	++scount;
-	if (scount > 34) { // 35th column should be first sample ID
-	  assert(val.at(0) == 't' || val.at(0) == 'n');
-	    allele_names.push_back(val);
-	}
+
+  BreakPointStoreReader reader;
+  igzstream infile;
+  const bool from_store = BreakPointStoreReader::IsStore(opt::input_file);
+  if (from_store) {
+    if (!reader.Open(opt::input_file, hdr)) {
+      std::cerr << "ERROR: Cannot open breakpoint store " << opt::input_file << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    // alleles come back keyed by sample id, so no renaming
+    allele_names = reader.SampleIds();
+    column_names = reader.SampleNames();
+  } else {
+    infile.open(opt::input_file.c_str(), std::ios::in);
+    std::string line, val;
+    getline(infile, line, '\n');
+    std::istringstream f(line);
+    size_t scount = 0;
+    while (std::getline(f, val, '\t')) {
+      ++scount;
+      if (scount > 34) { // 35th column should be first sample ID
+	assert(val.at(0) == 't' || val.at(0) == 'n');
+	allele_names.push_back(val);
       }
+    }
+    // the text alleles are keyed by the full column name
+    column_names = allele_names;
+  }
+
+  os_allbps_r << BreakPoint::header();
+  for (auto& i : column_names)
+    os_allbps_r << "\t" << i;
+  os_allbps_r << std::endl;
+
+  bps_store_r = new BreakPointStoreWriter();
+  if (!bps_store_r->Open(new_store_file, allele_names, column_names)) {
+    std::cerr << "ERROR: Could not open breakpoint store " << new_store_file << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
-    } else {
-	BreakPoint * bp = new BreakPoint(line, hdr);
+  // reader thread -> scoring threads -> ordered writer
+  struct RefilterItem {
+    std::string line; // empty if read from the store
+    BreakPoint bp;
+    std::string out;
+  };
+  typedef OrderedPipeline<RefilterItem>::Batch RefilterBatch;
+
+  auto read_batch = [&](RefilterBatch& batch, size_t n) {
+    batch.resize(n);
+    size_t k = 0;
+    if (from_store)
+      while (k < n && reader.Next(batch[k].bp))
+	++k;
+    else
+      while (k < n && getline(infile, batch[k].line, '\n'))
+	if (!batch[k].line.empty())
+	  ++k;
+    batch.resize(k);
+    return k == n;
+  };
+
+  auto score_batch = [&](RefilterBatch& batch) {
+    std::string id;
+    std::vector<BreakPoint*> to_score;
+    to_score.reserve(batch.size());
+    for (auto& r : batch) {
+      BreakPoint& bp = r.bp;
+      if (!r.line.empty()) {
+	bp = BreakPoint(r.line, hdr);
 
 	// fill in with the correct names from the header of bps.txt
-	std::string id ;
+	std::map<std::string, SampleInfo> tmp_alleles;
+	id.clear();
 	for (auto& i : allele_names) {
 	  id += "A";
-	  tmp_alleles[i] = bp->allele[id];
+	  tmp_alleles[i] = bp.allele[id];
 	}
-	bp->allele = tmp_alleles;
+	bp.allele.swap(tmp_alleles);
+      }
 
-	// fill in discordant info
-	for (auto& i : bp->allele) {
-	  if (i.first.at(0) == 't')
-	    bp->dc.tcount += i.second.disc;
-	  else
-	    bp->dc.ncount += i.second.disc;
+      // fill in discordant info
+      for (auto& i : bp.allele) {
+	if (i.first.at(0) == 't')
+	  bp.dc.tcount += i.second.disc;
+	else
+	  bp.dc.ncount += i.second.disc;
+      }
 
-	}
+      // match against DBsnp database. Modify bp in place
+      if (dbsnp_filter && opt::dbsnp.length()) 
+	dbsnp_filter->queryBreakpoint(bp);
 
-	// match against DBsnp database. Modify bp in place
-	if (dbsnp_filter && opt::dbsnp.length()) 
-	  dbsnp_filter->queryBreakpoint(*bp);
+      to_score.push_back(&bp);
+    }
 
-	// score them
-	bp->scoreBreakpoint(opt::lod, opt::lod_db, opt::lod_somatic, opt::lod_somatic_db, opt::scale_error, 0);
-	os_allbps_r << bp->toFileString(!opt::read_tracking) << std::endl;
-	delete bp;
-      }
-    ++line_count;
-  }
+    // score them
+    BreakPoint::scoreBreakpoints(to_score, opt::lod, opt::lod_db, opt::lod_somatic, opt::lod_somatic_db, opt::scale_error, 0);
+    for (auto& r : batch)
+      r.out = r.bp.toFileString(!opt::read_tracking);
+  };
+
+  size_t line_count = 0;
+  auto write_batch = [&](RefilterBatch& batch) {
+    for (auto& r : batch) {
+      if (line_count % 100000 == 0) 
+	std::cerr << "...read input bps / write output bps file at record " << SeqLib::AddCommas(line_count) << std::endl;
+      os_allbps_r << r.out << "\n";
+      bps_store_r->Add(r.bp);
+      ++line_count;
+    }
+  };
+
+  OrderedPipeline<RefilterItem> pipeline(opt::threads);
+  pipeline.run(read_batch, score_batch, write_batch);
 
   os_allbps_r.close();
+  bps_store_r->Close();
+  delete bps_store_r;
+  bps_store_r = nullptr;
   
   // primary VCFs
   std::cerr << " input file " << opt::input_file << std::endl;
-  if (SeqLib::read_access_test(new_bps_file)) {
+  if (SeqLib::read_access_test(new_store_file)) {
     if (opt::verbose)
-      std::cerr << "...making the primary VCFs (unfiltered and filtered) from file " << new_bps_file << std::endl;
-    VCFFile snowvcf(new_bps_file, opt::analysis_id, bwalker.Header(), header, true);
+      std::cerr << "...making the primary VCFs (unfiltered and filtered) from file " << new_store_file << std::endl;
+    VCFFile snowvcf(new_store_file, opt::analysis_id, bwalker.Header(), header, true, opt::threads);
  
     std::string basename = opt::analysis_id + ".snowman.unfiltered.";
     snowvcf.include_nonpass = true;
@@ -7,6 +7,8 @@
 #include <map>
 #include <vector>
 #include <cassert>
+#include <algorithm>
+#include <iterator>
 
 #include "SeqLib/ReadFilter.h"
 #include "KmerFilter.h"
@@ -14,7 +16,15 @@
 #include "DBSnpFilter.h"
 #include "svabaUtils.h"
 #include "LearnBamParams.h"
+#include "svabaExtract.h"
+#include "BreakPointStore.h"
+#include "DiscordantStream.h"
+#include "svabaTrace.h"
+#include "svabaStatus.h"
+#include "svabaMemory.h"
+#include "svabaReaderPool.h"
 #include "SeqLib/BFC.h"
+#include "SeqLib/ThreadPool.h"
 
 #define THREAD_READ_LIMIT 1 // 1000
 #define THREAD_CONTIG_LIMIT 1// 100
@@ -28,7 +38,7 @@ std::string myreplace(std::string &s,
 }
 
 // output files
-static ogzstream all_align, os_allbps, os_discordant, os_corrected;
+static ogzstream all_align, os_allbps, os_discordant, os_corrected, os_metrics;
 static std::ofstream log_file, bad_bed;
 static std::stringstream ss; // initalize a string stream once
 
@@ -59,6 +69,10 @@ static std::stringstream ss; // initalize a string stream once
 // NM, then dont' consider it a strong local match
 #define MAX_NM_FOR_LOCAL 10 
 
+// a window is slow for the region report if it took this many times the median wall time
+#define REPORT_SLOW_FACTOR 10
+#define REPORT_SLOW_MIN_SEC 30
+
 static SeqLib::RefGenome * ref_genome, * ref_genome_viral;
 static std::unordered_map<std::string, BamParamsMap> params_map; // key is bam id (t000), value is map with read group as key
 static SeqLib::BamHeader bwa_header, viral_header;
@@ -71,17 +85,27 @@ static int min_dscrd_size_for_variant = 0; // set a min size for what we can cal
 static std::unordered_map<std::string, int> min_isize_for_disc;
 
 static SeqLib::BamHeader b_header; // header for main bam
+// shared htslib pool for BGZF (de)compression. never freed, since the static
+// writers and the per-thread walkers still flush / read through it at exit
+static SeqLib::ThreadPool * hts_pool = nullptr;
+static svabaReaderPool * reader_pool = nullptr; // with --max-open-bams, opens the walkers' BAMs
 static SeqLib::BamReader b_reader; // reader for the main bam
 static SeqLib::BamWriter er_writer, b_microbe_writer, b_contig_writer;
 static SeqLib::BWAWrapper * microbe_bwa = nullptr;
 static SeqLib::BWAWrapper * main_bwa = nullptr;
 static SeqLib::Filter::ReadFilterCollection * mr;
 static SeqLib::GRC blacklist, germline_svs, simple_seq;
+static IntervalView blacklist_view, germline_view, simple_view; // sorted views of the above, for cursor queries
 static DBSnpFilter * dbsnp_filter;
+static svabaExtractWriter * extract_writer = nullptr; // for svaba extract
+static VCFFile * stream_vcf = nullptr; // filled as breakpoints are written out
+static BreakPointStoreWriter * bps_store = nullptr; // binary copy of bps.txt.gz
 static SeqLib::GRC file_regions, regions_torun;
 
 // mutex and time
 static pthread_mutex_t snow_lock;
+static pthread_mutex_t metrics_lock; // for os_metrics, which every region writes to
+static void __write_region_report(); // at the end of detection, from the metrics of each window
 static struct timespec start;
 
 // learned value 
@@ -113,6 +137,8 @@ namespace opt {
   static bool read_tracking = false; // turn on output of qnames
   static bool all_contigs = false;   // output all contigs
   static bool no_unfiltered = false; // don't output unfiltered variants
+  static bool no_bps_file = false; // don't write bps.txt.gz. VCFs are made in memory either way
+  static bool bcf = false; // write BCF instead of VCF
 
   // discordant clustering params
   static double sd_disc_cutoff = 3.92;
@@ -143,10 +169,17 @@ namespace opt {
   static std::string regionFile;  // region to run on
   static std::string analysis_id = "no_id";
   static int num_to_sample = 5000000;  // num to learn from (eg isize distribution)
+  static bool param_cache = true; // read / write the learned BAM params with the run's outputs (<id>.<sample>.svaba_params)
+  static std::string trace_file; // Chrome trace-event timeline of the run
+  static std::string status_file; // live progress, Prometheus text format
+  static int status_interval = 10; // seconds between status writes
+  static double max_memory = 0; // GB. 0 is no budget
+  static int max_open_bams = 0; // over all threads. 0 is every BAM open on every thread
 
   // runtime parameters
   static int verbose = 0;
   static int numThreads = 1;
+  static int hts_threads = 0; // threads in the shared BGZF pool. 0 is inline (de)compression
   static bool hp = false; // should run in highly-parallel mode? (no file dump til end)
 
   // data
@@ -158,6 +191,8 @@ namespace opt {
   static std::string germline_sv_file;
   static std::string dbsnp; // = "/xchip/gistic/Jeremiah/SnowmanFilters/dbsnp_138.b37_indel.vcf";
   static std::string main_bam = "-"; // the main bam
+  static std::string extract_file; // run from this svaba extract store instead of the BAMs
+  static bool extract_only = false; // svaba extract. Stop after read-in and write the store
 
   // optimize defaults for single sample mode
   static bool germline = false; 
@@ -197,7 +232,17 @@ enum {
   OPT_CLIP3,
   OPT_GERMLINE,
   OPT_SCALE_ERRORS,
-  OPT_NO_UNFILTERED
+  OPT_NO_UNFILTERED,
+  OPT_HTS_THREADS,
+  OPT_FROM_EXTRACT,
+  OPT_NO_BPS_FILE,
+  OPT_BCF,
+  OPT_NO_PARAM_CACHE,
+  OPT_TRACE,
+  OPT_STATUS,
+  OPT_STATUS_INTERVAL,
+  OPT_MAX_MEMORY,
+  OPT_MAX_OPEN_BAMS
 };
 
 static const char* shortopts = "hzIAt:n:p:v:r:G:e:k:c:a:m:B:D:Y:S:L:s:V:R:K:E:C:x:";
@@ -211,7 +256,11 @@ static const struct option longopts[] = {
   { "hp",                      no_argument, NULL, OPT_HP },
   { "normal-bam",              required_argument, NULL, 'n' },
   { "threads",                 required_argument, NULL, 'p' },
+  { "hts-threads",             required_argument, NULL, OPT_HTS_THREADS },
+  { "from-extract",            required_argument, NULL, OPT_FROM_EXTRACT },
   { "no-unfiltered",           no_argument, NULL, OPT_NO_UNFILTERED },
+  { "no-bps-file",             no_argument, NULL, OPT_NO_BPS_FILE },
+  { "bcf",                     no_argument, NULL, OPT_BCF },
   { "chunk-size",              required_argument, NULL, 'c' },
   { "region-file",             required_argument, NULL, 'k' },
   { "rules",                   required_argument, NULL, 'r' },
@@ -245,6 +294,12 @@ static const struct option longopts[] = {
   { "scale-errors",            required_argument, NULL, OPT_SCALE_ERRORS },
   { "discordant-only",         no_argument, NULL, OPT_DISCORDANT_ONLY },
   { "num-to-sample",           required_argument, NULL, OPT_NUM_TO_SAMPLE },
+  { "no-param-cache",          no_argument, NULL, OPT_NO_PARAM_CACHE },
+  { "trace",                   required_argument, NULL, OPT_TRACE },
+  { "status",                  required_argument, NULL, OPT_STATUS },
+  { "status-interval",         required_argument, NULL, OPT_STATUS_INTERVAL },
+  { "max-memory",              required_argument, NULL, OPT_MAX_MEMORY },
+  { "max-open-bams",           required_argument, NULL, OPT_MAX_OPEN_BAMS },
   { "write-asqg",              no_argument, NULL, OPT_ASQG   },
   { "ec-correct-type",         required_argument, NULL, 'K'},
   { "error-rate",              required_argument, NULL, 'e'},
@@ -264,12 +319,15 @@ static const char *RUN_USAGE_MESSAGE =
 "  -v, --verbose                        Select verbosity level (0-4). Default: 0 \n"
 "  -h, --help                           Display this help and exit\n"
 "  -p, --threads                        Use NUM threads to run svaba. Default: 1\n"
+"      --hts-threads                    Use NUM threads in a pool shared by all BAMs for BGZF (de)compression. Default: 0 (inline)\n"
 "  -a, --id-string                      String specifying the analysis ID to be used as part of ID common.\n"
 "  Main input\n"
 "  -G, --reference-genome               Path to indexed reference genome to be used by BWA-MEM.\n"
 "  -t, --case-bam                       Case BAM/CRAM/SAM file (eg tumor). Can input multiple.\n"
 "  -n, --control-bam                    (optional) Control BAM/CRAM/SAM file (eg normal). Can input multiple.\n"
 "  -k, --region                         Run on targeted intervals. Accepts BED file or Samtools-style string\n"
+"      --from-extract                   Run from a store made by svaba extract, instead of the BAMs. -t/-n not needed.\n"
+"                                       Use the same -k and -c as the extract. -L can only be raised.\n"
 "      --germline                       Sets recommended settings for case-only analysis (eg germline). (-I, -L5, assembles NM >= 3 reads)\n"
 "  Variant filtering and classification\n"
 "      --lod                            LOD cutoff to classify indel as non-REF (tests AF=0 vs AF=MaxLikelihood(AF)) [8]\n"
@@ -284,17 +342,35 @@ static const char *RUN_USAGE_MESSAGE =
 "  -x, --max-reads                      Max total read count to read in from assembly region. Set 0 to turn off. [10000]\n"
 "  -C, --max-coverage                   Max read coverage to send to assembler (per BAM). Subsample reads if exceeded. [500]\n"
 "      --no-interchrom-lookup           Skip mate lookup for inter-chr candidate events. Reduces power for translocations but less I/O.\n"
-"      --discordant-only                Only run the discordant read clustering module, skip assembly. \n"
+"      --discordant-only                Only run the discordant read clustering module, skip assembly. Without -k, and with\n"
+"                                       paired reads (a learned insert size), clusters genome-wide from one streaming pass\n"
+"                                       over each BAM. Otherwise runs in windows.\n"
 "      --num-assembly-rounds            Run assembler multiple times. > 1 will bootstrap the assembly. [2]\n"
-"      --num-to-sample                  When learning about inputs, number of reads to sample. [1000000]\n"
+"      --num-to-sample                  When learning about inputs, number of reads to sample. Spread over random windows\n"
+"                                       of the genome when the BAM is indexed, read on -p threads. [5000000]\n"
+"      --no-param-cache                 Always learn the BAM params. By default they are stored with the outputs in\n"
+"                                       <id>.<sample>.svaba_params (e.g. <id>.t000.svaba_params) and reused by a re-run with\n"
+"                                       the same -a while the BAM is unchanged.\n"
+"      --trace                          Write a timeline of each thread's regions, stages and lock waits to this file,\n"
+"                                       in the Chrome trace-event format (open in Perfetto or chrome://tracing)\n"
+"      --status                         Rewrite this file with the progress of the run (regions done, reads, the region on\n"
+"                                       each thread, queue depth, output bytes, RSS) in the Prometheus text format\n"
+"      --status-interval                Seconds between --status writes. [10]\n"
+"      --max-memory                     Memory budget in GB, checked against the summed mem_* estimates of the running windows\n"
+"                                       and buffered output (not RSS). Over it, threads wait to start new windows, windows read\n"
+"                                       fewer reads (lower -x and -C) and buffered output is written out, even with --hp. [off]\n"
+"      --max-open-bams                  Open BAMs when a window needs them, and keep at most this many open over all threads\n"
+"                                       (at least -p). Samples with no reads in a window are skipped. For many BAMs. [off]\n"
 "      --hp                             Highly parallel. Don't write output until completely done. More memory, but avoids all thread-locks.\n"
 "  Output options\n"
-"  -z, --g-zip                          Gzip and tabix the output VCF files. [off]\n"
+"  -z, --g-zip                          Gzip and tabix the output VCF files. Compressed and indexed on -p threads. [off]\n"
+"      --bcf                            Write indexed BCF files instead of VCF. [off]\n"
 "  -A, --all-contigs                    Output all contigs that were assembled, regardless of mapping or length. [off]\n"
 "      --read-tracking                  Track supporting reads by qname. Increases file sizes. [off]\n"
+"      --no-bps-file                    Don't write the bps.txt.gz file. The binary store (bps.svb, see svaba bps2txt) and VCFs are still made. [off]\n"
 "      --write-extracted-reads          For the case BAM, write reads sent to assembly to a BAM file. [off]\n"
 "  Optional external database\n"
-"  -D, --dbsnp-vcf                      DBsnp database (VCF) to compare indels against\n"
+"  -D, --dbsnp-vcf                      DBsnp database (VCF, or index from svaba dbsnp-index) to compare indels against\n"
 "  -B, --blacklist                      BED-file with blacklisted regions to not extract any reads from.\n"
 "  -Y, --microbial-genome               Path to indexed reference genome of microbial sequences to be used by BWA-MEM to filter reads.\n"
 "  -V, --germline-sv-database           BED file containing sites of known germline SVs. Used as additional filter for somatic SV detection\n"
@@ -317,10 +393,18 @@ static const char *RUN_USAGE_MESSAGE =
 "      --penalty-clip-5                 Set the BWA-MEM penalty for 5' clipping. [5]\n"
 "\n";
 
+void runExtract(int argc, char** argv) {
+  opt::extract_only = true;
+  runsvaba(argc, argv);
+}
+
 void runsvaba(int argc, char** argv) {
 
   parseRunOptions(argc, argv);
 
+  if (!opt::trace_file.empty())
+    svabaTrace::Enable();
+
   // open the output streams
   svabaUtils::fopen(opt::analysis_id + ".log", log_file);
   //  svabaUtils::fopen(opt::analysis_id + ".bad_mate_regions.bed", bad_bed);
@@ -355,6 +439,7 @@ void runsvaba(int argc, char** argv) {
     "***************************** PARAMS ****************************" << std::endl << 
     "    DBSNP Database file: " << opt::dbsnp << std::endl << 
     "    Max cov to assemble: " << opt::max_cov << std::endl <<
+    "    BGZF pool threads: " << opt::hts_threads << std::endl <<
     "    Error correction mode: " << opt::ec_correct_type << std::endl << 
     "    Subsample-rate for correction learning: " + std::to_string(opt::ec_subsample) << std::endl;
     ss << 
@@ -393,50 +478,98 @@ void runsvaba(int argc, char** argv) {
   WRITELOG(ss.str(), opt::verbose >= 1, true);
   ss.str(std::string());
   
+  // make the shared BGZF thread pool. Attached to every reader / writer after opening
+  if (opt::hts_threads > 0)
+    hts_pool = new SeqLib::ThreadPool(opt::hts_threads);
+
   // make one anyways, we check if its empty later
   ref_genome_viral = new SeqLib::RefGenome;
   microbe_bwa = nullptr;
   
   // open the microbe genome
   
-  if (!opt::microbegenome.empty()) {
+  if (!opt::microbegenome.empty() && !opt::extract_only) {
     WRITELOG("...loading the microbe reference sequence", opt::verbose > 0, true)
     microbe_bwa = new SeqLib::BWAWrapper();
     svabaUtils::__open_index_and_writer(opt::microbegenome, microbe_bwa, opt::analysis_id + ".microbe.bam", b_microbe_writer, ref_genome_viral, viral_header);  
+    if (hts_pool)
+      b_microbe_writer.SetThreadPool(*hts_pool);
   }
 
-  // open the main bam to get header info
-  if (!b_reader.Open(opt::main_bam)) {
-    if (opt::main_bam == "-")
-      std::cerr << "ERROR: Cannot read from stdin" << std::endl;
-    else
-      std::cerr << "ERROR: Cannot open main bam file: " << opt::main_bam << std::endl;
-    exit(EXIT_FAILURE);
+  if (!opt::extract_file.empty()) {
+
+    // running from an extract store. Take the header and learned params
+    // from the store, and never open the BAMs
+    svabaExtractReader er;
+    if (!er.Open(opt::extract_file)) {
+      std::cerr << "ERROR: Cannot open extract store: " << opt::extract_file << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    const ExtractParams& ep = er.Params();
+    b_header = SeqLib::BamHeader(ep.header);
+    opt::bam = ep.bams;
+    for (auto& b : opt::bam)
+      if (b.first.at(0) == 't') {
+	opt::main_bam = b.second;
+	break;
+      }
+    readlen = ep.readlen;
+    max_mapq_possible = ep.max_mapq;
+    min_dscrd_size_for_variant = ep.min_dscrd_size;
+    min_isize_for_disc = ep.min_isize_for_disc;
+
+    if ((int)opt::mate_lookup_min < ep.mate_lookup_min)
+      WRITELOG("!!!! WARNING. Mate lookup min of " + std::to_string(opt::mate_lookup_min) + " is below the extract value of " + 
+	       std::to_string(ep.mate_lookup_min) + ". Mate regions below the extract value were never read", true, true);
+
+    ss << "...loaded " << SeqLib::AddCommas(er.NumWindows()) << " windows from extract store " << opt::extract_file << std::endl;
+
+  } else {
+
+    // open the main bam to get header info
+    if (!b_reader.Open(opt::main_bam)) {
+      if (opt::main_bam == "-")
+	std::cerr << "ERROR: Cannot read from stdin" << std::endl;
+      else
+	std::cerr << "ERROR: Cannot open main bam file: " << opt::main_bam << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    
+    // then open the main header
+    b_header = b_reader.Header();
   }
 
-  // then open the main header
-  b_header = b_reader.Header();
   if (b_header.isEmpty()) {
     std::cerr << "ERROR: empty header in main bam file" << std::endl;
     exit(EXIT_FAILURE);
   }
+
+  if (!opt::status_file.empty() && !svabaStatus::Start(opt::status_file, opt::analysis_id, opt::status_interval, b_header))
+    WRITELOG("!!!! WARNING. Could not start the status reporter for " + opt::status_file, true, true);
   
-  // open some writer bams
-  if (opt::write_extracted_reads) // open the extracted reads writer
+  // open some writer bams. svaba extract only writes the store
+  if (opt::write_extracted_reads && !opt::extract_only) { // open the extracted reads writer
     svabaUtils::__openWriterBam(b_header, opt::analysis_id + ".extracted.reads.bam", er_writer);    
+    if (hts_pool)
+      er_writer.SetThreadPool(*hts_pool);
+  }
 
   // open the blacklists
   svabaUtils::__open_bed(opt::blacklist, blacklist, b_header);
+  blacklist_view = IntervalView(blacklist);
   if (blacklist.size())
     ss << "...loaded " << blacklist.size() << " blacklist regions from " << opt::blacklist << std::endl;
 
   // open the germline sv database
   svabaUtils::__open_bed(opt::germline_sv_file, germline_svs, b_header);
+  germline_view = IntervalView(germline_svs);
   if (germline_svs.size())
     ss << "...loaded " << germline_svs.size() << " germline SVs from " << opt::germline_sv_file << std::endl;
 
   // open the simple seq database
   svabaUtils::__open_bed(opt::simple_file, simple_seq, b_header);
+  simple_view = IntervalView(simple_seq);
   if (simple_seq.size())
     ss << "...loaded " << simple_seq.size() << " simple sequence regions from " << opt::simple_file << std::endl;
 
@@ -458,22 +591,36 @@ void runsvaba(int argc, char** argv) {
   if (opt::single_end) 
     goto afterlearn;
 
-  // learn bam
-  min_dscrd_size_for_variant = 0; // set a min size for what we can call with discordant reads only. 
-  for (auto& b : opt::bam) {
-    LearnBamParams parm(b.second);
-    params_map[b.first] = BamParamsMap();
-    parm.learnParams(params_map[b.first], opt::num_to_sample);
-    for (auto& i : params_map[b.first]) {
-      readlen = std::max(readlen, i.second.readlen);
-      max_mapq_possible = std::max(max_mapq_possible, i.second.max_mapq);
-      min_dscrd_size_for_variant = std::max(min_dscrd_size_for_variant, (int)std::floor(i.second.mean_isize + i.second.sd_isize * opt::sd_disc_cutoff)); 
-    }
+  // learn bam. Already have the params if running from an extract store
+  if (opt::extract_file.empty()) {
+    svabaTrace::Span span("learn params");
+    svabaStatus::Phase("learn params");
+    min_dscrd_size_for_variant = 0; // set a min size for what we can call with discordant reads only. 
+    for (auto& b : opt::bam) {
+      LearnBamParams parm(b.second, opt::param_cache ? opt::analysis_id + "." + b.first + ".svaba_params" : std::string());
+      params_map[b.first] = BamParamsMap();
+      if (parm.readCache(params_map[b.first], opt::num_to_sample)) {
+	ss << "...loaded BAM params from " << parm.cacheFile() << std::endl;
+      } else {
+	parm.learnParams(params_map[b.first], opt::num_to_sample, opt::numThreads);
+	if (opt::param_cache) {
+	  if (parm.writeCache(params_map[b.first], opt::num_to_sample))
+	    ss << "...wrote BAM params to " << parm.cacheFile() << std::endl;
+	  else
+	    ss << "...could not write BAM params to " << parm.cacheFile() << std::endl;
+	}
+      }
+      for (auto& i : params_map[b.first]) {
+        readlen = std::max(readlen, i.second.readlen);
+        max_mapq_possible = std::max(max_mapq_possible, i.second.max_mapq);
+        min_dscrd_size_for_variant = std::max(min_dscrd_size_for_variant, (int)std::floor(i.second.mean_isize + i.second.sd_isize * opt::sd_disc_cutoff)); 
+      }
 
-    ss << "BAM PARAMS FOR: " << b.first << "--" << b.second << std::endl;
-    for (auto& i : params_map[b.first])
-      ss << i.second << std::endl;
-    ss << " min_dscrd_size_for_variant " << min_dscrd_size_for_variant << std::endl;
+      ss << "BAM PARAMS FOR: " << b.first << "--" << b.second << std::endl;
+      for (auto& i : params_map[b.first])
+        ss << i.second << std::endl;
+      ss << " min_dscrd_size_for_variant " << min_dscrd_size_for_variant << std::endl;
+    }
   }
 
   // check if differing read lengths or max mapq
@@ -534,7 +681,11 @@ afterlearn:
 
   // open the reference for reading seqeuence
   ref_genome = new SeqLib::RefGenome;
-  svabaUtils::__open_index_and_writer(opt::refgenome, main_bwa, opt::analysis_id + ".contigs.bam", b_contig_writer, ref_genome, bwa_header);
+  // svaba extract needs the index for the discordant realignments, but writes no contigs
+  svabaUtils::__open_index_and_writer(opt::refgenome, main_bwa, opt::extract_only ? std::string() : opt::analysis_id + ".contigs.bam",
+				      b_contig_writer, ref_genome, bwa_header);
+  if (hts_pool)
+    b_contig_writer.SetThreadPool(*hts_pool);
   if (ref_genome->IsEmpty()) {
     std::cerr << "ERROR: Unable to open index file: " << opt::refgenome << std::endl;
     exit(EXIT_FAILURE);
@@ -597,24 +748,69 @@ afterlearn:
     exit(EXIT_FAILURE);
   }
 
-  // open the text files
-  svabaUtils::fopen(opt::analysis_id + ".alignments.txt.gz", all_align);
-  svabaUtils::fopen(opt::analysis_id + ".bps.txt.gz", os_allbps);
-  svabaUtils::fopen(opt::analysis_id + ".discordant.txt.gz", os_discordant);
-  if (opt::write_extracted_reads) 
-    svabaUtils::fopen(opt::analysis_id + ".corrected.fa.gz", os_corrected); 
-  
-  // write the headers to the text files
-  os_allbps << BreakPoint::header();
-  for (auto& b : opt::bam) 
-    os_allbps << "\t" << b.first << "_" << b.second;
-  os_allbps << std::endl;
-  os_discordant << DiscordantCluster::header() << std::endl;
+  if (opt::extract_only) {
+
+    // open the extract store instead of the text files
+    ExtractParams ep;
+    ep.header = b_header.AsString();
+    ep.bams = opt::bam;
+    ep.readlen = readlen;
+    ep.max_mapq = max_mapq_possible;
+    ep.min_dscrd_size = min_dscrd_size_for_variant;
+    ep.min_isize_for_disc = min_isize_for_disc;
+    ep.mate_lookup_min = opt::mate_lookup_min;
+
+    extract_writer = new svabaExtractWriter();
+    if (!extract_writer->Open(opt::analysis_id + ".extract.svx", ep)) {
+      std::cerr << "ERROR: Cannot open extract store for writing: " << opt::analysis_id << ".extract.svx" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+  } else {
+
+    // open the text files
+    svabaUtils::fopen(opt::analysis_id + ".alignments.txt.gz", all_align);
+    svabaUtils::fopen(opt::analysis_id + ".discordant.txt.gz", os_discordant);
+    if (opt::write_extracted_reads) 
+      svabaUtils::fopen(opt::analysis_id + ".corrected.fa.gz", os_corrected); 
+    
+    // write the headers to the text files
+    if (!opt::no_bps_file) {
+      svabaUtils::fopen(opt::analysis_id + ".bps.txt.gz", os_allbps);
+      os_allbps << BreakPoint::header();
+      for (auto& b : opt::bam) 
+	os_allbps << "\t" << b.first << "_" << b.second;
+      os_allbps << std::endl;
+    }
+    os_discordant << DiscordantCluster::header() << std::endl;
+
+    std::vector<std::string> ids, names;
+    for (auto& b : opt::bam) {
+      ids.push_back(b.first);
+      names.push_back(b.first + "_" + b.second);
+    }
+    bps_store = new BreakPointStoreWriter();
+    if (!bps_store->Open(opt::analysis_id + ".bps.svb", ids, names)) {
+      std::cerr << "ERROR: Could not open breakpoint store " << opt::analysis_id << ".bps.svb" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // per-region stage timings and counts
+  if (!opt::extract_only) {
+    svabaUtils::fopen(opt::analysis_id + ".metrics.tsv.gz", os_metrics);
+    os_metrics << svabaUtils::svabaRegionMetrics::header(svabaUtils::svabaTimer()) << std::endl;
+  }
+  pthread_mutex_init(&metrics_lock, NULL);
 
   // put args into string for VCF later
   for (int i = 0; i < argc; ++i)
     args += std::string(argv[i]) + " ";
 
+  // breakpoints go to the VCF as they are written out
+  if (!opt::extract_only)
+    stream_vcf = new VCFFile(opt::analysis_id, __make_vcf_header(), !opt::no_unfiltered);
+
   // start the timer
 #ifndef __APPLE__
   clock_gettime(CLOCK_MONOTONIC, &start);
@@ -622,7 +818,20 @@ afterlearn:
 
   // send the jobs to the queue
   WRITELOG("--- Loaded non-read data. Starting detection pipeline", true, true);
-  sendThreads(regions_torun);
+  double detect_start = svabaTrace::Now();
+  svabaStatus::Phase("detection");
+  if (opt::disc_cluster_only && opt::regionFile.empty() && opt::extract_file.empty() && !opt::extract_only && min_dscrd_size_for_variant)
+    runDiscordantStream();
+  else
+    sendThreads(regions_torun);
+  svabaTrace::Complete("detection", detect_start, svabaTrace::Now());
+
+  if (extract_writer) {
+    extract_writer->Close();
+    delete extract_writer;
+    extract_writer = nullptr;
+    WRITELOG("...wrote extract store " + opt::analysis_id + ".extract.svx", true, true);
+  }
 
   if (microbe_bwa)
     delete microbe_bwa;
@@ -643,10 +852,20 @@ afterlearn:
 
   // close the files
   all_align.close();
-  os_allbps.close();
+  if (!opt::no_bps_file)
+    os_allbps.close();
+  if (bps_store) {
+    bps_store->Close();
+    delete bps_store;
+    bps_store = nullptr;
+  }
   os_discordant.close();
   if (opt::write_corrected_reads) 
     os_corrected.close();
+  if (!opt::extract_only)
+    os_metrics.close();
+  __write_region_report(); // nothing to report for svaba extract
+  pthread_mutex_destroy(&metrics_lock);
   log_file.close();
 
   // more clean up 
@@ -656,38 +875,34 @@ afterlearn:
     delete ref_genome_viral;
   
   // make the VCF file
-  makeVCFs();
+  if (!opt::extract_only) {
+    double vcf_start = svabaTrace::Now();
+    svabaStatus::Phase("make vcfs");
+    makeVCFs();
+    svabaTrace::Complete("make vcfs", vcf_start, svabaTrace::Now());
+  }
+
+  if (!opt::trace_file.empty()) {
+    if (svabaTrace::Write(opt::trace_file, b_header))
+      std::cerr << "...wrote trace " << opt::trace_file << std::endl;
+    else
+      std::cerr << "ERROR: Could not write trace " << opt::trace_file << std::endl;
+  }
+
+  svabaStatus::Stop();
   
 #ifndef __APPLE__
   //  std::cerr << SeqLib::displayRuntime(start) << std::endl;
 #endif
 }
 
-void makeVCFs() {
+VCFHeader __make_vcf_header() {
 
-  if (opt::bam.size() == 0) {
-    std::cerr << "makeVCFs error: must supply a BAM via -t to get header from" << std::endl;
-    exit(EXIT_FAILURE);
-  }
-
-  if (!b_reader.IsOpen())     // open the tumor bam to get header info
-    b_reader.Open(opt::bam.begin()->second);
-    
-  // make the VCF file
-  WRITELOG("...loading the bps files for conversion to VCF", opt::verbose, true);
-
-  std::string file = opt::analysis_id + ".bps.txt.gz";
-  //if (!SeqLib::read_access_test(file))
-  //  file = opt::analysis_id + ".bps.txt";
-
-  // make the header
   VCFHeader header;
   header.filedate = svabaUtils::fileDateString();
   header.source = args;
   header.reference = opt::refgenome;
 
-  if (main_bwa)
-    delete main_bwa;  
   if (!bwa_header.isEmpty())
     for (int i = 0; i < bwa_header.NumSequences(); ++i)
       header.addContigField(bwa_header.IDtoName(i),bwa_header.GetSequenceLength(i));
@@ -698,29 +913,56 @@ void makeVCFs() {
     header.colnames += "\t" + fname; 
   }
 
-  // primary VCFs
-  if (SeqLib::read_access_test(file)) {
-    WRITELOG("...making the primary VCFs (unfiltered and filtered) from file " + file, opt::verbose, true);
-    VCFFile snowvcf(file, opt::analysis_id, b_header, header, !opt::no_unfiltered);
+  return header;
+}
 
-    if (!opt::no_unfiltered) {
-      std::string basename = opt::analysis_id + ".svaba.unfiltered.";
-      snowvcf.include_nonpass = true;
-      WRITELOG("...writing unfiltered VCFs", opt::verbose, true);
-      snowvcf.writeIndels(basename, opt::zip, opt::bam.size() == 1);
-      snowvcf.writeSVs(basename, opt::zip, opt::bam.size() == 1);
-    }
+void makeVCFs() {
 
-    WRITELOG("...writing filtered VCFs", opt::verbose, true);
-    std::string basename = opt::analysis_id + ".svaba.";
-    snowvcf.include_nonpass = false;
-    snowvcf.writeIndels(basename, opt::zip, opt::bam.size() == 1);
-    snowvcf.writeSVs(basename, opt::zip, opt::bam.size() == 1);
+  if (opt::bam.size() == 0) {
+    std::cerr << "makeVCFs error: must supply a BAM via -t to get header from" << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
-  } else {
-    WRITELOG("ERROR: Failed to make VCF. Could not file bps file " + file, true, true);
+  if (main_bwa)
+    delete main_bwa;  
+
+  if (!stream_vcf) {
+    WRITELOG("ERROR: Failed to make VCF. No breakpoints were collected", true, true);
+    return;
   }
 
+  // primary VCFs. The breakpoints were added as they were written out,
+  // so all that is left is the cross-window dedupe
+  WRITELOG("...making the primary VCFs (unfiltered and filtered)", opt::verbose, true);
+  stream_vcf->num_threads = opt::numThreads;
+  if (opt::bcf)
+    stream_vcf->hts_mode = "wb";
+  else if (opt::zip)
+    stream_vcf->hts_mode = "wz";
+  stream_vcf->finalize();
+
+  if (!opt::no_unfiltered) {
+    std::string basename = opt::analysis_id + ".svaba.unfiltered.";
+    stream_vcf->include_nonpass = true;
+    WRITELOG("...writing unfiltered VCFs", opt::verbose, true);
+    if (!stream_vcf->writeIndels(basename, opt::zip, opt::bam.size() == 1) ||
+	!stream_vcf->writeSVs(basename, opt::zip, opt::bam.size() == 1)) {
+      WRITELOG("ERROR: Failed to write the unfiltered VCFs " + basename + "*", true, true);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  WRITELOG("...writing filtered VCFs", opt::verbose, true);
+  std::string basename = opt::analysis_id + ".svaba.";
+  stream_vcf->include_nonpass = false;
+  if (!stream_vcf->writeIndels(basename, opt::zip, opt::bam.size() == 1) ||
+      !stream_vcf->writeSVs(basename, opt::zip, opt::bam.size() == 1)) {
+    WRITELOG("ERROR: Failed to write the VCFs " + basename + "*", true, true);
+    exit(EXIT_FAILURE);
+  }
+
+  delete stream_vcf;
+  stream_vcf = nullptr;
 }
 
 // parse the command line options
@@ -741,6 +983,8 @@ void parseRunOptions(int argc, char** argv) {
     switch (c) {
     case 'E' : arg >> opt::ec_subsample; break;
     case 'p': arg >> opt::numThreads; break;
+    case OPT_HTS_THREADS: arg >> opt::hts_threads; break;
+    case OPT_FROM_EXTRACT: arg >> opt::extract_file; break;
     case 'm': arg >> opt::sga::minOverlap; break;
     case 'a': arg >> opt::analysis_id; break;
     case 'B': arg >> opt::blacklist; break;
@@ -775,6 +1019,8 @@ void parseRunOptions(int argc, char** argv) {
     case OPT_ASQG: opt::sga::writeASQG = true; break;
     case OPT_LOD: arg >> opt::lod; break;
     case OPT_NO_UNFILTERED: opt::no_unfiltered = true; break;
+    case OPT_NO_BPS_FILE: opt::no_bps_file = true; break;
+    case OPT_BCF: opt::bcf = true; break;
     case OPT_LOD_DB: arg >> opt::lod_db; break;
     case OPT_LOD_SOMATIC: arg >> opt::lod_somatic; break;
     case OPT_LOD_SOMATIC_DB: arg >> opt::lod_somatic_db; break;
@@ -782,6 +1028,12 @@ void parseRunOptions(int argc, char** argv) {
     case OPT_SCALE_ERRORS: arg >> opt::scale_error; break;
     case 'C': arg >> opt::max_cov;  break;
     case OPT_NUM_TO_SAMPLE: arg >> opt::num_to_sample;  break;
+    case OPT_NO_PARAM_CACHE: opt::param_cache = false; break;
+    case OPT_TRACE: arg >> opt::trace_file; break;
+    case OPT_STATUS: arg >> opt::status_file; break;
+    case OPT_STATUS_INTERVAL: arg >> opt::status_interval; break;
+    case OPT_MAX_MEMORY: arg >> opt::max_memory; break;
+    case OPT_MAX_OPEN_BAMS: arg >> opt::max_open_bams; break;
     case OPT_READ_TRACK: opt::read_tracking = true; break;
 	case 't': 
 	  tmp = svabaUtils::__bamOptParse(opt::bam, arg, sample_number++, "t");
@@ -822,8 +1074,13 @@ void parseRunOptions(int argc, char** argv) {
     exit(EXIT_FAILURE);
   }
 
+  if (opt::extract_only && !opt::extract_file.empty()) {
+    WRITELOG("ERROR: --from-extract can't be used with svaba extract", true, true);
+    exit(EXIT_FAILURE);
+  }
+
   // check that we input something
-  if (opt::bam.size() == 0 && !die) {
+  if (opt::bam.size() == 0 && opt::extract_file.empty() && !die) {
     WRITELOG("Must add a bam file with -t flag. stdin with -t -", true, true);
     exit(EXIT_FAILURE);
   }
@@ -833,6 +1090,22 @@ void parseRunOptions(int argc, char** argv) {
     die = true;
   }
 
+  if (opt::hts_threads < 0) {
+    WRITELOG("Invalid number of threads from --hts-threads flag: " + SeqLib::AddCommas(opt::hts_threads), true, true);
+    die = true;
+  }
+
+  if (opt::max_memory < 0) {
+    WRITELOG("Invalid memory budget from --max-memory flag: " + std::to_string(opt::max_memory), true, true);
+    die = true;
+  }
+  svabaMemory::SetBudget(opt::max_memory * 1024 * 1024 * 1024);
+
+  if (opt::max_open_bams < 0) {
+    WRITELOG("Invalid number of BAMs from --max-open-bams flag: " + SeqLib::AddCommas(opt::max_open_bams), true, true);
+    die = true;
+  }
+
   if (die || help) 
     {
       std::cerr << "\n" << RUN_USAGE_MESSAGE;
@@ -843,9 +1116,128 @@ void parseRunOptions(int argc, char** argv) {
     }
 }
 
+// bytes of output held on the thread until the next WriteFilesOut
+static size_t __work_unit_bytes(const svabaWorkUnit& wu) {
+  size_t b = svabaMemory::Bytes(wu.m_contigs) + svabaMemory::Bytes(wu.m_vir_contigs) + svabaMemory::Bytes(wu.m_bps);
+  for (auto& a : wu.m_alc)
+    b += a.Bytes();
+  for (auto& d : wu.m_disc)
+    for (auto& r : d.second.reads)
+      b += svabaMemory::Bytes(r.second);
+  return b;
+}
+
+// one window, for the end of run region report
+struct RegionReport {
+  SeqLib::GenomicRegion region;
+  double wall, cpu;
+  std::map<std::string, int> sample_reads;
+  int num_mate_lookups;
+  SeqLib::GRC mate_capped;
+  std::string caps;
+};
+static std::vector<RegionReport> region_reports; // guarded by metrics_lock
+
+static void __write_metrics(const SeqLib::GenomicRegion& region, const svabaUtils::svabaTimer& st, 
+			    const svabaUtils::svabaRegionMetrics& m, long unsigned int thread_id) {
+  std::string line = m.toFileString(region, b_header, st, thread_id);
+  RegionReport r = {region, st.totalWall(), st.totalCPU(), m.sample_reads, m.num_mate_lookups, m.mate_capped, m.caps()};
+  pthread_mutex_lock(&metrics_lock);
+  os_metrics << line << "\n";
+  region_reports.push_back(r);
+  pthread_mutex_unlock(&metrics_lock);
+}
+
+static std::string __report_chr(const SeqLib::GenomicRegion& gr) {
+  // throws out of range if there is mismatch between main header and other headers
+  try {
+    return gr.ChrName(b_header);
+  } catch (...) {
+    return std::to_string(gr.chr);
+  }
+}
+
+// write <id>.regions.tsv (every window, slowest first) and
+// <id>.suggested_blacklist.bed (windows that were slow or hit a limit)
+static void __write_region_report() {
+
+  std::vector<RegionReport>& rr = region_reports;
+  if (rr.empty())
+    return;
+
+  std::sort(rr.begin(), rr.end(), [](const RegionReport& a, const RegionReport& b) {
+      return a.wall > b.wall;
+    });
+
+  std::set<std::string> samples;
+  for (auto& r : rr)
+    for (auto& s : r.sample_reads)
+      samples.insert(s.first);
+
+  std::ofstream os_regions;
+  svabaUtils::fopen(opt::analysis_id + ".regions.tsv", os_regions);
+  os_regions << "chr\tpos1\tpos2\twall_sec\tcpu_sec";
+  for (auto& s : samples)
+    os_regions << "\treads_" << s;
+  os_regions << "\tmate_lookups\tmate_regions_capped\tcaps" << std::endl;
+
+  for (auto& r : rr) {
+    if (r.region.IsEmpty())
+      os_regions << "ALL\t0\t0";
+    else
+      os_regions << __report_chr(r.region) << "\t" << r.region.pos1 << "\t" << r.region.pos2;
+    os_regions << "\t" << r.wall << "\t" << r.cpu;
+    for (auto& s : samples) {
+      auto ff = r.sample_reads.find(s);
+      os_regions << "\t" << (ff == r.sample_reads.end() ? 0 : ff->second);
+    }
+    os_regions << "\t" << r.num_mate_lookups << "\t" << r.mate_capped.size() << "\t" << r.caps << "\n";
+  }
+  os_regions.close();
+
+  // median is over the windows, which are sorted slowest first
+  double median = rr[rr.size() / 2].wall;
+  double slow = std::max(median * REPORT_SLOW_FACTOR, (double)REPORT_SLOW_MIN_SEC);
+
+  std::ofstream os_bl;
+  svabaUtils::fopen(opt::analysis_id + ".suggested_blacklist.bed", os_bl);
+  size_t count = 0;
+  SeqLib::GRC mates;
+  for (auto& r : rr) {
+    if (r.region.IsEmpty())
+      continue;
+    std::string reason;
+    if (r.wall >= slow)
+      reason = "slow:" + std::to_string((int)r.wall) + "s";
+    // limits hit by the window itself. Capped mate regions are listed on their own
+    std::istringstream caps(r.caps);
+    for (std::string c; std::getline(caps, c, ',');)
+      if (c != "." && c != "mate_limit")
+	reason += (reason.empty() ? "" : ",") + c;
+    mates.Concat(r.mate_capped);
+    if (reason.empty())
+      continue;
+    os_bl << __report_chr(r.region) << "\t" << r.region.pos1 << "\t" << r.region.pos2 << "\t" << reason << "\n";
+    ++count;
+  }
+
+  // mate regions too deep to read in are usually repeats, and are seen from many windows
+  mates.MergeOverlappingIntervals();
+  mates.CoordinateSort();
+  for (auto& m : mates) {
+    os_bl << __report_chr(m) << "\t" << m.pos1 << "\t" << m.pos2 << "\tmate_limit\n";
+    ++count;
+  }
+  os_bl.close();
+
+  WRITELOG("...wrote region report " + opt::analysis_id + ".regions.tsv and " + std::to_string(count) +
+	   " suggested blacklist regions to " + opt::analysis_id + ".suggested_blacklist.bed", true, true);
+}
+
 bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long unsigned int thread_id) {
   
   WRITELOG("Running region " + region.ToString() + " on thread " + std::to_string(thread_id), opt::verbose > 1, true);
+  svabaTrace::Span span("region", region.chr, region.pos1, region.pos2);
 
   for (auto& w : wu.walkers)
     set_walker_params(w.second);
@@ -865,13 +1257,45 @@ bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long un
   // start a timer
   svabaUtils::svabaTimer st;
   st.start();
+  svabaUtils::svabaRegionMetrics metrics;
+  metrics.mem_output = __work_unit_bytes(wu); // from earlier windows, until written
 
   // setup for the BAM walkers
   CountPair read_counts = {0,0};
 
+  // setup read collectors
+  CigarIndexMap cigmap;
+  std::vector<char*> all_seqs;
+  SeqLib::BamRecordVector bav_this;
+  std::unordered_set<std::string> dedupe;
+  size_t num_main_reads = 0;
+  MateRegionVector looked_up_mate_regions;
+
+  // running from an extract store, so load instead of reading the BAMs
+  if (wu.extract) {
+    if (!__load_extract_window(region, wu, bav_this, all_seqs, cigmap, read_counts, metrics.sample_reads, bfc)) {
+      WRITELOG("...window " + region.ToString() + " not found in extract store. Skipping", opt::verbose, true);
+      if (bfc)
+	delete bfc;
+      return true;
+    }
+    st.stop("r");
+    metrics.num_t_reads = read_counts.first;
+    metrics.num_n_reads = read_counts.second;
+    goto afterreadin;
+  }
+
   // read in alignments from the main region
   for (auto& w : wu.walkers) {
 
+    // open the BAM through the pool, unless it has nothing here
+    if (reader_pool) {
+      if (!reader_pool->HasReads(w.first, region))
+	continue;
+      if (!reader_pool->Checkout(w.second))
+	ERROR_EXIT("ERROR: Could not open the BAM of " + w.first + " through the reader pool (--max-open-bams)");
+    }
+
     // set the region to jump to
     if (!region.IsEmpty()) {
       w.second.SetRegion(region);
@@ -884,11 +1308,17 @@ bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long un
     }
 
     // do the reading, and store the bad mate regions
-    wu.badd.Concat(w.second.readBam(&log_file));
+    SeqLib::GRC capped = w.second.readBam(&log_file);
+    metrics.read_capped = metrics.read_capped || capped.size();
+    wu.badd.Concat(capped);
     wu.badd.MergeOverlappingIntervals();
     wu.badd.CreateTreeMap();
+    if (reader_pool)
+      reader_pool->Return(w.second);
     
     // adjust the counts
+    svabaStatus::AddReads(w.first, w.second.reads.size());
+    metrics.sample_reads[w.first] = w.second.reads.size();
     if (w.first.at(0) == 't') {
       read_counts.first += w.second.reads.size();
     } else {
@@ -897,30 +1327,55 @@ bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long un
 
   }
 
-  // collect all of the cigar strings in a hash
-  std::unordered_map<std::string, SeqLib::CigarMap> cigmap;
+  // collect all of the indel cigar counts, per sample
   for (const auto& w : wu.walkers) 
-    cigmap[w.first] = w.second.cigmap;
-
-  // setup read collectors
-  std::vector<char*> all_seqs;
-  SeqLib::BamRecordVector bav_this;
+    cigmap[w.first].merge(w.second.cigmap);
 
   // collect and clear reads from main round
-  std::unordered_set<std::string> dedupe;
   collect_and_clear_reads(wu.walkers, bav_this, all_seqs, dedupe);
+  num_main_reads = bav_this.size();
 
   // adjust counts and timer
   st.stop("r");
+  metrics.num_t_reads = read_counts.first;
+  metrics.num_n_reads = read_counts.second;
 
   // get the mate reads, if this is local assembly and has insert-size distro
   if (!region.IsEmpty() && !opt::single_end && min_dscrd_size_for_variant) {
-    run_mate_collection_loop(region, wu.walkers, wu.badd);
+    CountPair mate_counts = run_mate_collection_loop(region, wu.walkers, wu.badd, &looked_up_mate_regions, &metrics.mate_capped);
+    metrics.num_mate_reads = mate_counts.first + mate_counts.second;
+    metrics.num_mate_lookups = looked_up_mate_regions.size();
+    svabaStatus::AddMateReads(metrics.num_mate_reads);
     // collect the reads together from the mate walkers
     collect_and_clear_reads(wu.walkers, bav_this, all_seqs, dedupe);
     st.stop("m");
   }
-  
+
+  // svaba extract. Store the read-in stage for this window and stop
+  if (extract_writer) {
+    __write_extract_window(region, wu.walkers, bav_this, cigmap, num_main_reads, looked_up_mate_regions);
+    for (auto& i : all_seqs)
+      free(i);
+    if (bfc)
+      delete bfc;
+    st.stop("pp");
+    WRITELOG(svabaUtils::runTimeString(read_counts.first, read_counts.second, 0, region, b_header, st, start), opt::verbose > 1, true);
+    for (auto& w : wu.walkers) {
+      w.second.clear(); 
+      w.second.m_limit = opt::max_reads_per_assembly;
+    }
+    return true;
+  }
+
+ afterreadin:
+
+  // memory held for this window by the reads, coverage and indel counts
+  metrics.mem_walker = svabaMemory::Bytes(bav_this);
+  for (auto& w : wu.walkers)
+    metrics.mem_coverage += w.second.cov.Bytes() + w.second.weird_cov.Bytes();
+  for (auto& c : cigmap)
+    metrics.mem_cigmap += c.second.Bytes();
+  svabaMemory::Account(wu.m_mem_held, metrics.mem_total());
 
   // do the discordant read clustering
   DiscordantClusterMap dmap, dmap_tmp;
@@ -942,14 +1397,16 @@ bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long un
     if (below_size && (d.second.tcount + d.second.ncount) < 4)
       continue;
     else
-      dmap_tmp.insert(std::pair<std::string, DiscordantCluster>(d.first, d.second));
+      dmap_tmp.insert(std::pair<std::string, DiscordantCluster>(d.first, std::move(d.second)));
   }
-  dmap = dmap_tmp;
+  dmap.swap(dmap_tmp);
 
   // print out results
   if (opt::verbose > 3)
     for (auto& i : dmap) 
       WRITELOG(i.first + " " + i.second.toFileString(false), true, false);
+  metrics.num_disc_clusters = dmap.size();
+  st.stop("d");
 
  afterdiscclustering:
   
@@ -971,6 +1428,7 @@ bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long un
   if (bav_this.size() > (size_t)(region.Width() * 20) && region.Width() > 20000) {
     std::stringstream ssss;
     WRITELOG("TOO MANY READS IN REGION " + SeqLib::AddCommas(bav_this.size()) + "\t" + region.ToString(), opt::verbose, false);
+    metrics.too_many_reads = true;
     goto afterassembly;
   }
 
@@ -1010,11 +1468,16 @@ bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long un
   
   // do the assembly, contig realignment, contig local realignment, and read realignment
   // modifes bav_this, alc, all_contigs and all_microbial_contigs
-  run_assembly(region, bav_this, alc, all_contigs, all_microbial_contigs, dmap, cigmap, wu.ref_genome);
+  metrics.mem_assembly = svabaMemory::AssemblyBytes(bav_this);
+  svabaMemory::Account(wu.m_mem_held, metrics.mem_total());
+  run_assembly(region, bav_this, alc, all_contigs, all_microbial_contigs, dmap, cigmap, wu.ref_genome, st, metrics);
 
 afterassembly:
   
   st.stop("as");
+  metrics.num_contigs = alc.size();
+  for (auto& a : alc)
+    metrics.mem_alignment += a.Bytes();
   WRITELOG("...done assembling, post processing", opt::verbose > 1, false);
 
   // get the breakpoints
@@ -1022,7 +1485,7 @@ afterassembly:
   
   for (auto& i : alc) {
     std::vector<BreakPoint> allbreaks = i.getAllBreakPoints();
-    bp_glob.insert(bp_glob.end(), allbreaks.begin(), allbreaks.end());
+    bp_glob.insert(bp_glob.end(), std::make_move_iterator(allbreaks.begin()), std::make_move_iterator(allbreaks.end()));
   }
 
   if (dbsnp_filter && opt::dbsnp.length()) {
@@ -1032,8 +1495,9 @@ afterassembly:
   }
 
   // filter against blacklist
+  IntervalCursor bl_cursor(&blacklist_view);
   for (auto& i : bp_glob) 
-    i.checkBlacklist(blacklist);
+    i.checkBlacklist(bl_cursor);
 
   // add in the discordant clusters as breakpoints
   for (auto& i : dmap) {
@@ -1043,14 +1507,12 @@ afterassembly:
       i.second.m_reg1.chr == i.second.m_reg2.chr;
     // DiscordantCluster not associated with assembly BP and has 2+ read support
     if (!i.second.hasAssociatedAssemblyContig() && (i.second.tcount + i.second.ncount) > 1 && i.second.valid() && !below_size) {
-      BreakPoint tmpbp(i.second, main_bwa, dmap, region);
-      bp_glob.push_back(tmpbp);
+      bp_glob.emplace_back(i.second, main_bwa, dmap, region);
     }
   }
   
   // de duplicate the breakpoints
-  std::sort(bp_glob.begin(), bp_glob.end());
-  bp_glob.erase( std::unique( bp_glob.begin(), bp_glob.end() ), bp_glob.end() );
+  BreakPoint::sortUnique(bp_glob);
 
   // add the coverage data to breaks for allelic fraction computation
   std::unordered_map<std::string, STCoverage*> covs;
@@ -1060,36 +1522,40 @@ afterassembly:
   for (auto& i : bp_glob)
     i.addCovs(covs);
 
+  std::vector<BreakPoint*> to_score;
+  to_score.reserve(bp_glob.size());
   for (auto& i : bp_glob) {
     i.readlen = readlen; // set the readlength
-    i.scoreBreakpoint(opt::lod, opt::lod_db, opt::lod_somatic, opt::lod_somatic_db, opt::scale_error, min_dscrd_size_for_variant);
+    to_score.push_back(&i);
   }
+  BreakPoint::scoreBreakpoints(to_score, opt::lod, opt::lod_db, opt::lod_somatic, opt::lod_somatic_db, opt::scale_error, min_dscrd_size_for_variant);
 
   // label somatic breakpoints that intersect directly with normal as NOT somatic
-  std::unordered_set<std::string> norm_hash;
+  std::unordered_set<int64_t> norm_hash;
   for (auto& i : bp_glob) // hash the normals
     if (!i.somatic_score && i.confidence == "PASS" && i.evidence == "INDEL") {
-      norm_hash.insert(i.b1.hash());
-      norm_hash.insert(i.b2.hash());
-      norm_hash.insert(i.b1.hash(1));
-      norm_hash.insert(i.b1.hash(-1));
+      norm_hash.insert(i.b1.key());
+      norm_hash.insert(i.b2.key());
+      norm_hash.insert(i.b1.key(1));
+      norm_hash.insert(i.b1.key(-1));
     }
 
   // find somatic that intersect with norm. Set somatic = 0;
   for (auto& i : bp_glob)  
-    if (i.somatic_score && i.evidence == "INDEL" && (norm_hash.count(i.b1.hash()) || norm_hash.count(i.b2.hash()))) {
+    if (i.somatic_score && i.evidence == "INDEL" && (norm_hash.count(i.b1.key()) || norm_hash.count(i.b2.key()))) {
       i.somatic_score = -3;
     }
 
   // remove indels at repeats that have multiple variants
-  std::unordered_map<std::string, size_t> ccc;
+  std::unordered_map<int64_t, size_t> ccc;
   for (auto& i : bp_glob) {
     if (i.evidence == "INDEL" && i.repeat_seq.length() > 6) {
-      ++ccc[i.b1.hash()];
+      ++ccc[i.b1.key()];
     }
   }
   for (auto& i : bp_glob) {
-    if (ccc[i.b1.hash()] > 1)
+    auto ff = ccc.find(i.b1.key());
+    if (ff != ccc.end() && ff->second > 1)
       i.confidence = "REPVAR";
   }
 
@@ -1108,13 +1574,14 @@ afterassembly:
 
   // remove somatic SVs that overlap with germline svs
   if (germline_svs.size()) {
+    IntervalCursor gl_cursor(&germline_view);
     for (auto& i : bp_glob) {
       if (i.somatic_score && i.b1.gr.chr == i.b2.gr.chr && i.evidence != "INDEL") {
 	SeqLib::GenomicRegion gr1 = i.b1.gr;
 	SeqLib::GenomicRegion gr2 = i.b2.gr;
 	gr1.Pad(GERMLINE_CNV_PAD);
 	gr2.Pad(GERMLINE_CNV_PAD);
-	if (germline_svs.OverlapSameInterval(gr1, gr2)) {
+	if (gl_cursor.overlapsSameInterval(gr1, gr2)) {
 	  i.somatic_score = -1;
 	}
       }
@@ -1126,36 +1593,46 @@ afterassembly:
   // WHY IS THIS NOT THREAD SAFE?
   for (auto& i : bp_glob)
     i.setRefAlt(wu.ref_genome, wu.vir_genome);
+  metrics.num_bps = bp_glob.size();
+  metrics.mem_bps = svabaMemory::Bytes(bp_glob);
+  svabaMemory::Account(wu.m_mem_held, metrics.mem_total());
+  st.stop("sc");
 
-  // transfer local versions to thread store
+  // transfer local versions to thread store. These are moved, so count
+  // the reads first
   for (const auto& a : alc)
+    wu.m_bamreads_count += a.NumBamReads();
+  for (auto& a : alc)
     if (a.hasVariant()) {
-      wu.m_alc.push_back(a);
       wu.m_bamreads_count += a.NumBamReads();
+      wu.m_alc.push_back(std::move(a));
     }
   for (const auto& d : dmap)
     wu.m_disc_reads += d.second.reads.size();
   
-  wu.m_contigs.insert(wu.m_contigs.end(), all_contigs.begin(), all_contigs.end());
-  wu.m_vir_contigs.insert(wu.m_vir_contigs.end(), all_microbial_contigs.begin(), all_microbial_contigs.end());
-  wu.m_disc.insert(dmap.begin(), dmap.end());
-  for (const auto& a : alc)
-    wu.m_bamreads_count += a.NumBamReads();
+  wu.m_contigs.insert(wu.m_contigs.end(), std::make_move_iterator(all_contigs.begin()), std::make_move_iterator(all_contigs.end()));
+  wu.m_vir_contigs.insert(wu.m_vir_contigs.end(), std::make_move_iterator(all_microbial_contigs.begin()), std::make_move_iterator(all_microbial_contigs.end()));
+  wu.m_disc.insert(std::make_move_iterator(dmap.begin()), std::make_move_iterator(dmap.end()));
   for (auto& i : bp_glob) 
-    if ( i.hasMinimal() && (i.confidence != "NOLOCAL" || i.complex_local ) ) 
-      wu.m_bps.push_back(i);
+    if ( i.hasMinimal() && (i.confidence != "NOLOCAL" || i.complex_local ) ) {
+      wu.m_bps.push_back(std::move(i));
+      ++metrics.num_bps_kept;
+    }
+  metrics.mem_output = __work_unit_bytes(wu);
+  st.stop("pp");
   
-  // dump if getting to much memory
-  if (wu.MemoryLimit(THREAD_READ_LIMIT, THREAD_CONTIG_LIMIT) && !opt::hp) {
+  // dump if getting to much memory. Time under the shared lock is output wait.
+  // Over the memory budget, dump even in --hp mode
+  if ((wu.MemoryLimit(THREAD_READ_LIMIT, THREAD_CONTIG_LIMIT) && !opt::hp) || svabaMemory::Pressure()) {
     WRITELOG("writing contigs etc on thread " + std::to_string(thread_id) + " with limit hit of " + std::to_string(wu.m_bamreads_count), opt::verbose > 1, true);
-    pthread_mutex_lock(&snow_lock);    
+    svabaTrace::Lock(&snow_lock, "snow_lock wait");    
     WriteFilesOut(wu); 
     pthread_mutex_unlock(&snow_lock);
   }
   
   // write extracted reads
   if (opt::write_extracted_reads) {
-    pthread_mutex_lock(&snow_lock);    
+    svabaTrace::Lock(&snow_lock, "snow_lock wait");    
     for (auto& r : bav_this)
       er_writer.WriteRecord(r);
     pthread_mutex_unlock(&snow_lock);
@@ -1163,7 +1640,7 @@ afterassembly:
   
   // write the raw error corrected reads to a fasta
   if (opt::write_corrected_reads) {
-    pthread_mutex_lock(&snow_lock);    
+    svabaTrace::Lock(&snow_lock, "snow_lock wait");    
     for (auto& r : bav_this) {
       std::string seq = r.GetZTag("KC");
       if (seq.empty())
@@ -1173,7 +1650,9 @@ afterassembly:
     pthread_mutex_unlock(&snow_lock);
   }
 
-  st.stop("pp");
+  st.stop("w");
+  metrics.rss = svabaMemory::RSS();
+  __write_metrics(region, st, metrics, thread_id);
   
   // display the run time
   WRITELOG(svabaUtils::runTimeString(read_counts.first, read_counts.second, alc.size(), region, b_header, st, start), opt::verbose > 1, true);
@@ -1184,22 +1663,35 @@ afterassembly:
     w.second.m_limit = opt::max_reads_per_assembly;
   }
 
+  // the window is done, only the output not yet written is held
+  svabaMemory::Account(wu.m_mem_held, __work_unit_bytes(wu));
+
   return true;
 }
 
 void sendThreads(SeqLib::GRC& regions_torun) {
 
+  // with many BAMs, share a limited set of open ones across the threads
+  if (opt::max_open_bams && opt::extract_file.empty()) {
+    reader_pool = new svabaReaderPool(opt::bam, std::max(opt::max_open_bams, opt::numThreads), hts_pool);
+    WRITELOG("...summarizing reads per sample from the BAM indexes", opt::verbose, true);
+    reader_pool->Summarize(b_header, opt::numThreads);
+  }
+
   // Create the queue and consumer (worker) threads
   wqueue<svabaWorkItem*>  queue;
   std::vector<ConsumerThread<svabaWorkItem>*> threadqueue;
   for (int i = 0; i < opt::numThreads; i++) {
     ConsumerThread<svabaWorkItem>* threadr = new ConsumerThread<svabaWorkItem>(queue, opt::verbose > 0,
 										   opt::refgenome, opt::microbegenome,
-										   opt::bam);
+										   opt::bam, hts_pool, opt::extract_file,
+										   reader_pool != nullptr);
     threadr->start();
     threadqueue.push_back(threadr);
   }
 
+  svabaStatus::SetTotal(regions_torun.size() ? regions_torun.size() : 1);
+
   // send the jobs
   size_t count = 0;
   for (auto& i : regions_torun) {
@@ -1216,11 +1708,108 @@ void sendThreads(SeqLib::GRC& regions_torun) {
     threadqueue[i]->join();
 
   // write and free remaining items stored in the thread
-  pthread_mutex_lock(&snow_lock);
+  svabaTrace::Lock(&snow_lock, "snow_lock wait");
   for (int i = 0; i < opt::numThreads; ++i) 
     WriteFilesOut(threadqueue[i]->wu); 
   pthread_mutex_unlock(&snow_lock);
 
+  if (reader_pool) {
+    WRITELOG("...opened " + SeqLib::AddCommas(reader_pool->NumOpened()) + " BAMs, at most " +
+	     SeqLib::AddCommas(reader_pool->MaxOpen()) + " at a time", opt::verbose, true);
+    delete reader_pool;
+    reader_pool = nullptr;
+  }
+
+}
+
+// genome-wide --discordant-only. One pass over each BAM, no windows, walkers or assembly
+void runDiscordantStream() {
+
+  DiscordantStream ds(b_header, min_isize_for_disc, &blacklist_view);
+  WRITELOG("...streaming discordant reads from " + std::to_string(opt::bam.size()) + " BAMs", opt::verbose, true);
+  if (!ds.Read(opt::bam, opt::analysis_id, opt::numThreads, hts_pool))
+    ERROR_EXIT("ERROR: Failed to stream discordant reads");
+  WRITELOG("...kept " + SeqLib::AddCommas(ds.NumReads()) + " discordant reads of " + SeqLib::AddCommas(ds.NumScanned()) + " streamed", opt::verbose, true);
+
+  DiscordantClusterMap dmap = ds.Cluster(max_mapq_possible);
+  WRITELOG("...made " + SeqLib::AddCommas(dmap.size()) + " genome-wide discordant clusters", opt::verbose, true);
+
+  // BreakPoint only compares a cluster against others on the same pair of
+  // chromosomes, so make and score the breakpoints one chr pair at a time
+  std::map<std::pair<int,int>, DiscordantClusterMap> by_chr;
+  for (auto& d : dmap) {
+
+    // tag FR clusters that are below min_dscrd_size_for_variant AND low support
+    bool below_size = 	d.second.m_reg1.strand == '+' && d.second.m_reg2.strand == '-' && 
+      (d.second.m_reg2.pos1 - d.second.m_reg1.pos2) < min_dscrd_size_for_variant && 
+      d.second.m_reg1.chr == d.second.m_reg2.chr;
+    if (below_size && (d.second.tcount + d.second.ncount) < 4)
+      continue;
+    by_chr[std::pair<int,int>(d.second.m_reg1.chr, d.second.m_reg2.chr)].insert(std::pair<std::string, DiscordantCluster>(d.first, std::move(d.second)));
+  }
+  dmap.clear();
+
+  svabaWorkUnit wu;
+  for (auto& c : by_chr) {
+
+    DiscordantClusterMap& cmap = c.second;
+    SeqLib::GenomicRegion region(c.first.first, 0, b_header.GetSequenceLength(c.first.first));
+
+    std::vector<BreakPoint> bp_glob;
+    for (auto& i : cmap) {
+      // dont send DSCRD if FR and below size
+      bool below_size = 	i.second.m_reg1.strand == '+' && i.second.m_reg2.strand == '-' && 
+	(i.second.m_reg2.pos1 - i.second.m_reg1.pos2) < min_dscrd_size_for_variant && 
+	i.second.m_reg1.chr == i.second.m_reg2.chr;
+      if ((i.second.tcount + i.second.ncount) > 1 && i.second.valid() && !below_size)
+	bp_glob.emplace_back(i.second, main_bwa, cmap, region);
+    }
+
+    BreakPoint::sortUnique(bp_glob);
+
+    // filter against blacklist
+    IntervalCursor bl_cursor(&blacklist_view);
+    for (auto& i : bp_glob)
+      i.checkBlacklist(bl_cursor);
+
+    // no coverage tracks here. Estimate from the read starts seen in the pass
+    std::vector<BreakPoint*> to_score;
+    to_score.reserve(bp_glob.size());
+    for (auto& i : bp_glob) {
+      for (auto& b : opt::bam)
+	i.allele[b.first].cov = std::min(ds.Coverage(b.first, i.b1.gr.chr, i.b1.gr.pos1, readlen),
+					 ds.Coverage(b.first, i.b2.gr.chr, i.b2.gr.pos1, readlen));
+      i.readlen = readlen;
+      to_score.push_back(&i);
+    }
+    BreakPoint::scoreBreakpoints(to_score, opt::lod, opt::lod_db, opt::lod_somatic, opt::lod_somatic_db, opt::scale_error, min_dscrd_size_for_variant);
+
+    // remove somatic SVs that overlap with germline svs
+    if (germline_svs.size()) {
+      IntervalCursor gl_cursor(&germline_view);
+      for (auto& i : bp_glob) {
+	if (i.somatic_score && i.b1.gr.chr == i.b2.gr.chr) {
+	  SeqLib::GenomicRegion gr1 = i.b1.gr;
+	  SeqLib::GenomicRegion gr2 = i.b2.gr;
+	  gr1.Pad(GERMLINE_CNV_PAD);
+	  gr2.Pad(GERMLINE_CNV_PAD);
+	  if (gl_cursor.overlapsSameInterval(gr1, gr2))
+	    i.somatic_score = -1;
+	}
+      }
+    }
+
+    for (auto& i : bp_glob)
+      i.setRefAlt(ref_genome, ref_genome_viral);
+
+    wu.m_disc.insert(std::make_move_iterator(cmap.begin()), std::make_move_iterator(cmap.end()));
+    for (auto& i : bp_glob)
+      if (i.hasMinimal())
+	wu.m_bps.push_back(std::move(i));
+    WriteFilesOut(wu);
+  }
+
+  WRITELOG("...done genome-wide discordant clustering", opt::verbose, true);
 }
 
 SeqLib::GRC makeAssemblyRegions(const SeqLib::GenomicRegion& region) {
@@ -1282,7 +1871,7 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
   bw_ref.SetMismatchPenalty(9); // default 2
   bw.SetMismatchPenalty(9); // default 4
 
-  for (auto i : bav_this) {
+  for (auto& i : bav_this) {
     
     SeqLib::BamRecordVector brv, brv_ref;
 
@@ -1365,17 +1954,23 @@ void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequence
 void set_walker_params(svabaBamWalker& walk) {
 
   walk.main_bwa = main_bwa; // set the pointer
-  walk.blacklist = blacklist;
+  walk.blacklist = IntervalCursor(&blacklist_view);
   walk.do_kmer_filtering = (opt::ec_correct_type == "s" || opt::ec_correct_type == "f");
-  walk.simple_seq = &simple_seq;
+  walk.simple_seq = IntervalCursor(&simple_view);
   walk.kmer_subsample = opt::ec_subsample;
   walk.max_cov = opt::max_cov;
   walk.m_mr = mr;  // set the read filter pointer
   walk.m_limit = opt::max_reads_per_assembly;
 
+  // over the memory budget, downsample this window. Never above -x / -C, where 0 is no limit
+  if (svabaMemory::Pressure()) {
+    walk.m_limit = walk.m_limit ? std::min(std::max(walk.m_limit / 4, (size_t)1000), walk.m_limit) : 1000;
+    walk.max_cov = walk.max_cov ? std::min(std::max(walk.max_cov / 2, (size_t)10), walk.max_cov) : 10;
+  }
+
 }
 
-CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, SeqLib::GRC& badd) {
+CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, SeqLib::GRC& badd, MateRegionVector * looked_up, SeqLib::GRC * capped) {
 
   SeqLib::GRC this_bad_mate_regions; // store the newly found bad mate regions
   
@@ -1417,11 +2012,16 @@ CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMa
 	  continue;
       
       if (s.count > opt::mate_lookup_min * 2 || (jjj == 0)) { // be more strict about higher rounds and inter-chr
+	s.round = jjj;
 	somatic_mate_regions.add(s);
 	all_somatic_mate_regions.add(s);
       }
     }
     
+    // keep track of what was looked up (for svaba extract)
+    if (looked_up)
+      looked_up->Concat(somatic_mate_regions);
+
     // print out to log
     for (auto& i : somatic_mate_regions) 
       WRITELOG("...mate region " + i.ToString() + " case read count that triggered lookup: " + 
@@ -1443,6 +2043,8 @@ CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMa
   } // mate collection round loop
 
   // update this threads tally of bad mate regions
+  if (capped)
+    capped->Concat(this_bad_mate_regions);
   badd.Concat(this_bad_mate_regions);
   badd.MergeOverlappingIntervals();
   badd.CreateTreeMap();
@@ -1470,11 +2072,12 @@ MateRegionVector __collect_somatic_mate_regions(WalkerMap& walkers, MateRegionVe
 
 
   MateRegionVector somatic_mate_regions;
+  IntervalCursor bl_cursor(&blacklist_view);
   for (auto& b : opt::bam)
     if (b.first.at(0) == 't')
       for (auto& i : walkers[b.first].mate_regions) {
 	if (i.count >= opt::mate_lookup_min && !bl.CountOverlaps(i)
-	    && (!blacklist.size() || !blacklist.CountOverlaps(i)))
+	    && !bl_cursor.overlaps(i))
 	  somatic_mate_regions.add(i); 
       }
   
@@ -1518,16 +2121,15 @@ void correct_reads(std::vector<char*>& learn_seqs, SeqLib::BamRecordVector brv)
 }
 
 void remove_hardclips(SeqLib::BamRecordVector& brv) {
-  SeqLib::BamRecordVector bav_tmp;
-  for (auto& i : brv)
-    if (i.NumHardClip() == 0) 
-      bav_tmp.push_back(i);
-  brv = bav_tmp;
+  // filter in place, so the kept records aren't copied
+  brv.erase(std::remove_if(brv.begin(), brv.end(), [](const SeqLib::BamRecord& r) {
+	return r.NumHardClip() != 0;
+      }), brv.end());
 }
 
 void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector& bav_this, std::vector<AlignedContig>& master_alc, 
 		  SeqLib::BamRecordVector& master_contigs, SeqLib::BamRecordVector& master_microbial_contigs, DiscordantClusterMap& dmap,
-		  std::unordered_map<std::string, SeqLib::CigarMap>& cigmap, SeqLib::RefGenome* refg) {
+		  CigarIndexMap& cigmap, SeqLib::RefGenome* refg, svabaUtils::svabaTimer& st, svabaUtils::svabaRegionMetrics& metrics) {
 
   // get the local region
   std::string lregion;
@@ -1545,6 +2147,7 @@ void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector&
   SeqLib::BWAWrapper local_bwa;
   if (local_usv[0].Seq.length() > 200) // have to have pulled some ref sequence
     local_bwa.ConstructIndex(local_usv);
+  st.stop("ca");
 
   std::stringstream region_string;
   region_string << region;
@@ -1567,6 +2170,8 @@ void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector&
   
   // retrieve contigs
   all_contigs_this = engine.getContigs();
+  metrics.overlap_capped = engine.OverlapLimitHit();
+  st.stop("as");
   WRITELOG("...assembled " + std::to_string(all_contigs_this.size()) + " contigs for " + name, opt::verbose > 1, true);
 
   // store the aligned contig struct
@@ -1576,6 +2181,9 @@ void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector&
   WRITELOG("...aliging contigs to genome", opt::verbose > 1, false);
 
   SeqLib::UnalignedSequenceVector usv;
+
+  // for checking the contig alignments against simple sequence
+  IntervalCursor simple_cursor(&simple_view);
   
   for (auto& i : all_contigs_this) {
     
@@ -1668,14 +2276,9 @@ void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector&
     // check simple sequence overlaps
     if (simple_seq.size())
       for (auto& k : human_alignments) {
-	SeqLib::GRC ovl = simple_seq.FindOverlaps(k.AsGenomicRegion(), true);
-	int msize = 0;
-	for (auto& j: ovl) {
-	  int nsize = j.Width() - k.MaxDeletionBases() - 1;
-	  if (nsize > msize && nsize > 0)
-	    msize = nsize;
-	}
-	k.AddIntTag("SZ", msize);
+	int32_t swidth = simple_cursor.maxOverlapWidth(k.ChrID(), k.Position(), k.PositionEnd());
+	int msize = swidth - (int)k.MaxDeletionBases() - 1;
+	k.AddIntTag("SZ", msize > 0 ? msize : 0);
       }
 
     // make the aligned contigs
@@ -1689,6 +2292,7 @@ void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector&
   } // end loop through contigs
 
   assert(this_alc.size() == usv.size());
+  st.stop("ca");
 
   // didnt get any contigs that made it all the way through
   if (!this_alc.size())
@@ -1719,6 +2323,7 @@ void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector&
     master_alc.push_back(a);
     
   }
+  st.stop("ra");
 
 
 }
@@ -1740,7 +2345,6 @@ CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, in
     for (auto& s : mrv) 
       gg.add(SeqLib::GenomicRegion(s.chr, s.pos1, s.pos2, s.strand));
 
-    assert(w.second.SetMultipleRegions(gg));
     w.second.get_coverage = false;
     w.second.get_mate_regions = (round != MAX_MATE_ROUNDS);
 
@@ -1748,7 +2352,21 @@ CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, in
     // already added these to the to-do pile
     w.second.mate_regions.clear();
 
+    // open the BAM through the pool, unless it has nothing here
+    if (reader_pool) {
+      if (!reader_pool->HasReads(w.first, gg))
+	continue;
+      if (!reader_pool->Checkout(w.second))
+	ERROR_EXIT("ERROR: Could not open the BAM of " + w.first + " through the reader pool (--max-open-bams)");
+    }
+
+    // not in the assert, which an NDEBUG build drops
+    bool set = w.second.SetMultipleRegions(gg);
+    assert(set);
+    (void)set;
     this_bad_mate_regions.Concat(w.second.readBam(&log_file)); 
+    if (reader_pool)
+      reader_pool->Return(w.second);
     
     // update the counts
     if (w.first.at(0) == 't') 
@@ -1763,14 +2381,17 @@ CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, in
 
 void collect_and_clear_reads(WalkerMap& walkers, SeqLib::BamRecordVector& brv, std::vector<char*>& learn_seqs, std::unordered_set<std::string>& dedupe) {
 
+  size_t n = brv.size();
+  for (auto& w : walkers)
+    n += w.second.reads.size();
+  brv.reserve(n);
+
   // concatenate together all the reads from the different walkers
   for (auto& w : walkers) {
     for (auto& r : w.second.reads) {
       std::string sr = r.GetZTag("SR");
-      if (!dedupe.count(sr)) {
-	brv.push_back(r); 
-        dedupe.insert(sr);
-      }
+      if (dedupe.insert(sr).second)
+	brv.push_back(std::move(r)); // walker reads are cleared below
     }
 
     // concat together all of the learning sequences
@@ -1786,6 +2407,93 @@ void collect_and_clear_reads(WalkerMap& walkers, SeqLib::BamRecordVector& brv, s
   }
 }
 
+void __write_extract_window(const SeqLib::GenomicRegion& region, WalkerMap& walkers, SeqLib::BamRecordVector& bav_this,
+			    const CigarIndexMap& cigmap, size_t num_main_reads,
+			    const MateRegionVector& looked_up) {
+
+  ExtractWindow ew;
+  ew.region = SeqLib::GenomicRegion(region.chr, region.pos1, region.pos2);
+  ew.mate_regions = looked_up;
+  for (auto& c : cigmap)
+    ew.cigmap[c.first] = c.second;
+  for (auto& w : walkers)
+    ew.cov[w.first] = w.second.cov;
+
+  // tag the mate-region reads with (1-based) index of the mate region that
+  // brought them in, so a re-run can drop them under a higher lookup cutoff
+  for (size_t i = num_main_reads; i < bav_this.size(); ++i) {
+    SeqLib::GenomicRegion gr = bav_this[i].AsGenomicRegion();
+    int mx = 0;
+    for (size_t k = 0; k < looked_up.size(); ++k)
+      if (looked_up[k].GetOverlap(gr) && (!mx || looked_up[k].count > looked_up[mx-1].count))
+	mx = k + 1;
+    if (mx)
+      bav_this[i].AddIntTag("MX", mx);
+  }
+  ew.reads = bav_this;
+
+  pthread_mutex_lock(&snow_lock);
+  bool ok = extract_writer->WriteWindow(ew);
+  pthread_mutex_unlock(&snow_lock);
+
+  if (!ok) {
+    WRITELOG("ERROR: Failed to write window " + region.ToString() + " to extract store", true, true);
+    exit(EXIT_FAILURE);
+  }
+}
+
+bool __load_extract_window(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, SeqLib::BamRecordVector& bav_this,
+			   std::vector<char*>& all_seqs, CigarIndexMap& cigmap,
+			   CountPair& read_counts, std::map<std::string, int>& sample_reads, SeqLib::BFC * bfc) {
+
+  ExtractWindow ew;
+  if (!wu.extract->ReadWindow(region, ew))
+    return false;
+
+  for (auto& c : ew.cigmap)
+    cigmap[c.first] = c.second;
+  for (auto& c : ew.cov)
+    wu.walkers[c.first].cov = c.second;
+
+  for (auto& r : ew.reads) {
+
+    // drop mate-region reads whose region would not have been looked up with these
+    // params, by the same rule as __collect_somatic_mate_regions and the later rounds
+    int mx = r.GetIntTag("MX");
+    if (mx > 0 && mx <= (int)ew.mate_regions.size()) {
+      const MateRegion& m = ew.mate_regions[mx-1];
+      if (m.count < opt::mate_lookup_min || (m.round > 0 && m.count <= opt::mate_lookup_min * 2))
+	continue;
+      if (!opt::interchrom_lookup && (m.chr != region.chr || std::abs(m.pos1 - region.pos1) < LARGE_INTRA_LOOKUP_LIMIT))
+	continue;
+      r.RemoveTag("MX");
+    }
+
+    std::string sr = r.GetZTag("SR");
+    if (!sr.empty() && sr.at(0) == 't')
+      ++read_counts.first;
+    else
+      ++read_counts.second;
+    ++sample_reads[sr.substr(0, sr.find('_'))];
+
+    // train the error correction on the stored reads
+    std::string qq = r.QualitySequence();
+    if (qq.length() > 40 && !r.NumHardClip()) {
+      if (bfc)
+	bfc->AddSequence(qq.c_str(), r.Qualities().c_str(), r.Qname().c_str());
+      else if (opt::ec_correct_type == "s")
+	all_seqs.push_back(strdup(qq.c_str()));
+    }
+
+    bav_this.push_back(r);
+  }
+
+  for (auto& s : sample_reads)
+    svabaStatus::AddReads(s.first, s.second);
+
+  return true;
+}
+
 void WriteFilesOut(svabaWorkUnit& wu) {
 
   // print the alignment plots
@@ -1814,10 +2522,22 @@ void WriteFilesOut(svabaWorkUnit& wu) {
     }
   }
 
-  // send breakpoints to file
+  // send breakpoints to file and to the VCF
   for (auto& i : wu.m_bps) {
-    if ( i.hasMinimal() && (i.confidence != "NOLOCAL" || i.complex_local))
+    if ( !i.hasMinimal() || (i.confidence == "NOLOCAL" && !i.complex_local))
+      continue;
+
+    // both of these fill in the read name string, which can only be done once
+    if (!opt::no_bps_file)
       os_allbps << i.toFileString(!opt::read_tracking) << std::endl;
+    else
+      i.formatStrings(!opt::read_tracking);
+    if (bps_store)
+      bps_store->Add(i);
+
+    // same filter as when reading a bps.txt.gz for the VCF
+    if (stream_vcf && i.b1.chr_name != "Unknown" && i.b2.chr_name != "Unknown")
+      stream_vcf->add(std::shared_ptr<ReducedBreakPoint>(new ReducedBreakPoint(i, b_header)));
   }
 
   // clear them out
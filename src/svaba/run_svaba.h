@@ -21,8 +21,11 @@
 #include "svabaBamWalker.h"
 #include "DiscordantCluster.h"
 #include "svabaAssemblerEngine.h"
+#include "vcf.h"
 
 #include "workqueue.h"
+#include "svabaStatus.h"
+#include "svabaMemory.h"
 
 // typedefs
 typedef std::map<std::string, std::string> BamMap;
@@ -31,13 +34,16 @@ typedef std::map<std::string, SeqLib::SharedHTSFile> HTSFileMap;
 
 void learnBamParams(SeqLib::BamReader& walk, std::string id);
 void makeVCFs();
+VCFHeader __make_vcf_header();
 int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& subject);
 bool hasRepeat(const std::string& seq);
 void parseRunOptions(int argc, char** argv);
 void runsvaba(int argc, char** argv);
+void runExtract(int argc, char** argv);
 void learnParameters(const SeqLib::GRC& regions);
 int countJobs(SeqLib::GRC &file_regions, SeqLib::GRC &run_regions);
 void sendThreads(SeqLib::GRC& regions_torun);
+void runDiscordantStream();
 bool runWorkUnit(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, long unsigned int thread_id);
 SeqLib::GRC makeAssemblyRegions(const SeqLib::GenomicRegion& region);
 void alignReadsToContigs(SeqLib::BWAWrapper& bw, const SeqLib::UnalignedSequenceVector& usv, SeqLib::BamRecordVector& bav_this, std::vector<AlignedContig>& this_alc, const SeqLib::RefGenome * rg);
@@ -48,12 +54,18 @@ SeqLib::GRC __get_exclude_on_badness(std::map<std::string, svabaBamWalker>& walk
 void correct_reads(std::vector<char*>& learn_seqs, SeqLib::BamRecordVector brv);
 void run_assembly(const SeqLib::GenomicRegion& region, SeqLib::BamRecordVector& bav_this, std::vector<AlignedContig>& master_alc, 
 		  SeqLib::BamRecordVector& master_contigs, SeqLib::BamRecordVector& master_microbial_contigs, DiscordantClusterMap& dmap,
-		  std::unordered_map<std::string, SeqLib::CigarMap>& cigmap, SeqLib::RefGenome* refg);
+		  CigarIndexMap& cigmap, SeqLib::RefGenome* refg, svabaUtils::svabaTimer& st, svabaUtils::svabaRegionMetrics& metrics);
 void remove_hardclips(SeqLib::BamRecordVector& brv);
 CountPair collect_mate_reads(WalkerMap& walkers, const MateRegionVector& mrv, int round, SeqLib::GRC& this_bad_mate_regions);
-CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, SeqLib::GRC& badd);
+CountPair run_mate_collection_loop(const SeqLib::GenomicRegion& region, WalkerMap& wmap, SeqLib::GRC& badd, MateRegionVector * looked_up = nullptr, SeqLib::GRC * capped = nullptr);
 void collect_and_clear_reads(WalkerMap& walkers, SeqLib::BamRecordVector& brv, std::vector<char*>& learn_seqs, std::unordered_set<std::string>& dedupe);
 void WriteFilesOut(svabaWorkUnit& wu); 
+void __write_extract_window(const SeqLib::GenomicRegion& region, WalkerMap& walkers, SeqLib::BamRecordVector& bav_this,
+			    const CigarIndexMap& cigmap, size_t num_main_reads,
+			    const MateRegionVector& looked_up);
+bool __load_extract_window(const SeqLib::GenomicRegion& region, svabaWorkUnit& wu, SeqLib::BamRecordVector& bav_this,
+			   std::vector<char*>& all_seqs, CigarIndexMap& cigmap,
+			   CountPair& read_counts, std::map<std::string, int>& sample_reads, SeqLib::BFC * bfc);
 void run_test_assembly();
 
 class svabaWorkItem {
@@ -70,7 +82,12 @@ class svabaWorkItem {
     int getNumber() { return m_number; }
     
     bool run(svabaWorkUnit& wu, long unsigned int thread_id) { 
-      return runWorkUnit(m_gr, wu, thread_id);
+      svabaMemory::Acquire();
+      svabaStatus::RegionStart(m_gr);
+      bool ok = runWorkUnit(m_gr, wu, thread_id);
+      svabaStatus::RegionDone();
+      svabaMemory::Release();
+      return ok;
     }
 };
 
@@ -11,6 +11,10 @@
 
 #include "refilter.h"
 #include "run_svaba.h"
+#include "BreakPointStore.h"
+#include "svabaBenchmark.h"
+#include "DBSnpFilter.h"
+#include "PONFilter.h"
 
 #define AUTHOR "Jeremiah Wala <jwala@broadinstitute.org>"
 
@@ -24,7 +28,12 @@ static const char *SVABA_USAGE_MESSAGE =
 "Usage: svaba <command> [options]\n\n"
 "Commands:\n"
 "           run            Run SvABA SV and Indel detection on BAM(s)\n"
+"           extract        Run only the read-in stage of svaba run and store it, for fast re-runs with svaba run --from-extract\n"
 "           refilter       Refilter the SvABA breakpoints with additional/different criteria to created filtered VCF and breakpoints file.\n"
+"           bps2txt        Print a binary breakpoint store (bps.svb) as a bps.txt table\n"
+"           benchmark      Time internal components (eg scoring) on synthetic input\n"
+"           dbsnp-index    Compile a DBSnp VCF to a binary index for fast loading with -D\n"
+"           pon            Build a binary indel panel of normals from many bps files (svaba pon build)\n"
 "\nReport bugs to jwala@broadinstitute.org \n\n";
 
 int main(int argc, char** argv) {
@@ -39,8 +48,18 @@ int main(int argc, char** argv) {
       return 0;
     } else if (command == "run") {
       runsvaba(argc -1, argv + 1);
+    } else if (command == "extract") {
+      runExtract(argc -1, argv + 1);
     } else if (command == "refilter") {
       runRefilterBreakpoints(argc-1, argv+1);
+    } else if (command == "bps2txt") {
+      runBpsToText(argc-1, argv+1);
+    } else if (command == "benchmark") {
+      runBenchmark(argc-1, argv+1);
+    } else if (command == "dbsnp-index") {
+      runDBSnpIndex(argc-1, argv+1);
+    } else if (command == "pon") {
+      runPON(argc-1, argv+1);
     }
     else {
       std::cerr << SVABA_USAGE_MESSAGE;
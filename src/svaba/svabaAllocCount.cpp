@@ -0,0 +1,90 @@
+#include "svabaAllocCount.h"
+
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+// Replacement global operator new / delete that count allocations per
+// thread, for the handoff component of svaba benchmark. This file is only
+// in svaba_bench_SOURCES, so svaba run keeps the library allocator
+
+static thread_local size_t __num_allocs = 0;
+
+size_t svabaAllocCount() {
+  return __num_allocs;
+}
+
+// as the standard operator new: retry through the new_handler until it
+// frees memory or gives up, and throw bad_alloc if there is none
+static void* __alloc(size_t n) {
+  ++__num_allocs;
+  if (!n)
+    n = 1;
+  while (true) {
+    void * p = malloc(n);
+    if (p)
+      return p;
+    std::new_handler h = std::get_new_handler();
+    if (!h)
+      throw std::bad_alloc();
+    h();
+  }
+}
+
+static void* __alloc_nothrow(size_t n) noexcept {
+  try {
+    return __alloc(n);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new(size_t n) { return __alloc(n); }
+void* operator new[](size_t n) { return __alloc(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return __alloc_nothrow(n); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return __alloc_nothrow(n); }
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void * p, const std::nothrow_t&) noexcept { free(p); }
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+#endif
+
+// C++17 over-aligned types. The build is C++11, so these are only for
+// compilers that default to a newer standard
+#ifdef __cpp_aligned_new
+static void* __alloc_aligned(size_t n, std::align_val_t a) {
+  ++__num_allocs;
+  size_t al = std::max(static_cast<size_t>(a), sizeof(void*));
+  if (!n)
+    n = 1;
+  while (true) {
+    void * p = nullptr;
+    if (!posix_memalign(&p, al, n))
+      return p;
+    std::new_handler h = std::get_new_handler();
+    if (!h)
+      throw std::bad_alloc();
+    h();
+  }
+}
+
+void* operator new(size_t n, std::align_val_t a) { return __alloc_aligned(n, a); }
+void* operator new[](size_t n, std::align_val_t a) { return __alloc_aligned(n, a); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+  try { return __alloc_aligned(n, a); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+  try { return __alloc_aligned(n, a); } catch (...) { return nullptr; }
+}
+void operator delete(void * p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void * p, std::align_val_t) noexcept { free(p); }
+void operator delete(void * p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void * p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void * p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void * p, size_t, std::align_val_t) noexcept { free(p); }
+#endif
@@ -0,0 +1,15 @@
+#ifndef SVABA_ALLOC_COUNT_H__
+#define SVABA_ALLOC_COUNT_H__
+
+#include <cstddef>
+
+/** operator new calls made on this thread so far.
+ *
+ * Defined only in svabaAllocCount.cpp, which replaces the global operator
+ * new and is linked into the svaba_bench program (make svaba_bench) and
+ * never into svaba. The declaration is weak, so in svaba the function
+ * is null and svaba benchmark reports times without allocation counts.
+ */
+size_t svabaAllocCount() __attribute__((weak));
+
+#endif
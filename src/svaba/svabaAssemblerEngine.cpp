@@ -234,6 +234,8 @@ void svabaAssemblerEngine::doAssembly(ReadTable *pRT, SeqLib::UnalignedSequenceV
     ++workid;
 
   }
+  if (ocount >= MAX_OVERLAPS_PER_ASSEMBLY)
+    m_overlap_limit = true;
 
   std::string line;
   bool bIsSelfCompare = true;
@@ -34,6 +34,9 @@ class svabaAssemblerEngine
   
   void clearContigs() { m_contigs.clear(); }
 
+  /** Did an assembly stop computing overlaps at MAX_OVERLAPS_PER_ASSEMBLY reads */
+  bool OverlapLimitHit() const { return m_overlap_limit; }
+
   ReadTable* removeDuplicates(ReadTable* pRT);
 
   void calculateSeedParameters(int read_len, const int minOverlap, int& seed_length, int& seed_stride) const;
@@ -66,6 +69,8 @@ class svabaAssemblerEngine
   std::string outVariantsFile = ""; // dummy
   
   bool m_write_asqg = false;
+
+  bool m_overlap_limit = false;
   
   ReadTable m_pRT;
   
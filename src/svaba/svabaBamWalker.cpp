@@ -29,29 +29,32 @@ static const std::string FWD_ADAPTER_A = "AGATCGGAAGAGC";
 static const std::string FWD_ADAPTER_B = "AGATCGGAAAGCA";
 static const std::string REV_ADAPTER = "GCTCTTCCGATCT";
 
-void svabaBamWalker::addCigar(SeqLib::BamRecord &r) {
+void svabaBamWalker::addCigar(const SeqLib::BamRecord &r) {
+
+  const bam1_t * b = r.raw();
 
   // this is a 100% match
-  if (r.CigarSize() == 1)
+  if (b->core.n_cigar == 1)
     return;
-  std::stringstream cigar_ss;
-  cigar_ss.str(std::string());
-  int pos = r.Position(); // position ON REFERENCE
-  
-  for (auto& i : r.GetCigar()) {
 
-       // if it's a D or I, add it to the list
-      if (i.Type() == 'D' || i.Type() == 'I') {	
+  const uint32_t * cig = bam_get_cigar(b);
+  int32_t pos = b->core.pos; // position ON REFERENCE
+  
+  for (uint32_t k = 0; k < b->core.n_cigar; ++k) {
 
-	cigar_ss << r.ChrID() << "_" << pos << "_" << i.Length() << i.Type();
-	++cigmap[cigar_ss.str()];
+    int op = bam_cigar_op(cig[k]);
+    uint32_t len = bam_cigar_oplen(cig[k]);
 
-	cigar_ss.str(std::string());
-      }
+    // if it's a D or I, add it to the list
+    if (op == BAM_CDEL || op == BAM_CINS) {
+      CigarKey key = makeCigarKey(b->core.tid, pos, len, op == BAM_CINS ? 'I' : 'D');
+      if (key != CIGAR_KEY_NONE)
+	cigmap.add(key);
+    }
       
-      // move along the REFERENCE
-      if (!(i.Type() == 'I') && !(i.Type() == 'S') && !(i.Type() == 'H'))
-	pos += i.Length();
+    // move along the REFERENCE
+    if (op != BAM_CINS && op != BAM_CSOFT_CLIP && op != BAM_CHARD_CLIP)
+      pos += len;
   }
   
 }
@@ -70,6 +73,12 @@ bool svabaBamWalker::isDuplicate(const SeqLib::BamRecord &r) {
   return true;
 }
 
+bool svabaBamWalker::CloseBam() {
+  bool ok = Close();
+  m_bams.clear();
+  return ok;
+}
+
 SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log)
 {
 
@@ -88,7 +97,7 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log)
   while (GetNextRecord(r)) {
 
     // check if it passed blacklist
-    if (blacklist.size() && blacklist.CountOverlaps(r.AsGenomicRegion())) {
+    if (blacklist.overlaps(r.ChrID(), r.Position(), r.PositionEnd())) {
       continue;
     }
 
@@ -146,21 +155,9 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log)
       cov.addRead(r, INFORMATIVE_COVERAGE_BUFFER, false); 
     
     // check if in simple-seq
-    if (simple_seq->size()) {
-      
-      // check simple sequence overlaps
-      SeqLib::GRC ovl = simple_seq->FindOverlaps(r.AsGenomicRegion(), true);
-      
-      int msize = 0;
-      for (auto& j: ovl) {
-	int nsize = j.Width() - r.MaxDeletionBases() - 1;
-	if (nsize > msize && nsize > 0)
-	  msize = nsize;
-      }
-      
-      if (msize > 30)
-        qcpass = false;
-    }
+    int32_t swidth = simple_seq.maxOverlapWidth(r.ChrID(), r.Position(), r.PositionEnd());
+    if (swidth && swidth - (int)r.MaxDeletionBases() - 1 > 30)
+      qcpass = false;
     
     pass_all = pass_all && qcpass && rule_pass;
     
@@ -229,6 +226,9 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log)
     reads.push_back(r); // adding later because of kmer correction
     
   } // end the read loop
+
+  // sort and count the indel cigars for this read-in
+  cigmap.settle();
   
 #ifdef QNAME
   for (auto& j : reads) { DEBUG("SBW read kept pre-filter", j); }
@@ -263,8 +263,8 @@ SeqLib::GRC svabaBamWalker::readBam(std::ofstream * log)
 
 void svabaBamWalker::subSampleToWeirdCoverage(double max_coverage) {
   
-  SeqLib::BamRecordVector new_reads;
-
+  // compact the kept reads to the front in place, rather than copying to a new vector
+  size_t j = 0;
   for (auto& r : reads)
     {
       double this_cov1 = weird_cov.getCoverageAtPosition(r.ChrID(), r.Position());
@@ -284,17 +284,18 @@ void svabaBamWalker::subSampleToWeirdCoverage(double max_coverage) {
 	  }
 	  #endif
 	  uint32_t k = __ac_Wang_hash(__ac_X31_hash_string(r.Qname().c_str()) ^ m_seed);
-	  if ((double)(k&0xffffff) / 0x1000000 <= sample_rate) // passed the random filter
-	    new_reads.push_back(r);
-	}
-      else // didn't have a coverage problems
-	{
-	  new_reads.push_back(r);
+	  if ((double)(k&0xffffff) / 0x1000000 > sample_rate) // failed the random filter
+	    continue;
 	}
+
+      // didn't have a coverage problem, or passed the filter
+      if (&reads[j] != &r)
+	reads[j] = std::move(r);
+      ++j;
       
     }
 
-  reads = new_reads;
+  reads.erase(reads.begin() + j, reads.end());
 }
 
 void svabaBamWalker::calculateMateRegions() {
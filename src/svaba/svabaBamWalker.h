@@ -11,6 +11,8 @@
 #include "STCoverage.h"
 #include "SeqLib/BWAWrapper.h"
 #include "DiscordantRealigner.h"
+#include "CigarIndex.h"
+#include "IntervalView.h"
 
 #include "SeqLib/BFC.h"
 
@@ -21,6 +23,7 @@ class MateRegion: public SeqLib::GenomicRegion
   MateRegion() {}
   MateRegion (int32_t c, uint32_t p1, uint32_t p2, char s = '*') : SeqLib::GenomicRegion(c, p1, p2, s) {}
   size_t count = 0;// read count
+  int round = 0; // mate lookup round it was looked up on
   SeqLib::GenomicRegion partner;
 
 };
@@ -40,7 +43,7 @@ class svabaBamWalker: public SeqLib::BamReader {
   std::string prefix; // eg. tumor, normal
 
   // regions to blacklist
-  SeqLib::GRC blacklist;
+  IntervalCursor blacklist;
 
   // read in the reads
   SeqLib::GRC readBam(std::ofstream* log = nullptr);
@@ -63,9 +66,13 @@ class svabaBamWalker: public SeqLib::BamReader {
   
   bool hasAdapter(const SeqLib::BamRecord& r) const;
   
-  void addCigar(SeqLib::BamRecord &r);
+  void addCigar(const SeqLib::BamRecord &r);
   
   bool isDuplicate(const SeqLib::BamRecord &r);
+
+  // close the BAM so that Open can open it again. BamReader::Close keeps it in
+  // m_bams, and Open refuses a BAM that is already there
+  bool CloseBam();
   
   void subSampleToWeirdCoverage(double max_coverage);
   
@@ -89,14 +96,14 @@ class svabaBamWalker: public SeqLib::BamReader {
   //    coverage to compare against this buffered alt cov.
   STCoverage cov, weird_cov; //c
 
-  // hash of cigars for indels
-  SeqLib::CigarMap cigmap; //c
+  // counts of indel cigar ops
+  CigarIndex cigmap; //c
 
   // mate regions to lookup
   MateRegionVector mate_regions; //c
 
   // filter out reads at simple repeats?
-  SeqLib::GRC * simple_seq;
+  IntervalCursor simple_seq;
   
   // object for realigning discordant reads
   DiscordantRealigner dr; //c
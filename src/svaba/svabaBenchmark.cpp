@@ -0,0 +1,1348 @@
+#include "svabaBenchmark.h"
+
+#include <getopt.h>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <iterator>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#include "BreakPoint.h"
+#include "PONFilter.h"
+#include "BreakPointStore.h"
+#include "svabaExtract.h"
+#include "DBSnpFilter.h"
+#include "gzstream.h"
+#include "KmerFilter.h"
+#include "STCoverage.h"
+#include "DiscordantCluster.h"
+#include "svabaAssemblerEngine.h"
+#include "svabaOverlapAlgorithm.h"
+#include "vcf.h"
+#include "svabaAllocCount.h"
+#include "run_svaba.h"
+
+#include "SeqLib/BFC.h"
+#include "htslib/faidx.h"
+
+#include "SuffixArray.h"
+#include "RLBWT.h"
+
+#include "SimGenome.h"
+
+// simulated reads for the read kernels
+#define BENCH_READLEN 101
+#define BENCH_ISIZE 350
+#define BENCH_COVERAGE 30
+#define BENCH_DELETION 2000
+
+// results must match the scalar path to within this
+#define BENCH_TOLERANCE 1e-9
+
+namespace opt {
+  namespace bench {
+    static size_t num = 0; // 0 is the component default
+    static int reps = 3;
+    static unsigned seed = 42;
+    static std::string json;
+
+    // sim
+    static std::string id = "sim";
+    static std::string refgenome;
+    static std::string region;
+    static std::string coverage = "30,30";
+    static int nsv = 20;
+    static int nindel = 200;
+    static int synthetic_len = 0;
+  }
+}
+
+enum {
+  OPT_SYNTHETIC_REF
+};
+
+static const char* shortopts = "hn:r:s:j:a:G:k:c:R:X:";
+static const struct option longopts[] = {
+  { "help",                    no_argument, NULL, 'h' },
+  { "num",                     required_argument, NULL, 'n' },
+  { "reps",                    required_argument, NULL, 'r' },
+  { "seed",                    required_argument, NULL, 's' },
+  { "json",                    required_argument, NULL, 'j' },
+  { "id-string",               required_argument, NULL, 'a' },
+  { "reference-genome",        required_argument, NULL, 'G' },
+  { "region",                  required_argument, NULL, 'k' },
+  { "coverage",                required_argument, NULL, 'c' },
+  { "num-rearrangements",      required_argument, NULL, 'R' },
+  { "num-indels",              required_argument, NULL, 'X' },
+  { "synthetic-ref",           required_argument, NULL, OPT_SYNTHETIC_REF },
+  { NULL, 0, NULL, 0 }
+};
+
+static const char *BENCHMARK_USAGE_MESSAGE =
+"Usage: svaba benchmark <component> [OPTION]\n\n"
+"  Description: Time an svaba component on synthetic input and check it against the reference code\n"
+"\n"
+"  Components\n"
+"      score                            Genotype / LOD scoring, GenotypeBatch vs SampleInfo::modelSelection\n"
+"      pon                              Panel of normals lookup, PONFilter vs the chr_pos string map it replaced\n"
+"      assembly                         svabaAssemblerEngine::performAssembly on the reads of one window (string graph overlaps and walks)\n"
+"      overlap                          svabaOverlapAlgorithm::overlapRead of each read of one window against the FM-index of them all\n"
+"      kmer                             SGA kmer correction, KmerFilter::makeIndex and correctReads\n"
+"      bfc                              BFC training and correction\n"
+"      cluster                          DiscordantCluster::clusterReads\n"
+"      coverage                         STCoverage::addRead\n"
+"      handoff                          Reads through the window hand-off: subSampleToWeirdCoverage, collect_and_clear_reads\n"
+"                                       and remove_hardclips. Counts operator new calls in svaba_bench (make svaba_bench)\n"
+"      dedupe                           VCFFile::deduplicate on synthetic breakpoints and moved copies of them, which must\n"
+"                                       come out as dups, on one thread and on four\n"
+"      formats                          Write each on-disk format (bps.svb, extract store, .svdb, PON index) to $TMPDIR and read it back. Fails on any\n"
+"                                       record that does not come back as written, or on a stale .svdb being used\n"
+"      all                              Each of the above\n"
+"      sim                              Not timed. Simulate a tumor / normal pair of paired-end FASTQs and a truth set\n"
+"                                       (for bin/svaba-benchmark.sh). The same seed gives the same reads\n"
+"  Options\n"
+"  -n, --num                            Number of samples / lookups / reads. Default: 1000000 for score, pon, cluster\n"
+"                                       and coverage, 200000 breakpoints for dedupe, 100000 for handoff, 20000 for bfc, 5000\n"
+"                                       (one window) for assembly, overlap and kmer, and for formats 12388 breakpoints\n"
+"                                       (three store blocks, also the PON input), 5000 extract reads and 20000 DBSnp sites\n"
+"  -r, --reps                           Number of timed repetitions (best is reported). Default: 3\n"
+"  -s, --seed                           Random seed. Default: 42\n"
+"  -j, --json                           Also write the timings to this JSON file, for tracking regressions\n"
+"  -h, --help                           Display this help and exit\n"
+"  sim Options\n"
+"  -a, --id-string                      Prefix of the output files <id>.tumor_1.fq, <id>.normal_2.fq, <id>.truth.tsv... Default: sim\n"
+"  -G, --reference-genome               Reference to simulate on, indexed with samtools faidx\n"
+"  -k, --region                         Region of the first contig of -G to simulate on, e.g. 1:1,000,000-11,000,000\n"
+"      --synthetic-ref                  Instead of -G / -k, write a random reference of this many bp to <id>.ref.fa\n"
+"  -c, --coverage                       Tumor,normal coverage. Default: 30,30\n"
+"  -R, --num-rearrangements             Rearrangements in the tumor. Default: 20\n"
+"  -X, --num-indels                     Indels in the tumor (approximate). Default: 200\n"
+"\n";
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double __seconds(BenchClock::time_point a, BenchClock::time_point b) {
+  return std::chrono::duration<double>(b - a).count();
+}
+
+// one timed kernel, for the JSON report
+struct BenchResult {
+  std::string name;
+  size_t items;
+  std::vector<double> secs; // each repetition
+  std::vector<std::pair<std::string, double>> counters;
+};
+
+static std::vector<BenchResult> results;
+
+static void __record(const std::string& name, size_t items, const std::vector<double>& secs,
+		     const std::vector<std::pair<std::string, double>>& counters = {}) {
+  results.push_back({name, items, secs, counters});
+}
+
+static double __best(const std::vector<double>& v) {
+  return *std::min_element(v.begin(), v.end());
+}
+
+static double __median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+}
+
+static bool __write_json(const std::string& file) {
+
+  std::ofstream os(file);
+  if (!os)
+    return false;
+
+  os << std::setprecision(6) << "{\n  \"context\": {\"seed\": " << opt::bench::seed << ", \"reps\": " << opt::bench::reps << "},\n  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& b = results[i];
+    double best = __best(b.secs);
+    os << (i ? "," : "") << "\n    {\"name\": \"" << b.name << "\", \"iterations\": " << b.secs.size()
+       << ", \"items\": " << b.items << ", \"real_time\": " << best << ", \"median_time\": " << __median(b.secs)
+       << ", \"time_unit\": \"s\", \"items_per_second\": " << (best > 0 ? b.items / best : 0);
+    for (auto& c : b.counters)
+      os << ", \"" << c.first << "\": " << c.second;
+    os << "}";
+  }
+  os << "\n  ]\n}\n";
+  return !os.fail();
+}
+
+static char __comp(char c) {
+  switch (c) {
+  case 'A': return 'T';
+  case 'C': return 'G';
+  case 'G': return 'C';
+  case 'T': return 'A';
+  default: return 'N';
+  }
+}
+
+// read pairs at BENCH_COVERAGE on a random chr 0 with a deletion halfway, so
+// the pairs across it are discordant. Bases have a 0.5% error rate
+static SeqLib::BamRecordVector __make_reads(size_t n, SeqLib::GenomicRegion& window) {
+
+  std::mt19937 rng(opt::bench::seed);
+  const char bases[] = "ACGT";
+  const int32_t glen = std::max((int32_t)(n * BENCH_READLEN / BENCH_COVERAGE), 4 * BENCH_ISIZE);
+  const int32_t brk = glen / 2;
+
+  std::string ref(glen + BENCH_DELETION, 'N');
+  for (auto& c : ref)
+    c = bases[rng() % 4];
+  std::string hap = ref.substr(0, brk) + ref.substr(brk + BENCH_DELETION);
+  window = SeqLib::GenomicRegion(0, 0, (int32_t)ref.length());
+
+  std::normal_distribution<double> isize_d(BENCH_ISIZE, 30);
+  std::uniform_real_distribution<double> err_d(0, 1);
+  const std::string qual(BENCH_READLEN, '?');
+  SeqLib::Cigar cig;
+  cig.add(SeqLib::CigarField('M', BENCH_READLEN));
+
+  SeqLib::BamRecordVector reads;
+  reads.reserve(n);
+  for (size_t i = 0; i + 1 < n; i += 2) {
+
+    int32_t isize = std::max(BENCH_READLEN, std::min(3 * BENCH_ISIZE, (int)std::round(isize_d(rng))));
+    int32_t p1 = rng() % (hap.length() - isize);
+    int32_t p2 = p1 + isize - BENCH_READLEN;
+    std::string s1 = hap.substr(p1, BENCH_READLEN);
+    std::string s2 = hap.substr(p2, BENCH_READLEN);
+    std::reverse(s2.begin(), s2.end());
+    std::transform(s2.begin(), s2.end(), s2.begin(), __comp);
+    for (auto& c : s1)
+      if (err_d(rng) < 0.005) c = bases[rng() % 4];
+    for (auto& c : s2)
+      if (err_d(rng) < 0.005) c = bases[rng() % 4];
+
+    // haplotype to reference coordinates
+    int32_t r1 = p1 < brk ? p1 : p1 + BENCH_DELETION;
+    int32_t r2 = p2 < brk ? p2 : p2 + BENCH_DELETION;
+
+    std::string qn = "r" + std::to_string(i / 2);
+    for (int m = 0; m < 2; ++m) {
+      SeqLib::BamRecord r;
+      r.init();
+      r.SetQname(qn);
+      r.SetSequence(m ? s2 : s1);
+      r.SetQualities(qual, 33);
+      r.SetCigar(cig);
+      r.SetChrID(0);
+      r.SetChrIDMate(0);
+      r.SetPosition(m ? r2 : r1);
+      r.SetPositionMate(m ? r1 : r2);
+      r.SetPairedFlag();
+      r.SetMapQuality(60);
+      if (m)
+	r.SetReverseFlag();
+      else
+	r.SetMateReverseFlag();
+      r.AddZTag("SR", "t000_" + std::to_string(m ? 147 : 99) + "_" + qn);
+      r.AddIntTag("DD", 1);
+      reads.push_back(r);
+    }
+  }
+  return reads;
+}
+
+static size_t __num(size_t def) {
+  return opt::bench::num ? opt::bench::num : def;
+}
+
+static void __report(const std::string& name, size_t items, const std::vector<double>& secs, const std::string& result, double value) {
+
+  double best = __best(secs);
+  std::cout << std::setprecision(4)
+	    << "component\titems\treps\tbest_sec\tmedian_sec\titems_per_sec\t" << result << std::endl
+	    << name << "\t" << items << "\t" << secs.size() << "\t" << best << "\t" << __median(secs) << "\t"
+	    << (best > 0 ? items / best : 0) << "\t" << value << std::endl;
+  __record(name, items, secs, {{result, value}});
+}
+
+static int __bench_assembly() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector reads = __make_reads(__num(5000), window);
+  const int min_overlap = (0.6 * BENCH_READLEN) < 30 ? 30 : 0.6 * BENCH_READLEN;
+
+  std::vector<double> secs;
+  size_t contigs = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    BenchClock::time_point st = BenchClock::now();
+    svabaAssemblerEngine engine("bench", 0, min_overlap, BENCH_READLEN);
+    engine.fillReadTable(reads);
+    engine.performAssembly(3);
+    contigs = engine.getContigs().size();
+    secs.push_back(__seconds(st, BenchClock::now()));
+  }
+
+  __report("assembly", reads.size(), secs, "contigs", contigs);
+  return 0;
+}
+
+// the overlap step of the assembly on its own: every read of one window
+// against the FM-index of them all, in the exact mode doAssembly runs in.
+// Removing duplicates and building the index are not timed
+static int __bench_overlap() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector reads = __make_reads(__num(5000), window);
+  const int min_overlap = (0.6 * BENCH_READLEN) < 30 ? 30 : 0.6 * BENCH_READLEN;
+
+  ReadTable rt;
+  for (size_t i = 0; i < reads.size(); ++i) {
+    SeqItem si;
+    si.id = "read_" + std::to_string(i);
+    si.seq = reads[i].QualitySequence();
+    rt.addRead(si);
+  }
+
+  svabaAssemblerEngine engine("bench", 0, min_overlap, BENCH_READLEN);
+  ReadTable * rt_nd = engine.removeDuplicates(&rt);
+  SuffixArray * sa_f = new SuffixArray(rt_nd, 1, false);
+  RLBWT * bwt_f = new RLBWT(sa_f, rt_nd);
+  rt_nd->reverseAll();
+  SuffixArray * sa_r = new SuffixArray(rt_nd, 1, false);
+  RLBWT * bwt_r = new RLBWT(sa_r, rt_nd);
+  rt_nd->reverseAll();
+
+  svabaOverlapAlgorithm overlapper(bwt_f, bwt_r, 0, 0, 0, true);
+  overlapper.setExactModeOverlap(true);
+  overlapper.setExactModeIrreducible(true);
+
+  std::vector<double> secs;
+  size_t blocks = 0, fail = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    size_t n = 0;
+    SeqItem si;
+    rt_nd->setZero();
+    BenchClock::time_point st = BenchClock::now();
+    while (rt_nd->getRead(si)) {
+      SeqRecord read;
+      read.id = si.id;
+      read.seq = si.seq;
+      OverlapBlockList obl;
+      overlapper.overlapRead(read, min_overlap, &obl);
+      n += obl.size();
+    }
+    secs.push_back(__seconds(st, BenchClock::now()));
+    fail += r && n != blocks;
+    blocks = n;
+  }
+  size_t items = rt_nd->getCount();
+
+  delete bwt_f;
+  delete bwt_r;
+  delete sa_f;
+  delete sa_r;
+  delete rt_nd;
+
+  __report("overlap", items, secs, "blocks", blocks);
+  if (fail) {
+    std::cerr << "ERROR: overlapRead gave a different number of blocks on a later rep" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+static int __bench_kmer() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector input = __make_reads(__num(5000), window);
+
+  std::vector<double> secs;
+  int corrected = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    SeqLib::BamRecordVector reads = input;
+    std::vector<char*> learn;
+    for (auto& i : reads)
+      learn.push_back(strdup(i.QualitySequence().c_str()));
+
+    BenchClock::time_point st = BenchClock::now();
+    KmerFilter kmer;
+    kmer.makeIndex(learn);
+    corrected = kmer.correctReads(reads);
+    secs.push_back(__seconds(st, BenchClock::now()));
+
+    for (auto& i : learn)
+      free(i);
+  }
+
+  __report("kmer", input.size(), secs, "corrected", corrected);
+  return 0;
+}
+
+static int __bench_bfc() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector input = __make_reads(__num(20000), window);
+
+  std::vector<double> secs;
+  size_t changed = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    SeqLib::BamRecordVector reads = input;
+
+    BenchClock::time_point st = BenchClock::now();
+    SeqLib::BFC bfc;
+    for (auto& i : reads)
+      bfc.AddSequence(i.QualitySequence().c_str(), i.Qualities().c_str(), i.Qname().c_str());
+    bfc.Train();
+    bfc.clear();
+    bfc.ErrorCorrectToTag(reads, "KC");
+    secs.push_back(__seconds(st, BenchClock::now()));
+
+    changed = 0;
+    for (auto& i : reads) {
+      std::string kc = i.GetZTag("KC");
+      changed += !kc.empty() && kc != i.Sequence();
+    }
+  }
+
+  __report("bfc", input.size(), secs, "corrected", changed);
+  return 0;
+}
+
+static int __bench_cluster() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector reads = __make_reads(__num(1000000), window);
+
+  std::vector<double> secs;
+  size_t clusters = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    BenchClock::time_point st = BenchClock::now();
+    DiscordantClusterMap dmap = DiscordantCluster::clusterReads(reads, window, 60, nullptr);
+    clusters = dmap.size();
+    secs.push_back(__seconds(st, BenchClock::now()));
+  }
+
+  __report("cluster", reads.size(), secs, "clusters", clusters);
+  return 0;
+}
+
+static int __bench_coverage() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector reads = __make_reads(__num(1000000), window);
+
+  std::vector<double> secs;
+  int depth = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    BenchClock::time_point st = BenchClock::now();
+    STCoverage cov(window);
+    for (auto& i : reads)
+      cov.addRead(i, 0, false);
+    secs.push_back(__seconds(st, BenchClock::now()));
+    depth = cov.getCoverageAtPosition(0, window.pos2 / 4);
+  }
+
+  __report("coverage", reads.size(), secs, "depth_at_q1", depth);
+  return 0;
+}
+
+// the read hand-off of a window in svaba run, through the real functions:
+// each walker subsamples to its weird-read coverage, collect_and_clear_reads
+// moves the walker reads into one vector and remove_hardclips filters it.
+// Returns the operator new calls, which are only counted in svaba_bench
+static size_t __handoff(const SeqLib::BamRecordVector& reads, SeqLib::BamRecordVector& brv, double& secs) {
+
+  // a tumor and a normal walker with half the reads each, as readBam
+  // leaves them. Not timed. The records share their data with reads
+  WalkerMap walkers;
+  for (size_t i = 0; i < reads.size(); ++i) {
+    svabaBamWalker& w = walkers[i % 2 ? "n000" : "t000"];
+    w.max_cov = BENCH_COVERAGE / 3; // so the subsample drops reads
+    w.weird_cov.addRead(reads[i], 0, false);
+    w.reads.push_back(reads[i]);
+  }
+
+  std::vector<char*> learn_seqs;
+  std::unordered_set<std::string> dedupe;
+
+  size_t before = svabaAllocCount ? svabaAllocCount() : 0;
+  BenchClock::time_point st = BenchClock::now();
+
+  for (auto& w : walkers)
+    w.second.subSampleToWeirdCoverage(w.second.max_cov);
+  collect_and_clear_reads(walkers, brv, learn_seqs, dedupe);
+  remove_hardclips(brv);
+
+  secs = __seconds(st, BenchClock::now());
+  return svabaAllocCount ? svabaAllocCount() - before : 0;
+}
+
+static int __bench_handoff() {
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector reads = __make_reads(__num(100000), window);
+
+  // the SR tag readBam adds, which collect_and_clear_reads dedupes on. Every
+  // 20th read is hardclipped, for remove_hardclips. Only the cigar is
+  // changed, which is all NumHardClip looks at
+  SeqLib::Cigar hc;
+  hc.add(SeqLib::CigarField('M', BENCH_READLEN - 5));
+  hc.add(SeqLib::CigarField('H', 5));
+  size_t nhc = 0;
+  for (size_t i = 0; i < reads.size(); ++i) {
+    reads[i].AddZTag("SR", std::string(i % 2 ? "n000" : "t000") + "_" + std::to_string(reads[i].AlignmentFlag()) + "_" + reads[i].Qname());
+    if (i % 20 == 0) {
+      reads[i].SetCigar(hc);
+      ++nhc;
+    }
+  }
+
+  std::vector<double> secs;
+  size_t allocs = 0, kept = 0;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    SeqLib::BamRecordVector brv;
+    double t;
+    allocs = __handoff(reads, brv, t);
+    secs.push_back(t);
+
+    for (auto& i : brv)
+      if (i.NumHardClip()) {
+	std::cerr << "ERROR: remove_hardclips kept a hardclipped read" << std::endl;
+	return 1;
+      }
+    if ((r && brv.size() != kept) || brv.size() + nhc > reads.size()) {
+      std::cerr << "ERROR: the hand-off kept " << brv.size() << " of " << reads.size() << " reads, " << kept << " before" << std::endl;
+      return 1;
+    }
+    kept = brv.size();
+  }
+
+  std::vector<std::pair<std::string, double>> counters = {{"kept", (double)kept}};
+  if (svabaAllocCount)
+    counters.push_back(std::pair<std::string, double>("allocs", (double)allocs));
+  std::cout << std::setprecision(4)
+	    << "component\treads\tbest_sec\tmedian_sec\tkept\tallocs" << std::endl
+	    << "handoff\t" << reads.size() << "\t" << __best(secs) << "\t" << __median(secs) << "\t" << kept << "\t"
+	    << (svabaAllocCount ? std::to_string(allocs) : std::string("NA")) << std::endl;
+  __record("handoff", reads.size(), secs, counters);
+  return 0;
+}
+
+// samples that look like real calls: mostly low alt counts at typical depths,
+// across the repeat error rates the scorer uses
+static std::vector<SampleInfo> __make_samples(size_t n, std::vector<double>& er) {
+
+  std::mt19937 rng(opt::bench::seed);
+  std::uniform_int_distribution<int> cov_d(0, 120);
+  std::uniform_real_distribution<double> af_d(0, 1);
+  std::uniform_int_distribution<int> er_d(0, 6);
+  const double rates[] = {5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 5e-2, 0.04};
+  const int readlens[] = {0, 101, 151};
+
+  std::vector<SampleInfo> s(n);
+  er.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    s[i].cov = cov_d(rng);
+    s[i].alt = (int)std::round(s[i].cov * af_d(rng) * af_d(rng)) + (i % 17 == 0 ? 3 : 0); // some alt > cov
+    s[i].readlen = readlens[i % 3];
+    er[i] = rates[er_d(rng)];
+  }
+  return s;
+}
+
+static int __bench_score() {
+
+  const size_t n = __num(1000000);
+  std::vector<double> er;
+  std::vector<SampleInfo> input = __make_samples(n, er);
+
+  // scalar reference
+  double t_scalar = 1e300;
+  std::vector<double> s_secs;
+  std::vector<SampleInfo> scalar;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    scalar = input;
+    BenchClock::time_point st = BenchClock::now();
+    for (size_t i = 0; i < n; ++i)
+      scalar[i].modelSelection(er[i]);
+    s_secs.push_back(__seconds(st, BenchClock::now()));
+    t_scalar = std::min(t_scalar, s_secs.back());
+  }
+
+  // batch
+  double t_batch = 1e300;
+  std::vector<double> b_secs;
+  std::vector<SampleInfo> batched;
+  GenotypeBatch gb;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    batched = input;
+    BenchClock::time_point st = BenchClock::now();
+    gb.clear();
+    for (size_t i = 0; i < n; ++i)
+      gb.add(batched[i], er[i]);
+    gb.run();
+    for (size_t i = 0; i < n; ++i)
+      gb.get(i, batched[i]);
+    b_secs.push_back(__seconds(st, BenchClock::now()));
+    t_batch = std::min(t_batch, b_secs.back());
+  }
+
+  // compare
+  double max_diff = 0;
+  size_t gt_mismatch = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const SampleInfo& a = scalar[i];
+    const SampleInfo& b = batched[i];
+    max_diff = std::max(max_diff, std::fabs(a.LO - b.LO));
+    max_diff = std::max(max_diff, std::fabs(a.LO_n - b.LO_n));
+    max_diff = std::max(max_diff, std::fabs(a.af - b.af));
+    for (size_t g = 0; g < 3; ++g)
+      max_diff = std::max(max_diff, std::fabs(a.genotype_likelihoods[g] - b.genotype_likelihoods[g]));
+    if (a.genotype != b.genotype || a.PL != b.PL || a.GQ != b.GQ)
+      ++gt_mismatch;
+  }
+
+  std::cout << std::setprecision(4)
+	    << "component\tsamples\tscalar_sec\tbatch_sec\tscalar_per_sec\tbatch_per_sec\tspeedup\tmax_abs_diff\tgenotype_mismatch" << std::endl
+	    << "score\t" << n << "\t" << t_scalar << "\t" << t_batch << "\t"
+	    << n / t_scalar << "\t" << n / t_batch << "\t" << t_scalar / t_batch << "\t"
+	    << max_diff << "\t" << gt_mismatch << std::endl;
+  __record("score_scalar", n, s_secs);
+  __record("score_batch", n, b_secs, {{"max_abs_diff", max_diff}, {"genotype_mismatch", (double)gt_mismatch}});
+
+  if (max_diff > BENCH_TOLERANCE || gt_mismatch) {
+    std::cerr << "ERROR: batch scoring does not match the scalar reference" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// PON sites on a few chromosomes, and queries of which about half are sites
+static int __bench_pon() {
+
+  const size_t n = __num(1000000);
+  std::mt19937 rng(opt::bench::seed);
+  std::uniform_int_distribution<int> chr_d(0, 23);
+  std::uniform_int_distribution<int> pos_d(1, 50000000);
+  std::uniform_int_distribution<int> cnt_d(2, 40);
+
+  std::vector<PONEntry> sites(n);
+  for (size_t i = 0; i < n; ++i) {
+    sites[i].key = PONFilter::Key(chr_d(rng), pos_d(rng));
+    sites[i].count = cnt_d(rng);
+    sites[i].pad = 0;
+  }
+
+  std::vector<std::pair<int32_t, int32_t>> q(n);
+  for (size_t i = 0; i < n; ++i) {
+    if (i % 2 == 0) {
+      const PONEntry& e = sites[rng() % n];
+      q[i] = std::make_pair((int32_t)(e.key >> 32), (int32_t)(uint32_t)e.key);
+    } else {
+      q[i] = std::make_pair(chr_d(rng), pos_d(rng));
+    }
+  }
+
+  // reference: the string keyed map the PON used to be. Later sites win on a
+  // duplicate key, so give the table the same ones
+  std::unordered_map<std::string, size_t> ref;
+  for (auto& e : sites)
+    ref[std::to_string(e.key >> 32) + "_" + std::to_string((uint32_t)e.key)] = e.count;
+  std::vector<PONEntry> uniq;
+  for (auto& r : ref) {
+    size_t u = r.first.find('_');
+    PONEntry e;
+    e.key = PONFilter::Key(std::stoi(r.first.substr(0, u)), std::stoi(r.first.substr(u + 1)));
+    e.count = r.second;
+    e.pad = 0;
+    uniq.push_back(e);
+  }
+
+  double t_build = 1e300;
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    BenchClock::time_point st = BenchClock::now();
+    PONFilter p(uniq);
+    t_build = std::min(t_build, __seconds(st, BenchClock::now()));
+  }
+  PONFilter pon(uniq);
+
+  double t_map = 1e300;
+  std::vector<double> m_secs;
+  std::vector<int> a(n);
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    BenchClock::time_point st = BenchClock::now();
+    for (size_t i = 0; i < n; ++i) {
+      std::unordered_map<std::string, size_t>::const_iterator ff = ref.find(std::to_string(q[i].first) + "_" + std::to_string(q[i].second));
+      a[i] = ff == ref.end() ? 0 : ff->second;
+    }
+    m_secs.push_back(__seconds(st, BenchClock::now()));
+    t_map = std::min(t_map, m_secs.back());
+  }
+
+  double t_pon = 1e300;
+  std::vector<double> p_secs;
+  std::vector<int> b(n);
+  for (int r = 0; r < opt::bench::reps; ++r) {
+    BenchClock::time_point st = BenchClock::now();
+    for (size_t i = 0; i < n; ++i)
+      b[i] = pon.NSamps(q[i].first, q[i].second);
+    p_secs.push_back(__seconds(st, BenchClock::now()));
+    t_pon = std::min(t_pon, p_secs.back());
+  }
+
+  size_t mismatch = 0, hits = 0;
+  for (size_t i = 0; i < n; ++i) {
+    mismatch += a[i] != b[i];
+    hits += b[i] > 0;
+  }
+
+  std::cout << std::setprecision(4)
+	    << "component\tlookups\tmap_sec\tpon_sec\tmap_per_sec\tpon_per_sec\tspeedup\tbuild_sec\thits\tmismatch" << std::endl
+	    << "pon\t" << n << "\t" << t_map << "\t" << t_pon << "\t"
+	    << n / t_map << "\t" << n / t_pon << "\t" << t_map / t_pon << "\t"
+	    << t_build << "\t" << hits << "\t" << mismatch << std::endl;
+  __record("pon_map", n, m_secs);
+  __record("pon_lookup", n, p_secs, {{"hits", (double)hits}, {"mismatch", (double)mismatch}});
+
+  if (mismatch) {
+    std::cerr << "ERROR: PONFilter lookups do not match the reference map" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// scratch files for the formats component, removed when it is done
+static std::string __tmp_prefix() {
+  const char * d = getenv("TMPDIR");
+  return std::string(d && *d ? d : "/tmp") + "/svaba_formats_" + std::to_string(getpid());
+}
+
+static void __format_row(const std::string& name, size_t n, double w, double r, size_t mismatch) {
+  std::cout << std::setprecision(4) << name << "\t" << n << "\t" << w << "\t" << r << "\t" << mismatch << std::endl;
+  __record(name + "_write", n, {w});
+  __record(name + "_read", n, {r}, {{"mismatch", (double)mismatch}});
+}
+
+// scored breakpoints on three chr, spanning a few store blocks. Every
+// column gets a value, and some samples and read names are missing
+static std::vector<BreakPoint> __make_breakpoints(size_t n) {
+
+  std::mt19937 rng(opt::bench::seed);
+  std::uniform_int_distribution<int> pos_d(1, 50000000);
+  const char * evidence[] = {"INDEL", "ASSMB", "DSCRD", "COMPL"};
+  const char * conf[] = {"PASS", "LOWQUAL", "LOWMAPQ"};
+  const char * gt[] = {"0/0", "0/1", "1/1"};
+
+  std::vector<BreakPoint> v(n);
+  for (size_t i = 0; i < n; ++i) {
+    BreakPoint& b = v[i];
+    std::string chr = std::to_string(1 + i % 3);
+    int32_t p = pos_d(rng);
+    b.b1 = BreakEnd(SeqLib::GenomicRegion(i % 3, p, p), rng() % 61, chr);
+    b.b2 = BreakEnd(SeqLib::GenomicRegion(i % 3, p + 100, p + 100), rng() % 61, chr);
+    b.b1.gr.strand = '+';
+    b.b2.gr.strand = i % 2 ? '-' : '+';
+    b.b1.nm = rng() % 5;
+    b.b2.nm = rng() % 5;
+    b.b1.sub_n = rng() % 3;
+    b.b2.sub_n = rng() % 3;
+    b.dc.mapq1 = rng() % 61;
+    b.dc.mapq2 = rng() % 61;
+    b.evidence = evidence[i % 4];
+    b.confidence = conf[rng() % 3];
+    b.num_align = b.evidence == "INDEL" ? 1 : 2;
+    b.quality = rng() % 61;
+    b.secondary = i % 7 == 0;
+    b.pon = rng() % 4;
+    b.blacklist = i % 11 == 0;
+    b.somatic_score = (int)(rng() % 100) / 4.0;
+    b.somatic_lod = (int)(rng() % 100) / 8.0;
+    b.ref = "ACGT";
+    b.alt = i % 2 ? "A" : "ACGTT";
+    b.homology = i % 3 ? "" : "GT";
+    b.insertion = i % 5 ? "" : "CCA";
+    b.cname = "c_" + chr + "_" + std::to_string(p) + "_C" + std::to_string(i % 9);
+    b.repeat_seq = i % 6 ? "" : "AAAA";
+    b.rs = i % 8 ? "" : "D";
+    b.read_names = i % 2 ? "x" : "r" + std::to_string(i) + ",r" + std::to_string(i + 1);
+    b.bxtable = i % 4 ? "" : "AACC_2";
+    for (int s = 0; s < 2; ++s) {
+      if (s && i % 5 == 0) // no normal
+	continue;
+      SampleInfo& a = b.allele[s ? "n000" : "t000"];
+      a.indel = b.evidence == "INDEL";
+      a.cov = rng() % 100;
+      a.alt = rng() % 20;
+      a.split = rng() % 20;
+      a.cigar = rng() % 20;
+      a.disc = rng() % 20;
+      a.GQ = (int)(rng() % 99);
+      a.LO_n = (int)(rng() % 400) / 16.0;
+      a.LO = (int)(rng() % 400) / 16.0;
+      a.genotype = gt[rng() % 3];
+      a.PL = std::to_string(rng() % 99) + "," + std::to_string(rng() % 99) + ",0";
+    }
+  }
+  return v;
+}
+
+// breakpoint store: all of it back, and a region through the .idx
+static int __check_bps(const std::string& prefix) {
+
+  std::vector<BreakPoint> bps = __make_breakpoints(__num(3 * BPS_BLOCK_SIZE + 100));
+  const std::string file = prefix + ".bps.svb";
+
+  BenchClock::time_point st = BenchClock::now();
+  BreakPointStoreWriter w;
+  bool ok = w.Open(file, {"t000", "n000"}, {"t000_tumor.bam", "n000_normal.bam"});
+  for (size_t i = 0; ok && i < bps.size(); ++i)
+    ok = w.Add(bps[i]);
+  w.Close();
+  double t_write = __seconds(st, BenchClock::now());
+
+  size_t mismatch = ok ? 0 : bps.size();
+  st = BenchClock::now();
+  BreakPointStoreReader r;
+  BreakPoint b;
+  size_t i = 0;
+  if (ok && BreakPointStoreReader::IsStore(file) && r.Open(file) && r.SampleIds().size() == 2 &&
+      r.SampleNames()[1] == "n000_normal.bam") {
+    for (; r.Next(b); ++i)
+      mismatch += i >= bps.size() || b.toFileString(true) != bps[i].toFileString(true);
+  }
+  mismatch += i > bps.size() ? 0 : bps.size() - i;
+  double t_read = __seconds(st, BenchClock::now());
+
+  // the region read gives the records in it, in order
+  const int32_t p1 = 10000000, p2 = 20000000;
+  std::vector<std::string> want, got;
+  for (auto& x : bps)
+    if (x.b1.chr_name == "2" && x.b1.gr.pos1 >= p1 && x.b1.gr.pos1 <= p2)
+      want.push_back(x.toFileString(true));
+  BreakPointStoreReader rr;
+  if (rr.Open(file) && rr.SetRegion("2", p1, p2))
+    while (rr.Next(b))
+      got.push_back(b.toFileString(true));
+  mismatch += want != got;
+
+  __format_row("bps", bps.size(), t_write, t_read, mismatch);
+
+  remove(file.c_str());
+  remove((file + ".idx").c_str());
+  return mismatch ? 1 : 0;
+}
+
+// what of a read the store has to keep
+static std::string __read_fields(const SeqLib::BamRecord& r) {
+  return r.Qname() + "\t" + std::to_string(r.AlignmentFlag()) + "\t" + std::to_string(r.ChrID()) + "\t" +
+    std::to_string(r.Position()) + "\t" + std::to_string(r.MapQuality()) + "\t" + r.CigarString() + "\t" +
+    std::to_string(r.MatePosition()) + "\t" + r.Sequence() + "\t" + r.Qualities() + "\t" + r.GetZTag("SR");
+}
+
+static size_t __window_mismatch(const ExtractWindow& a, const ExtractWindow& b) {
+
+  size_t m = a.region.chr != b.region.chr || a.region.pos1 != b.region.pos1 || a.region.pos2 != b.region.pos2;
+
+  m += a.reads.size() != b.reads.size();
+  for (size_t i = 0; i < a.reads.size() && i < b.reads.size(); ++i)
+    m += __read_fields(a.reads[i]) != __read_fields(b.reads[i]);
+
+  m += a.cigmap.size() != b.cigmap.size();
+  for (auto& c : a.cigmap) {
+    auto ff = b.cigmap.find(c.first);
+    m += ff == b.cigmap.end() || ff->second.entries() != c.second.entries();
+  }
+
+  m += a.cov.size() != b.cov.size();
+  for (auto& c : a.cov) {
+    auto ff = b.cov.find(c.first);
+    if (ff == b.cov.end()) {
+      ++m;
+      continue;
+    }
+    for (int32_t p = a.region.pos1; p <= a.region.pos2; ++p)
+      m += c.second.getCoverageAtPosition(a.region.chr, p) != ff->second.getCoverageAtPosition(a.region.chr, p);
+  }
+
+  std::vector<std::vector<size_t>> ma, mb;
+  for (auto& r : a.mate_regions)
+    ma.push_back({(size_t)r.chr, (size_t)r.pos1, (size_t)r.pos2, r.count, (size_t)r.round});
+  for (auto& r : b.mate_regions)
+    mb.push_back({(size_t)r.chr, (size_t)r.pos1, (size_t)r.pos2, r.count, (size_t)r.round});
+  m += ma != mb;
+
+  return m;
+}
+
+// extract store: the params header, and two windows read back out of order
+static int __check_extract(const std::string& prefix) {
+
+  ExtractParams p;
+  p.header = "@HD\tVN:1.4\n@SQ\tSN:1\tLN:250000000\n";
+  p.bams = {{"t000", "tumor.bam"}, {"n000", "normal.bam"}};
+  p.readlen = BENCH_READLEN;
+  p.max_mapq = 60;
+  p.min_dscrd_size = 1000;
+  p.mate_lookup_min = 3;
+  p.min_isize_for_disc = {{"rg1", 800}, {"rg2", 950}};
+
+  SeqLib::GenomicRegion window;
+  SeqLib::BamRecordVector reads = __make_reads(__num(5000), window);
+
+  std::vector<ExtractWindow> ww(2);
+  for (size_t k = 0; k < ww.size(); ++k) {
+    ExtractWindow& w = ww[k];
+    w.region = SeqLib::GenomicRegion(0, k * window.pos2 / 2, (k + 1) * window.pos2 / 2);
+    STCoverage& cov = w.cov["t000"];
+    cov = STCoverage(w.region);
+    for (auto& r : reads)
+      if (r.Position() >= w.region.pos1 && r.Position() < w.region.pos2) {
+	w.reads.push_back(r);
+	cov.addRead(r, 0, false);
+      }
+    CigarIndex& cm = w.cigmap["t000"];
+    for (int32_t i = 0; i < 50; ++i)
+      cm.add(makeCigarKey(0, w.region.pos1 + 37 * i, 1 + i % 30, i % 2 ? 'I' : 'D'), 1 + i % 4);
+    cm.settle();
+    MateRegion mr(1, 1000000 * (k + 1), 1000000 * (k + 1) + 5000);
+    mr.count = 4 + k;
+    mr.round = k;
+    w.mate_regions.add(mr);
+  }
+
+  const std::string file = prefix + ".extract";
+  BenchClock::time_point st = BenchClock::now();
+  bool ok;
+  {
+    svabaExtractWriter w;
+    ok = w.Open(file, p);
+    for (auto& x : ww)
+      ok = ok && w.WriteWindow(x);
+  }
+  double t_write = __seconds(st, BenchClock::now());
+
+  size_t mismatch = ok ? 0 : ww.size();
+  st = BenchClock::now();
+  svabaExtractReader r;
+  if (ok && r.Open(file)) {
+    const ExtractParams& q = r.Params();
+    mismatch += q.header != p.header || q.bams != p.bams || q.readlen != p.readlen || q.max_mapq != p.max_mapq ||
+      q.min_dscrd_size != p.min_dscrd_size || q.mate_lookup_min != p.mate_lookup_min ||
+      q.min_isize_for_disc != p.min_isize_for_disc || r.NumWindows() != ww.size();
+    for (size_t k = ww.size(); k-- > 0;) {
+      ExtractWindow x;
+      mismatch += !r.ReadWindow(ww[k].region, x) || __window_mismatch(ww[k], x);
+    }
+  } else {
+    mismatch = ww.size();
+  }
+  double t_read = __seconds(st, BenchClock::now());
+
+  __format_row("extract", ww[0].reads.size() + ww[1].reads.size(), t_write, t_read, mismatch);
+
+  remove(file.c_str());
+  remove((file + ".idx").c_str());
+  return mismatch ? 1 : 0;
+}
+
+// DBSnp index: same sites as the VCF it was made from, and not used
+// in place of the VCF once the VCF has changed
+static int __check_svdb(const std::string& prefix) {
+
+  const size_t n = __num(20000);
+  std::mt19937 rng(opt::bench::seed);
+  std::uniform_int_distribution<int> pos_d(1, 50000000);
+  const SeqLib::BamHeader h("@HD\tVN:1.4\n@SQ\tSN:1\tLN:250000000\n@SQ\tSN:2\tLN:250000000\n");
+
+  const std::string vcf = prefix + ".dbsnp.vcf";
+  std::vector<std::string> keys;
+  {
+    std::ofstream os(vcf);
+    os << "##fileformat=VCFv4.1\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n";
+    for (size_t i = 0; i < n; ++i) {
+      int p = pos_d(rng);
+      os << 1 + i % 2 << "\t" << p << "\trs" << i << "\t" << (i % 3 ? "A\tAGT" : "ACGTA\tA") << "\t.\t.\t.\n";
+      keys.push_back(std::to_string(i % 2) + "_" + std::to_string(p));
+      keys.push_back(std::to_string(i % 2) + "_" + std::to_string(pos_d(rng))); // mostly not a site
+    }
+  }
+
+  DBSnpFilter from_vcf(vcf, h);
+
+  BenchClock::time_point st = BenchClock::now();
+  bool ok = DBSnpFilter::BuildIndex(vcf, vcf + ".svdb");
+  double t_write = __seconds(st, BenchClock::now());
+
+  st = BenchClock::now();
+  DBSnpFilter from_idx(vcf + ".svdb", h);
+  size_t mismatch = ok ? 0 : 1;
+  mismatch += !DBSnpFilter::IsIndex(vcf + ".svdb") || from_idx.size() != from_vcf.size();
+  for (auto& k : keys)
+    mismatch += from_idx.queryHash(k) != from_vcf.queryHash(k);
+  double t_read = __seconds(st, BenchClock::now());
+
+  // add a site, so the next to the VCF index is stale
+  {
+    std::ofstream os(vcf, std::ios::app);
+    os << "2\t60000000\trs_new\tA\tAGT\t.\t.\t.\n";
+  }
+  DBSnpFilter from_stale(vcf, h);
+  mismatch += from_stale.size() != from_vcf.size() + 1 || !from_stale.queryHash("1_60000000");
+
+  __format_row("svdb", n, t_write, t_read, mismatch);
+
+  remove(vcf.c_str());
+  remove((vcf + ".svdb").c_str());
+  return mismatch ? 1 : 0;
+}
+
+// PON index: built from two stores and a bps.txt.gz of the same
+// breakpoints, every site with the number of files it is in
+static int __check_pon(const std::string& prefix) {
+
+  std::vector<BreakPoint> bps = __make_breakpoints(__num(3 * BPS_BLOCK_SIZE + 100));
+  // not in name order, so the lookups have to go through the chr names
+  const SeqLib::BamHeader h("@HD\tVN:1.4\n@SQ\tSN:3\tLN:250000000\n@SQ\tSN:1\tLN:250000000\n@SQ\tSN:2\tLN:250000000\n");
+  const std::vector<std::string> files = {prefix + ".pon0.bps.svb", prefix + ".pon1.bps.svb", prefix + ".pon2.bps.txt.gz"};
+
+  // file f has every record but one in f + 2, so sites are in 1 to 3 files
+  std::map<std::pair<int32_t, int32_t>, int> want;
+  bool ok = true;
+  for (size_t f = 0; f < files.size(); ++f) {
+    std::set<std::pair<int32_t, int32_t>> keys;
+    BreakPointStoreWriter w;
+    ogzstream gz;
+    if (f < 2)
+      ok = ok && w.Open(files[f], {"n000", "t000"}, {"n000", "t000"});
+    else {
+      gz.open(files[f].c_str(), std::ios::out);
+      gz << BreakPoint::header() << "\tn000\tt000\n";
+    }
+    for (size_t i = 0; i < bps.size(); ++i) {
+      if (i % (f + 2) == 0)
+	continue;
+      BreakPoint& b = bps[i];
+      if (f < 2)
+	ok = ok && w.Add(b);
+      else
+	gz << b.toFileString(true) << "\n";
+      if (b.evidence != "INDEL")
+	continue;
+      for (auto& a : b.allele)
+	if (std::max(a.second.alt, a.second.cigar) > 0) {
+	  keys.insert(std::make_pair(h.Name2ID(b.b1.chr_name), b.b1.gr.pos1));
+	  break;
+	}
+    }
+    w.Close();
+    if (f == 2)
+      gz.close();
+    for (auto& k : keys)
+      ++want[k];
+  }
+
+  BenchClock::time_point st = BenchClock::now();
+  ok = ok && PONFilter::Build(files, prefix + ".svpon", 2, 1);
+  double t_write = __seconds(st, BenchClock::now());
+
+  size_t mismatch = ok ? 0 : 1;
+  st = BenchClock::now();
+  if (ok && PONFilter::IsIndex(prefix + ".svpon")) {
+    PONFilter pon(prefix + ".svpon", h);
+    uint64_t size;
+    int64_t mtime;
+    mismatch += pon.size() != want.size() || pon.SourceFiles() != files.size() ||
+      !PONFilter::SourceStat(files, size, mtime) || pon.SourceSize() != size || pon.SourceMtime() != mtime;
+    for (auto& k : want)
+      mismatch += pon.NSamps(k.first.first, k.first.second) != k.second;
+    for (auto& b : bps) { // the other end is not a site
+      int32_t c = h.Name2ID(b.b2.chr_name);
+      mismatch += !want.count(std::make_pair(c, b.b2.gr.pos1)) && pon.NSamps(c, b.b2.gr.pos1);
+    }
+  } else {
+    mismatch = 1;
+  }
+  double t_read = __seconds(st, BenchClock::now());
+
+  __format_row("pon_index", want.size(), t_write, t_read, mismatch);
+
+  for (auto& f : files) {
+    remove(f.c_str());
+    remove((f + ".idx").c_str());
+  }
+  remove((prefix + ".svpon").c_str());
+  return mismatch ? 1 : 0;
+}
+
+static int __bench_formats() {
+
+  const std::string prefix = __tmp_prefix();
+  std::cout << "component\trecords\twrite_sec\tread_sec\tmismatch" << std::endl;
+
+  int fail = 0;
+  fail |= __check_bps(prefix);
+  fail |= __check_extract(prefix);
+  fail |= __check_svdb(prefix);
+  fail |= __check_pon(prefix);
+
+  if (fail)
+    std::cerr << "ERROR: an on-disk format did not read back as written" << std::endl;
+  return fail;
+}
+
+// reads of one sample to <id>.<name>_1.fq / _2.fq, with errors at Q30
+// VCFFile::deduplicate on the SVs of __make_breakpoints, with a copy of
+// every 4th one moved a few bp, which has to come out as a dup. Dedupe
+// on threads has to mark the same dups as on one
+static int __bench_dedupe() {
+
+  std::vector<BreakPoint> bps = __make_breakpoints(__num(200000));
+  const SeqLib::BamHeader h("@HD\tVN:1.4\n@SQ\tSN:1\tLN:250000000\n@SQ\tSN:2\tLN:250000000\n@SQ\tSN:3\tLN:250000000\n");
+
+  VCFFile vcf(__tmp_prefix(), VCFHeader(), true);
+  std::vector<size_t> copies;
+  for (size_t i = 0; i < bps.size(); ++i) {
+    vcf.add(std::shared_ptr<ReducedBreakPoint>(new ReducedBreakPoint(bps[i], h)));
+    if (i % 4 != 1) // ASSMB
+      continue;
+    BreakPoint c = bps[i];
+    const int32_t d = 1 + i % 9; // within the pad of a 100 bp event
+    c.b1.gr.pos1 += d;
+    c.b2.gr.pos1 += d;
+    if (vcf.add(std::shared_ptr<ReducedBreakPoint>(new ReducedBreakPoint(c, h))))
+      copies.push_back(vcf.svs.size() - 1);
+  }
+  vcf.finalize(); // dedupes once, on one thread
+
+  std::vector<bool> want;
+  for (auto& s : vcf.svs)
+    want.push_back(s.dup);
+
+  std::vector<double> secs;
+  size_t dups = 0, missed = 0, mismatch = 0;
+  for (int r = 0; r <= opt::bench::reps; ++r) {
+    // the last pass is untimed, on threads
+    vcf.num_threads = r < opt::bench::reps ? 1 : 4;
+    for (auto& s : vcf.svs)
+      s.dup = false;
+    BenchClock::time_point st = BenchClock::now();
+    vcf.deduplicate();
+    if (r < opt::bench::reps)
+      secs.push_back(__seconds(st, BenchClock::now()));
+    dups = 0;
+    for (size_t i = 0; i < vcf.svs.size(); ++i) {
+      dups += vcf.svs[i].dup;
+      mismatch += vcf.svs[i].dup != want[i];
+    }
+  }
+  for (auto& i : copies)
+    missed += !vcf.svs[i].dup;
+
+  std::cout << std::setprecision(4)
+	    << "component\tbreak_pairs\tbest_sec\tmedian_sec\tdups\tmissed\tmismatch" << std::endl
+	    << "dedupe\t" << vcf.svs.size() << "\t" << __best(secs) << "\t" << __median(secs) << "\t"
+	    << dups << "\t" << missed << "\t" << mismatch << std::endl;
+  __record("dedupe", vcf.svs.size(), secs, {{"dups", (double)dups}, {"missed", (double)missed}, {"mismatch", (double)mismatch}});
+
+  if (missed || mismatch) {
+    std::cerr << "ERROR: deduplicate missed " << missed << " moved copies and marked " << mismatch << " differently from one thread" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+static size_t __write_fastq_pair(ReadSim& rs, const std::string& name, int cov) {
+
+  std::vector<std::string> reads1, reads2, qual1, qual2;
+  const std::vector<std::string> quality_scores = {std::string(BENCH_READLEN, '?')};
+  rs.samplePairedEndReadsToCoverage(reads1, reads2, qual1, qual2, cov, 0, 0, 0,
+				    BENCH_READLEN, BENCH_ISIZE, 50, quality_scores);
+
+  std::ofstream pe1(opt::bench::id + "." + name + "_1.fq");
+  std::ofstream pe2(opt::bench::id + "." + name + "_2.fq");
+  for (size_t i = 0; i < reads1.size(); ++i) {
+    rs.baseQualityRelevantErrors(reads1[i], qual1[i]);
+    rs.baseQualityRelevantErrors(reads2[i], qual2[i]);
+    pe1 << "@" << name << i << "\n" << reads1[i] << "\n+\n" << qual1[i] << "\n";
+    pe2 << "@" << name << i << "\n" << reads2[i] << "\n+\n" << qual2[i] << "\n";
+  }
+  return reads1.size();
+}
+
+// chr:pos1-pos2 on the first contig of the reference. SimGenome puts its breaks on chr 0
+// and SeqFrag fetches it by the name "1"
+static bool __sim_region(faidx_t * findex, SeqLib::GenomicRegion& gg) {
+
+  std::string r = opt::bench::region;
+  r.erase(std::remove(r.begin(), r.end(), ','), r.end());
+  size_t c = r.rfind(':');
+  size_t d = r.find('-', c == std::string::npos ? 0 : c);
+  if (c == std::string::npos || d == std::string::npos)
+    return false;
+  if (faidx_nseq(findex) < 1 || r.substr(0, c) != faidx_iseq(findex, 0))
+    return false;
+  gg = SeqLib::GenomicRegion(0, std::stoi(r.substr(c + 1, d - c - 1)), std::stoi(r.substr(d + 1)));
+  return gg.pos2 > gg.pos1 && gg.pos2 <= faidx_seq_len(findex, faidx_iseq(findex, 0));
+}
+
+// tumor / normal reads and truth set for bin/svaba-benchmark.sh. Seeded, so repeatable
+static int __sim_tumor_normal() {
+
+  srand(opt::bench::seed);
+  std::cerr << "...simulating tumor / normal with seed " << opt::bench::seed << std::endl;
+
+  SeqLib::GenomicRegion gg;
+
+  // random reference, a single contig "1"
+  if (opt::bench::synthetic_len > 0) {
+    opt::bench::refgenome = opt::bench::id + ".ref.fa";
+    std::cerr << "...writing synthetic reference " << opt::bench::refgenome << " of " << opt::bench::synthetic_len << " bp" << std::endl;
+    std::ofstream rf(opt::bench::refgenome);
+    rf << ">1\n";
+    const char bases[] = "ACGT";
+    for (int i = 0; i < opt::bench::synthetic_len; ++i) {
+      rf << bases[rand() % 4];
+      if (i % 60 == 59)
+	rf << "\n";
+    }
+    rf << "\n";
+    rf.close();
+    if (fai_build(opt::bench::refgenome.c_str()) != 0) {
+      std::cerr << "ERROR: Could not index " << opt::bench::refgenome << std::endl;
+      return 1;
+    }
+    gg = SeqLib::GenomicRegion(0, 1, opt::bench::synthetic_len);
+  } else if (opt::bench::refgenome.empty() || opt::bench::region.empty()) {
+    std::cerr << "ERROR: sim needs -G and -k, or --synthetic-ref" << std::endl;
+    return 1;
+  }
+
+  faidx_t * findex = fai_load(opt::bench::refgenome.c_str());
+  if (!findex) {
+    std::cerr << "ERROR: Could not load the index of " << opt::bench::refgenome << std::endl;
+    return 1;
+  }
+  if (opt::bench::synthetic_len <= 0 && !__sim_region(findex, gg)) {
+    std::cerr << "ERROR: -k " << opt::bench::region << " must be a region of the first contig of -G" << std::endl;
+    fai_destroy(findex);
+    return 1;
+  }
+
+  int tcov = 30, ncov = 30;
+  char comma;
+  std::istringstream cs(opt::bench::coverage);
+  if (!(cs >> tcov))
+    tcov = 30;
+  ncov = (cs >> comma >> ncov) ? ncov : tcov;
+
+  std::cerr << "--Generating breaks on: " << gg << std::endl;
+  std::cerr << "--Total number of rearrangement breaks: " << opt::bench::nsv << std::endl;
+  std::cerr << "--Total (approx) number of indels: " << opt::bench::nindel << std::endl;
+  SimGenome sg(gg, opt::bench::nsv, opt::bench::nindel, findex, false, 0);
+
+  // truth set. SV lines are chr, pos1, strand1, pos2, strand2, insert length and
+  // indel lines are length, type, chr, pos1, pos2, fragment, ref, alt
+  std::ofstream truth(opt::bench::id + ".truth.tsv");
+  std::istringstream bs(sg.printBreaks());
+  std::string line;
+  while (std::getline(bs, line))
+    truth << "SV\t" << line << "\n";
+  for (auto& i : sg.m_indels)
+    truth << "INDEL\t" << i << "\n";
+  truth.close();
+
+  // tumor is the rearranged genome, normal is the reference region
+  ReadSim tumor;
+  tumor.addAllele(sg.getSequence(), 1);
+  size_t nt = __write_fastq_pair(tumor, "tumor", tcov);
+
+  int len = 0;
+  std::string chr = faidx_iseq(findex, 0);
+  char * seq = faidx_fetch_seq(findex, const_cast<char*>(chr.c_str()), gg.pos1 - 1, gg.pos2 - 1, &len);
+  fai_destroy(findex);
+  if (!seq) {
+    std::cerr << "ERROR: Could not read the region " << gg << " from " << opt::bench::refgenome << std::endl;
+    return 1;
+  }
+  ReadSim normal;
+  normal.addAllele(std::string(seq), 1);
+  free(seq);
+  size_t nn = __write_fastq_pair(normal, "normal", ncov);
+
+  std::cerr << "...wrote " << nt << " tumor and " << nn << " normal read pairs, and the truth set " << opt::bench::id << ".truth.tsv" << std::endl;
+  return 0;
+}
+
+void runBenchmark(int argc, char** argv) {
+
+  // argv[0] is "benchmark", argv[1] the component
+  std::string component = argc > 1 ? argv[1] : "";
+  bool die = component.empty() || component[0] == '-';
+
+  if (!die) {
+    --argc; ++argv;
+    for (char c; (c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1;) {
+      std::istringstream arg(optarg != NULL ? optarg : "");
+      switch (c) {
+      case 'n': arg >> opt::bench::num; break;
+      case 'r': arg >> opt::bench::reps; break;
+      case 's': arg >> opt::bench::seed; break;
+      case 'j': arg >> opt::bench::json; break;
+      case 'a': arg >> opt::bench::id; break;
+      case 'G': arg >> opt::bench::refgenome; break;
+      case 'k': arg >> opt::bench::region; break;
+      case 'c': arg >> opt::bench::coverage; break;
+      case 'R': arg >> opt::bench::nsv; break;
+      case 'X': arg >> opt::bench::nindel; break;
+      case OPT_SYNTHETIC_REF: arg >> opt::bench::synthetic_len; break;
+      default: die = true; break;
+      }
+    }
+  }
+
+  if (opt::bench::reps < 1)
+    opt::bench::reps = 1;
+
+  typedef int (*BenchFunc)();
+  const std::vector<std::pair<std::string, BenchFunc>> components = {
+    {"score", __bench_score}, {"pon", __bench_pon}, {"assembly", __bench_assembly}, {"overlap", __bench_overlap},
+    {"kmer", __bench_kmer}, {"bfc", __bench_bfc}, {"cluster", __bench_cluster}, {"coverage", __bench_coverage},
+    {"handoff", __bench_handoff}, {"dedupe", __bench_dedupe}, {"formats", __bench_formats} };
+
+  if (!die && component == "sim") {
+    if (__sim_tumor_normal())
+      exit(EXIT_FAILURE);
+    return;
+  }
+
+  bool known = component == "all";
+  for (auto& c : components)
+    known = known || c.first == component;
+
+  if (die || !known) {
+    std::cerr << "\n" << BENCHMARK_USAGE_MESSAGE;
+    exit(EXIT_FAILURE);
+  }
+
+  int fail = 0;
+  for (auto& c : components)
+    if (component == "all" || c.first == component)
+      fail |= c.second();
+
+  if (!opt::bench::json.empty() && !__write_json(opt::bench::json)) {
+    std::cerr << "ERROR: Could not write " << opt::bench::json << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (fail)
+    exit(EXIT_FAILURE);
+}
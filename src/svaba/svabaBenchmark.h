@@ -0,0 +1,7 @@
+#ifndef SVABA_BENCHMARK_H__
+#define SVABA_BENCHMARK_H__
+
+/** svaba benchmark: time internal components on synthetic input */
+void runBenchmark(int argc, char** argv);
+
+#endif
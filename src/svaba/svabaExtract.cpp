@@ -0,0 +1,303 @@
+#include "svabaExtract.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "htslib/sam.h"
+
+#define EXTRACT_MAGIC "SVX\2"
+
+// low-level helpers for the binary layout. Everything is host byte order
+static bool __write_int(BGZF * fp, int32_t v) {
+  return bgzf_write(fp, &v, sizeof(int32_t)) == sizeof(int32_t);
+}
+
+static bool __read_int(BGZF * fp, int32_t& v) {
+  return bgzf_read(fp, &v, sizeof(int32_t)) == sizeof(int32_t);
+}
+
+static bool __write_string(BGZF * fp, const std::string& s) {
+  if (!__write_int(fp, s.length()))
+    return false;
+  return s.empty() || bgzf_write(fp, s.c_str(), s.length()) == (ssize_t)s.length();
+}
+
+static bool __read_string(BGZF * fp, std::string& s) {
+  int32_t len;
+  if (!__read_int(fp, len) || len < 0)
+    return false;
+  s.resize(len);
+  return !len || bgzf_read(fp, &s[0], len) == len;
+}
+
+static bool __write_region(BGZF * fp, const SeqLib::GenomicRegion& gr) {
+  return __write_int(fp, gr.chr) && __write_int(fp, gr.pos1) && __write_int(fp, gr.pos2);
+}
+
+static bool __read_region(BGZF * fp, SeqLib::GenomicRegion& gr) {
+  int32_t c, p1, p2;
+  if (!__read_int(fp, c) || !__read_int(fp, p1) || !__read_int(fp, p2))
+    return false;
+  gr.chr = c;
+  gr.pos1 = p1;
+  gr.pos2 = p2;
+  return true;
+}
+
+// write coverage as runs of consecutive positions with the same count
+static bool __write_coverage(BGZF * fp, const STCoverage& cov) {
+
+  std::vector<int32_t> runs; // chr, start, len, count
+  const std::vector<CovMap>& maps = cov.GetCoverageMaps();
+  for (size_t c = 0; c < maps.size(); ++c) {
+
+    std::vector<std::pair<int,int>> pc(maps[c].begin(), maps[c].end());
+    std::sort(pc.begin(), pc.end());
+
+    for (size_t i = 0; i < pc.size(); ++i) {
+      size_t n = runs.size();
+      if (n && runs[n-4] == (int)c && runs[n-3] + runs[n-2] == pc[i].first && runs[n-1] == pc[i].second) {
+	++runs[n-2];
+      } else {
+	runs.push_back(c);
+	runs.push_back(pc[i].first);
+	runs.push_back(1);
+	runs.push_back(pc[i].second);
+      }
+    }
+  }
+
+  if (!__write_int(fp, runs.size() / 4))
+    return false;
+  ssize_t bytes = runs.size() * sizeof(int32_t);
+  return !bytes || bgzf_write(fp, &runs[0], bytes) == bytes;
+}
+
+static bool __read_coverage(BGZF * fp, STCoverage& cov) {
+
+  int32_t nruns;
+  if (!__read_int(fp, nruns) || nruns < 0)
+    return false;
+
+  std::vector<int32_t> runs(nruns * 4);
+  ssize_t bytes = runs.size() * sizeof(int32_t);
+  if (bytes && bgzf_read(fp, &runs[0], bytes) != bytes)
+    return false;
+
+  for (size_t i = 0; i < runs.size(); i += 4)
+    for (int32_t p = runs[i+1]; p < runs[i+1] + runs[i+2]; ++p)
+      cov.setCoverageAtPosition(runs[i], p, runs[i+3]);
+
+  return true;
+}
+
+bool svabaExtractWriter::Open(const std::string& file, const ExtractParams& p) {
+
+  m_fp = bgzf_open(file.c_str(), "w");
+  if (!m_fp)
+    return false;
+
+  m_idx.open(file + ".idx");
+  if (!m_idx.is_open())
+    return false;
+
+  bool ok = bgzf_write(m_fp, EXTRACT_MAGIC, 4) == 4;
+  ok = ok && __write_string(m_fp, p.header);
+
+  ok = ok && __write_int(m_fp, p.bams.size());
+  for (auto& b : p.bams)
+    ok = ok && __write_string(m_fp, b.first) && __write_string(m_fp, b.second);
+
+  ok = ok && __write_int(m_fp, p.readlen) && __write_int(m_fp, p.max_mapq) &&
+    __write_int(m_fp, p.min_dscrd_size) && __write_int(m_fp, p.mate_lookup_min);
+
+  ok = ok && __write_int(m_fp, p.min_isize_for_disc.size());
+  for (auto& i : p.min_isize_for_disc)
+    ok = ok && __write_string(m_fp, i.first) && __write_int(m_fp, i.second);
+
+  // start the windows on a fresh block
+  ok = ok && bgzf_flush(m_fp) == 0;
+
+  return ok;
+}
+
+bool svabaExtractWriter::WriteWindow(const ExtractWindow& w) {
+
+  if (!m_fp)
+    return false;
+
+  int64_t voffset = bgzf_tell(m_fp);
+
+  bool ok = __write_region(m_fp, w.region);
+
+  // per-bam cigar maps and coverage
+  ok = ok && __write_int(m_fp, w.cigmap.size());
+  for (auto& c : w.cigmap) {
+    ok = ok && __write_string(m_fp, c.first) && __write_int(m_fp, c.second.size());
+    for (auto& k : c.second.entries())
+      ok = ok && bgzf_write(m_fp, &k.first, sizeof(CigarKey)) == sizeof(CigarKey) && __write_int(m_fp, k.second);
+  }
+
+  ok = ok && __write_int(m_fp, w.cov.size());
+  for (auto& c : w.cov)
+    ok = ok && __write_string(m_fp, c.first) && __write_coverage(m_fp, c.second);
+
+  // mate regions
+  ok = ok && __write_int(m_fp, w.mate_regions.size());
+  for (auto& m : w.mate_regions)
+    ok = ok && __write_region(m_fp, m) && __write_int(m_fp, m.count) && __write_int(m_fp, m.round);
+
+  // the reads, as raw bam records
+  ok = ok && __write_int(m_fp, w.reads.size());
+  for (auto& r : w.reads)
+    ok = ok && bam_write1(m_fp, r.raw()) >= 0;
+
+  if (!ok)
+    return false;
+
+  m_idx << w.region.chr << "\t" << w.region.pos1 << "\t" << w.region.pos2 << "\t"
+	<< voffset << "\t" << w.reads.size() << std::endl;
+
+  return true;
+}
+
+void svabaExtractWriter::Close() {
+
+  if (m_fp) {
+    bgzf_close(m_fp);
+    m_fp = nullptr;
+  }
+  if (m_idx.is_open())
+    m_idx.close();
+}
+
+svabaExtractReader::~svabaExtractReader() {
+  if (m_fp)
+    bgzf_close(m_fp);
+}
+
+bool svabaExtractReader::Open(const std::string& file) {
+
+  // load the index
+  std::ifstream idx(file + ".idx");
+  if (!idx.is_open()) {
+    std::cerr << "ERROR: Cannot open extract index " << file << ".idx" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(idx, line)) {
+    std::istringstream iss(line);
+    SeqLib::GenomicRegion gr;
+    int64_t voffset;
+    if (!(iss >> gr.chr >> gr.pos1 >> gr.pos2 >> voffset))
+      continue;
+    m_index[gr] = voffset;
+  }
+
+  m_fp = bgzf_open(file.c_str(), "r");
+  if (!m_fp)
+    return false;
+
+  // read the params header
+  char magic[4];
+  if (bgzf_read(m_fp, magic, 4) != 4 || memcmp(magic, EXTRACT_MAGIC, 3)) {
+    std::cerr << "ERROR: Not an svaba extract store: " << file << std::endl;
+    return false;
+  }
+  if (memcmp(magic, EXTRACT_MAGIC, 4)) {
+    std::cerr << "ERROR: Extract store " << file << " is from an older svaba. Re-run svaba extract" << std::endl;
+    return false;
+  }
+
+  bool ok = __read_string(m_fp, m_params.header);
+
+  int32_t n = 0;
+  ok = ok && __read_int(m_fp, n);
+  for (int32_t i = 0; ok && i < n; ++i) {
+    std::string id, path;
+    ok = __read_string(m_fp, id) && __read_string(m_fp, path);
+    m_params.bams[id] = path;
+  }
+
+  ok = ok && __read_int(m_fp, m_params.readlen) && __read_int(m_fp, m_params.max_mapq) &&
+    __read_int(m_fp, m_params.min_dscrd_size) && __read_int(m_fp, m_params.mate_lookup_min);
+
+  ok = ok && __read_int(m_fp, n);
+  for (int32_t i = 0; ok && i < n; ++i) {
+    std::string rg;
+    int32_t mi;
+    ok = __read_string(m_fp, rg) && __read_int(m_fp, mi);
+    m_params.min_isize_for_disc[rg] = mi;
+  }
+
+  if (!ok)
+    std::cerr << "ERROR: Truncated header in extract store " << file << std::endl;
+
+  return ok;
+}
+
+bool svabaExtractReader::ReadWindow(const SeqLib::GenomicRegion& gr, ExtractWindow& w) {
+
+  // lookup on coordinates only
+  SeqLib::GenomicRegion key(gr.chr, gr.pos1, gr.pos2);
+  std::map<SeqLib::GenomicRegion, int64_t>::const_iterator ff = m_index.find(key);
+  if (ff == m_index.end() || !m_fp)
+    return false;
+
+  if (bgzf_seek(m_fp, ff->second, SEEK_SET) < 0)
+    return false;
+
+  bool ok = __read_region(m_fp, w.region);
+
+  int32_t n = 0, m = 0;
+  ok = ok && __read_int(m_fp, n);
+  for (int32_t i = 0; ok && i < n; ++i) {
+    std::string id;
+    ok = __read_string(m_fp, id) && __read_int(m_fp, m);
+    CigarIndex& cm = w.cigmap[id];
+    for (int32_t j = 0; ok && j < m; ++j) {
+      CigarKey k;
+      int32_t c;
+      ok = bgzf_read(m_fp, &k, sizeof(CigarKey)) == sizeof(CigarKey) && __read_int(m_fp, c);
+      cm.add(k, c);
+    }
+    cm.settle();
+  }
+
+  ok = ok && __read_int(m_fp, n);
+  for (int32_t i = 0; ok && i < n; ++i) {
+    std::string id;
+    ok = __read_string(m_fp, id) && __read_coverage(m_fp, w.cov[id]);
+  }
+
+  ok = ok && __read_int(m_fp, n);
+  for (int32_t i = 0; ok && i < n; ++i) {
+    SeqLib::GenomicRegion mr;
+    int32_t c, rd;
+    ok = __read_region(m_fp, mr) && __read_int(m_fp, c) && __read_int(m_fp, rd);
+    MateRegion mm(mr.chr, mr.pos1, mr.pos2);
+    mm.count = c;
+    mm.round = rd;
+    w.mate_regions.add(mm);
+  }
+
+  ok = ok && __read_int(m_fp, n);
+  w.reads.reserve(w.reads.size() + std::max(n, 0));
+  for (int32_t i = 0; ok && i < n; ++i) {
+    bam1_t * b = bam_init1();
+    if (bam_read1(m_fp, b) < 0) {
+      bam_destroy1(b);
+      ok = false;
+      break;
+    }
+    SeqLib::BamRecord r;
+    r.assign(b); // takes ownership
+    w.reads.push_back(r);
+  }
+
+  return ok;
+}
@@ -0,0 +1,113 @@
+#ifndef SVABA_EXTRACT_H__
+#define SVABA_EXTRACT_H__
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <unordered_map>
+
+#include "htslib/bgzf.h"
+
+#include "SeqLib/BamRecord.h"
+#include "SeqLib/GenomicRegion.h"
+#include "STCoverage.h"
+#include "CigarIndex.h"
+#include "svabaBamWalker.h"
+
+// values learned from the BAMs at extract time. A re-run from the
+// store needs these, since it never opens the BAMs
+struct ExtractParams {
+
+  std::string header; // text of the main BAM header
+  std::map<std::string, std::string> bams; // bam id (eg t000) -> path
+
+  int32_t readlen = 0;
+  int32_t max_mapq = 0;
+  int32_t min_dscrd_size = 0;
+  std::unordered_map<std::string, int> min_isize_for_disc; // read group -> min isize
+
+  // mate lookup was done with this cutoff, so re-runs can only raise it
+  int32_t mate_lookup_min = 0;
+
+};
+
+// everything the read-in stage produces for one assembly window
+struct ExtractWindow {
+
+  SeqLib::GenomicRegion region;
+
+  // de-duplicated reads from all BAMs, including the mate-region reads.
+  // mate-region reads carry an MX tag, which indexes into mate_regions
+  SeqLib::BamRecordVector reads;
+
+  // per bam id
+  std::map<std::string, CigarIndex> cigmap;
+  std::map<std::string, STCoverage> cov;
+
+  // mate regions that were looked up, with the read count that triggered them and the lookup round
+  MateRegionVector mate_regions;
+
+};
+
+/** Write a block-compressed store of the read-in stage, one record per window.
+ *
+ * The store is a BGZF stream with a params header followed by the window
+ * records. A plain-text index (<store>.idx) gives the virtual offset of each window.
+ */
+class svabaExtractWriter {
+
+ public:
+
+  svabaExtractWriter() {}
+
+  ~svabaExtractWriter() { Close(); }
+
+  /** Open the store and write the params header */
+  bool Open(const std::string& file, const ExtractParams& p);
+
+  /** Append one window. Not thread-safe, caller must lock */
+  bool WriteWindow(const ExtractWindow& w);
+
+  /** Flush and close the store and its index */
+  void Close();
+
+ private:
+
+  BGZF * m_fp = nullptr;
+  std::ofstream m_idx;
+
+};
+
+/** Random-access reader for a store made by svabaExtractWriter.
+ *
+ * Each thread should hold its own reader.
+ */
+class svabaExtractReader {
+
+ public:
+
+  svabaExtractReader() {}
+
+  ~svabaExtractReader();
+
+  /** Open the store, read the params header and load the window index */
+  bool Open(const std::string& file);
+
+  /** Load the window with exactly this region. Returns false if not in the store */
+  bool ReadWindow(const SeqLib::GenomicRegion& gr, ExtractWindow& w);
+
+  const ExtractParams& Params() const { return m_params; }
+
+  size_t NumWindows() const { return m_index.size(); }
+
+ private:
+
+  BGZF * m_fp = nullptr;
+
+  ExtractParams m_params;
+
+  std::map<SeqLib::GenomicRegion, int64_t> m_index;
+
+};
+
+#endif
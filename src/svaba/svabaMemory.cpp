@@ -0,0 +1,110 @@
+#include "svabaMemory.h"
+
+#include <fstream>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "BreakPoint.h"
+
+namespace svabaMemory {
+
+  static size_t budget = 0;
+  static int running = 0;
+  static size_t in_use = 0; // accounted bytes, over all threads
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_cond_t room = PTHREAD_COND_INITIALIZER;
+
+  size_t RSS() {
+#ifndef __APPLE__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    if (statm >> pages >> pages)
+      return pages * sysconf(_SC_PAGESIZE);
+    return 0;
+#else
+    // peak, the closest OSX gives without mach calls. Only reported, the
+    // budget is checked against the accounted bytes
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+#endif
+  }
+
+  void SetBudget(size_t bytes) {
+    budget = bytes;
+  }
+
+  size_t Budget() {
+    return budget;
+  }
+
+  void Account(size_t& held, size_t bytes) {
+    pthread_mutex_lock(&lock);
+    in_use = in_use - held + bytes;
+    if (bytes < held)
+      pthread_cond_broadcast(&room);
+    held = bytes;
+    pthread_mutex_unlock(&lock);
+  }
+
+  size_t InUse() {
+    pthread_mutex_lock(&lock);
+    size_t b = in_use;
+    pthread_mutex_unlock(&lock);
+    return b;
+  }
+
+  bool Pressure(double frac) {
+    return budget && InUse() > budget * frac;
+  }
+
+  void Acquire() {
+    pthread_mutex_lock(&lock);
+    // one region always runs, or nothing would free the memory. Account
+    // and Release wake this when the sum goes down
+    while (budget && running > 0 && in_use > budget)
+      pthread_cond_wait(&room, &lock);
+    ++running;
+    pthread_mutex_unlock(&lock);
+  }
+
+  void Release() {
+    pthread_mutex_lock(&lock);
+    --running;
+    pthread_cond_broadcast(&room);
+    pthread_mutex_unlock(&lock);
+  }
+
+  size_t Bytes(const BreakPoint& bp) {
+    size_t b = sizeof(BreakPoint);
+    for (const std::string * s : {&bp.seq, &bp.cname, &bp.rs, &bp.insertion, &bp.homology, &bp.repeat_seq,
+	  &bp.evidence, &bp.confidence, &bp.ref, &bp.alt, &bp.read_names, &bp.bxtable})
+      b += s->capacity();
+    // map and set nodes
+    b += bp.allele.size() * (sizeof(SampleInfo) + 64);
+    b += (bp.split_reads.size() + bp.qnames.size()) * 64;
+    for (auto& r : bp.dc.reads)
+      b += Bytes(r.second) + r.first.capacity() + 32;
+    for (auto& r : bp.dc.mates)
+      b += Bytes(r.second) + r.first.capacity() + 32;
+    return b;
+  }
+
+  size_t Bytes(const std::vector<BreakPoint>& v) {
+    size_t b = (v.capacity() - v.size()) * sizeof(BreakPoint);
+    for (auto& i : v)
+      b += Bytes(i);
+    return b;
+  }
+
+  size_t AssemblyBytes(const SeqLib::BamRecordVector& reads) {
+    size_t bases = 0;
+    for (auto& r : reads)
+      bases += r.Length();
+    // read table entry and sequence, then per base a 1 byte BWT symbol and an
+    // 8 byte suffix array element, for the forward and reverse index
+    return reads.size() * 96 + bases + 2 * bases * 9;
+  }
+
+}
@@ -0,0 +1,69 @@
+#ifndef SVABA_MEMORY_H__
+#define SVABA_MEMORY_H__
+
+#include <cstddef>
+#include <vector>
+
+#include "SeqLib/BamRecord.h"
+
+struct BreakPoint;
+
+/** Memory accounting and the --max-memory budget for svaba run.
+ *
+ * The byte counts are estimates from the sizes of the containers and
+ * records each stage holds, not tracked allocations. They are reported per
+ * region in the metrics file. Each thread also accounts the estimates of its
+ * running region and of its buffered output here, and the budget is checked
+ * against their sum rather than RSS, which glibc rarely gives back. With a
+ * budget set, a thread waits to start a new region while the sum is over the
+ * budget and another region is still running, and regions started under
+ * pressure read fewer reads.
+ */
+namespace svabaMemory {
+
+  /** Resident bytes of this process, for the metrics. On OSX this is the peak */
+  size_t RSS();
+
+  /** Set the budget in bytes. 0 is no budget */
+  void SetBudget(size_t bytes);
+
+  size_t Budget();
+
+  /** Change the bytes one thread has accounted from held to bytes */
+  void Account(size_t& held, size_t bytes);
+
+  /** Sum of the accounted bytes of all threads */
+  size_t InUse();
+
+  /** The accounted bytes are over this fraction of the budget (always false with no budget) */
+  bool Pressure(double frac = 0.8);
+
+  /** Wait until there is room to start a region, then count it as running */
+  void Acquire();
+
+  /** A region from Acquire is done */
+  void Release();
+
+  /** Record, bam1_t and its data */
+  inline size_t Bytes(const SeqLib::BamRecord& r) {
+    return sizeof(SeqLib::BamRecord) + 64 /* bam1_t */ + (r.raw() ? r.raw()->m_data : 0);
+  }
+
+  inline size_t Bytes(const SeqLib::BamRecordVector& v) {
+    size_t b = v.capacity() * sizeof(SeqLib::BamRecord);
+    for (auto& r : v)
+      b += Bytes(r) - sizeof(SeqLib::BamRecord);
+    return b;
+  }
+
+  size_t Bytes(const BreakPoint& bp);
+
+  size_t Bytes(const std::vector<BreakPoint>& v);
+
+  /** Estimate for assembling these reads: the SGA read table, and the
+   * forward and reverse BWT and suffix arrays built from it */
+  size_t AssemblyBytes(const SeqLib::BamRecordVector& reads);
+
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "svabaReaderPool.h"
+
+#include <algorithm>
+
+#include "htslib/sam.h"
+
+#include "svabaBamWalker.h"
+#include "svabaTrace.h"
+
+svabaReaderPool::svabaReaderPool(const std::map<std::string, std::string>& bams, size_t max_open, SeqLib::ThreadPool * pool)
+  : m_max(std::max(max_open, (size_t)1)), m_pool(pool) {
+  for (auto& b : bams) {
+    Sample& s = m_samples[b.first];
+    s.id = b.first;
+    s.bam = b.second;
+  }
+  pthread_mutex_init(&m_lock, NULL);
+  pthread_cond_init(&m_returned, NULL);
+}
+
+svabaReaderPool::~svabaReaderPool() {
+  pthread_mutex_destroy(&m_lock);
+  pthread_cond_destroy(&m_returned);
+}
+
+void* svabaReaderPool::__summarize(void * arg) {
+
+  Sample * s = static_cast<Sample*>(arg);
+  const SeqLib::BamHeader& h = *s->h;
+
+  htsFile * fp = sam_open(s->bam.c_str(), "r");
+  if (!fp)
+    return NULL;
+  hts_idx_t * idx = sam_index_load(fp, s->bam.c_str());
+  if (!idx) {
+    sam_close(fp);
+    return NULL;
+  }
+
+  std::vector<std::vector<bool>> bins(h.NumSequences());
+  for (int c = 0; c < h.NumSequences(); ++c) {
+    bins[c].assign(h.GetSequenceLength(c) / READER_POOL_BIN + 1, false);
+
+    // skip the queries for contigs with nothing on them
+    uint64_t mapped = 0, unmapped = 0;
+    if (hts_idx_get_stat(idx, c, &mapped, &unmapped) == 0 && mapped + unmapped == 0)
+      continue;
+
+    // a query with no chunks to read has no reads. Reads that overlap
+    // into a bin from the one before count for both
+    for (size_t i = 0; i < bins[c].size(); ++i) {
+      hts_itr_t * itr = sam_itr_queryi(idx, c, i * READER_POOL_BIN, (i + 1) * READER_POOL_BIN);
+      bins[c][i] = !itr || itr->n_off > 0;
+      if (itr)
+	hts_itr_destroy(itr);
+    }
+  }
+
+  hts_idx_destroy(idx);
+  sam_close(fp);
+  s->bins.swap(bins);
+  return NULL;
+}
+
+void svabaReaderPool::Summarize(const SeqLib::BamHeader& h, int threads) {
+
+  std::vector<Sample*> ss;
+  for (auto& s : m_samples) {
+    s.second.h = &h;
+    ss.push_back(&s.second);
+  }
+
+  threads = std::max(1, threads);
+  for (size_t k = 0; k < ss.size(); k += threads) {
+    std::vector<pthread_t> tt;
+    for (size_t j = k; j < ss.size() && j < k + threads; ++j) {
+      pthread_t t;
+      pthread_create(&t, NULL, __summarize, ss[j]);
+      tt.push_back(t);
+    }
+    for (auto& t : tt)
+      pthread_join(t, NULL);
+  }
+}
+
+bool svabaReaderPool::HasReads(const std::string& id, const SeqLib::GenomicRegion& gr) const {
+
+  if (gr.IsEmpty())
+    return true;
+
+  auto ff = m_samples.find(id);
+  if (ff == m_samples.end() || gr.chr < 0 || gr.chr >= (int)ff->second.bins.size())
+    return true;
+
+  const std::vector<bool>& b = ff->second.bins[gr.chr];
+  size_t i = std::max(gr.pos1, 0) / READER_POOL_BIN;
+  size_t j = std::max(gr.pos2, 0) / READER_POOL_BIN;
+  for (; i <= j && i < b.size(); ++i)
+    if (b[i])
+      return true;
+  return false;
+}
+
+bool svabaReaderPool::HasReads(const std::string& id, const SeqLib::GRC& grc) const {
+  for (auto& gr : grc)
+    if (HasReads(id, gr))
+      return true;
+  return false;
+}
+
+bool svabaReaderPool::Checkout(svabaBamWalker& w) {
+
+  svabaTrace::Lock(&m_lock, "reader pool wait");
+
+  auto ff = m_open.find(&w);
+  if (ff != m_open.end()) {
+    ff->second.busy = true;
+    pthread_mutex_unlock(&m_lock);
+    return true;
+  }
+
+  // make room by closing the least recently returned BAM
+  while (m_open.size() >= m_max) {
+    auto lru = m_open.end();
+    for (auto it = m_open.begin(); it != m_open.end(); ++it)
+      if (!it->second.busy && (lru == m_open.end() || it->second.last < lru->second.last))
+	lru = it;
+    if (lru != m_open.end()) {
+      // idle, so its thread is not reading from it. It checks out again before it does
+      lru->first->CloseBam();
+      m_open.erase(lru);
+    } else {
+      pthread_cond_wait(&m_returned, &m_lock);
+    }
+  }
+  m_open[&w].busy = true;
+  ++m_opened;
+  pthread_mutex_unlock(&m_lock);
+
+  // open outside the lock. The slot is held, and only this thread uses w
+  auto s = m_samples.find(w.prefix);
+  bool ok = s != m_samples.end() && w.Open(s->second.bam);
+  if (ok && m_pool)
+    w.SetThreadPool(*m_pool);
+
+  if (!ok) {
+    pthread_mutex_lock(&m_lock);
+    m_open.erase(&w);
+    pthread_cond_signal(&m_returned);
+    pthread_mutex_unlock(&m_lock);
+  }
+  return ok;
+}
+
+void svabaReaderPool::Return(svabaBamWalker& w) {
+  pthread_mutex_lock(&m_lock);
+  auto ff = m_open.find(&w);
+  if (ff != m_open.end()) {
+    ff->second.busy = false;
+    ff->second.last = ++m_tick;
+  }
+  pthread_cond_signal(&m_returned);
+  pthread_mutex_unlock(&m_lock);
+}
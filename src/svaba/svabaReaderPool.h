@@ -0,0 +1,92 @@
+#ifndef SVABA_READER_POOL_H__
+#define SVABA_READER_POOL_H__
+
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SeqLib/BamHeader.h"
+#include "SeqLib/GenomicRegionCollection.h"
+#include "SeqLib/ThreadPool.h"
+
+class svabaBamWalker;
+
+// bp per bin of the per-sample read summary
+#define READER_POOL_BIN 16384
+
+/** Size-limited set of open BAMs shared by all threads (svaba run --max-open-bams).
+ *
+ * Each thread still keeps a walker per sample for the reads and counts of its
+ * window, but a walker's BAM is opened here only when a read needs it, and at most
+ * max_open are open across all threads. A thread checks out one walker at a time
+ * for a read and returns it open. Opening one past the limit closes the least
+ * recently returned walker, of any thread.
+ *
+ * Summarize() reads each BAM index once to mark the bins with any reads per
+ * sample, so windows and mate regions that a sample has no reads in skip it
+ * without opening it.
+ */
+class svabaReaderPool {
+
+ public:
+
+  /**
+   * @param bams Sample id (e.g. n001) -> BAM path
+   * @param max_open Most BAMs open at once, over all threads. At least one per thread
+   * @param pool BGZF thread pool to attach to each BAM when it is opened
+   */
+  svabaReaderPool(const std::map<std::string, std::string>& bams, size_t max_open, SeqLib::ThreadPool * pool = nullptr);
+
+  ~svabaReaderPool();
+
+  /** Mark the bins with reads for each sample from its index, threads samples at a time.
+   * Samples whose index can not be read are taken to have reads everywhere */
+  void Summarize(const SeqLib::BamHeader& h, int threads);
+
+  /** Sample may have reads here. Always true for an empty (whole genome) region */
+  bool HasReads(const std::string& id, const SeqLib::GenomicRegion& gr) const;
+
+  bool HasReads(const std::string& id, const SeqLib::GRC& grc) const;
+
+  /** Open the walker's BAM if it is closed, and keep it open until Return.
+   * Waits while max_open walkers are checked out */
+  bool Checkout(svabaBamWalker& w);
+
+  /** Done reading. The BAM stays open until it is the oldest over the limit */
+  void Return(svabaBamWalker& w);
+
+  /** Number of times a BAM was opened, counting reopens after a close */
+  size_t NumOpened() const { return m_opened; }
+
+  size_t MaxOpen() const { return m_max; }
+
+ private:
+
+  struct Sample {
+    std::string id, bam;
+    std::vector<std::vector<bool>> bins; // [chr][pos / READER_POOL_BIN]. Empty if unknown
+    const SeqLib::BamHeader * h = nullptr;
+  };
+
+  struct Handle {
+    bool busy = false;
+    size_t last = 0; // m_tick when returned
+  };
+
+  std::map<std::string, Sample> m_samples;
+  std::map<svabaBamWalker*, Handle> m_open;
+
+  size_t m_max;
+  size_t m_tick = 0;
+  size_t m_opened = 0;
+  SeqLib::ThreadPool * m_pool;
+
+  pthread_mutex_t m_lock;
+  pthread_cond_t m_returned;
+
+  static void* __summarize(void * arg);
+};
+
+#endif
@@ -0,0 +1,288 @@
+#include "svabaStatus.h"
+
+#include <map>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "svabaTrace.h"
+
+namespace svabaStatus {
+
+  bool enabled = false;
+
+  // what one worker thread is on
+  struct ThreadState {
+    bool active = false;
+    SeqLib::GenomicRegion region;
+    double start = 0;
+    size_t done = 0;
+  };
+
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+  static pthread_t reporter;
+  static bool stopping = false;
+
+  static std::string status_file, out_prefix, phase = "setup";
+  static int interval = 10;
+  static SeqLib::BamHeader header;
+  static double t0 = 0;
+
+  static size_t total = 0, started = 0, finished = 0, mate_reads = 0;
+  static std::map<std::string, size_t> reads;
+  static std::vector<ThreadState> threads;
+  static thread_local int t_slot = -1;
+
+  // resident and peak resident bytes
+  static void __rss(size_t& rss, size_t& peak) {
+    rss = peak = 0;
+#ifndef __APPLE__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    if (statm >> pages >> pages)
+      rss = pages * sysconf(_SC_PAGESIZE);
+#endif
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+#ifdef __APPLE__
+      peak = ru.ru_maxrss; // bytes on OSX
+#else
+      peak = ru.ru_maxrss * 1024;
+#endif
+  }
+
+  // bytes in the files named <prefix>*, other than the status file itself
+  static size_t __output_bytes() {
+
+    std::string dir = ".", base = out_prefix;
+    size_t sl = out_prefix.rfind('/');
+    if (sl != std::string::npos) {
+      dir = sl ? out_prefix.substr(0, sl) : "/";
+      base = out_prefix.substr(sl + 1);
+    }
+
+    size_t bytes = 0;
+    DIR * d = opendir(dir.c_str());
+    if (!d)
+      return 0;
+    for (struct dirent * e; (e = readdir(d)) != NULL;) {
+      std::string name(e->d_name);
+      if (name.compare(0, base.length(), base) != 0)
+	continue;
+      std::string path = dir + "/" + name;
+      struct stat st;
+      if (path != status_file && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+	bytes += st.st_size;
+    }
+    closedir(d);
+    return bytes;
+  }
+
+  static std::string __region_string(const SeqLib::GenomicRegion& r) {
+    if (r.IsEmpty())
+      return "all";
+    std::stringstream ss;
+    if (r.chr >= 0 && r.chr < header.NumSequences())
+      ss << header.IDtoName(r.chr);
+    else
+      ss << r.chr;
+    ss << ":" << r.pos1 << "-" << r.pos2;
+    return ss.str();
+  }
+
+  static void __metric(std::ostream& os, const std::string& name, const std::string& type, const std::string& help) {
+    os << "# HELP svaba_" << name << " " << help << "\n# TYPE svaba_" << name << " " << type << "\n";
+  }
+
+  // the counters, copied under the lock so the file can be written without it
+  struct Snapshot {
+    std::string phase;
+    size_t total, started, finished, mate_reads;
+    std::map<std::string, size_t> reads;
+    std::vector<ThreadState> threads;
+  };
+
+  // call with the lock held
+  static Snapshot __snapshot() {
+    Snapshot s;
+    s.phase = phase;
+    s.total = total;
+    s.started = started;
+    s.finished = finished;
+    s.mate_reads = mate_reads;
+    s.reads = reads;
+    s.threads = threads;
+    return s;
+  }
+
+  // without the lock. The directory scan and the file write would hold up the workers
+  static void __write(const Snapshot& s, bool done) {
+
+    double now = svabaTrace::Now();
+    size_t rss, peak;
+    __rss(rss, peak);
+    const std::vector<ThreadState>& threads = s.threads;
+
+    std::stringstream os;
+    os << std::fixed << std::setprecision(3);
+    __metric(os, "info", "gauge", "Current stage of the run");
+    os << "svaba_info{phase=\"" << s.phase << "\"} 1\n";
+    __metric(os, "done", "gauge", "1 once the run has finished");
+    os << "svaba_done " << done << "\n";
+    __metric(os, "elapsed_seconds", "gauge", "Wall seconds since the run started");
+    os << "svaba_elapsed_seconds " << now - t0 << "\n";
+    __metric(os, "regions_total", "gauge", "Regions to run");
+    os << "svaba_regions_total " << s.total << "\n";
+    __metric(os, "regions_done", "counter", "Regions finished");
+    os << "svaba_regions_done " << s.finished << "\n";
+    __metric(os, "regions_active", "gauge", "Regions being run");
+    os << "svaba_regions_active " << s.started - s.finished << "\n";
+    __metric(os, "queue_depth", "gauge", "Regions waiting for a thread");
+    os << "svaba_queue_depth " << (s.total > s.started ? s.total - s.started : 0) << "\n";
+    __metric(os, "reads_total", "counter", "Reads taken in from the main regions, per sample");
+    for (auto& r : s.reads)
+      os << "svaba_reads_total{sample=\"" << r.first << "\"} " << r.second << "\n";
+    __metric(os, "mate_reads_total", "counter", "Reads taken in from mate-region lookups");
+    os << "svaba_mate_reads_total " << s.mate_reads << "\n";
+    __metric(os, "thread_region_seconds", "gauge", "Seconds the thread has been on its current region");
+    for (size_t i = 0; i < threads.size(); ++i)
+      if (threads[i].active)
+	os << "svaba_thread_region_seconds{thread=\"" << i << "\",region=\"" << __region_string(threads[i].region) << "\"} "
+	   << now - threads[i].start << "\n";
+    __metric(os, "thread_regions_done", "counter", "Regions finished by the thread");
+    for (size_t i = 0; i < threads.size(); ++i)
+      os << "svaba_thread_regions_done{thread=\"" << i << "\"} " << threads[i].done << "\n";
+    __metric(os, "output_bytes", "gauge", "Bytes written to the output files so far");
+    os << "svaba_output_bytes " << __output_bytes() << "\n";
+    __metric(os, "rss_bytes", "gauge", "Resident memory");
+    os << "svaba_rss_bytes " << rss << "\n";
+    __metric(os, "peak_rss_bytes", "gauge", "Peak resident memory");
+    os << "svaba_peak_rss_bytes " << peak << "\n";
+
+    std::string tmp = status_file + ".tmp";
+    std::ofstream of(tmp);
+    of << os.str();
+    of.close();
+    if (!of.fail())
+      std::rename(tmp.c_str(), status_file.c_str());
+  }
+
+  static void* __report(void*) {
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+      Snapshot s = __snapshot();
+      pthread_mutex_unlock(&lock);
+      __write(s, false);
+      pthread_mutex_lock(&lock);
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += interval;
+      while (!stopping && pthread_cond_timedwait(&wake, &lock, &ts) != ETIMEDOUT)
+	;
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+  }
+
+  bool Start(const std::string& file, const std::string& prefix, int secs, const SeqLib::BamHeader& h) {
+    status_file = file;
+    out_prefix = prefix;
+    interval = secs > 0 ? secs : 1;
+    header = h;
+    t0 = svabaTrace::Now();
+    stopping = false;
+    enabled = true;
+    if (pthread_create(&reporter, NULL, __report, NULL) != 0) {
+      enabled = false;
+      return false;
+    }
+    return true;
+  }
+
+  void Stop() {
+    if (!enabled)
+      return;
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    phase = "done";
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(reporter, NULL);
+
+    pthread_mutex_lock(&lock);
+    Snapshot s = __snapshot();
+    enabled = false;
+    pthread_mutex_unlock(&lock);
+    __write(s, true);
+  }
+
+  void Phase(const std::string& p) {
+    if (!enabled)
+      return;
+    pthread_mutex_lock(&lock);
+    phase = p;
+    pthread_mutex_unlock(&lock);
+  }
+
+  void SetTotal(size_t n) {
+    if (!enabled)
+      return;
+    pthread_mutex_lock(&lock);
+    total = n;
+    pthread_mutex_unlock(&lock);
+  }
+
+  void RegionStart(const SeqLib::GenomicRegion& region) {
+    if (!enabled)
+      return;
+    pthread_mutex_lock(&lock);
+    if (t_slot < 0) {
+      t_slot = threads.size();
+      threads.push_back(ThreadState());
+    }
+    ThreadState& t = threads[t_slot];
+    t.active = true;
+    t.region = region;
+    t.start = svabaTrace::Now();
+    ++started;
+    pthread_mutex_unlock(&lock);
+  }
+
+  void RegionDone() {
+    if (!enabled || t_slot < 0)
+      return;
+    pthread_mutex_lock(&lock);
+    threads[t_slot].active = false;
+    ++threads[t_slot].done;
+    ++finished;
+    pthread_mutex_unlock(&lock);
+  }
+
+  void AddReads(const std::string& sample, size_t n) {
+    if (!enabled)
+      return;
+    pthread_mutex_lock(&lock);
+    reads[sample] += n;
+    pthread_mutex_unlock(&lock);
+  }
+
+  void AddMateReads(size_t n) {
+    if (!enabled)
+      return;
+    pthread_mutex_lock(&lock);
+    mate_reads += n;
+    pthread_mutex_unlock(&lock);
+  }
+
+}
@@ -0,0 +1,53 @@
+#ifndef SVABA_STATUS_H__
+#define SVABA_STATUS_H__
+
+#include <string>
+#include <cstddef>
+
+#include "SeqLib/GenomicRegion.h"
+#include "SeqLib/BamHeader.h"
+
+/** Live progress of svaba run, as a Prometheus text-format file (svaba run --status).
+ *
+ * Worker threads report region start / finish and read counts. A reporter
+ * thread rewrites the file every few seconds (to a tmp file, then rename, so
+ * a reader never sees half of it) with regions done / total, queue depth,
+ * reads per sample, the region on each thread and how long it has run, output
+ * bytes and RSS. When the status file is off every call returns after one check.
+ */
+namespace svabaStatus {
+
+  extern bool enabled;
+
+  inline bool Enabled() { return enabled; }
+
+  /** Start the reporter thread
+   * @param file Status file to rewrite
+   * @param prefix Output files starting with this (the analysis id) are counted in output bytes
+   * @param interval Seconds between writes
+   */
+  bool Start(const std::string& file, const std::string& prefix, int interval, const SeqLib::BamHeader& h);
+
+  /** Write the final status, with svaba_done 1, and stop the reporter */
+  void Stop();
+
+  /** Current stage of the run, e.g. "learn params" or "detection" */
+  void Phase(const std::string& phase);
+
+  /** Number of regions that will be run */
+  void SetTotal(size_t n);
+
+  /** The calling thread started on a region */
+  void RegionStart(const SeqLib::GenomicRegion& region);
+
+  /** The calling thread finished its region */
+  void RegionDone();
+
+  /** Reads taken in for a sample (e.g. t000) */
+  void AddReads(const std::string& sample, size_t n);
+
+  void AddMateReads(size_t n);
+
+}
+
+#endif
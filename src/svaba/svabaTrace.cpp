@@ -0,0 +1,136 @@
+#include "svabaTrace.h"
+
+#include <ctime>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+// events are appended to fixed-size chunks, so a full chunk is never moved
+#define TRACE_CHUNK 16384
+
+namespace svabaTrace {
+
+  bool enabled = false;
+
+  struct Event {
+    char name[24];
+    double begin, end;
+    int32_t chr, pos1, pos2;
+  };
+
+  // one per thread. Only the owning thread appends to it
+  struct Buffer {
+    size_t tid = 0;
+    size_t n = 0;
+    size_t dropped = 0;
+    std::vector<std::vector<Event>> chunks;
+  };
+
+  static double t0 = 0;
+  static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+  static std::vector<Buffer*> buffers;
+  static thread_local Buffer * t_buf = nullptr;
+
+  // the first event on a thread registers its buffer
+  static Buffer* __buffer() {
+    if (!t_buf) {
+      t_buf = new Buffer();
+      pthread_mutex_lock(&reg_lock);
+      t_buf->tid = buffers.size();
+      buffers.push_back(t_buf);
+      pthread_mutex_unlock(&reg_lock);
+    }
+    return t_buf;
+  }
+
+  void Enable() {
+    t0 = Now();
+    enabled = true;
+  }
+
+  double Now() {
+#ifndef __APPLE__
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+    return clock() / (double)CLOCKS_PER_SEC;
+#endif
+  }
+
+  void Complete(const char* name, double begin, double end, int32_t chr, int32_t pos1, int32_t pos2) {
+
+    if (!enabled)
+      return;
+
+    Buffer * b = __buffer();
+    if (b->n >= TRACE_MAX_EVENTS) {
+      ++b->dropped;
+      return;
+    }
+    if (b->chunks.empty() || b->chunks.back().size() == TRACE_CHUNK) {
+      b->chunks.push_back(std::vector<Event>());
+      b->chunks.back().reserve(TRACE_CHUNK);
+    }
+
+    Event e;
+    strncpy(e.name, name, sizeof(e.name) - 1);
+    e.name[sizeof(e.name) - 1] = '\0';
+    e.begin = begin;
+    e.end = end;
+    e.chr = chr;
+    e.pos1 = pos1;
+    e.pos2 = pos2;
+    b->chunks.back().push_back(e);
+    ++b->n;
+  }
+
+  void Lock(pthread_mutex_t * m, const char* name) {
+    if (!enabled) {
+      pthread_mutex_lock(m);
+      return;
+    }
+    double st = Now();
+    pthread_mutex_lock(m);
+    Complete(name, st, Now());
+  }
+
+  bool Write(const std::string& file, const SeqLib::BamHeader& h) {
+
+    enabled = false;
+    t_buf = nullptr;
+
+    std::ofstream os(file);
+    if (!os)
+      return false;
+
+    size_t dropped = 0;
+    os << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"svaba\"}}";
+
+    pthread_mutex_lock(&reg_lock);
+    for (auto& b : buffers) {
+      os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid
+	 << ",\"args\":{\"name\":\"" << (b->tid ? "thread " + std::to_string(b->tid) : std::string("main")) << "\"}}";
+      for (auto& c : b->chunks)
+	for (auto& e : c) {
+	  // microseconds
+	  os << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+	     << ",\"ts\":" << (e.begin - t0) * 1e6 << ",\"dur\":" << (e.end - e.begin) * 1e6;
+	  if (e.chr >= 0 && e.chr < h.NumSequences())
+	    os << ",\"args\":{\"region\":\"" << h.IDtoName(e.chr) << ":" << e.pos1 << "-" << e.pos2 << "\"}";
+	  os << "}";
+	}
+      dropped += b->dropped;
+      delete b;
+    }
+    buffers.clear();
+    pthread_mutex_unlock(&reg_lock);
+
+    os << "\n],\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+    os.close();
+    return !os.fail();
+  }
+
+}
@@ -0,0 +1,71 @@
+#ifndef SVABA_TRACE_H__
+#define SVABA_TRACE_H__
+
+#include <string>
+#include <cstdint>
+#include <pthread.h>
+
+#include "SeqLib/BamHeader.h"
+
+// max events kept per thread. Later ones are dropped and counted
+#define TRACE_MAX_EVENTS (1 << 22)
+
+/** Timeline of a run in the Chrome / Perfetto trace-event format (svaba run --trace).
+ *
+ * Each thread records complete events (name, start, duration, region) into
+ * its own buffer, so recording takes no lock. The buffers are written to one
+ * JSON file by Write() once the worker threads have been joined. When tracing
+ * is off every call returns after one check.
+ */
+namespace svabaTrace {
+
+  extern bool enabled;
+
+  inline bool Enabled() { return enabled; }
+
+  /** Start recording. Times in the trace are from this call */
+  void Enable();
+
+  /** Monotonic seconds, the same clock as svabaTimer wall time */
+  double Now();
+
+  /** Record an event on the calling thread
+   * @param name Copied, up to 23 characters
+   * @param chr Region of the event, or -1 for none
+   */
+  void Complete(const char* name, double begin, double end, int32_t chr = -1, int32_t pos1 = 0, int32_t pos2 = 0);
+
+  /** pthread_mutex_lock, recording the time spent waiting as an event */
+  void Lock(pthread_mutex_t * m, const char* name);
+
+  /** Write every thread's events and free them. Call after the threads are done
+   * @param h Header to name the chromosomes of the regions
+   */
+  bool Write(const std::string& file, const SeqLib::BamHeader& h);
+
+  /** Records an event from construction to destruction */
+  class Span {
+
+  public:
+
+    Span(const char* name, int32_t chr = -1, int32_t pos1 = 0, int32_t pos2 = 0)
+      : m_name(name), m_chr(chr), m_pos1(pos1), m_pos2(pos2), m_begin(enabled ? Now() : 0) {}
+
+    ~Span() {
+      if (enabled)
+	Complete(m_name, m_begin, Now(), m_chr, m_pos1, m_pos2);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+  private:
+
+    const char * m_name;
+    int32_t m_chr, m_pos1, m_pos2;
+    double m_begin;
+  };
+
+}
+
+#endif
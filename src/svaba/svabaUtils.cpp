@@ -2,6 +2,8 @@
 
 #include <iomanip>
 
+#include "svabaTrace.h"
+
 namespace svabaUtils {
 
 static std::string POLYA = "AAAAAAAAAAAAAAAAAAA";
@@ -29,20 +31,98 @@ static std::string POLYTC = "TCTCTCTCTCTCTCTCTCTCTCTC";
     return mdate.str();
   }
 
+  // read-in, mate lookup, discordant clustering, correction, assembly,
+  // contig alignment, read to contig alignment, scoring, post-processing, output wait
   svabaTimer::svabaTimer() {
-    s = {"r", "m", "as", "bw", "pp", "k"};
-    for (auto& i : s)
+    s = {"r", "m", "d", "k", "as", "ca", "ra", "sc", "pp", "w"};
+    for (auto& i : s) {
       times[i] = 0;
-    curr_clock = clock();
+      cpu[i] = 0;
+    }
+    start();
+  }
+
+  static double __seconds(clockid_t id) {
+#ifndef __APPLE__
+    timespec t;
+    clock_gettime(id, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+    return clock() / (double)CLOCKS_PER_SEC;
+#endif
   }
 
   void svabaTimer::stop(const std::string& part) { 
-    times[part] += (clock() - curr_clock); 
-    curr_clock = clock();
+    double w = __seconds(CLOCK_MONOTONIC);
+    double c = __seconds(CLOCK_THREAD_CPUTIME_ID);
+    times[part] += w - curr_wall;
+    cpu[part] += c - curr_cpu;
+    if (svabaTrace::Enabled())
+      svabaTrace::Complete(part.c_str(), curr_wall, w);
+    curr_wall = w;
+    curr_cpu = c;
   }
 
   void svabaTimer::start() { 
-    curr_clock = clock(); 
+    curr_wall = __seconds(CLOCK_MONOTONIC);
+    curr_cpu = __seconds(CLOCK_THREAD_CPUTIME_ID);
+  }
+
+  double svabaTimer::totalWall() const {
+    double t = 0;
+    for (auto& i : times)
+      t += i.second;
+    return t;
+  }
+
+  double svabaTimer::totalCPU() const {
+    double t = 0;
+    for (auto& i : cpu)
+      t += i.second;
+    return t;
+  }
+
+  std::string svabaRegionMetrics::header(const svabaTimer& st) {
+    std::stringstream ss;
+    ss << "chr\tpos1\tpos2\tthread";
+    for (auto& i : st.s)
+      ss << "\twall_" << i << "\tcpu_" << i;
+    ss << "\twall_total\tcpu_total\tt_reads\tn_reads\tmate_reads\tdisc_clusters\tcontigs\tbps\tbps_kept"
+       << "\tmem_walker\tmem_coverage\tmem_cigmap\tmem_assembly\tmem_alignment\tmem_bps\tmem_output\trss"
+       << "\tmate_lookups\tcaps";
+    return ss.str();
+  }
+
+  std::string svabaRegionMetrics::toFileString(const SeqLib::GenomicRegion& region, const SeqLib::BamHeader& h, 
+					       const svabaTimer& st, long unsigned int thread_id) const {
+    std::stringstream ss;
+    if (region.IsEmpty())
+      ss << "ALL\t0\t0";
+    else
+      ss << h.IDtoName(region.chr) << "\t" << region.pos1 << "\t" << region.pos2;
+    ss << "\t" << thread_id << std::fixed << std::setprecision(4);
+    for (auto& i : st.s)
+      ss << "\t" << st.times.at(i) << "\t" << st.cpu.at(i);
+    ss << "\t" << st.totalWall() << "\t" << st.totalCPU()
+       << "\t" << num_t_reads << "\t" << num_n_reads << "\t" << num_mate_reads << "\t" << num_disc_clusters
+       << "\t" << num_contigs << "\t" << num_bps << "\t" << num_bps_kept
+       << "\t" << mem_walker << "\t" << mem_coverage << "\t" << mem_cigmap << "\t" << mem_assembly
+       << "\t" << mem_alignment << "\t" << mem_bps << "\t" << mem_output << "\t" << rss
+       << "\t" << num_mate_lookups << "\t" << caps();
+    return ss.str();
+  }
+
+  std::string svabaRegionMetrics::caps() const {
+    std::string c;
+    if (read_capped)
+      c += ",read_limit";
+    if (mate_capped.size())
+      c += ",mate_limit";
+    if (too_many_reads)
+      c += ",too_many_reads";
+    if (overlap_capped)
+      c += ",overlap_limit";
+    return c.empty() ? "." : c.substr(1);
   }
 
   std::ostream& operator<<(std::ostream &out, const svabaTimer st) {
@@ -55,20 +135,19 @@ static std::string POLYTC = "TCTCTCTCTCTCTCTCTCTCTCTC";
 
     char buffer[140];
     
-    auto itr = st.times.find("r");
-    auto itm = st.times.find("m");
-    auto ita = st.times.find("as");
-    auto itk = st.times.find("k");
-    auto itp = st.times.find("pp");
+    // assembly includes the contig alignments, post-processing the clustering and scoring
+    const std::unordered_map<std::string, double>& t = st.times;
+    double a = t.at("as") + t.at("ca") + t.at("ra");
+    double p = t.at("d") + t.at("sc") + t.at("pp");
 
     if (total_time)
-      sprintf (buffer, "R: %2d%% M: %2d%% K: %2d%% A: %2d%% P: %2d%%", 
-	       SeqLib::percentCalc<double>(itr->second, total_time),
-	       SeqLib::percentCalc<double>(itm->second, total_time),
-	       SeqLib::percentCalc<double>(itk->second, total_time),
-	       SeqLib::percentCalc<double>(ita->second, total_time),
-	       //SeqLib::percentCalc<double>(itb->second, total_time),
-	       SeqLib::percentCalc<double>(itp->second, total_time));
+      sprintf (buffer, "R: %2d%% M: %2d%% K: %2d%% A: %2d%% P: %2d%% W: %2d%%", 
+	       SeqLib::percentCalc<double>(t.at("r"), total_time),
+	       SeqLib::percentCalc<double>(t.at("m"), total_time),
+	       SeqLib::percentCalc<double>(t.at("k"), total_time),
+	       SeqLib::percentCalc<double>(a, total_time),
+	       SeqLib::percentCalc<double>(p, total_time),
+	       SeqLib::percentCalc<double>(t.at("w"), total_time));
     else
       sprintf (buffer, "NO TIME");
     out << std::string(buffer);
@@ -281,7 +360,9 @@ int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& s
     // get the dictionary from reference
     bwa_header = b->HeaderFromIndex();
     
-    // open the bam for writing  
+    // open the bam for writing, unless there is no name
+    if (wname.empty())
+      return true;
     writer.SetHeader(bwa_header);
     if (!writer.Open(wname)) // open and write header
       return false;
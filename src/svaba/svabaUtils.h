@@ -13,24 +13,73 @@
 
 namespace svabaUtils {
 
-// make a structure to store timing opt
+// per-stage timing for one region. Wall time is monotonic and CPU time is for
+// the calling thread only, so the numbers are meaningful with many threads
 struct svabaTimer {
   
   svabaTimer();
 
-  std::unordered_map<std::string, double> times;
-  std::vector<std::string> s;
+  std::unordered_map<std::string, double> times; // wall seconds, by stage
+  std::unordered_map<std::string, double> cpu;   // thread CPU seconds, by stage
+  std::vector<std::string> s; // stages, in pipeline order
 
-  clock_t curr_clock;
+  double curr_wall = 0, curr_cpu = 0;
 
+  // add the time since the last stop / start to this stage
   void stop(const std::string& part);
 
   void start();
+
+  double totalWall() const;
+
+  double totalCPU() const;
   
   // print it
   friend std::ostream& operator<<(std::ostream &out, const svabaTimer st);
 };
 
+// counters for one region, written with the timer to <id>.metrics.tsv.gz
+struct svabaRegionMetrics {
+
+  int num_t_reads = 0;
+  int num_n_reads = 0;
+  int num_mate_reads = 0; // added by mate lookup
+  int num_disc_clusters = 0;
+  int num_contigs = 0; // with an alignment
+  int num_bps = 0;
+  int num_bps_kept = 0; // sent to output
+
+  // estimated bytes held by each stage (see svabaMemory)
+  size_t mem_walker = 0; // reads of the window
+  size_t mem_coverage = 0;
+  size_t mem_cigmap = 0;
+  size_t mem_assembly = 0; // read table and BWT / SA
+  size_t mem_alignment = 0; // contigs and reads aligned to them
+  size_t mem_bps = 0;
+  size_t mem_output = 0; // buffered on the thread for writing
+  size_t rss = 0; // process RSS at the end of the window
+
+  size_t mem_total() const {
+    return mem_walker + mem_coverage + mem_cigmap + mem_assembly + mem_alignment + mem_bps + mem_output;
+  }
+
+  // for the region report
+  std::map<std::string, int> sample_reads; // main-region reads per sample
+  int num_mate_lookups = 0; // mate regions read
+  SeqLib::GRC mate_capped; // mate regions that hit the read limit
+  bool read_capped = false; // main region hit the read limit (-x)
+  bool too_many_reads = false; // skipped assembly, too many reads for the width
+  bool overlap_capped = false; // assembly stopped at MAX_OVERLAPS_PER_ASSEMBLY
+
+  /** Limits hit, comma separated, or "." */
+  std::string caps() const;
+
+  static std::string header(const svabaTimer& st);
+
+  std::string toFileString(const SeqLib::GenomicRegion& region, const SeqLib::BamHeader& h, 
+			   const svabaTimer& st, long unsigned int thread_id) const;
+};
+
  double CalcMHWScore(std::vector<int>& scores);
  
  int overlapSize(const SeqLib::BamRecord& query, const SeqLib::BamRecordVector& subject);
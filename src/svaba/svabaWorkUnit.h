@@ -10,6 +10,7 @@
 #include "BreakPoint.h"
 #include "DiscordantCluster.h"
 #include "SeqLib/RefGenome.h"
+#include "svabaExtract.h"
 
 typedef std::map<std::string, svabaBamWalker> WalkerMap;
 
@@ -19,6 +20,7 @@ struct svabaWorkUnit {
   WalkerMap walkers;
   SeqLib::RefGenome * ref_genome = nullptr;
   SeqLib::RefGenome * vir_genome = nullptr;
+  svabaExtractReader * extract = nullptr; // if running from an extract store
   //SeqLib::GRC m_bad_regions;// bad region tracker for this thread
   
   // other structures to hold results
@@ -28,6 +30,7 @@ struct svabaWorkUnit {
   DiscordantClusterMap m_disc;
   size_t m_bamreads_count = 0;
   size_t m_disc_reads = 0;
+  size_t m_mem_held = 0; // bytes accounted with svabaMemory for this thread
   SeqLib::GRC badd;
 
   void clear() {
@@ -51,6 +54,8 @@ struct svabaWorkUnit {
       delete ref_genome;
     if (vir_genome)
       delete vir_genome;
+    if (extract)
+      delete extract;
   }
   
 };
@@ -7,16 +7,27 @@
 #include <sstream>
 #include <iostream>
 #include <unordered_set> 
+#include <algorithm>
+#include <map>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
 
 #include "htslib/tbx.h"
 #include "htslib/bgzf.h"
 
 #include "gzstream.h"
+#include "BCFWriter.h"
+#include "BreakPointStore.h"
+#include "OrderedPipeline.h"
 #include "SeqLib/GenomicRegionCollection.h"
 
 #define VCF_SECONDARY_CAP 200
 #define SOMATIC_LOD 1 // just a dummy now. scoring is elsewhere, and output is 0 (germline) or 1 (somatic)
 #define DEDUPEPAD 200
+#define VCF_SPILL_RUN 20000 // breakpoints buffered per sorted run
+#define VCF_MERGE_WAYS 64 // runs merged at once
 
 using namespace std;
 
@@ -187,15 +198,23 @@ bool VCFEntry::operator<(const VCFEntry &v) const {
 }
 
 // create a VCFFile from a svaba breakpoints file
-VCFFile::VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, const VCFHeader& vheader, bool nopass) {
+VCFFile::VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, const VCFHeader& vheader, bool nopass, int threads) {
 
   analysis_id = id;
-
-  //open the file
-  igzstream infile(file.c_str(), ios::in);
-  
-  // confirm that it is open
-  if (!infile) {
+  num_threads = threads;
+
+  // binary breakpoint store (bps.svb) or bps.txt.gz
+  BreakPointStoreReader reader;
+  igzstream infile;
+  const bool from_store = BreakPointStoreReader::IsStore(file);
+  bool ok;
+  if (from_store) {
+    ok = reader.Open(file, h);
+  } else {
+    infile.open(file.c_str(), ios::in);
+    ok = infile.good();
+  }
+  if (!ok) {
     cerr << "Can't read file " << file << " for parsing VCF" << endl;
     exit(EXIT_FAILURE);
   }
@@ -203,8 +222,494 @@ VCFFile::VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, c
   // read in the header of the csv
   std::string line;
 
-  //string sample_id_tum = analysis_id + "T";
-  //string sample_id_norm= analysis_id + "N";
+  __init_headers(vheader);
+  __open_spill();
+
+  // keep track of exact positions to keep from duplicating
+  // read the reference if not open
+  cerr << "...vcf - reading in the breakpoints file" << endl;
+  
+  include_nonpass = nopass;
+
+  if (!from_store)
+    getline(infile, line, '\n'); // skip first line
+
+  // parse on the worker threads, and add in file order
+  struct ParseItem {
+    std::string line;
+    BreakPoint b;
+    std::shared_ptr<ReducedBreakPoint> bp;
+  };
+  typedef OrderedPipeline<ParseItem>::Batch ParseBatch;
+
+  auto read_batch = [&](ParseBatch& batch, size_t n) {
+    batch.resize(n);
+    size_t k = 0;
+    if (from_store) {
+      while (k < n && reader.Next(batch[k].b))
+	if (batch[k].b.b1.chr_name != "Unknown" && batch[k].b.b2.chr_name != "Unknown")
+	  ++k;
+    } else {
+      while (k < n && getline(infile, batch[k].line, '\n'))
+	if (!batch[k].line.empty() && batch[k].line.find("mapq") == std::string::npos &&
+	    batch[k].line.find("Unknown") == std::string::npos)
+	  ++k;
+    }
+    batch.resize(k);
+    return k == n;
+  };
+
+  auto parse_batch = [&](ParseBatch& batch) {
+    for (auto& r : batch) {
+      if (from_store) {
+	r.bp = std::make_shared<ReducedBreakPoint>(r.b, h);
+	r.b = BreakPoint();
+      } else {
+	r.bp = std::make_shared<ReducedBreakPoint>(r.line, h);
+	std::string().swap(r.line);
+      }
+    }
+  };
+
+  auto add_batch = [&](ParseBatch& batch) {
+    for (auto& r : batch)
+      add(r.bp);
+  };
+
+  OrderedPipeline<ParseItem> pipeline(num_threads);
+  pipeline.run(read_batch, parse_batch, add_batch);
+
+  finalize();
+}
+
+VCFFile::VCFFile(std::string id, const VCFHeader& vheader, bool nopass) {
+  analysis_id = id;
+  include_nonpass = nopass;
+  __init_headers(vheader);
+  __open_spill();
+}
+
+VCFFile::~VCFFile() {
+  for (VCFSpill * sp : {&m_sv_spill, &m_indel_spill}) {
+    if (sp->fp)
+      bgzf_close(sp->fp);
+    if (!sp->file.empty())
+      std::remove(sp->file.c_str());
+  }
+}
+
+static bool __spill_int(BGZF * fp, int64_t v) {
+  return bgzf_write(fp, &v, sizeof(int64_t)) == sizeof(int64_t);
+}
+
+static bool __unspill_int(BGZF * fp, int64_t& v) {
+  return bgzf_read(fp, &v, sizeof(int64_t)) == sizeof(int64_t);
+}
+
+static bool __spill_dbl(BGZF * fp, double v) {
+  return bgzf_write(fp, &v, sizeof(double)) == sizeof(double);
+}
+
+static bool __unspill_dbl(BGZF * fp, double& v) {
+  return bgzf_read(fp, &v, sizeof(double)) == sizeof(double);
+}
+
+// length, then the bytes. A null char* is length -1
+static bool __spill_str(BGZF * fp, const char * s, int64_t len) {
+  if (!__spill_int(fp, s ? len : -1))
+    return false;
+  return !s || !len || bgzf_write(fp, s, len) == len;
+}
+
+static bool __unspill_str(BGZF * fp, std::string& s, bool& null) {
+  int64_t len;
+  if (!__unspill_int(fp, len))
+    return false;
+  null = len < 0;
+  s.resize(null ? 0 : len);
+  return null || !len || bgzf_read(fp, &s[0], len) == len;
+}
+
+static bool __unspill_cstr(BGZF * fp, char *& p) {
+  std::string s;
+  bool null;
+  if (!__unspill_str(fp, s, null))
+    return false;
+  p = nullptr;
+  if (!null) {
+    p = (char*)malloc(s.length() + 1);
+    memcpy(p, s.c_str(), s.length() + 1);
+  }
+  return true;
+}
+
+static bool __spill_end(BGZF * fp, const ReducedBreakEnd& b) {
+  return __spill_str(fp, b.chr_name.c_str(), b.chr_name.length()) && __spill_int(fp, b.gr.chr) &&
+    __spill_int(fp, b.gr.pos1) && __spill_int(fp, b.gr.pos2) && __spill_int(fp, b.gr.strand) &&
+    __spill_int(fp, b.mapq) && __spill_int(fp, b.sub_n) && __spill_int(fp, b.nm);
+}
+
+static bool __unspill_end(BGZF * fp, ReducedBreakEnd& b) {
+  bool null;
+  int64_t v[7];
+  if (!__unspill_str(fp, b.chr_name, null))
+    return false;
+  for (auto& i : v)
+    if (!__unspill_int(fp, i))
+      return false;
+  b.gr.chr = v[0]; b.gr.pos1 = v[1]; b.gr.pos2 = v[2]; b.gr.strand = (char)v[3];
+  b.mapq = v[4]; b.sub_n = v[5]; b.nm = v[6];
+  return true;
+}
+
+// every field of the breakpoint, to read back when writing the VCF
+static bool __spill(BGZF * fp, const ReducedBreakPoint& b) {
+
+  for (const char * p : {b.ref, b.alt, b.cname, b.evidence, b.confidence, b.insertion, b.homology, b.repeat})
+    if (!__spill_str(fp, p, p ? strlen(p) : 0))
+      return false;
+  if (!__spill_str(fp, b.read_names.c_str(), b.read_names.length()) || !__spill_str(fp, b.bxtable.c_str(), b.bxtable.length()))
+    return false;
+  if (!__spill_int(fp, b.format_s.size()))
+    return false;
+  for (auto& f : b.format_s)
+    if (!__spill_str(fp, f.c_str(), f.length()))
+      return false;
+  if (!__spill_end(fp, b.b1) || !__spill_end(fp, b.b2))
+    return false;
+  if (!__spill_dbl(fp, b.somatic_score) || !__spill_dbl(fp, b.somatic_lod) || !__spill_dbl(fp, b.true_lod) || !__spill_dbl(fp, b.quality))
+    return false;
+  for (int64_t v : {(int64_t)b.nsplit, (int64_t)b.tsplit, (int64_t)b.af_n, (int64_t)b.num_align, (int64_t)b.secondary,
+	(int64_t)b.dbsnp, (int64_t)b.pass, (int64_t)b.blacklist, (int64_t)b.indel, (int64_t)b.imprecise,
+	(int64_t)b.tcov_support, (int64_t)b.ncov_support, (int64_t)b.tcov, (int64_t)b.ncov,
+	(int64_t)b.tcigar, (int64_t)b.ncigar, (int64_t)b.dummy, (int64_t)b.af_t, (int64_t)b.pon,
+	(int64_t)b.dc.mapq1, (int64_t)b.dc.mapq2, (int64_t)b.dc.tcount, (int64_t)b.dc.ncount})
+    if (!__spill_int(fp, v))
+      return false;
+  return true;
+}
+
+static bool __unspill(BGZF * fp, ReducedBreakPoint& b) {
+
+  for (char ** p : {&b.ref, &b.alt, &b.cname, &b.evidence, &b.confidence, &b.insertion, &b.homology, &b.repeat})
+    if (!__unspill_cstr(fp, *p))
+      return false;
+  bool null;
+  int64_t n;
+  if (!__unspill_str(fp, b.read_names, null) || !__unspill_str(fp, b.bxtable, null) || !__unspill_int(fp, n) || n < 0)
+    return false;
+  b.format_s.resize(n);
+  for (auto& f : b.format_s)
+    if (!__unspill_str(fp, f, null))
+      return false;
+  if (!__unspill_end(fp, b.b1) || !__unspill_end(fp, b.b2))
+    return false;
+  double q;
+  if (!__unspill_dbl(fp, b.somatic_score) || !__unspill_dbl(fp, b.somatic_lod) || !__unspill_dbl(fp, b.true_lod) || !__unspill_dbl(fp, q))
+    return false;
+  b.quality = q;
+  int64_t v[23];
+  for (auto& i : v)
+    if (!__unspill_int(fp, i))
+      return false;
+  b.nsplit = v[0]; b.tsplit = v[1]; b.af_n = v[2]; b.num_align = v[3]; b.secondary = v[4];
+  b.dbsnp = v[5]; b.pass = v[6]; b.blacklist = v[7]; b.indel = v[8]; b.imprecise = v[9];
+  b.tcov_support = v[10]; b.ncov_support = v[11]; b.tcov = v[12]; b.ncov = v[13];
+  b.tcigar = v[14]; b.ncigar = v[15]; b.dummy = v[16]; b.af_t = v[17]; b.pon = v[18];
+  b.dc.mapq1 = v[19]; b.dc.mapq2 = v[20]; b.dc.tcount = v[21]; b.dc.ncount = v[22];
+  return true;
+}
+
+// a new uniquely named spill file next to the outputs, open for writing
+static BGZF * __new_spill(const std::string& prefix, std::string& file) {
+  std::string t = prefix + ".vcf.spill.XXXXXX";
+  std::vector<char> name(t.begin(), t.end());
+  name.push_back('\0');
+  int fd = mkstemp(name.data());
+  BGZF * fp = fd < 0 ? nullptr : bgzf_dopen(fd, "w1");
+  if (!fp) {
+    cerr << "ERROR: Could not open " << t << " to buffer the VCF records" << endl;
+    exit(EXIT_FAILURE);
+  }
+  file = name.data();
+  return fp;
+}
+
+void VCFFile::__open_spill() {
+  m_sv_spill.fp = __new_spill(analysis_id, m_sv_spill.file);
+  m_indel_spill.fp = __new_spill(analysis_id, m_indel_spill.file);
+}
+
+// position order of the ends, as VCFEntry::operator< (chr, pos1, pos2 of
+// the end's region), then the order they were added
+static bool __end_less(const std::vector<VCFSpillEntry>& v, size_t a, int ae, size_t b, int be) {
+  const VCFSpillEntry& x = v[a];
+  const VCFSpillEntry& y = v[b];
+  int32_t xc = ae == 1 ? x.chr1 : x.chr2, xp = ae == 1 ? x.pos1 : x.pos2, xe = ae == 1 ? x.end1 : x.end2;
+  int32_t yc = be == 1 ? y.chr1 : y.chr2, yp = be == 1 ? y.pos1 : y.pos2, ye = be == 1 ? y.end1 : y.end2;
+  if (xc != yc)
+    return xc < yc;
+  if (xp != yp)
+    return xp < yp;
+  if (xe != ye)
+    return xe < ye;
+  return a < b || (a == b && ae < be);
+}
+
+// k-way merge of sorted runs. Each run is read front to back on
+// its own handle, so there is one seek per run, not per record
+class VCFRunMerge {
+
+ public:
+
+  // dups are always skipped, and non-PASS unless nonpass
+  VCFRunMerge(const std::string& file, const std::vector<VCFSpillRun>& runs, const std::vector<VCFSpillEntry>& v, bool nonpass)
+    : m_file(file), m_v(v), m_nonpass(nonpass) {
+    for (auto& r : runs) {
+      if (!r.n)
+	continue;
+      Head h;
+      h.fp = bgzf_open(file.c_str(), "r");
+      if (!h.fp || bgzf_seek(h.fp, r.offset, SEEK_SET) < 0) {
+	cerr << "ERROR: Could not read back VCF records from " << file << endl;
+	exit(EXIT_FAILURE);
+      }
+      h.left = r.n;
+      m_heads.push_back(h);
+    }
+    for (size_t k = 0; k < m_heads.size(); ++k)
+      if (__advance(m_heads[k]))
+	m_heap.push_back(k);
+    std::make_heap(m_heap.begin(), m_heap.end(), Greater(this));
+  }
+
+  ~VCFRunMerge() {
+    for (auto& h : m_heads)
+      if (h.fp)
+	bgzf_close(h.fp);
+  }
+
+  // the next entry in position order and its index in v. False when done
+  bool Next(VCFEntry& e, size_t& idx) {
+    if (m_heap.empty())
+      return false;
+    std::pop_heap(m_heap.begin(), m_heap.end(), Greater(this));
+    Head& h = m_heads[m_heap.back()];
+    idx = h.idx;
+    e = VCFEntry();
+    e.bp = h.bp;
+    e.id = m_v[idx].id;
+    e.id_num = h.id_num;
+    if (__advance(h))
+      std::push_heap(m_heap.begin(), m_heap.end(), Greater(this));
+    else
+      m_heap.pop_back();
+    return true;
+  }
+
+ private:
+
+  struct Head {
+    BGZF * fp = nullptr;
+    size_t left = 0; // records not yet read
+    size_t idx = 0;
+    int id_num = 1;
+    std::shared_ptr<ReducedBreakPoint> bp;
+  };
+
+  struct Greater {
+    const VCFRunMerge * m;
+    Greater(const VCFRunMerge * t) : m(t) {}
+    bool operator()(size_t a, size_t b) const {
+      const Head& x = m->m_heads[a];
+      const Head& y = m->m_heads[b];
+      return __end_less(m->m_v, y.idx, y.id_num, x.idx, x.id_num);
+    }
+  };
+
+  // read the next record of a run that is to be kept
+  bool __advance(Head& h) {
+    while (h.left) {
+      --h.left;
+      int64_t idx, id_num;
+      h.bp = std::make_shared<ReducedBreakPoint>();
+      if (!__unspill_int(h.fp, idx) || !__unspill_int(h.fp, id_num) || !__unspill(h.fp, *h.bp)) {
+	cerr << "ERROR: Could not read back a VCF record from " << m_file << endl;
+	exit(EXIT_FAILURE);
+      }
+      h.idx = idx;
+      h.id_num = id_num;
+      if (!m_v[idx].dup && (m_v[idx].pass || m_nonpass))
+	return true;
+    }
+    h.bp.reset();
+    return false;
+  }
+
+  std::string m_file;
+  const std::vector<VCFSpillEntry>& m_v;
+  bool m_nonpass;
+  std::vector<Head> m_heads;
+  std::vector<size_t> m_heap;
+
+};
+
+void VCFFile::__flush_run(VCFSpill& spill, const std::vector<VCFSpillEntry>& v, bool sv) {
+
+  if (spill.buf.empty())
+    return;
+
+  // (position in buf, end), both ends of each SV
+  std::vector<std::pair<size_t, int>> order;
+  for (size_t i = 0; i < spill.buf.size(); ++i) {
+    order.push_back(std::pair<size_t, int>(i, 1));
+    if (sv)
+      order.push_back(std::pair<size_t, int>(i, 2));
+  }
+  std::sort(order.begin(), order.end(), [&](const std::pair<size_t, int>& a, const std::pair<size_t, int>& b) {
+      return __end_less(v, spill.buf[a.first].first, a.second, spill.buf[b.first].first, b.second);
+    });
+
+  VCFSpillRun r;
+  r.offset = bgzf_tell(spill.fp);
+  r.n = order.size();
+  for (auto& o : order)
+    if (!__spill_int(spill.fp, spill.buf[o.first].first) || !__spill_int(spill.fp, o.second) ||
+	!__spill(spill.fp, *spill.buf[o.first].second)) {
+      cerr << "ERROR: Could not write to " << spill.file << endl;
+      exit(EXIT_FAILURE);
+    }
+  spill.runs.push_back(r);
+  spill.buf.clear();
+}
+
+void VCFFile::__reduce_runs(VCFSpill& spill, const std::vector<VCFSpillEntry>& v, bool sv) {
+
+  // each pass merges VCF_MERGE_WAYS runs into one, in a new file
+  while (spill.runs.size() > VCF_MERGE_WAYS) {
+    std::cerr << "...vcf - merging " << spill.runs.size() << " sorted runs of " << (sv ? "SVs" : "indels") << std::endl;
+    VCFSpill out;
+    out.fp = __new_spill(analysis_id, out.file);
+    for (size_t k = 0; k < spill.runs.size(); k += VCF_MERGE_WAYS) {
+      std::vector<VCFSpillRun> group(spill.runs.begin() + k, spill.runs.begin() + std::min(k + VCF_MERGE_WAYS, spill.runs.size()));
+      VCFRunMerge merge(spill.file, group, v, true);
+      VCFSpillRun r;
+      r.offset = bgzf_tell(out.fp);
+      r.n = 0;
+      VCFEntry e;
+      size_t idx;
+      while (merge.Next(e, idx)) {
+	if (!__spill_int(out.fp, idx) || !__spill_int(out.fp, e.id_num) || !__spill(out.fp, *e.bp)) {
+	  cerr << "ERROR: Could not write to " << out.file << endl;
+	  exit(EXIT_FAILURE);
+	}
+	++r.n;
+      }
+      out.runs.push_back(r);
+    }
+    if (bgzf_close(out.fp) < 0) {
+      cerr << "ERROR: Could not write to " << out.file << endl;
+      exit(EXIT_FAILURE);
+    }
+    out.fp = nullptr;
+    std::remove(spill.file.c_str());
+    spill.file = out.file;
+    spill.runs = out.runs;
+  }
+}
+
+bool VCFFile::add(const std::shared_ptr<ReducedBreakPoint>& bp) {
+
+  // each line gets an ID, kept or not
+  ++m_line_count;
+  ++global_id;
+
+  // skip non pass if not emitting unfiltered
+  if (!include_nonpass && !bp->pass)
+    return false;
+
+  ++cname_count[std::string(bp->cname)];
+  if (cname_count[std::string(bp->cname)] >= VCF_SECONDARY_CAP)
+    return false;
+    
+  // remove BX tags for unfiltered
+  if (!bp->pass)
+    bp->bxtable = "x";
+
+  VCFSpillEntry s;
+  s.chr1 = bp->b1.gr.chr;
+  s.pos1 = bp->b1.gr.pos1;
+  s.chr2 = bp->b2.gr.chr;
+  s.pos2 = bp->b2.gr.pos1;
+  s.end1 = bp->b1.gr.pos2;
+  s.end2 = bp->b2.gr.pos2;
+  s.id = global_id;
+  memset(s.evidence, 0, sizeof(s.evidence));
+  if (bp->evidence)
+    strncpy(s.evidence, bp->evidence, sizeof(s.evidence) - 1);
+  s.pass = bp->pass;
+  s.somatic = bp->somatic_score >= SOMATIC_LOD;
+  s.dup = false;
+
+  // indels are deduped on the exact allele as they come. A PASS
+  // indel replaces a non-PASS one at the same allele
+  if (bp->indel) {
+    VCFEntry e;
+    e.bp = bp;
+    e.id_num = 1;
+    std::string hh = std::to_string(s.chr1) + ":" + std::to_string(s.pos1) + "_" + e.getRefString() + "_" + e.getAltString();
+    auto ff = m_indel_keys.find(hh);
+    if (ff != m_indel_keys.end()) {
+      if (!s.pass || indels[ff->second].pass)
+	return false;
+      indels[ff->second].dup = true;
+      ff->second = indels.size();
+    } else {
+      m_indel_keys[hh] = indels.size();
+    }
+  }
+
+  // buffer it, and write the buffer as a sorted run when full
+  std::vector<VCFSpillEntry>& v = bp->indel ? indels : svs;
+  VCFSpill& spill = bp->indel ? m_indel_spill : m_sv_spill;
+  spill.buf.push_back(std::pair<size_t, std::shared_ptr<ReducedBreakPoint>>(v.size(), bp));
+  v.push_back(s);
+  if (spill.buf.size() >= VCF_SPILL_RUN)
+    __flush_run(spill, v, !bp->indel);
+
+  return true;
+}
+
+void VCFFile::finalize() {
+
+  cname_count.clear();
+  m_indel_keys.clear();
+  std::cerr << "...vcf sizeof VCFSpillEntry " << sizeof(VCFSpillEntry) << " bytes, the rest is in " << m_sv_spill.file << " and " << m_indel_spill.file << std::endl;
+  std::cerr << "...read in " << SeqLib::AddCommas(indels.size()) << " indels and " << SeqLib::AddCommas(svs.size()) << " SVs " << std::endl;
+
+  // done writing, close to read back
+  __flush_run(m_sv_spill, svs, true);
+  __flush_run(m_indel_spill, indels, false);
+  for (VCFSpill * sp : {&m_sv_spill, &m_indel_spill}) {
+    if (bgzf_close(sp->fp) < 0) {
+      cerr << "ERROR: Could not write to " << sp->file << endl;
+      exit(EXIT_FAILURE);
+    }
+    sp->fp = nullptr;
+  }
+  
+  std::cerr << "...vcf - deduplicating " << SeqLib::AddCommas(svs.size()) << " events" << std::endl;
+  deduplicate();
+  size_t ndup = 0;
+  for (auto& s : svs)
+    ndup += s.dup;
+  std::cerr << "...vcf - deduplicated down to " << SeqLib::AddCommas(svs.size() - ndup) << " break pairs" << std::endl;
+
+  __reduce_runs(m_sv_spill, svs, true);
+  __reduce_runs(m_indel_spill, indels, false);
+}
+
+void VCFFile::__init_headers(const VCFHeader& vheader) {
 
   sv_header    = vheader;
   indel_header = vheader;
@@ -232,6 +737,9 @@ VCFFile::VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, c
   sv_header.addFilterField("MULTIMATCH", "Low MAPQ and this contig fragment maps well to multiple locations");
   sv_header.addFilterField("LOWSPANDSCRD", "Discordant-only cluster is too small given isize distribution to call confidently"); 
   sv_header.addFilterField("SIMPLESEQUENCE", "Major portion of one contig mapping falls in a simple sequence, as given by -R flag. Assembly-only filter"); 
+  sv_header.addFilterField("BLACKLIST", "Breakpoint falls in a region of the blacklist");
+  sv_header.addFilterField("LOWMATCHLEN", "Less than 40bp of contig match to reference on one end, not counting homology");
+  sv_header.addFilterField("SECONDARY", "Contig alignment is secondary and has MAPQ < 30 on one end");
   //sv_header.addSampleField(sample_id_norm);
   //sv_header.addSampleField(sample_id_tum);
   //sv_header.colnames = sv_header.colnames + "\t" + sample_id_norm + "\t" + sample_id_tum;
@@ -268,6 +776,7 @@ VCFFile::VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, c
   sv_header.addInfoField("INSERTION","1","String","Sequence insertion at the breakpoint.");
   sv_header.addInfoField("SPAN","1","Integer","Distance between the breakpoints. -1 for interchromosomal");
   sv_header.addInfoField("DISC_MAPQ","1","Integer","Mean mapping quality of discordant reads mapped here");
+  sv_header.addInfoField("PON","1","Integer","Number of normal samples that have this SV present");
 
   // add the indel header fields
   indel_header.addInfoField("SCTG","1","String","Identifier for the contig assembled by svaba to make the indel call");
@@ -302,169 +811,110 @@ VCFFile::VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, c
   indel_header.addInfoField("BX",".","String","Table of BX tag counts for supporting reads");
   indel_header.addInfoField("DBSNP","0","Flag","Variant found in dbSNP");
   indel_header.addInfoField("LOD","1","Float","Log of the odds that variant is real vs artifact");
+}
 
-  // keep track of exact positions to keep from duplicating
-  // read the reference if not open
-  cerr << "...vcf - reading in the breakpoints file" << endl;
-  
-  include_nonpass = nopass;
+// a break pair packed for the dedupe sweep
+struct DedupeBreak {
+  int32_t pos1, pos2; // b1 and b2 positions
+  size_t idx; // index in svs
+  bool pass;
+  const VCFSpillEntry * s;
+};
 
-  // read it in line by line
-  getline(infile, line, '\n'); // skip first line
-  size_t line_count = 0;
-  while (getline(infile, line, '\n')) {
+typedef std::vector<DedupeBreak> DedupeBucket;
 
-    if (line.find("mapq") != std::string::npos)
-      continue;
+struct DedupeJob {
+  std::vector<DedupeBucket*> buckets;
+  size_t next = 0;
+  pthread_mutex_t lock;
+  std::vector<std::vector<size_t>> dups; // per bucket
+};
+
+static bool __is_tsi_pair(const VCFSpillEntry * a, const VCFSpillEntry * b) {
+  // strcmp of 0 is match 
+  return (!strcmp(a->evidence, "TSI_L") && !strcmp(b->evidence, "TSI_G")) || 
+    (!strcmp(a->evidence, "TSI_G") && !strcmp(b->evidence, "TSI_L"));
+}
 
-    if (line.find("Unknown") != std::string::npos)
-      continue;
+// ReducedBreakPoint::operator< on evidence. The split and discordant counts
+// it compares next are not kept for the VCF, so ties go to the first added
+static bool __better(const VCFSpillEntry * a, const VCFSpillEntry * b) {
+  int c = strcmp(a->evidence, b->evidence);
+  return c < 0 || (c == 0 && a->id < b->id);
+}
 
-    // parse the breakpoint from the file
-    std::shared_ptr<ReducedBreakPoint> bp(new ReducedBreakPoint(line, h));
+// sweep one chr-pair bucket, sorted on pos1. An entry is a dup if another
+// entry with the same pass status has both ends within pad of it and is better
+static void __dedupe_bucket(const DedupeBucket& v, std::vector<size_t>& dups, bool same_chr) {
 
-    // add the VCFentry Pair
-    ++line_count;
-    std::shared_ptr<VCFEntryPair> vpair(new VCFEntryPair(bp));
+  for (auto& i : v) {
 
-    // skip non pass if not emitting unfiltered
-    if (!include_nonpass && !bp->pass)
-      continue;
+    // if both ends are close then they match
+    int pad = !same_chr || std::abs(i.pos1 - i.pos2) > DEDUPEPAD*2 ? DEDUPEPAD : 10;
 
-    ++cname_count[std::string(bp->cname)];
-    if (cname_count[std::string(bp->cname)] >= VCF_SECONDARY_CAP)
-      {
-	//delete bp;
-	//delete vpair;
+    DedupeBucket::const_iterator jj = std::lower_bound(v.begin(), v.end(), i.pos1 - pad, [](const DedupeBreak& d, int32_t p) {
+	return d.pos1 < p;
+      });
+    for (; jj != v.end() && jj->pos1 <= i.pos1 + pad; ++jj) {
+      if (jj->idx == i.idx || jj->pass != i.pass || std::abs(jj->pos2 - i.pos2) > pad)
 	continue;
-      }
-    
-    // remove BX tags for unfiltered
-    if (!bp->pass)
-      bp->bxtable = "x";
-
-    if (bp->indel) {
-      indels.insert(pair<int, std::shared_ptr<VCFEntryPair>>(line_count, vpair));
-    }
-    else  {
-      entry_pairs.insert(pair<int, std::shared_ptr<VCFEntryPair>>(line_count, vpair));
+      // this has worst read coverage that what it overlaps, so mark as dup. If tie, take left-most break
+      // check that its not a local clashing with a global, because they're supposed to be two annotations for one event
+      if (__better(i.s, jj->s) && !__is_tsi_pair(i.s, jj->s))
+	dups.push_back(jj->idx);
     }
-   
   }
-  
-  cname_count.clear();
-  std::cerr << "...vcf sizeof empty VCFEntryPair " << sizeof(VCFEntryPair) << " bytes " << std::endl;
-  std::cerr << "...read in " << SeqLib::AddCommas(indels.size()) << " indels and " << SeqLib::AddCommas(entry_pairs.size()) << " SVs " << std::endl;
-  
-  std::cerr << "...vcf - deduplicating " << SeqLib::AddCommas(entry_pairs.size()) << " events" << std::endl;
-  deduplicate();
-  std::cerr << "...vcf - deduplicated down to " << SeqLib::AddCommas((entry_pairs.size() - dups.size())) << " break pairs" << std::endl;
-  
 }
 
-// make a class to hold break end + id
-class GenomicRegionWithID : public SeqLib::GenomicRegion 
-{
-  public: 
-  GenomicRegionWithID(int32_t c, uint32_t p1, uint32_t p2, int i, int p) : SeqLib::GenomicRegion(c,p1,p2), id(i), pass(p) {}
-  uint32_t id:30, pass:2;
-};
+static void* __dedupe_thread(void * arg) {
+
+  DedupeJob * job = static_cast<DedupeJob*>(arg);
+  while (true) {
+    pthread_mutex_lock(&job->lock);
+    size_t k = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (k >= job->buckets.size())
+      break;
+    const DedupeBucket& v = *job->buckets[k];
+    __dedupe_bucket(v, job->dups[k], v.front().s->chr1 == v.front().s->chr2);
+  }
+  return NULL;
+}
 
-// deduplicate
+// deduplicate the SVs. Indels were deduped as they were added
 void VCFFile::deduplicate() {
 
-  // create the interval tree maps
-  // grv1 are left entries, grv2 are right
-  // keep it sorted so grv1 always has left most
-  SeqLib::GenomicRegionCollection<GenomicRegionWithID> grv1;
-  SeqLib::GenomicRegionCollection<GenomicRegionWithID> grv2;
-  for (auto& i : entry_pairs) {
-    grv1.add(GenomicRegionWithID(i.second->bp->b1.gr.chr, i.second->bp->b1.gr.pos1, i.second->bp->b1.gr.pos2, i.first, i.second->e1.bp->pass)); 
-    grv2.add(GenomicRegionWithID(i.second->bp->b2.gr.chr, i.second->bp->b2.gr.pos1, i.second->bp->b2.gr.pos2, i.first, i.second->e2.bp->pass)); 
-  }
-  grv1.CreateTreeMap();
-  grv2.CreateTreeMap();
-  assert(grv1.size() == grv2.size());
-
-  int pad = 1;
-  size_t count = 0;
-  
-  for (auto& i : entry_pairs) {
-
-    if (count % 250000 == 0)
-      std::cerr << "...dedupe at " << SeqLib::AddCommas(count) << " of " << SeqLib::AddCommas(entry_pairs.size()) << std::endl;
-
-    // if both ends are close then they match
-    pad = (i.second->bp->b1.gr.chr != i.second->bp->b2.gr.chr) || std::abs(i.second->bp->b1.gr.pos1 - i.second->bp->b2.gr.pos1) > DEDUPEPAD*2 ? DEDUPEPAD : 10;
-
-    ++count;
-    SeqLib::GenomicIntervalVector giv1, giv2;
-    SeqLib::GenomicIntervalTreeMap::const_iterator ff1 = grv1.GetTree()->find(i.second->bp->b1.gr.chr);
-    SeqLib::GenomicIntervalTreeMap::const_iterator ff2 = grv2.GetTree()->find(i.second->bp->b2.gr.chr);
-    assert(ff1 != grv1.GetTree()->end());
-    assert(ff2 != grv2.GetTree()->end());
-    ff1->second.findContained(i.second->bp->b1.gr.pos1-pad, i.second->bp->b1.gr.pos1+pad, giv1);
-    ff2->second.findContained(i.second->bp->b2.gr.pos1-pad, i.second->bp->b2.gr.pos1+pad, giv2);
-      //grv1.m_tree[i.second->bp->b1.gr.chr].findContained(i.second->bp->b1.gr.pos1-pad, i.second->bp->b1.gr.pos1+pad, giv1);
-      //grv2.m_tree[i.second->bp->b2.gr.chr].findContained(i.second->bp->b2.gr.pos1-pad, i.second->bp->b2.gr.pos1+pad, giv2);
-    
-    // loop through hits and only add if not the current site.
-    // If key_count is 2, then it hit on each side. This is a dup
-    // If this is a dup, remove all the things it dups to
-    // then when you come across one that was marked as dup, just skip
-    // the intersection step
-
-    bool is_pass = i.second->e1.bp->pass; 
-
-    std::unordered_map<int, std::pair<size_t, size_t>> key_count; // left and right is pair
-
-    // loop hits to left end
-    for (auto& j : giv1) 
-      if (grv1.at(j.value).id != i.first && ( is_pass == (grv1.at(j.value).pass) )) //j is hit. Make sure have same pass status
-	++key_count[grv1.at(j.value).id].first;
-    // loop hits to right end
-    for (auto& j : giv2)
-      if (grv2.at(j.value).id != i.first && ( is_pass == (grv2.at(j.value).pass) )) //j is hit, grv2.at(j.value).id is key of hit
-	++key_count[grv2.at(j.value).id].second;
-
-    // loop through hit keys and if key is hit twice (1 left, 1 right), it is an overlap
-    for (auto& j : key_count) {
-      //assert(*i.second->bp < *entry_pairs[j.first]->bp + *entry_pairs[j.first]->bp < *i.second->bp == 1); // comparator is working
-      if (j.second.first && j.second.second) { // left and right hit for this key
- 	if (*i.second->bp < *entry_pairs[j.first]->bp) { // this has worst read coverage that what it overlaps, so mark as dup. If tie, take left-most break
-	  // check that its not a local clashing with a global, because they're supposed to be two annotations for one event
-	  if ( (!strcmp(i.second->bp->evidence, "TSI_L") && !strcmp(entry_pairs[j.first]->bp->evidence, "TSI_G")) || // strcmp of 0 is match 
-	       (!strcmp(i.second->bp->evidence, "TSI_G") && !strcmp(entry_pairs[j.first]->bp->evidence, "TSI_L")) ) 
-	    ; // don't add as a duplicate
-	  else {
-	    dups.insert(j.first); 
-	  }
-	}
-      }
-    }
+  // bucket the break pairs by chr pair. Two pairs can only
+  // be dups if both ends are on the same chromosomes
+  std::map<std::pair<int32_t, int32_t>, DedupeBucket> bucketmap;
+  for (size_t i = 0; i < svs.size(); ++i) {
+    const VCFSpillEntry& s = svs[i];
+    bucketmap[std::pair<int32_t, int32_t>(s.chr1, s.chr2)].push_back({s.pos1, s.pos2, i, s.pass, &s});
   }
 
-  // dedupe the indels
-  std::cerr << "...hashing " << SeqLib::AddCommas(indels.size()) << " indels for dedupe" << std::endl;
-  std::unordered_set<std::string> hashr;
-  VCFEntryPairMap tmp_indels;
-
-  for (auto& i : indels) {
-    
-    std::string hh;
-    try {
-      hh = std::to_string(i.second->e1.bp->b1.gr.chr) + ":" + std::to_string(i.second->e1.bp->b1.gr.pos1) + 
-	     "_" + i.second->e1.getRefString() + "_" + i.second->e1.getAltString();
-      } catch (...) {
-      	std::cerr << " error " << std::endl;
-   }
-    if (!hashr.count(hh)) {
-      hashr.insert(hh);
-      tmp_indels.insert(pair<int, std::shared_ptr<VCFEntryPair>>(i.first, i.second));
-    }
+  DedupeJob job;
+  for (auto& b : bucketmap) {
+    std::sort(b.second.begin(), b.second.end(), [](const DedupeBreak& a, const DedupeBreak& c) {
+	return a.pos1 < c.pos1;
+      });
+    job.buckets.push_back(&b.second);
   }
-  std::cerr << "...done deduping indels" << std::endl;
-  indels = tmp_indels;
+  job.dups.resize(job.buckets.size());
+
+  std::cerr << "...dedupe sweeping " << SeqLib::AddCommas(job.buckets.size()) << " chromosome pairs on " << num_threads << " threads" << std::endl;
+
+  pthread_mutex_init(&job.lock, NULL);
+  std::vector<pthread_t> threads(std::max(1, num_threads) - 1);
+  for (auto& t : threads)
+    pthread_create(&t, NULL, __dedupe_thread, &job);
+  __dedupe_thread(&job);
+  for (auto& t : threads)
+    pthread_join(t, NULL);
+  pthread_mutex_destroy(&job.lock);
+
+  for (auto& d : job.dups)
+    for (auto& i : d)
+      svs[i].dup = true;
 }
 
 // print a breakpoint pair
@@ -483,7 +933,13 @@ bool VCFEntry::operator==(const VCFEntry &v) const {
 }
 
 // write out somatic and germline INDEL vcfs
-void VCFFile::writeIndels(string basename, bool zip, bool onefile) const {
+bool VCFFile::writeIndels(string basename, bool zip, bool onefile) const {
+
+  if (!hts_mode.empty()) {
+    std::string ext = hts_mode == "wb" ? ".bcf" : ".vcf.gz";
+    return __write_hts(indels, m_indel_spill, indel_header, basename + (onefile ? "indel" : "germline.indel") + ext,
+		       basename + "somatic.indel" + ext, onefile);
+  }
 
   std::string gname = basename + "germline.indel.vcf.gz";
   std::string sname = basename + "somatic.indel.vcf.gz";
@@ -503,6 +959,12 @@ void VCFFile::writeIndels(string basename, bool zip, bool onefile) const {
   if (zip) {
     g_bg = bgzf_open(gname.c_str(), "w");
     if (!onefile) s_bg = bgzf_open(sname.c_str(), "w");
+    if (!g_bg || (!onefile && !s_bg)) {
+      cerr << "ERROR: Could not open " << (g_bg ? sname : gname) << " for writing" << endl;
+      if (g_bg) bgzf_close(g_bg);
+      if (s_bg) bgzf_close(s_bg);
+      return false;
+    }
     std::stringstream indel_h;
     indel_h << indel_header << endl;
     if (!bgzf_write(g_bg, indel_h.str().c_str(), indel_h.str().length())) {
@@ -516,29 +978,22 @@ void VCFFile::writeIndels(string basename, bool zip, bool onefile) const {
     out_g.open(gname_nz.c_str());
     if (!onefile)
       out_s.open(sname_nz.c_str());
+    if (!out_g || (!onefile && !out_s)) {
+      cerr << "ERROR: Could not open " << (out_g ? sname_nz : gname_nz) << " for writing" << endl;
+      return false;
+    }
     out_g << indel_header << endl;
     if (!onefile)
       out_s << indel_header << endl;
   }
 
-  VCFEntryVec tmpvec;
-
-  // put the indels into a sorted vector
-  for (auto& i : indels) {
-    tmpvec.push_back(i.second->e1);
-  }
-
-  // sort the temp entry vec
-  sort(tmpvec.begin(), tmpvec.end());  
-
-  // print out the entries
-  for (auto& i : tmpvec) { 
+  // print out the entries, merged in order from the sorted runs
+  VCFRunMerge merge(m_indel_spill.file, m_indel_spill.runs, indels, include_nonpass);
+  VCFEntry i;
+  size_t k;
+  while (merge.Next(i, k)) {
 
-    if (!i.bp->pass && !include_nonpass)
-      continue;
-
-    std::stringstream ss;
-    if (!onefile && i.bp->somatic_score >= SOMATIC_LOD) {
+    if (!onefile && indels[k].somatic) {
       if (zip) 
 	__write_to_zip_vcf(i, s_bg);
       else 
@@ -569,11 +1024,18 @@ void VCFFile::writeIndels(string basename, bool zip, bool onefile) const {
     if (!onefile)
       tabixVcf(sname);
   }
-  
+
+  return true;
 }
 
 // write out somatic and germline SV vcfs
-void VCFFile::writeSVs(std::string basename, bool zip, bool onefile) const {
+bool VCFFile::writeSVs(std::string basename, bool zip, bool onefile) const {
+
+  if (!hts_mode.empty()) {
+    std::string ext = hts_mode == "wb" ? ".bcf" : ".vcf.gz";
+    return __write_hts(svs, m_sv_spill, sv_header, basename + (onefile ? "sv" : "germline.sv") + ext,
+		       basename + "somatic.sv" + ext, onefile);
+  }
 
   std::string gname, sname, gname_nz, sname_nz; 
   gname = basename + "germline.sv.vcf.gz";
@@ -596,6 +1058,12 @@ void VCFFile::writeSVs(std::string basename, bool zip, bool onefile) const {
     g_bg = bgzf_open(gname.c_str(), "w");
     if (!onefile)
       s_bg = bgzf_open(sname.c_str(), "w");
+    if (!g_bg || (!onefile && !s_bg)) {
+      cerr << "ERROR: Could not open " << (g_bg ? sname : gname) << " for writing" << endl;
+      if (g_bg) bgzf_close(g_bg);
+      if (s_bg) bgzf_close(s_bg);
+      return false;
+    }
     std::stringstream sv_h;
     sv_h << sv_header << endl;
     if (!bgzf_write(g_bg, sv_h.str().c_str(), sv_h.str().length())) {
@@ -609,35 +1077,24 @@ void VCFFile::writeSVs(std::string basename, bool zip, bool onefile) const {
     out_g.open(gname_nz.c_str());
     if (!onefile)
       out_s.open(sname_nz.c_str());
+    if (!out_g || (!onefile && !out_s)) {
+      cerr << "ERROR: Could not open " << (out_g ? sname_nz : gname_nz) << " for writing" << endl;
+      return false;
+    }
 
     out_g << sv_header << endl;
     if (!onefile)
       out_s << sv_header << endl;
   }
     
-  VCFEntryVec tmpvec;
-
-  // put the pair maps into a vector
-  for (VCFEntryPairMap::const_iterator it = entry_pairs.begin(); it != entry_pairs.end(); it++) {
-    
-    if (!dups.count( it->first)) { // dont include duplicate entries
-      tmpvec.push_back(it->second->e1);
-      tmpvec.push_back(it->second->e2);
-    }
-
-  }
-
-  // sort the temp entry vec
-  sort(tmpvec.begin(), tmpvec.end());  
-
-  // print out the entries
-  for (auto& i : tmpvec) { 
-
-    if (!i.bp->pass && !include_nonpass)
-      continue;
+  // print out both ends of the SVs that are not duplicates, merged in order from the sorted runs
+  VCFRunMerge merge(m_sv_spill.file, m_sv_spill.runs, svs, include_nonpass);
+  VCFEntry i;
+  size_t k;
+  while (merge.Next(i, k)) {
     
     // somatic
-    if (!onefile &&  i.bp->somatic_score >= SOMATIC_LOD) { 
+    if (!onefile && svs[k].somatic) { 
       if (zip) 
 	__write_to_zip_vcf(i, s_bg);
       else
@@ -669,9 +1126,35 @@ void VCFFile::writeSVs(std::string basename, bool zip, bool onefile) const {
     tabixVcf(gname);
   }
 
+  return true;
 }
 
 
+// write sorted entries through htslib, split into somatic and germline
+bool VCFFile::__write_hts(const std::vector<VCFSpillEntry>& v, const VCFSpill& spill,
+			  const VCFHeader& h, const std::string& gname, const std::string& sname, bool onefile) const {
+
+  BCFWriter g_w, s_w;
+  if (!g_w.Open(gname, hts_mode.c_str(), h, num_threads))
+    return false;
+  if (!onefile && !s_w.Open(sname, hts_mode.c_str(), h, num_threads))
+    return false;
+
+  VCFRunMerge merge(spill.file, spill.runs, v, include_nonpass);
+  VCFEntry i;
+  size_t k;
+  while (merge.Next(i, k)) {
+
+    if (!(!onefile && v[k].somatic ? s_w.Write(i) : g_w.Write(i)))
+      return false;
+  }
+
+  // writes the indexes
+  g_w.Close();
+  s_w.Close();
+  return true;
+}
+
 // tabix the vcf
 void tabixVcf(const std::string &fn) {
 
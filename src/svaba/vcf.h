@@ -8,6 +8,7 @@
 #include <unordered_set>
 
 #include "SeqLib/GenomicRegion.h"
+#include "htslib/bgzf.h"
 
 #include "BreakPoint.h"
 
@@ -121,32 +122,77 @@ typedef std::vector<VCFEntryPair> VCFEntryPairVec;
 typedef std::unordered_map<int, std::shared_ptr<VCFEntryPair>> VCFEntryPairMap;
 typedef std::unordered_map<int, VCFEntry> VCFEntryMap;
 
-// declare a structure to hold the entire VCF
+// one breakpoint in the VCFFile spill file, with what the dedupe and the sort need
+struct VCFSpillEntry {
+  int32_t chr1, pos1, chr2, pos2;
+  int32_t end1, end2; // gr.pos2 of each end, the last key of VCFEntry::operator<
+  uint32_t id; // VCF ID is id:1 / id:2
+  char evidence[8]; // dedupe preference, as ReducedBreakPoint::operator<
+  bool pass, somatic, dup;
+};
+
+// a run of records in a spill file, sorted by position
+struct VCFSpillRun {
+  int64_t offset; // BGZF virtual offset of the first record
+  size_t n;
+};
+
+// temporary file of sorted runs. Breakpoints are buffered as they are added
+// and written out as a sorted run when the buffer fills
+struct VCFSpill {
+  std::string file;
+  BGZF * fp = nullptr; // open for writing until VCFFile::finalize
+  std::vector<VCFSpillRun> runs;
+  std::vector<std::pair<size_t, std::shared_ptr<ReducedBreakPoint>>> buf; // index in svs / indels, breakpoint
+};
+
+// declare a structure to hold the entire VCF. Breakpoints are written in
+// sorted runs to temporary spill files (<id>.vcf.spill.XXXXXX) as they are
+// added, and only the compact VCFSpillEntry and the indel dedupe keys are
+// kept in memory. Writing merges the runs, reading each one front to back
 struct VCFFile {
 
   VCFFile() {}
-  ~VCFFile() {}
+  ~VCFFile();
+
+  VCFFile(const VCFFile&) = delete;
+  VCFFile& operator=(const VCFFile&) = delete;
 
   VCFFile(std::string file, std::string tmethod);
 
-  // create a VCFFile from a csv
-  VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, const VCFHeader& vheader, bool nopass);
+  // create a VCFFile from a bps.txt.gz or bps.svb store. Parsing runs on threads
+  VCFFile(std::string file, std::string id, const SeqLib::BamHeader& h, const VCFHeader& vheader, bool nopass, int threads = 1);
+
+  // create an empty VCFFile, to be filled with add() as breakpoints are made
+  VCFFile(std::string id, const VCFHeader& vheader, bool nopass);
+
+  // add one breakpoint, in the order they would be in the bps file.
+  // Returns false if it was not kept
+  bool add(const std::shared_ptr<ReducedBreakPoint>& bp);
+
+  // deduplicate once everything is added. Must call before writing
+  void finalize();
 
   std::string filename;
   std::string method;
 
   std::string analysis_id; 
 
-  std::unordered_set<int> dups;
-
   //  VCFHeader header;
   VCFHeader indel_header;
   VCFHeader sv_header;
-  VCFEntryPairMap entry_pairs;
-  VCFEntryPairMap indels;
+  std::vector<VCFSpillEntry> svs;
+  std::vector<VCFSpillEntry> indels;
   
   bool include_nonpass = false;
 
+  // threads for parsing the bps file, deduplicate (split by chromosome pair) and compression
+  int num_threads = 1;
+
+  // htslib mode to write with: "wb" for BCF, "wz" for vcf.gz.
+  // Empty writes text (zip arg of writeIndels / writeSVs)
+  std::string hts_mode;
+
   // output it to a string
   friend std::ostream& operator<<(std::ostream& out, const VCFFile& v);
   
@@ -159,10 +205,34 @@ struct VCFFile {
   //
   void deduplicate();
   
-  //
-  void writeIndels(std::string basename, bool zip, bool onefile) const;
-  void writeSVs(std::string basename, bool zip, bool onefile) const;
+  // false if a file could not be opened or a record could not be written
+  bool writeIndels(std::string basename, bool zip, bool onefile) const;
+  bool writeSVs(std::string basename, bool zip, bool onefile) const;
   
+ private:
+
+  // add the svaba filter, info and format fields
+  void __init_headers(const VCFHeader& vheader);
+
+  bool __write_hts(const std::vector<VCFSpillEntry>& v, const VCFSpill& spill,
+		   const VCFHeader& h, const std::string& gname, const std::string& sname, bool onefile) const;
+
+  // open the spill files for add()
+  void __open_spill();
+
+  // write the buffered breakpoints as one sorted run
+  void __flush_run(VCFSpill& spill, const std::vector<VCFSpillEntry>& v, bool sv);
+
+  // merge runs until there are few enough to read at once
+  void __reduce_runs(VCFSpill& spill, const std::vector<VCFSpillEntry>& v, bool sv);
+
+  size_t m_line_count = 0;
+
+  VCFSpill m_sv_spill, m_indel_spill;
+
+  // chr:pos_ref_alt -> index in indels
+  std::unordered_map<std::string, size_t> m_indel_keys;
+
 
 };
 
@@ -5,7 +5,9 @@
 #include <list>
 
 #include "svabaWorkUnit.h"
+#include "svabaTrace.h"
 #include "SeqLib/RefGenome.h"
+#include "SeqLib/ThreadPool.h"
 
 typedef std::map<std::string, svabaBamWalker> WalkerMap;
 
@@ -126,7 +128,10 @@ public:
 
  ConsumerThread(wqueue<T*>& queue, bool verbose, 
 		const std::string& ref, const std::string& vir,
-		const std::map<std::string, std::string>& bams) : m_queue(queue), m_verbose(verbose) {
+		const std::map<std::string, std::string>& bams,
+		SeqLib::ThreadPool * pool = nullptr,
+		const std::string& extract = std::string(),
+		bool lazy_open = false) : m_queue(queue), m_verbose(verbose) {
 
     // load the reference genomce
     if (m_verbose)
@@ -142,13 +147,26 @@ public:
       wu.vir_genome->LoadIndex(vir);
     } 
 
-    // open the bams for this thread
-    if (m_verbose)
+    // open the extract store instead of the bams, if running from one
+    if (!extract.empty()) {
+      wu.extract = new svabaExtractReader();
+      if (!wu.extract->Open(extract)) {
+	std::cerr << "ERROR: Could not open the extract store " << extract << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    }
+
+    // open the bams for this thread. With lazy_open, the reader pool opens them as needed
+    if (m_verbose && !lazy_open)
       std::cerr << "\tOpening BAMs for thread " << self() << std::endl;
     for (auto& b : bams) {
       wu.walkers[b.first] = svabaBamWalker();
-      wu.walkers[b.first].Open(b.second);
+      if (!wu.extract && !lazy_open)
+	wu.walkers[b.first].Open(b.second);
       wu.walkers[b.first].prefix = b.first;
+      // share BGZF decompression across all walkers on all threads
+      if (pool && !lazy_open)
+	wu.walkers[b.first].SetThreadPool(*pool);
     }
     
 
@@ -161,7 +179,10 @@ public:
       //if (m_verbose)
 	//printf("thread %lu, loop %d - waiting for item...\n", 
 	//     (long unsigned int)self(), i);
+      double qs = svabaTrace::Now();
       T* item = (T*)m_queue.remove();
+      if (svabaTrace::Enabled())
+	svabaTrace::Complete("queue wait", qs, svabaTrace::Now());
       item->run(wu, (long unsigned)self()); 
       delete item;
       if (m_queue.size() == 0)
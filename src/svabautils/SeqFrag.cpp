@@ -368,7 +368,8 @@ void SeqFrag::addIndels(size_t n) {
 void SeqFrag::getSeqFromRef(faidx_t * findex) {
 
   int len;
-  std::string chrstring = m_gr.ChrName(SeqLib::BamHeader());
+  // the contig of the index with this id, so the reference can use any names
+  std::string chrstring = m_gr.chr >= 0 && m_gr.chr < faidx_nseq(findex) ? faidx_iseq(findex, m_gr.chr) : m_gr.ChrName(SeqLib::BamHeader());
   char * seq = faidx_fetch_seq(findex, const_cast<char*>(chrstring.c_str()), m_gr.pos1-1, m_gr.pos2/*-1*/, &len);
   
   if (!seq) {